@@ -15,144 +15,339 @@
 
 =========================================================================*/
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include <itkDiffusionTensor3D.h>
-#include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
-#include <itkVector.h>
-#include <itkExtractImageFilter.h>
-#include <itkAddImageFilter.h>
-#include <itkUnaryFunctorImageFilter.h>
-#include <itkImageDuplicator.h>
 #include <itkVersion.h>
 #include <itkCastImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itksys/SystemTools.hxx>
 
-#include "itkLogEuclideanTensorImageFilter.h"
-#include "itkExpEuclideanTensorImageFilter.h"
+#include "itkTensorKarcherMeanImageFilter.h"
+#include "tensorio.h"
+#include "tensoraverage.h"
+#include "tensorpopulation.h"
 #include "dtiaverageCLP.h"
 
-template <class TElementType>
-class PixelDivider
+typedef itk::TensorKarcherMeanImageFilter<TensorImageType, TensorImageType> KarcherMeanFilterType;
+typedef KarcherMeanFilterType::IterationsImageType                          IterationsImageType;
+
+int writeMean(TensorImageType::Pointer mean, const std::string & tensorOutput, bool doubleDTI)
+{
+  try
+    {
+    if( !doubleDTI )
+      {
+      typedef itk::DiffusionTensor3D<float> TensorFloatPixelType;
+      typedef itk::Image<TensorFloatPixelType, 3> TensorFloatImageType;
+      typedef itk::CastImageFilter< TensorImageType, TensorFloatImageType > CastDTIFilterType ;
+      CastDTIFilterType::Pointer castFilter = CastDTIFilterType::New() ;
+      castFilter->SetInput( mean ) ;
+      typedef itk::ImageFileWriter<TensorFloatImageType> TensorFileWriterType;
+      TensorFileWriterType::Pointer tensorWriter = TensorFileWriterType::New();
+      tensorWriter->SetFileName(tensorOutput.c_str());
+      tensorWriter->SetInput(castFilter->GetOutput());
+      tensorWriter->SetUseCompression(true);
+      tensorWriter->Update();
+      }
+    else
+      {
+      typedef itk::ImageFileWriter<TensorImageType> TensorFileWriterType;
+      TensorFileWriterType::Pointer twrit = TensorFileWriterType::New();
+      twrit->SetUseCompression(true);
+      twrit->SetInput(mean);
+      twrit->SetFileName(tensorOutput);
+      twrit->Update();
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+// Uncompressed MetaImage copies of the tensor files that cannot be
+// read by slabs, such as compressed nrrd files.  The copies are removed
+// when the object is destroyed.
+class StreamableTensorFiles
 {
 public:
-  // Divide by zero so we get warned if we didnt replace the default functor
-  PixelDivider() : m_Denominator(0)
+  StreamableTensorFiles()
   {
   }
 
-  PixelDivider(double denominator) : m_Denominator(denominator)
+  ~StreamableTensorFiles()
   {
+    for( unsigned int i = 0; i < m_Copies.size(); ++i )
+      {
+      itksys::SystemTools::RemoveFile(m_Copies[i].c_str() );
+      }
   }
 
-  TElementType operator()(const TElementType & numerator)
+  // Returns filename if it can be read by slabs, otherwise copies it to
+  // copy, which must end in .mha, and returns copy.  The file is
+  // decoded entirely once, only while it is copied.
+  std::string Get(const std::string & filename, const std::string & copy, bool verbose)
   {
-    return numerator / m_Denominator;
-  }
+    if( canStreamReadTensorFile(filename) )
+      {
+      return filename;
+      }
+    if( verbose )
+      {
+      std::cout << "Decompressing " << filename << " to " << copy << std::endl;
+      }
+    m_Copies.push_back(copy);
 
-  bool operator !=(const PixelDivider & rhs)
-  {
-    return this != &rhs;
+    typedef itk::ImageFileWriter<TensorImageType> TensorFileWriterType;
+    TensorFileWriterType::Pointer writer = TensorFileWriterType::New();
+    writer->SetInput(readTensors(filename) );
+    writer->SetFileName(copy);
+    writer->SetUseCompression(false);
+    writer->Update();
+    return copy;
   }
 
-  double m_Denominator;
+private:
+  StreamableTensorFiles(const StreamableTensorFiles &); // purposely not implemented
+  void operator=(const StreamableTensorFiles &);        // purposely not implemented
+
+  std::vector<std::string> m_Copies;
 };
 
-enum StatisticsType { Euclidean, LogEuclidean, PGA };
-int main(int argc, char* argv[])
+// Affine-invariant mean of the inputs, computed slab by slab along the
+// last axis so that the slabs of all the inputs fit in memoryLimit
+// megabytes.  The inputs that cannot be read by slabs are first copied
+// uncompressed to temporaryPrefix<i>.mha.  The number of iterations
+// used at every voxel is returned in iterations.
+TensorImageType::Pointer riemannianMean(const std::vector<std::string> & inputs,
+                                        double tolerance, unsigned int maxIterations,
+                                        unsigned int memoryLimit, const std::string & temporaryPrefix,
+                                        bool verbose, IterationsImageType::Pointer & iterations)
 {
-  PARSE_ARGS;
-
-  typedef double                                       RealType;
-  typedef itk::DiffusionTensor3D<RealType>             TensorPixelType;
-  typedef itk::Image<TensorPixelType, 3>               TensorImageType;
-  typedef itk::ImageFileReader<TensorImageType>        TensorFileReader;
-  typedef itk::LogEuclideanTensorImageFilter<RealType> LogEuclideanFilter;
-  typedef LogEuclideanFilter::OutputImageType          LogTensorImageType;
-  typedef LogTensorImageType::PixelType                LogTensorPixelType;
-
-  typedef itk::AddImageFilter<LogTensorImageType, LogTensorImageType,
-                              LogTensorImageType>                         AddImageFilter;
-  typedef itk::UnaryFunctorImageFilter<LogTensorImageType, LogTensorImageType,
-                                       PixelDivider<LogTensorPixelType> > DivideImageFilter;
+  const TensorImageType::RegionType region = readTensorFileRegion(inputs[0]);
+  for( unsigned int i = 1; i < inputs.size(); ++i )
+    {
+    if( readTensorFileRegion(inputs[i]) != region )
+      {
+      throw itk::ExceptionObject("Tensor fields to average must have the same size");
+      }
+    }
 
-  typedef itk::ImageDuplicator<LogTensorImageType> DuplicateImageFilter;
+  // Reading a slab of a file that cannot be streamed decodes the whole
+  // file, so only one slab of every input is in memory at a time
+  StreamableTensorFiles    copies;
+  std::vector<std::string> streamable(inputs.size() );
+  for( unsigned int i = 0; i < inputs.size(); ++i )
+    {
+    std::ostringstream copy;
+    copy << temporaryPrefix << i << ".mha";
+    streamable[i] = copies.Get(inputs[i], copy.str(), verbose);
+    }
 
-  //  const std::vector<std::string> sources = vm["inputs"].as<std::vector<std::string> >();
+  // The slabs of the inputs and of the mean
+  const TensorImageType::SizeType size = region.GetSize();
+  const double                    bytesPerSlice =
+    static_cast<double>(size[0]) * size[1] * sizeof(TensorPixelType) * (inputs.size() + 1);
+  const unsigned int slabThickness = static_cast<unsigned int>(
+      std::max(1.0, std::min(static_cast<double>(size[2]), memoryLimit * 1048576.0 / bytesPerSlice) ) );
 
-  const int numberofinputs = inputs.size();
-  if( numberofinputs > 0 )
+  TensorImageType::Pointer mean;
+  unsigned int             maxIterationsUsed = 0;
+  for( itk::IndexValueType z = 0; z < static_cast<itk::IndexValueType>(size[2]); z += slabThickness )
     {
-    TensorFileReader::Pointer   reader = TensorFileReader::New();
-    AddImageFilter::Pointer     adder = AddImageFilter::New();
-    LogEuclideanFilter::Pointer logfilt = LogEuclideanFilter::New();
-
-    DuplicateImageFilter::Pointer dup = DuplicateImageFilter::New();
-    std::cout << "lbl1" << std::endl;
+    TensorImageType::RegionType slab = region;
+    slab.SetIndex(2, region.GetIndex(2) + z);
+    slab.SetSize(2, std::min(static_cast<itk::SizeValueType>(slabThickness), size[2] - z) );
     if( verbose )
       {
-      std::cout << "Loading: " <<  inputs[0] << std::endl;
+      std::cout << "Slab: " << slab.GetIndex() << " " << slab.GetSize() << std::endl;
       }
 
-    reader->SetFileName(inputs[0]);
-    reader->Update();
-    logfilt->SetInput(reader->GetOutput() );
-    logfilt->Update();
+    KarcherMeanFilterType::Pointer karcher = KarcherMeanFilterType::New();
+    karcher->SetTolerance(tolerance);
+    karcher->SetMaximumNumberOfIterations(maxIterations);
+    for( unsigned int i = 0; i < inputs.size(); ++i )
+      {
+      karcher->SetInput(i, readTensorRegion(streamable[i], slab) );
+      }
+    karcher->Update();
+    maxIterationsUsed = std::max(maxIterationsUsed, karcher->GetMaximumIterationsUsed() );
+
+    if( !mean )
+      {
+      mean = TensorImageType::New();
+      mean->CopyInformation(karcher->GetOutput() );
+      mean->SetRegions(region);
+      mean->Allocate();
 
-    dup->SetInputImage(logfilt->GetOutput() );
-    dup->Update();
-    LogTensorImageType::Pointer average = dup->GetOutput();
-    for( int i = 1; i < numberofinputs; ++i )
+      iterations = IterationsImageType::New();
+      iterations->CopyInformation(karcher->GetIterationsOutput() );
+      iterations->SetRegions(region);
+      iterations->Allocate();
+      }
+    itk::ImageRegionConstIterator<TensorImageType> in(karcher->GetOutput(), slab);
+    itk::ImageRegionIterator<TensorImageType>      out(mean, slab);
+    for( ; !in.IsAtEnd(); ++in, ++out )
+      {
+      out.Set(in.Get() );
+      }
+    itk::ImageRegionConstIterator<IterationsImageType> iin(karcher->GetIterationsOutput(), slab);
+    itk::ImageRegionIterator<IterationsImageType>      iout(iterations, slab);
+    for( ; !iin.IsAtEnd(); ++iin, ++iout )
+      {
+      iout.Set(iin.Get() );
+      }
+    }
+  if( verbose )
+    {
+    std::cout << "Maximum number of Karcher iterations: " << maxIterationsUsed << std::endl;
+    }
+  return mean;
+}
+
+// Log-Euclidean mean of the inputs and of the saved partial states.
+// The inputs are accumulated one at a time into a single buffer while
+// the next one is read on a background thread.  Inputs may be tensor
+// files or Log-Euclidean cache files, the logarithm is only computed
+// for the former.  TAccumulator is LogEuclideanSum, or
+// LogEuclideanPopulationStatistics to keep the second moments in the
+// state.
+template <class TAccumulator>
+int logEuclideanAverage(TAccumulator & accumulator,
+                        const std::vector<std::string> & inputs,
+                        const std::vector<std::string> & stateInputs,
+                        const std::string & stateOutput, const std::string & tensorOutput,
+                        bool logOutput, bool doubleDTI, bool verbose)
+{
+  TensorImageType::Pointer mean;
+  try
+    {
+    for( unsigned int i = 0; i < stateInputs.size(); ++i )
       {
       if( verbose )
         {
-        std::cout << "Loading: " <<  inputs[i] << std::endl;
+        std::cout << "Merging state: " << stateInputs[i] << std::endl;
         }
-      reader->SetFileName(inputs[i].c_str() );
-
-      adder->SetInput1(average);
-      adder->SetInput2(logfilt->GetOutput() );
-      adder->Update();
+      accumulator.Merge(stateInputs[i]);
+      }
 
-      dup->SetInputImage(adder->GetOutput() );
-      dup->Update();
-      average = dup->GetOutput();
+    TensorFilePrefetcher prefetcher;
+    if( !inputs.empty() )
+      {
+      prefetcher.Start(inputs[0]);
+      }
+    for( unsigned int i = 0; i < inputs.size(); ++i )
+      {
+      TensorImageType::Pointer    tensors;
+      LogTensorImageType::Pointer logtensors;
+      prefetcher.Wait(tensors, logtensors);
+      if( i + 1 < inputs.size() )
+        {
+        prefetcher.Start(inputs[i + 1]);
+        }
+      if( verbose )
+        {
+        std::cout << "Accumulating: " <<  inputs[i] << std::endl;
+        }
+      if( tensors )
+        {
+        accumulator.Add(tensors);
+        }
+      else
+        {
+        accumulator.Add(logtensors);
+        }
+      }
+    if( verbose )
+      {
+      std::cout << "Number of tensor fields: " << accumulator.GetCount() << std::endl;
+      }
 
+    if( stateOutput != "" )
+      {
+      accumulator.Save(stateOutput);
+      }
+    if( tensorOutput == "" )
+      {
+      return EXIT_SUCCESS;
       }
+    if( logOutput )
+      {
+      // Keep the average in the Log-Euclidean domain
+      writeLogTensors(tensorOutput, accumulator.GetLogMean(), doubleDTI);
+      return EXIT_SUCCESS;
+      }
+    mean = accumulator.GetMean();
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return writeMean(mean, tensorOutput, doubleDTI);
+}
 
-    DivideImageFilter::Pointer divide = DivideImageFilter::New();
-    divide->SetFunctor(PixelDivider<LogTensorPixelType>(numberofinputs) );
-    divide->SetInput(average);
-    divide->Update();
+int main(int argc, char* argv[])
+{
+  PARSE_ARGS;
 
-    typedef itk::ExpEuclideanTensorImageFilter<RealType> ExpEuclideanFilter;
-    ExpEuclideanFilter::Pointer expf = ExpEuclideanFilter::New();
-    expf->SetInput(divide->GetOutput() );
+  //  const std::vector<std::string> sources = vm["inputs"].as<std::vector<std::string> >();
 
-    if( !doubleDTI )
+  const int numberofinputs = inputs.size();
+  if( numberofinputs > 0 && method == "riemannian" )
+    {
+    if( !stateInputs.empty() || stateOutput != "" )
       {
-      typedef itk::DiffusionTensor3D<float> TensorFloatPixelType;
-      typedef itk::Image<TensorFloatPixelType, 3> TensorFloatImageType;
-      typedef itk::CastImageFilter< TensorImageType, TensorFloatImageType > CastDTIFilterType ;
-      CastDTIFilterType::Pointer castFilter = CastDTIFilterType::New() ;
-      castFilter->SetInput( expf->GetOutput() ) ;
-      typedef itk::ImageFileWriter<TensorFloatImageType> TensorFileWriterType;
-      TensorFileWriterType::Pointer tensorWriter = TensorFileWriterType::New();
-      tensorWriter->SetFileName(tensorOutput.c_str());
-      tensorWriter->SetInput(castFilter->GetOutput());
-      tensorWriter->SetUseCompression(true);
-      tensorWriter->Update();
+      std::cerr << "The Riemannian mean needs all the tensor fields, it cannot use saved states" << std::endl;
+      return EXIT_FAILURE;
       }
-    else
+    if( logOutput )
       {
-      typedef itk::ImageFileWriter<TensorImageType> TensorFileWriterType;
-      TensorFileWriterType::Pointer twrit = TensorFileWriterType::New();
-      twrit->SetUseCompression(true);
-      twrit->SetInput(expf->GetOutput());
-      twrit->SetFileName(tensorOutput);
-      twrit->Update();
+      std::cerr << "The Riemannian mean cannot be saved as a Log-Euclidean file" << std::endl;
+      return EXIT_FAILURE;
+      }
+    TensorImageType::Pointer     mean;
+    IterationsImageType::Pointer iterations;
+    try
+      {
+      mean = riemannianMean(inputs, tolerance, maxIterations, memoryLimit, tensorOutput + ".input", verbose,
+                            iterations);
+      if( iterationsOutput != "" )
+        {
+        typedef itk::ImageFileWriter<IterationsImageType> IterationsWriterType;
+        IterationsWriterType::Pointer iterationsWriter = IterationsWriterType::New();
+        iterationsWriter->SetInput(iterations);
+        iterationsWriter->SetFileName(iterationsOutput);
+        iterationsWriter->SetUseCompression(true);
+        iterationsWriter->Update();
+        }
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << e << std::endl;
+      return EXIT_FAILURE;
+      }
+    return writeMean(mean, tensorOutput, doubleDTI);
+    }
+  else if( method != "riemannian" && (numberofinputs > 0 || !stateInputs.empty() ) )
+    {
+    if( secondMoments )
+      {
+      LogEuclideanPopulationStatistics stats;
+      return logEuclideanAverage(stats, inputs, stateInputs, stateOutput, tensorOutput,
+                                 logOutput, doubleDTI, verbose);
       }
+    LogEuclideanSum sum;
+    return logEuclideanAverage(sum, inputs, stateInputs, stateOutput, tensorOutput,
+                               logOutput, doubleDTI, verbose);
     }
   else
     {
@@ -59,13 +59,12 @@
 #include "itkTensorRotateImageFilter.h"
 
 // tensor correction headers
-#include "itkDiffusionTensor3DZeroCorrection.h"
-#include "itkDiffusionTensor3DAbsCorrection.h"
-#include "itkDiffusionTensor3DNearestCorrection.h"
+#include "tensorcorrection.h"
 
 #include <vnl/algo/vnl_svd.h>
 
 #include "dtitypes.h"
+#include "imagecrop.h"
 #include <dtiestimCLP.h>
 
 const char* NRRD_MEASUREMENT_KEY = "NRRD_measurement frame";
@@ -311,6 +310,7 @@ int main(int argc, char* argv[])
     }
 
   // Read brain mask if it is specified.
+  LabelImageType::Pointer brainMaskImage;
   if( brainMask != "" )
     {
     typedef itk::ImageFileReader<LabelImageType> MaskFileReaderType;
@@ -358,6 +358,7 @@ int main(int argc, char* argv[])
       mask->Update();
 
       dwi = mask->GetOutput();
+      brainMaskImage = maskreader->GetOutput();
       }
     catch( itk::ExceptionObject & e )
       {
@@ -673,6 +674,34 @@ int main(int argc, char* argv[])
   {
       defaultTensor[ i ] = defaultTensorValue[ i ] ;
   }
+  // Only estimate the tensors inside the bounding box of the brain
+  // mask. The masked out voxels are below the threshold and get the
+  // default tensor anyway. The B0 image and the threshold are computed
+  // on the full image above so they are not affected.
+  VectorImageType::Pointer fullDWI = dwi;
+  if( cropToMask )
+    {
+    if( !brainMaskImage )
+      {
+      std::cerr << "Cropping to the mask requested, but no brain mask specified" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( brainMaskImage->GetLargestPossibleRegion() != dwi->GetLargestPossibleRegion() )
+      {
+      std::cerr << "Cropping to the mask requires the brain mask to have the size of the DWI" << std::endl;
+      return EXIT_FAILURE;
+      }
+    const VectorImageType::RegionType cropRegion = computeMaskBoundingBox(brainMaskImage, cropMargin);
+    if( VERBOSE )
+      {
+      std::cout << "Cropping to region: " << cropRegion << std::endl;
+      }
+    dwi = cropImage(dwi, cropRegion);
+    }
+  // Tensor of the voxels outside of the crop region: the one the
+  // estimation method gives to the masked out voxels of the full image
+  TensorPixelType outsideTensor(0.0);
+
   //  if(vm["method"].as<EstimationType>() == LinearEstimate)
   if( method == "lls" )
     {
@@ -687,6 +716,7 @@ int main(int argc, char* argv[])
        llsestimator->SetShiftNegativeEigenvaluesCoefficient( ShiftNegativeEigenvaluesCoefficient ) ;
        llsestimator->Update();
        tensors = llsestimator->GetOutput();
+       outsideTensor = defaultTensor;
     }
   //  else if(vm["method"].as<EstimationType>() == NonlinearEstimate)
   else if( method == "nls" )
@@ -705,6 +735,7 @@ int main(int argc, char* argv[])
     estimator->SetShiftNegativeEigenvaluesCoefficient( ShiftNegativeEigenvaluesCoefficient ) ;
     estimator->Update();
     tensors = estimator->GetOutput();
+    outsideTensor = defaultTensor;
     }
   // else if(vm["method"].as<EstimationType>() == WeightedEstimate)
   else if( method == "wls" )
@@ -727,6 +758,7 @@ int main(int argc, char* argv[])
     estimator->SetShiftNegativeEigenvaluesCoefficient( ShiftNegativeEigenvaluesCoefficient ) ;
     estimator->Update();
     tensors = estimator->GetOutput();
+    outsideTensor = defaultTensor;
     }
   //  else if(vm["method"].as<EstimationType>() == MaximumLikelihoodEstimate)
   else if( method == "ml" )
@@ -763,63 +795,44 @@ int main(int argc, char* argv[])
     estimator->SetSigma(sigma);
     estimator->Update();
     tensors = estimator->GetOutput();
+    // The maximum likelihood estimator has no default tensor: it keeps
+    // the initial tensor of the voxels below the threshold, which is
+    // the default tensor of the weighted estimate
+    outsideTensor = estimatorInit->GetDefaultTensor();
     }
   else
     {
     std::cerr << "Invalid estimation method"  << std::endl;
     return EXIT_FAILURE;
     }
-
-  // Tensors Corrections
-  if( !correction.compare( "zero" ) )
-    {
-    typedef itk::DiffusionTensor3DZeroCorrectionFilter<TensorImageType, TensorImageType> ZeroCorrection;
-    ZeroCorrection::Pointer zeroFilter = ZeroCorrection::New();
-    zeroFilter->SetInput( tensors );
-    zeroFilter->Update();
-    tensors = zeroFilter->GetOutput();
-    }
-  else if( !correction.compare( "abs" ) )
-    {
-    typedef itk::DiffusionTensor3DAbsCorrectionFilter<TensorImageType, TensorImageType> AbsCorrection;
-    AbsCorrection::Pointer absFilter = AbsCorrection::New();
-    absFilter->SetInput( tensors );
-    absFilter->Update();
-    tensors = absFilter->GetOutput();
-    }
-  else if( !correction.compare( "nearest" ) )
-    {
-    typedef itk::DiffusionTensor3DNearestCorrectionFilter<TensorImageType, TensorImageType> NearestCorrection;
-    NearestCorrection::Pointer nearestFilter = NearestCorrection::New();
-    nearestFilter->SetInput( tensors );
-    nearestFilter->Update();
-    tensors = nearestFilter->GetOutput();
-    }
+  tensors = uncropImage(tensors, fullDWI, outsideTensor);
 
   // wp = D*x
   // wv = M*x
   // wv' = D'M*x
 
-  // Write tensor file if requested
+  // Correct the tensors and write the tensor file. The correction and
+  // the cast to float are done in a single pass.
   try
     {
     if( !doubleDTI )
       {
-      typedef itk::DiffusionTensor3D<float> TensorFloatPixelType ;
-      typedef itk::Image<TensorFloatPixelType, DIM> TensorFloatImageType ;
-      typedef itk::CastImageFilter< TensorImageType, TensorFloatImageType > CastDTIFilterType ;
-      CastDTIFilterType::Pointer castFilter = CastDTIFilterType::New() ;
-      castFilter->SetInput( tensors ) ;
+      TensorFloatImageType::Pointer tensorFloat =
+        correctTensors<TensorFloatImageType>(tensors, correction, ITK_NULLPTR);
       typedef itk::ImageFileWriter<TensorFloatImageType> TensorFileWriterType ;
       TensorFileWriterType::Pointer tensorWriter = TensorFileWriterType::New() ;
       tensorWriter->SetFileName(tensorOutput.c_str()) ;
-      tensors->SetMetaDataDictionary(dict) ;
-      tensorWriter->SetInput(castFilter->GetOutput()) ;
+      tensorFloat->SetMetaDataDictionary(dict) ;
+      tensorWriter->SetInput(tensorFloat) ;
       tensorWriter->SetUseCompression(true) ;
       tensorWriter->Update() ;
       }
     else
       {
+      if( correction != "none" )
+        {
+        tensors = correctTensors<TensorImageType>(tensors, correction, ITK_NULLPTR);
+        }
       typedef itk::ImageFileWriter<TensorImageType> TensorFileWriterType ;
       TensorFileWriterType::Pointer tensorWriter = TensorFileWriterType::New() ;
       tensorWriter->SetFileName(tensorOutput.c_str()) ;
@@ -0,0 +1,114 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <itkCastImageFilter.h>
+#include <itkVersion.h>
+
+#include "tensorio.h"
+#include "tensorpopulation.h"
+#include "imageio.h"
+#include "dtipopulationstatsCLP.h"
+
+int main(int argc, char* argv[])
+{
+  PARSE_ARGS;
+
+  const int numberofinputs = inputs.size();
+  if( numberofinputs == 0 )
+    {
+    std::cerr << "At least one tensor field has to be specified" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if( numberofinputs < 2 && (covarianceOutput != "" || generalizedVarianceOutput != ""
+                             || pgaVariancesOutput != "" || pgaModesOutput != "") )
+    {
+    std::cerr << "The covariance and the principal modes need at least two tensor fields" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  try
+    {
+    // Single pass over the population, the next subject is read while
+    // the current one is accumulated
+    LogEuclideanPopulationStatistics stats;
+    TensorFilePrefetcher             prefetcher;
+    prefetcher.Start(inputs[0]);
+    for( int i = 0; i < numberofinputs; ++i )
+      {
+      TensorImageType::Pointer    tensors;
+      LogTensorImageType::Pointer logtensors;
+      prefetcher.Wait(tensors, logtensors);
+      if( i + 1 < numberofinputs )
+        {
+        prefetcher.Start(inputs[i + 1]);
+        }
+      if( verbose )
+        {
+        std::cout << "Accumulating: " << inputs[i] << std::endl;
+        }
+      if( tensors )
+        {
+        stats.Add(tensors);
+        }
+      else
+        {
+        stats.Add(logtensors);
+        }
+      }
+
+    if( meanOutput != "" )
+      {
+      if( doubleDTI )
+        {
+        writeImage(meanOutput, stats.GetMean() );
+        }
+      else
+        {
+        typedef itk::CastImageFilter<TensorImageType, TensorFloatImageType> CastDTIFilterType;
+        CastDTIFilterType::Pointer cast = CastDTIFilterType::New();
+        cast->SetInput(stats.GetMean() );
+        cast->Update();
+        writeImage(meanOutput, cast->GetOutput() );
+        }
+      }
+    if( covarianceOutput != "" )
+      {
+      writeImage(covarianceOutput, stats.GetCovariance() );
+      }
+    if( generalizedVarianceOutput != "" )
+      {
+      writeImage(generalizedVarianceOutput, stats.GetGeneralizedVariance() );
+      }
+    if( pgaVariancesOutput != "" || pgaModesOutput != "" )
+      {
+      LogEuclideanPopulationStatistics::OutputVectorImageType::Pointer variances;
+      LogEuclideanPopulationStatistics::OutputVectorImageType::Pointer modes;
+      stats.GetPrincipalModes(numberOfModes, variances, modes);
+      if( pgaVariancesOutput != "" )
+        {
+        writeImage(pgaVariancesOutput, variances);
+        }
+      if( pgaModesOutput != "" )
+        {
+        writeImage(pgaModesOutput, modes);
+        }
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -28,17 +28,13 @@
 #include <itkImageFileReader.h>
 
 // dtiprocess headers
-#include "itkVectorMaskImageFilter.h"
 #include "transforms.h"
 #include "tensoroperations.h"
 #include "imageio.h"
+#include "tensorio.h"
+#include "imagecrop.h"
 #include "deformationfieldio.h"
 
-// tensor correction headers
-#include "itkDiffusionTensor3DZeroCorrection.h"
-#include "itkDiffusionTensor3DAbsCorrection.h"
-#include "itkDiffusionTensor3DNearestCorrection.h"
-
 #include "dtiprocessCLP.h"
 
 // Bad global variables.  TODO: remove these
@@ -64,18 +60,16 @@ int main(int argc, char* argv[])
 //     VERBOSE = true;
 //   }
   VERBOSE = verbose;
-  // Read tensor image
-  typedef itk::ImageFileReader<TensorImageType> FileReaderType;
-  FileReaderType::Pointer dtireader = FileReaderType::New();
+  // Read tensor image (tensor or Log-Euclidean tensor file)
   if( dtiImage == "" )
     {
     std::cerr << "Missing DTI Image filename" << std::endl;
     exit(1);
     }
-  dtireader->SetFileName(dtiImage.c_str() );
+  TensorImageType::Pointer tensors;
   try
     {
-    dtireader->Update();
+    tensors = readTensors(dtiImage);
     }
   catch( itk::ExceptionObject & e )
     {
@@ -87,7 +81,7 @@ int main(int argc, char* argv[])
   // namic conventions defined at http://wiki.na-mic.org/Wiki/index.php/NAMIC_Wiki:DTI:Nrrd_format
   GradientListType::Pointer gradientContainer = GradientListType::New();
 
-  itk::MetaDataDictionary & dict = dtireader->GetOutput()->GetMetaDataDictionary();
+  itk::MetaDataDictionary & dict = tensors->GetMetaDataDictionary();
 
   std::vector<std::string> keys = dict.GetKeys();
   for( std::vector<std::string>::const_iterator it = keys.begin();
@@ -140,34 +134,7 @@ int main(int argc, char* argv[])
               << reorientation << std::endl;
     }
 
-  TensorImageType::Pointer tensors = dtireader->GetOutput();
-
-  // Tensors Corrections
-  if( !correction.compare( "zero" ) )
-    {
-    typedef itk::DiffusionTensor3DZeroCorrectionFilter<TensorImageType, TensorImageType> ZeroCorrection;
-    ZeroCorrection::Pointer zeroFilter = ZeroCorrection::New();
-    zeroFilter->SetInput( tensors );
-    zeroFilter->Update();
-    tensors = zeroFilter->GetOutput();
-    }
-  else if( !correction.compare( "abs" ) )
-    {
-    typedef itk::DiffusionTensor3DAbsCorrectionFilter<TensorImageType, TensorImageType> AbsCorrection;
-    AbsCorrection::Pointer absFilter = AbsCorrection::New();
-    absFilter->SetInput( tensors );
-    absFilter->Update();
-    tensors = absFilter->GetOutput();
-    }
-  else if( !correction.compare( "nearest" ) )
-    {
-    typedef itk::DiffusionTensor3DNearestCorrectionFilter<TensorImageType, TensorImageType> NearestCorrection;
-    NearestCorrection::Pointer nearestFilter = NearestCorrection::New();
-    nearestFilter->SetInput( tensors );
-    nearestFilter->Update();
-    tensors = nearestFilter->GetOutput();
-    }
-
+  LabelImageType::Pointer maskImage;
   //  if(vm.count("mask"))
   if( mask != "" )
     {
@@ -175,63 +142,111 @@ int main(int argc, char* argv[])
     MaskFileReaderType::Pointer maskreader = MaskFileReaderType::New();
     //    maskreader->SetFileName(vm["mask"].as<std::string>());
     maskreader->SetFileName(mask.c_str() );
-    typedef itk::VectorMaskImageFilter<TensorImageType, LabelImageType, TensorImageType> MaskFilterType;
-    MaskFilterType::Pointer _mask = MaskFilterType::New();
-    _mask->SetInput1(tensors);
-    _mask->SetInput2(maskreader->GetOutput() );
+    try
+      {
+      maskreader->Update();
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << e << std::endl;
+      return EXIT_FAILURE;
+      }
+    maskImage = maskreader->GetOutput();
+    }
 
+  // Tensors Corrections and masking, fused in a single pass
+  if( correction != "none" || maskImage )
+    {
     try
       {
-      _mask->Update();
+      tensors = correctTensors<TensorImageType>(tensors, correction, maskImage);
       }
     catch( itk::ExceptionObject & e )
       {
       std::cerr << e << std::endl;
       return EXIT_FAILURE;
       }
+    }
 
-    tensors = _mask->GetOutput();
-    // If the outmask option is specified, the masked tensor field is saved
-    if( outmask != "" )
+  // If the outmask option is specified, the masked tensor field is saved
+  if( maskImage && outmask != "" )
+    {
+    if( !doubleDTI )
       {
-      if( !doubleDTI )
+      CastDTIFilterType::Pointer castFilter = CastDTIFilterType::New() ;
+      castFilter->SetInput( tensors ) ;
+      TensorFileWriterType::Pointer dtiwriter = TensorFileWriterType::New();
+      dtiwriter->SetFileName(outmask.c_str());
+      dtiwriter->SetInput(castFilter->GetOutput());
+      dtiwriter->SetUseCompression(true);
+      try
         {
-        CastDTIFilterType::Pointer castFilter = CastDTIFilterType::New() ;
-        castFilter->SetInput( tensors ) ;
-        TensorFileWriterType::Pointer dtiwriter = TensorFileWriterType::New();
-        dtiwriter->SetFileName(outmask.c_str());
-        dtiwriter->SetInput(castFilter->GetOutput());
-        dtiwriter->SetUseCompression(true);
-        try
-          {
-          dtiwriter->Update();
-          }
-          catch (itk::ExceptionObject & e)
-          {
-            std::cerr << e <<std::endl;
-            return EXIT_FAILURE;
-          }
+        dtiwriter->Update();
         }
-      else
-        {
-        typedef itk::ImageFileWriter<TensorImageType> FileWriterType;
-        FileWriterType::Pointer dtiwriter = FileWriterType::New();
-        dtiwriter->SetFileName(outmask.c_str());
-        dtiwriter->SetUseCompression(true);
-        dtiwriter->SetInput(tensors);
-        try
-          {
-          dtiwriter->Update();
-          }
         catch (itk::ExceptionObject & e)
-          {
+        {
           std::cerr << e <<std::endl;
           return EXIT_FAILURE;
-          }
+        }
+      }
+    else
+      {
+      typedef itk::ImageFileWriter<TensorImageType> FileWriterType;
+      FileWriterType::Pointer dtiwriter = FileWriterType::New();
+      dtiwriter->SetFileName(outmask.c_str());
+      dtiwriter->SetUseCompression(true);
+      dtiwriter->SetInput(tensors);
+      try
+        {
+        dtiwriter->Update();
+        }
+      catch (itk::ExceptionObject & e)
+        {
+        std::cerr << e <<std::endl;
+        return EXIT_FAILURE;
         }
       }
     }
 
+  // Save the corrected tensors in the Log-Euclidean domain so that
+  // later averaging or statistics do not recompute the logarithms
+  if( logOutput != "" )
+    {
+    try
+      {
+      writeLogTensors(logOutput, logTensors(tensors), doubleDTI);
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << e << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // Restrict the processing to the bounding box of the mask. Tensors
+  // outside of the mask are zero so the scalar maps pasted back into
+  // the full image are unchanged.
+  TensorImageType::Pointer fullTensors = tensors;
+  if( cropToMask )
+    {
+    if( !maskImage )
+      {
+      std::cerr << "Cropping to the mask requested, but no mask specified" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( maskImage->GetLargestPossibleRegion() != tensors->GetLargestPossibleRegion() )
+      {
+      std::cerr << "Cropping to the mask requires the mask to have the size of the tensor image" << std::endl;
+      return EXIT_FAILURE;
+      }
+    const TensorImageType::RegionType cropRegion = computeMaskBoundingBox(maskImage, cropMargin);
+    if( VERBOSE )
+      {
+      std::cout << "Cropping to region: " << cropRegion << std::endl;
+      }
+    tensors = cropImage(tensors, cropRegion);
+    }
+
   // sigma set in PARSE_ARGS
   // double sigma = vm["sigma"].as<double>();
 
@@ -242,12 +257,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(faOutput,
-                 createFA<unsigned short>(tensors) );
+                 uncropImage(createFA<unsigned short>(tensors), fullTensors) );
       }
     else
       {
       writeImage(faOutput,
-                 createFA<double>(tensors) );
+                 uncropImage(createFA<double>(tensors), fullTensors) );
       }
     }
 
@@ -255,27 +270,27 @@ int main(int argc, char* argv[])
   if( faGradientOutput != "" )
     {
     writeImage(faGradientOutput,
-               createFAGradient(tensors, sigma) );
+               uncropImage(createFAGradient(tensors, sigma), fullTensors) );
     }
 
   //  if(vm.count("fa-gradmag-output"))
   if( faGradientMagOutput != "" )
     {
     writeImage(faGradientMagOutput,
-               createFAGradMag(tensors, sigma) );
+               uncropImage(createFAGradMag(tensors, sigma), fullTensors) );
     }
 
   if( colorFAOutput != "" )
     {
     writeImage(colorFAOutput,
-               createColorFA(tensors) );
+               uncropImage(createColorFA(tensors), fullTensors) );
     }
 
   if( principalEigenvectorOutput != "" )
 //     vm.count("closest-dotproduct-output"))
     {
     writeImage(principalEigenvectorOutput,
-               createPrincipalEigenvector(tensors) );
+               uncropImage(createPrincipalEigenvector(tensors), fullTensors) );
     }
 
   //  if(vm.count("md-output"))
@@ -284,12 +299,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(mdOutput,
-                 createMD<unsigned short>(tensors) );
+                 uncropImage(createMD<unsigned short>(tensors), fullTensors) );
       }
     else
       {
       writeImage(mdOutput,
-                 createMD<double>(tensors) );
+                 uncropImage(createMD<double>(tensors), fullTensors) );
       }
     }
 
@@ -298,12 +313,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(lambda1Output,
-                 createLambda<unsigned short>(tensors, Lambda1) );
+                 uncropImage(createLambda<unsigned short>(tensors, Lambda1), fullTensors) );
       }
     else
       {
       writeImage(lambda1Output,
-                 createLambda<double>(tensors, Lambda1) );
+                 uncropImage(createLambda<double>(tensors, Lambda1), fullTensors) );
       }
     }
 
@@ -312,12 +327,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(lambda2Output,
-                 createLambda<unsigned short>(tensors, Lambda2) );
+                 uncropImage(createLambda<unsigned short>(tensors, Lambda2), fullTensors) );
       }
     else
       {
       writeImage(lambda2Output,
-                 createLambda<double>(tensors, Lambda2) );
+                 uncropImage(createLambda<double>(tensors, Lambda2), fullTensors) );
       }
     }
 
@@ -326,12 +341,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(lambda3Output,
-                 createLambda<unsigned short>(tensors, Lambda3) );
+                 uncropImage(createLambda<unsigned short>(tensors, Lambda3), fullTensors) );
       }
     else
       {
       writeImage(lambda3Output,
-                 createLambda<double>(tensors, Lambda3) );
+                 uncropImage(createLambda<double>(tensors, Lambda3), fullTensors) );
       }
     }
 
@@ -340,12 +355,12 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(RDOutput,
-                 createRD<unsigned short>(tensors) );
+                 uncropImage(createRD<unsigned short>(tensors), fullTensors) );
       }
     else
       {
       writeImage(RDOutput,
-                 createRD<double>(tensors) );
+                 uncropImage(createRD<double>(tensors), fullTensors) );
       }
     }
 
@@ -354,19 +369,19 @@ int main(int argc, char* argv[])
     if( scale )
       {
       writeImage(frobeniusNormOutput,
-                 createFro<unsigned short>(tensors) );
+                 uncropImage(createFro<unsigned short>(tensors), fullTensors) );
       }
     else
       {
       writeImage(frobeniusNormOutput,
-                 createFro<double>(tensors) );
+                 uncropImage(createFro<double>(tensors), fullTensors) );
       }
     }
 
   if( negativeEigenvectorOutput != "" )
     {
     writeImage(negativeEigenvectorOutput,
-               createNegativeEigenValueLabel(tensors) );
+               uncropImage(createNegativeEigenValueLabel(tensors), fullTensors) );
     }
 
   if( rotOutput != "" )
@@ -375,17 +390,17 @@ int main(int argc, char* argv[])
     //If the input affine file is a dof file from rview
     if(dofFile != "")
       {
-      tensorImage = createROT(tensors,dofFile,0) ;
+      tensorImage = createROT(fullTensors,dofFile,0) ;
       }
     //If the input affine file is a new dof file (output of dof2mat)
     else if(newdof_file != "")
       {
-      tensorImage = createROT(tensors, newdof_file, 1);
+      tensorImage = createROT(fullTensors, newdof_file, 1);
       }
     //If the input affine file is an itk compatible file
     else if(affineitk_file != "")
       {
-      tensorImage = createROT(tensors, affineitk_file, 2);
+      tensorImage = createROT(fullTensors, affineitk_file, 2);
       }
     else
       {
@@ -421,8 +436,12 @@ int main(int argc, char* argv[])
       }
 
     forward = readDeformationField(forwardTransformation, dftype);
+    // The B-spline coefficients depend on the whole image, so the
+    // cubic interpolation is always done on the uncropped tensors.
+    // Points mapped outside of the cropped box get the padding value
+    // of the warp, like points mapped outside of the full image.
     TensorImageType::Pointer tensorImage ;
-    tensorImage = createWarp(tensors,
+    tensorImage = createWarp((interpolation == "cubic" ? fullTensors : tensors),
                forward,
                //vm["reorientation"].as<TensorReorientationType>(),
                (reorientation == "fs" ? FiniteStrain :
@@ -445,21 +464,49 @@ int main(int argc, char* argv[])
       }
     }
 
-#if 0 //
-  if( vm.count("stats") )
+  if( statisticsOutput != "" )
     {
-    if( !vm.count("mask") )
+    IntImageType::Pointer labels;
+    const std::string labelFile = statisticsLabels != "" ? statisticsLabels : mask;
+    if( labelFile != "" )
+      {
+      typedef itk::ImageFileReader<IntImageType> LabelFileReaderType;
+      LabelFileReaderType::Pointer labelreader = LabelFileReaderType::New();
+      labelreader->SetFileName(labelFile.c_str() );
+      try
+        {
+        labelreader->Update();
+        }
+      catch( itk::ExceptionObject & e )
+        {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+        }
+      labels = labelreader->GetOutput();
+      }
+    else
       {
       std::cerr << "WARNING: No mask specified.  Computing whole brain statistics" << std::endl;
+      labels = IntImageType::New();
+      labels->CopyInformation(fullTensors);
+      labels->SetRegions(fullTensors->GetLargestPossibleRegion() );
+      labels->Allocate();
+      labels->FillBuffer(1);
       }
     if( VERBOSE )
       {
       std::cout << "Computing tensor stats" << std::endl;
       }
 
-//    TensorRegionStatistics tstat = computeTensorStatistics(tensors);
-
+    try
+      {
+      writeRegionStatistics(statisticsOutput, fullTensors, labels, statisticsPercentiles);
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << e << std::endl;
+      return EXIT_FAILURE;
+      }
     }
-#endif
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,66 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+  Copyright (c)  Casey Goodlett. All rights reserved.
+  See NeuroLibCopyright.txt or http://www.ia.unc.edu/dev/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// STL includes
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "fiberio.h"
+#include "dtitypes.h"
+#include "fibermergeCLP.h"
+
+int main(int argc, char* argv[])
+{
+  PARSE_ARGS;
+
+  if( fiberInputs.empty() || fiberOutput == "" )
+    {
+    std::cerr << "Input fiber files and an output fiber file need to be specified." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  try
+    {
+    FiberFileWriter writer;
+    writer.Open(fiberOutput, !noProperties);
+
+    // Fibers passed from an input to the output at once
+    const unsigned long FibersPerChunk = 1000;
+
+    for( std::vector<std::string>::const_iterator file = fiberInputs.begin(); file != fiberInputs.end(); ++file )
+      {
+      FiberFileReader reader;
+      reader.Open(*file);
+      if( verbose )
+        {
+        std::cout << *file << ": " << reader.GetNumberOfFibers() << " fibers" << std::endl;
+        }
+
+      FiberBundle chunk;
+      while( reader.ReadFibers(FibersPerChunk, chunk) )
+        {
+        writer.WriteFibers(chunk);
+        }
+      }
+
+    writer.Close();
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
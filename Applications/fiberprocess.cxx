@@ -16,18 +16,21 @@ PURPOSE.  See the above copyright notices for more information.
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 // ITK includes
 #include <itkDiffusionTensor3D.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkTensorLinearInterpolateImageFunction.h>
+#include <itkTensorBrickedLinearInterpolateImageFunction.h>
 #include <itkVectorLinearInterpolateImageFunction.h>
 #include <itkVersion.h>
 
 // #include "FiberCalculator.h"
 #include "deformationfieldoperations.h"
 #include "fiberio.h"
+#include "tensorio.h"
 #include "dtitypes.h"
 #include "fiberprocessCLP.h"
 
@@ -42,8 +45,9 @@ int main(int argc, char* argv[])
     }
   const bool VERBOSE = verbose;
 
-  // Reader fiber bundle
-  GroupType::Pointer group = readFiberFile(fiberFile);
+  // Fiber bundle reader, the fibers are processed by chunks
+  FiberFileReader reader;
+  reader.Open(fiberFile);
 
   DeformationImageType::Pointer deformationfield(ITK_NULLPTR);
   if( hField != "" )
@@ -71,66 +75,34 @@ int main(int argc, char* argv[])
     noWarp = true;
     }
 
-  // Setup new fiber bundle group
-  GroupType::Pointer newgroup = GroupType::New();
-  newgroup->SetId(0);
-
-  ChildrenListType* children = group->GetChildren(0);
-
-  if( VERBOSE )
-    {
-    std::cout << "Getting spacing" << std::endl;
-    }
-
-  // Get Spacing and offset from group
-  double spacing[3];
-  if( noWarp )
-    {
-    newgroup->SetObjectToWorldTransform( group->GetObjectToWorldTransform() );
-    newgroup->ComputeObjectToParentTransform();
-    for( unsigned int i = 0; i < 3; i++ )
-      {
-      spacing[i] = (group->GetSpacing() )[i];
-      }
-    }
-  else
-    {
-    spacing[0] = spacing[1] = spacing[2] = 1;
-    }
-  newgroup->SetSpacing(spacing);
-
-  itk::Vector<double, 3> sooffset;
-  for( unsigned int i = 0; i < 3; i++ )
-    {
-    sooffset[i] = (group->GetObjectToParentTransform()->GetOffset() )[i];
-    }
-
-  if( VERBOSE )
+  if( VERBOSE && deformationfield )
     {
-    std::cout << "Group Spacing: " << spacing[0] << ", " << spacing[1] << ", " << spacing[2] << std::endl;
-    std::cout << "Group Offset: " << sooffset[0] << ", " << sooffset[1]  << ", " << sooffset[2] << std::endl;
-    if( deformationfield )
-      {
-      std::cout << "deformationfield: '" << deformationfield << "'" << std::endl;
-      }
+    std::cout << "deformationfield: '" << deformationfield << "'" << std::endl;
     }
 
   // Setup tensor file if available
-  typedef itk::ImageFileReader<TensorImageType>                              TensorImageReader;
-  typedef itk::TensorLinearInterpolateImageFunction<TensorImageType, double> TensorInterpolateType;
-  TensorImageReader::Pointer     tensorreader = ITK_NULLPTR;
+  typedef itk::TensorInterpolateImageFunction<TensorImageType, double>       TensorInterpolateType;
+  typedef itk::TensorLinearInterpolateImageFunction<TensorImageType, double> TensorLinearInterpolateType;
+  typedef itk::TensorBrickedLinearInterpolateImageFunction<TensorImageType, double> TensorBrickedInterpolateType;
+  TensorImageType::Pointer       tensorimage = ITK_NULLPTR;
   TensorInterpolateType::Pointer tensorinterp = ITK_NULLPTR;
 
   if( tensorVolume != "" )
     {
-    tensorreader = TensorImageReader::New();
-    tensorinterp = TensorInterpolateType::New();
+    if( brickedLayout )
+      {
+      tensorinterp = TensorBrickedInterpolateType::New();
+      }
+    else
+      {
+      tensorinterp = TensorLinearInterpolateType::New();
+      }
 
-    tensorreader->SetFileName(tensorVolume);
     try
       {
-      tensorreader->Update();
-      tensorinterp->SetInputImage(tensorreader->GetOutput() );
+      // Tensor or Log-Euclidean tensor file
+      tensorimage = readTensors(tensorVolume);
+      tensorinterp->SetInputImage(tensorimage);
       }
     catch( itk::ExceptionObject exp )
       {
@@ -144,9 +116,6 @@ int main(int argc, char* argv[])
     std::cout << "Starting Loop" << std::endl;
     }
 
-  ChildrenListType::iterator it;
-  unsigned int               id = 1;
-
   // Need to allocate an image to write into for creating
   // the fiber label map
   IntImageType::Pointer labelimage;
@@ -157,36 +126,99 @@ int main(int argc, char* argv[])
       std::cerr << "Must specify tensor file to copy image metadata for fiber voxelize." << std::endl;
       return EXIT_FAILURE;
       }
-    // tensorreader->GetOutput();
+    // tensorimage;
     labelimage = IntImageType::New();
-    labelimage->SetSpacing(tensorreader->GetOutput()->GetSpacing() );
-    labelimage->SetOrigin(tensorreader->GetOutput()->GetOrigin() );
-    labelimage->SetDirection(tensorreader->GetOutput()->GetDirection() );
-    labelimage->SetRegions(tensorreader->GetOutput()->GetLargestPossibleRegion() );
+    labelimage->SetSpacing(tensorimage->GetSpacing() );
+    labelimage->SetOrigin(tensorimage->GetOrigin() );
+    labelimage->SetDirection(tensorimage->GetDirection() );
+    labelimage->SetRegions(tensorimage->GetLargestPossibleRegion() );
     labelimage->Allocate();
     labelimage->FillBuffer(0);
     }
-  // For each fiber
-  for( it = children->begin(); it != children->end(); it++ )
+
+  FiberFileWriter fiberwriter;
+  if( fiberOutput != "" )
     {
-    DTIPointListType     pointlist = dynamic_cast<DTITubeType *>( (*it).GetPointer() )->GetPoints();
-    DTITubeType::Pointer newtube = DTITubeType::New();
-    DTIPointListType     newpoints;
+    fiberwriter.Open(fiberOutput, saveProperties);
+    }
 
-    DTIPointListType::iterator pit;
+  // Fibers read, processed and written at once
+  const unsigned long FibersPerChunk = 1000;
+  FiberBundle         bundle;
+  FiberBundle         newbundle;
+  for( bool firstchunk = true; reader.ReadFibers(FibersPerChunk, bundle); firstchunk = false )
+    {
+    // Setup new fiber bundle
+    newbundle.Clear();
 
-    typedef DeformationInterpolateType::ContinuousIndexType ContinuousIndexType;
-    ContinuousIndexType tensor_ci, def_ci;
+    // Unwarped fibers keep the object space of the input, warped ones
+    // are in world coordinates
+    if( noWarp )
+      {
+      newbundle.SetSpacing(bundle.GetSpacing() );
+      newbundle.SetOrigin(bundle.GetOrigin() );
+      }
+
+    if( VERBOSE && firstchunk )
+      {
+      const double * spacing = newbundle.GetSpacing();
+      const double * sooffset = bundle.GetOrigin();
+      std::cout << "Group Spacing: " << spacing[0] << ", " << spacing[1] << ", " << spacing[2] << std::endl;
+      std::cout << "Group Offset: " << sooffset[0] << ", " << sooffset[1]  << ", " << sooffset[2] << std::endl;
+      }
+
+    // Same fibers as the input
+    const unsigned long npoints = bundle.GetNumberOfPoints();
+    for( unsigned long f = 0; f < bundle.GetNumberOfFibers(); ++f )
+      {
+      newbundle.AddFiber(bundle.GetFiberEnd(f) - bundle.GetFiberBegin(f) );
+      }
+
+    // The input scalars are kept with noDataChange, and are not
+    // replaced by the recomputed ones
+    if( noDataChange == true )
+      {
+      for( FiberBundle::ScalarMapType::const_iterator scit = bundle.GetScalars().begin();
+           scit != bundle.GetScalars().end(); ++scit )
+        {
+        newbundle.GetScalar(scit->first) = scit->second;
+        }
+      }
 
-    // For each point along the fiber
-    for( pit = pointlist.begin(); pit != pointlist.end(); ++pit )
+    const unsigned int NumberOfMeasures = 9;
+    const char * const measurenames[NumberOfMeasures] = { "FA", "fa", "md", "fro", "l1", "ad", "l2", "l3", "rd" };
+    float *            measures[NumberOfMeasures];
+    bool               computemeasures = false;
+    for( unsigned int m = 0; m < NumberOfMeasures; ++m )
       {
-      typedef DTIPointType::PointType PointType;
+      // The measures are only written to the fiber output
+      measures[m] = ITK_NULLPTR;
+      if( fiberOutput != "" && !newbundle.HasScalar(measurenames[m]) && npoints > 0 )
+        {
+        measures[m] = &newbundle.GetScalar(measurenames[m])[0];
+        computemeasures = true;
+        }
+      }
+
+    const FiberBundle::ArrayType & positions = bundle.GetPositions();
+    const FiberBundle::ArrayType & tensors = bundle.GetTensors();
+    FiberBundle::ArrayType &       newpositions = newbundle.GetPositions();
+    FiberBundle::ArrayType &       newtensors = newbundle.GetTensors();
+
+    typedef DeformationInterpolateType::ContinuousIndexType ContinuousIndexType;
+    ContinuousIndexType def_ci;
 
-      // p is not really a point its a continuous index
-      const PointType               p = pit->GetPosition();
-      DTITubeType::TransformPointer transform = ( (*it).GetPointer() )->GetObjectToWorldTransform();
-      const PointType               p_world_orig = transform->TransformPoint( p );
+    // The tensors of the whole chunk are interpolated at once, after the
+    // positions are computed
+    const bool interpolate = tensorVolume != "" && fiberOutput != "" && !noDataChange;
+    std::vector<TensorInterpolateType::ContinuousIndexType> tensor_cis(interpolate ? npoints : 0);
+    std::vector<TensorInterpolateType::OutputType>          sampled(tensor_cis.size() );
+
+    // For each point of each fiber
+    for( unsigned long k = 0; k < npoints; ++k )
+      {
+      itk::Point<double, 3> p_world_orig;
+      bundle.GetWorldPosition(k, p_world_orig.GetDataPointer() );
 
       itk::Point<double, 3> pt_trans = p_world_orig;
 
@@ -208,15 +240,11 @@ int main(int argc, char* argv[])
             {
             pt_trans[i] += warp[i];
             }
-//          deformationfield->TransformContinuousIndexToPhysicalPoint( def_ci , pt_trans ) ;
-//          std::cout<<p << " "<< p_world_orig<<" "<<pt_trans<<std::endl;
           }
         }
-//            std::cout<<"plop6"<<std::endl;
 
       if( voxelize != "" )
         {
-//        std::cout<<p << " "<< p_world_orig<<" "<<pt_trans<<std::endl;
         ContinuousIndexType cind;
         itk::Index<3>       ind;
         labelimage->TransformPhysicalPointToContinuousIndex(pt_trans, cind);
@@ -240,83 +268,86 @@ int main(int argc, char* argv[])
           }
         }
 
-      DTIPointType newpoint;
-      if( noDataChange == true )
+      for( unsigned int i = 0; i < 3; ++i )
         {
-        newpoint = *pit;
+        // Object space of the input, or world coordinate system with
+        // spacing 1
+        newpositions[3 * k + i] = noWarp ? positions[3 * k + i] : pt_trans[i];
         }
-      // Should not have to do this
-      if( noWarp )
-        {
-//        std::cout<<"no warp"<<std::endl;
-        newpoint.SetPosition(p);
-        }
-      else
+
+      if( interpolate )
         {
-        // set the point to world coordinate system and set the spacing to 1
-//        std::cout<<"warp"<<std::endl;
-        newpoint.SetPosition(pt_trans);
+        tensorimage->TransformPhysicalPointToContinuousIndex(pt_trans, tensor_cis[k]);
         }
+      }
 
-      // newpoint.SetRadius(.4);
-      // newpoint.SetRed(0.0);
-      // newpoint.SetGreen(1.0);
-      // newpoint.SetBlue(0.0);
+    if( interpolate && npoints > 0 )
+      {
+      tensorinterp->EvaluateAtContinuousIndexBatch(&tensor_cis[0], &sampled[0], npoints);
+      }
 
+    for( unsigned long k = 0; k < npoints; ++k )
+      {
       // Attribute tensor data if provided
-      float sotensor[6];
       itk::DiffusionTensor3D<double> tensor;
-      if( tensorVolume != "" && fiberOutput != "" && !noDataChange )
+      if( interpolate )
         {
-        tensorreader->GetOutput()->TransformPhysicalPointToContinuousIndex(pt_trans, tensor_ci);
-        tensor = tensorinterp->EvaluateAtContinuousIndex(tensor_ci).GetDataPointer() ;
-
-        // TODO: Change SpatialObject interface to accept DiffusionTensor3D
+        tensor = sampled[k].GetDataPointer();
+        }
+      else
+        {
+        // copy prior tensor info
         for( unsigned int i = 0; i < 6; ++i )
           {
-          sotensor[i] = tensor[i];
+          tensor[i] = tensors[6 * k + i];
           }
-	}
-      else 
-	{
-	  // copy prior tensor info
-	  for( unsigned int i = 0; i < 6; ++i )
-	    {
-	      sotensor[i] = pit->GetTensorMatrix()[i];
-	      tensor[i] = pit->GetTensorMatrix()[i];
-	    }
-	
-	}
+        }
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        newtensors[6 * k + i] = tensor[i];
+        }
+
+      // No eigen decomposition if no measure is needed
+      if( !computemeasures )
+        {
+        continue;
+        }
 
       typedef itk::DiffusionTensor3D<double>::EigenValuesArrayType EigenValuesType;
       EigenValuesType eigenvalues;
       tensor.ComputeEigenValues(eigenvalues);
-      
-      newpoint.SetRadius(0.5);
-      newpoint.SetTensorMatrix(sotensor);
-      newpoint.AddField(itk::DTITubeSpatialObjectPoint<3>::FA, tensor.GetFractionalAnisotropy() );
-      newpoint.AddField("fa", tensor.GetFractionalAnisotropy() );
-      newpoint.AddField("md", tensor.GetTrace() / 3);
-      newpoint.AddField("fro", sqrt(tensor[0] * tensor[0]
-				    + 2 * tensor[1] * tensor[1]
-				    + 2 * tensor[2] * tensor[2]
-				    + tensor[3] * tensor[3]
-				    + 2 * tensor[4] * tensor[4]
-				    + tensor[5] * tensor[5]) );
-      newpoint.AddField("l1", eigenvalues[2]);
-      newpoint.AddField("ad", eigenvalues[2]);
-      newpoint.AddField("l2", eigenvalues[1]);
-      newpoint.AddField("l3", eigenvalues[0]);
-      newpoint.AddField("rd", (eigenvalues[0]+eigenvalues[1])/2.0);
-
-      newpoints.push_back(newpoint);
+
+      const float values[NumberOfMeasures] =
+        {
+        static_cast<float>(tensor.GetFractionalAnisotropy() ),
+        static_cast<float>(tensor.GetFractionalAnisotropy() ),
+        static_cast<float>(tensor.GetTrace() / 3),
+        static_cast<float>(sqrt(tensor[0] * tensor[0]
+                                + 2 * tensor[1] * tensor[1]
+                                + 2 * tensor[2] * tensor[2]
+                                + tensor[3] * tensor[3]
+                                + 2 * tensor[4] * tensor[4]
+                                + tensor[5] * tensor[5]) ),
+        static_cast<float>(eigenvalues[2]),
+        static_cast<float>(eigenvalues[2]),
+        static_cast<float>(eigenvalues[1]),
+        static_cast<float>(eigenvalues[0]),
+        static_cast<float>( (eigenvalues[0] + eigenvalues[1]) / 2.0)
+        };
+      for( unsigned int m = 0; m < NumberOfMeasures; ++m )
+        {
+        if( measures[m] )
+          {
+          measures[m][k] = values[m];
+          }
+        }
+      }
+
+    if( fiberOutput != "" )
+      {
+      fiberwriter.WriteFibers(newbundle);
       }
-    newtube->SetSpacing(spacing);
-    newtube->SetId(id++);
-    newtube->SetPoints(newpoints);
-    newgroup->AddSpatialObject(newtube);
     }
-//  std::cout<<"plop2"<<std::endl;
 
   if( VERBOSE )
     {
@@ -330,7 +361,7 @@ int main(int argc, char* argv[])
 
   if( fiberOutput != "" )
     {
-      writeFiberFile(fiberOutput, newgroup, saveProperties);
+    fiberwriter.Close();
     }
 
   if( voxelize != "" )
@@ -351,6 +382,5 @@ int main(int argc, char* argv[])
       }
     }
 
-  delete children;
   return EXIT_SUCCESS;
 }
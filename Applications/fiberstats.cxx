@@ -34,12 +34,13 @@ int main(int argc, char* argv[])
   PARSE_ARGS;
   // End option reading configuration
   const bool         VERBOSE = verbose;
-  GroupType::Pointer group = readFiberFile(fiberFile);
+  FiberBundle        bundle;
+  readFiberFile(fiberFile, bundle);
 
   verboseMessage("Getting spacing");
 
-  // Get Spacing and offset from group
-  const double* spacing = group->GetSpacing();
+  // Get Spacing and offset from the bundle
+  const double* spacing = bundle.GetSpacing();
 
   typedef itk::Index<3>                              IndexType;
   typedef itk::Functor::IndexLexicographicCompare<3> IndexCompare;
@@ -53,31 +54,35 @@ int main(int argc, char* argv[])
   bundlestats["md"] = MeasureSample();
   bundlestats["fro"] = MeasureSample();
 
+  // Scalar arrays of the measured statistics
+  typedef std::map<std::string, const FiberBundle::ArrayType *> ScalarArrayMap;
+  ScalarArrayMap scalars;
+  for( SampleMap::const_iterator smit = bundlestats.begin(); smit != bundlestats.end(); ++smit )
+    {
+    if( bundle.HasScalar(smit->first) )
+      {
+      scalars[smit->first] = &bundle.GetScalar(smit->first);
+      }
+    }
+
   // For each fiber
-  std::vector<double> FiberLengthsVector;
-  ChildrenListType*          children = group->GetChildren(0);
-  ChildrenListType::iterator it;
-  for( it = children->begin(); it != children->end(); it++ )
+  std::vector<double>              FiberLengthsVector;
+  const FiberBundle::ArrayType & positions = bundle.GetPositions();
+  for( unsigned long f = 0; f < bundle.GetNumberOfFibers(); ++f )
     {
-    DTIPointListType pointlist =
-      dynamic_cast<DTITubeType *>( (*it).GetPointer() )->GetPoints();
-    DTITubeType::Pointer newtube = DTITubeType::New();
     // For each point along the fiber
     double FiberLength=0;// Added by Adrien Kaiser 04-03-2013
-    typedef DTIPointType::PointType PointType;
-    PointType Previousp = pointlist.begin()->GetPosition();// Added by Adrien Kaiser 04-03-2013
-    for( DTIPointListType::iterator pit = pointlist.begin();
-         pit != pointlist.end(); ++pit )
+    for( unsigned long k = bundle.GetFiberBegin(f); k < bundle.GetFiberEnd(f); ++k )
       {
-      PointType p = pit->GetPosition();
+      const float * p = &positions[3 * k];
 
       // Added by Adrien Kaiser 04-03-2013: Compute length between 2 points
-      if(pit != pointlist.begin()) // no previous for the first one
+      if( k != bundle.GetFiberBegin(f) ) // no previous for the first one
       {
+        const float * Previousp = p - 3;
         double length = sqrt( (Previousp[0]-p[0])*(Previousp[0]-p[0]) + (Previousp[1]-p[1])*(Previousp[1]-p[1]) +(Previousp[2]-p[2])*(Previousp[2]-p[2]) );
         FiberLength = FiberLength + length;
       }
-      Previousp = p;
       //
 
       IndexType i;
@@ -87,15 +92,10 @@ int main(int argc, char* argv[])
 
       seenvoxels.insert(i);
 
-      typedef DTIPointType::FieldListType FieldList;
-      const FieldList & fl = pit->GetFields();
-      for( FieldList::const_iterator flit = fl.begin();
-           flit != fl.end(); ++flit )
+      for( ScalarArrayMap::const_iterator scit = scalars.begin();
+           scit != scalars.end(); ++scit )
         {
-        if( bundlestats.count(flit->first) )
-          {
-          bundlestats[flit->first].push_back(flit->second);
-          }
+        bundlestats[scit->first].push_back( (*scit->second)[k]);
         }
 
       } // end point loop
@@ -154,6 +154,5 @@ int main(int argc, char* argv[])
     std::cout << statname << " std: " << std::sqrt(var) << std::endl;
     }
 */
-  delete children;
   return EXIT_SUCCESS;
 }
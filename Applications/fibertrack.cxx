@@ -16,6 +16,7 @@
 =========================================================================*/
 
 #include "fiberio.h"
+#include "tensorio.h"
 #include "pomacros.h"
 #include "itkImageToDTIStreamlineTractographyFilter.h"
 
@@ -33,7 +34,6 @@
 
 #include "fibertrackCLP.h"
 
-enum IntegrationType { Euler, Midpoint, RK4 };
 int main(int argc, char* argv[])
 {
   typedef itk::DiffusionTensor3D<double> DiffusionTensor;
@@ -41,27 +41,37 @@ int main(int argc, char* argv[])
   typedef itk::Image<unsigned short, 3>  LabelImage;
   typedef itk::GroupSpatialObject<3>     FiberBundle;
 
-  typedef itk::ImageFileReader<TensorImage> TensorImageReader;
-  typedef itk::ImageFileReader<LabelImage>  LabelImageReader;
+  typedef itk::ImageFileReader<LabelImage> LabelImageReader;
 
   typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImage, LabelImage, FiberBundle> TractographyFilter;
 
   PARSE_ARGS;
 
-  if( inputTensor == "" || inputROI == "" || outputFiberFile == "" )
+  if( inputTensor == "" || inputROI == "" || (outputFiberFile == "" && !probabilistic) )
     {
     std::cerr << "Tensor image and roi image needs to be specified." << std::endl;
     return EXIT_FAILURE;
     }
-  TensorImageReader::Pointer tensorreader = TensorImageReader::New();
-  LabelImageReader::Pointer  labelreader  = LabelImageReader::New();
+  if( probabilistic && connectivityOutput == "" )
+    {
+    std::cerr << "Probabilistic tracking needs a connectivity output image." << std::endl;
+    return EXIT_FAILURE;
+    }
+  if( probabilistic && numberOfShards > 1 )
+    {
+    std::cerr << "Probabilistic tracking cannot be sharded: the connectivity images of the shards cannot be merged."
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  TensorImage::Pointer      tensorimage;
+  LabelImageReader::Pointer labelreader = LabelImageReader::New();
 
-  tensorreader->SetFileName(inputTensor);
   labelreader->SetFileName(inputROI);
 
   try
     {
-    tensorreader->Update();
+    // Tensor or Log-Euclidean tensor file
+    tensorimage = readTensors(inputTensor);
     labelreader->Update();
     }
   catch( itk::ExceptionObject & e )
@@ -72,19 +82,19 @@ int main(int argc, char* argv[])
 
   if( verbose )
     {
-    tensorreader->GetOutput()->Print(std::cout);
+    tensorimage->Print(std::cout);
     }
 
   // Sanity check the ROI and tensor image as they must be consistent
   // for the filter to work correctly
-  requireequal( (tensorreader->GetOutput()->GetSpacing() == labelreader->GetOutput()->GetSpacing() ),
+  requireequal( (tensorimage->GetSpacing() == labelreader->GetOutput()->GetSpacing() ),
                 "Image Spacings", force);
-  requireequal( (tensorreader->GetOutput()->GetLargestPossibleRegion() ==
+  requireequal( (tensorimage->GetLargestPossibleRegion() ==
                  labelreader->GetOutput()->GetLargestPossibleRegion() ),
                 "Image Sizes", force);
-  requireequal( (tensorreader->GetOutput()->GetOrigin() == labelreader->GetOutput()->GetOrigin() ),
+  requireequal( (tensorimage->GetOrigin() == labelreader->GetOutput()->GetOrigin() ),
                 "Image Origins", force);
-  requireequal( (tensorreader->GetOutput()->GetDirection() == labelreader->GetOutput()->GetDirection() ),
+  requireequal( (tensorimage->GetDirection() == labelreader->GetOutput()->GetDirection() ),
                 "Image Orientations", force);
 
   TractographyFilter::Pointer fibertracker = TractographyFilter::New();
@@ -96,7 +106,19 @@ int main(int argc, char* argv[])
     {
     fibertracker->WholeBrainOn();
     }
-  fibertracker->SetTensorImage(tensorreader->GetOutput() );
+  if( stopAtTarget )
+    {
+    fibertracker->StopAtTargetOn();
+    }
+  if( brickedLayout )
+    {
+    fibertracker->BrickedLayoutOn();
+    }
+  if( precomputeDirections )
+    {
+    fibertracker->PrecomputeDirectionsOn();
+    }
+  fibertracker->SetTensorImage(tensorimage );
   fibertracker->SetROIImage(labelreader->GetOutput() );
   fibertracker->SetSourceLabel(sourceLabel);
   fibertracker->SetTargetLabel(targetLabel);
@@ -104,11 +126,55 @@ int main(int argc, char* argv[])
   fibertracker->SetMaximumAngleChange(maxAngle);
   fibertracker->SetMinimumFractionalAnisotropy(minFa);
   fibertracker->SetStepSize(stepSize);
-  fibertracker->Update();
+  if( integrator == "euler" )
+    {
+    fibertracker->SetIntegrator(TractographyFilter::Euler);
+    }
+  else if( integrator == "midpoint" )
+    {
+    fibertracker->SetIntegrator(TractographyFilter::Midpoint);
+    }
+  else if( integrator == "rk45" )
+    {
+    fibertracker->SetIntegrator(TractographyFilter::RK45);
+    }
+  else
+    {
+    fibertracker->SetIntegrator(TractographyFilter::RK4);
+    }
+  fibertracker->SetErrorTolerance(errorTolerance);
+  fibertracker->SetMinimumStepSize(minStepSize);
+  fibertracker->SetMaximumStepSize(maxStepSize);
+  fibertracker->SetNumberOfShards(numberOfShards);
+  fibertracker->SetShard(shard);
+  if( probabilistic )
+    {
+    fibertracker->ProbabilisticOn();
+    fibertracker->SetNumberOfSamples(numberOfSamples);
+    fibertracker->SetDirectionDispersion(directionDispersion);
+    fibertracker->SetRandomSeed(randomSeed);
+    }
+  else
+    {
+    // The fibers are written as they are tracked
+    FiberFileSink::Pointer fibersink = FiberFileSink::New();
+    fibersink->SetFileName(outputFiberFile);
+    fibertracker->SetFiberSink(fibersink);
+    fibertracker->SetFiberBufferSize(fiberBufferSize);
+    }
 
   try
     {
-    writeFiberFile(outputFiberFile, fibertracker->GetOutput() );
+    fibertracker->Update();
+    if( probabilistic )
+      {
+      typedef itk::ImageFileWriter<TractographyFilter::ConnectivityImageType> ConnectivityWriter;
+      ConnectivityWriter::Pointer connectivitywriter = ConnectivityWriter::New();
+      connectivitywriter->SetInput(fibertracker->GetConnectivityImage() );
+      connectivitywriter->SetFileName(connectivityOutput);
+      connectivitywriter->SetUseCompression(true);
+      connectivitywriter->Update();
+      }
     }
   catch( itk::ExceptionObject e )
     {
@@ -0,0 +1,104 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkBrickedTensorVolume.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkBrickedTensorVolume_h
+#define __itkBrickedTensorVolume_h
+
+#include "itkIntTypes.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class BrickedTensorVolume
+ * \brief Copy of a 3D image stored by bricks of 8x8x8 voxels.
+ *
+ * In the scanline layout of Image, the 8 corners of a trilinear
+ * interpolation are in 4 rows of the buffer, the ones along z a whole
+ * slice apart, so a step through the volume in any direction but x
+ * touches new cache lines and often a new page for each corner.  Here
+ * each brick of 8x8x8 voxels is contiguous (8x8x8 tensors of doubles
+ * are 24 kB, within the L1 or L2 cache), bricks follow each other in x,
+ * y then z order and the voxels of a brick are in scanline order, so
+ * most interpolations read from a single brick.
+ *
+ * The indices are relative to the start of the copied region, and the
+ * region is padded to whole bricks.
+ */
+template <class TPixel>
+class BrickedTensorVolume
+{
+public:
+  typedef TPixel PixelType;
+
+  /** log2 of the brick size */
+  itkStaticConstMacro(BrickBits, unsigned int, 3);
+  itkStaticConstMacro(BrickSize, unsigned int, 1 << BrickBits);
+
+  BrickedTensorVolume()
+  {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      m_NumberOfBricks[i] = 0;
+      }
+  }
+
+  /** Copies the buffered region of image */
+  template <class TImage>
+  void CopyImage(const TImage * image)
+  {
+    const typename TImage::RegionType & region = image->GetBufferedRegion();
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      m_NumberOfBricks[i] = (region.GetSize(i) + BrickSize - 1) >> BrickBits;
+      }
+    std::vector<PixelType>( static_cast<SizeValueType>( m_NumberOfBricks[0] ) * m_NumberOfBricks[1]
+                            * m_NumberOfBricks[2] << (3 * BrickBits) ).swap(m_Buffer);
+
+    ImageRegionConstIteratorWithIndex<TImage> it(image, region);
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      const typename TImage::IndexType index = it.GetIndex();
+      m_Buffer[this->ComputeOffset(index[0] - region.GetIndex(0), index[1] - region.GetIndex(1),
+                                   index[2] - region.GetIndex(2) )] = it.Get();
+      }
+  }
+
+  /** Buffer offset of the voxel (x, y, z), relative to the start of the
+   * copied region */
+  OffsetValueType ComputeOffset(IndexValueType x, IndexValueType y, IndexValueType z) const
+  {
+    const IndexValueType mask = BrickSize - 1;
+    const OffsetValueType brick = ( (z >> BrickBits) * m_NumberOfBricks[1] + (y >> BrickBits) )
+      * m_NumberOfBricks[0] + (x >> BrickBits);
+
+    return (brick << (3 * BrickBits) )
+           + ( ( ( (z & mask) << BrickBits) + (y & mask) ) << BrickBits) + (x & mask);
+  }
+
+  const PixelType * GetBufferPointer() const
+  {
+    return m_Buffer.empty() ? ITK_NULLPTR : &m_Buffer[0];
+  }
+
+private:
+  OffsetValueType        m_NumberOfBricks[3];
+  std::vector<PixelType> m_Buffer;
+};
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,245 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkComposeFunctor.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkComposeFunctor_h
+#define __itkComposeFunctor_h
+
+#include "itkNumericTraits.h"
+
+namespace itk
+{
+
+/** Functors to chain pixel-wise operations at compile time.
+ *
+ * A chain such as tensor correction, masking, a scalar measure and a
+ * rescaling is usually run as one functor image filter per step, each
+ * one allocating its own output image. Composing the functors gives a
+ * single functor for UnaryFunctorImageFilter or
+ * BinaryFunctorImageFilter, so the whole chain runs as one
+ * multithreaded pass with one output buffer and the intermediate
+ * values stay on the stack.
+ *
+ * The parts of a composed functor are reached with GetFirst() and
+ * GetSecond() to set their parameters before calling SetFunctor().
+ */
+namespace Functor
+{
+
+/** \class Compose
+ * \brief Unary functor computing Second(First(x)).
+ */
+template <class TFirst, class TSecond, class TInput, class TOutput>
+class Compose
+{
+public:
+  Compose()
+  {
+  }
+
+  ~Compose()
+  {
+  }
+
+  TFirst & GetFirst()
+  {
+    return m_First;
+  }
+
+  TSecond & GetSecond()
+  {
+    return m_Second;
+  }
+
+  bool operator!=( const Compose & other ) const
+  {
+    return m_First != other.m_First || m_Second != other.m_Second;
+  }
+
+  bool operator==( const Compose & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline TOutput operator()( const TInput & x )
+  {
+    return static_cast<TOutput>( m_Second( m_First( x ) ) );
+  }
+
+private:
+  TFirst  m_First;
+  TSecond m_Second;
+};
+
+/** \class ComposeBinary
+ * \brief Binary functor computing Second(First(a), b).
+ *
+ * Typically First is a per-pixel operation of the image and Second
+ * a mask functor whose second argument is the mask pixel.
+ */
+template <class TFirst, class TSecond, class TInput1, class TInput2, class TOutput>
+class ComposeBinary
+{
+public:
+  ComposeBinary()
+  {
+  }
+
+  ~ComposeBinary()
+  {
+  }
+
+  TFirst & GetFirst()
+  {
+    return m_First;
+  }
+
+  TSecond & GetSecond()
+  {
+    return m_Second;
+  }
+
+  bool operator!=( const ComposeBinary & other ) const
+  {
+    return m_First != other.m_First || m_Second != other.m_Second;
+  }
+
+  bool operator==( const ComposeBinary & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline TOutput operator()( const TInput1 & a, const TInput2 & b )
+  {
+    return static_cast<TOutput>( m_Second( m_First( a ), b ) );
+  }
+
+private:
+  TFirst  m_First;
+  TSecond m_Second;
+};
+
+/** \class BinaryCompose
+ * \brief Binary functor computing Second(First(a, b)).
+ *
+ * Applies a unary functor to the result of a binary one, e.g. a
+ * scalar measure to a masked tensor.
+ */
+template <class TFirst, class TSecond, class TInput1, class TInput2, class TOutput>
+class BinaryCompose
+{
+public:
+  BinaryCompose()
+  {
+  }
+
+  ~BinaryCompose()
+  {
+  }
+
+  TFirst & GetFirst()
+  {
+    return m_First;
+  }
+
+  TSecond & GetSecond()
+  {
+    return m_Second;
+  }
+
+  bool operator!=( const BinaryCompose & other ) const
+  {
+    return m_First != other.m_First || m_Second != other.m_Second;
+  }
+
+  bool operator==( const BinaryCompose & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline TOutput operator()( const TInput1 & a, const TInput2 & b )
+  {
+    return static_cast<TOutput>( m_Second( m_First( a, b ) ) );
+  }
+
+private:
+  TFirst  m_First;
+  TSecond m_Second;
+};
+
+/** \class ShiftScale
+ * \brief Computes (x + Shift) * Scale, clamped to the range of the
+ * output type.
+ *
+ * Same arithmetic as ShiftScaleImageFilter, so it can replace that
+ * filter at the end of a composed chain.
+ */
+template <class TInput, class TOutput>
+class ShiftScale
+{
+public:
+  typedef typename NumericTraits<TInput>::RealType RealType;
+
+  ShiftScale() : m_Shift(0.0), m_Scale(1.0)
+  {
+  }
+
+  ~ShiftScale()
+  {
+  }
+
+  void SetShift(RealType shift)
+  {
+    m_Shift = shift;
+  }
+
+  void SetScale(RealType scale)
+  {
+    m_Scale = scale;
+  }
+
+  bool operator!=( const ShiftScale & other ) const
+  {
+    return m_Shift != other.m_Shift || m_Scale != other.m_Scale;
+  }
+
+  bool operator==( const ShiftScale & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline TOutput operator()( const TInput & x ) const
+  {
+    const RealType value = ( static_cast<RealType>( x ) + m_Shift ) * m_Scale;
+
+    if( value < NumericTraits<TOutput>::NonpositiveMin() )
+      {
+      return NumericTraits<TOutput>::NonpositiveMin();
+      }
+    else if( value > NumericTraits<TOutput>::max() )
+      {
+      return NumericTraits<TOutput>::max();
+      }
+    return static_cast<TOutput>( value );
+  }
+
+private:
+  RealType m_Shift;
+  RealType m_Scale;
+};
+
+} // end namespace Functor
+
+} // end namespace itk
+
+#endif
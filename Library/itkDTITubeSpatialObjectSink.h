@@ -0,0 +1,78 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkDTITubeSpatialObjectSink.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkDTITubeSpatialObjectSink_h
+#define __itkDTITubeSpatialObjectSink_h
+
+#include <itkObject.h>
+#include <itkDTITubeSpatialObject.h>
+
+namespace itk
+{
+
+/** \class DTITubeSpatialObjectSink
+ * \brief Receives fibers one at a time as they are produced.
+ *
+ * A tractography filter given a sink passes each finished fiber to
+ * AddFiber() instead of adding it to its output group, so the fibers
+ * can be written out while tracking goes on and the memory used does
+ * not grow with the number of fibers. Begin() is called before the
+ * first fiber and End() after the last one.
+ *
+ * The sink must not keep the tube: it is released once AddFiber()
+ * returns.
+ */
+template <unsigned int TDimension = 3>
+class ITK_EXPORT DTITubeSpatialObjectSink : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef DTITubeSpatialObjectSink Self;
+  typedef Object                   Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  typedef DTITubeSpatialObject<TDimension> TubeType;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(DTITubeSpatialObjectSink, Object);
+
+  virtual void Begin()
+  {
+  }
+
+  virtual void AddFiber(TubeType * tube) = 0;
+
+  virtual void End()
+  {
+  }
+
+protected:
+  DTITubeSpatialObjectSink()
+  {
+  }
+
+  virtual ~DTITubeSpatialObjectSink()
+  {
+  }
+
+private:
+  DTITubeSpatialObjectSink(const Self &); // purposely not implemented
+  void operator=(const Self &);           // purposely not implemented
+
+};
+
+} // end namespace itk
+
+#endif
@@ -56,9 +56,9 @@ public:
   {
   }
 
-  bool operator!=( const DiffusionTensor3DAbs & other ) const
+  bool operator!=( const DiffusionTensor3DAbs & ) const
   {
-    return *this != other;
+    return false;
   }
 
   bool operator==( const DiffusionTensor3DAbs & other ) const
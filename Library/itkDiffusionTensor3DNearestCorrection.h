@@ -52,9 +52,9 @@ public:
   {
   }
 
-  bool operator!=( const DiffusionTensor3DNearest & other ) const
+  bool operator!=( const DiffusionTensor3DNearest & ) const
   {
-    return *this != other;
+    return false;
   }
 
   bool operator==( const DiffusionTensor3DNearest & other ) const
@@ -56,9 +56,9 @@ public:
   {
   }
 
-  bool operator!=( const DiffusionTensor3DZero & other ) const
+  bool operator!=( const DiffusionTensor3DZero & ) const
   {
-    return *this != other;
+    return false;
   }
 
   bool operator==( const DiffusionTensor3DZero & other ) const
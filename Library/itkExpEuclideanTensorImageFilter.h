@@ -18,14 +18,15 @@
 #define __itkExpEuclideanTensorImageFilter_h
 
 #include <itkUnaryFunctorImageFilter.h>
-#include <vnl/vnl_double_3x3.h>
 #include <itkDiffusionTensor3D.h>
+#include <vnl/vnl_math.h>
+#include "itkSymmetricMatrixFunction3x3.h"
 
 namespace itk
 {
 
-// This functor class invokes the computation of fractional anisotropy from
-// every pixel.
+// This functor class computes the matrix exponential of the
+// Log-Euclidean vector of every pixel.
 namespace Functor
 {
 
@@ -36,8 +37,6 @@ public:
   typedef typename TInput::RealValueType                 RealValueType;
   typedef typename itk::DiffusionTensor3D<RealValueType> OutputType;
   typedef OutputType                                     TensorType;
-  typedef typename OutputType::EigenVectorsMatrixType    EigenVectorType;
-  typedef typename OutputType::EigenValuesArrayType      EigenValueType;
 
   ExpEuclideanTensorFunction()
   {
@@ -47,54 +46,57 @@ public:
   {
   }
 
-  OutputType operator()( const TInput & x )
+  bool operator!=( const ExpEuclideanTensorFunction & ) const
   {
-    DiffusionTensor3D<double> tensor;
-    for( int i = 0; i < 6; ++i )
-      {
-      tensor[i] = x[i];
-      }
-    tensor[1] /= sqrt(2.0);
-    tensor[2] /= sqrt(2.0);
-    tensor[4] /= sqrt(2.0);
-
-    EigenValueType  D;
-    EigenVectorType U;
+    return false;
+  }
 
-    tensor.ComputeEigenAnalysis(D, U);
+  bool operator==( const ExpEuclideanTensorFunction & other ) const
+  {
+    return !(*this != other);
+  }
 
-    vnl_matrix_fixed<double, 3, 3> m;
-    m.fill(0);
-    m(0, 0) = exp(D[0]);
-    m(1, 1) = exp(D[1]);
-    m(2, 2) = exp(D[2]);
+  inline OutputType operator()( const TInput & x ) const
+  {
+    const RealValueType sqrt1_2 = vnl_math::sqrt1_2;
+    RealValueType       matlog[6];
 
-//    std::cout << U << std::endl;
-//    std::cout << D << std::endl;
+    matlog[0] = x[0];
+    matlog[1] = x[1] * sqrt1_2;
+    matlog[2] = x[2] * sqrt1_2;
+    matlog[3] = x[3];
+    matlog[4] = x[4] * sqrt1_2;
+    matlog[5] = x[5];
 
-    vnl_matrix_fixed<double, 3, 3> res(U.GetVnlMatrix().transpose() * m * U.GetVnlMatrix() );
+    RealValueType tensor[6];
+    ApplySymmetricMatrixFunction3x3(matlog, tensor, &ExpEuclideanTensorFunction::Exp);
 
     OutputType op;
-    op[0] = res(0, 0);
-    op[1] = res(0, 1);
-    op[2] = res(0, 2);
-    op[3] = res(1, 1);
-    op[4] = res(1, 2);
-    op[5] = res(2, 2);
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      op[i] = tensor[i];
+      }
 
     return op;
   }
 
+private:
+  static RealValueType Exp(RealValueType lambda)
+  {
+    return std::exp(lambda);
+  }
+
 };
 
 }  // end namespace functor
 
 /** \class ExpEuclideanTensorImageFilter
- * \brief Computes the 6-element vector field that are the unique
- * elements of the matrix-logarithm of the tensor field.
+ * \brief Computes the tensor field from the 6-element vector field
+ * of the unique elements of its matrix-logarithm.
  *
  * ExpEuclideanImageFilter applies pixel-wise the invokation for
- * computing the matrix logarithm of every pixel.
+ * computing the matrix exponential of every pixel. It is the inverse
+ * of LogEuclideanTensorImageFilter.
  *
  * \sa DiffusionTensor3D
  *
@@ -109,13 +111,13 @@ class ITK_EXPORT ExpEuclideanTensorImageFilter :
                           Functor::ExpEuclideanTensorFunction<Vector<T, 6> > >
 {
 public:
-//  typedef Image<Vector<typename TInputImage::PixelType::RealValueType,6>,3 > TOutputImage;
   typedef Image<Vector<T, 6>, 3>         InputImageType;
   typedef Image<DiffusionTensor3D<T>, 3> OutputImageType;
 
   /** Standard class typedefs. */
-  typedef ExpEuclideanTensorImageFilter                       Self;
-  typedef ImageToImageFilter<InputImageType, OutputImageType> Superclass;
+  typedef ExpEuclideanTensorImageFilter Self;
+  typedef UnaryFunctorImageFilter<InputImageType, OutputImageType,
+                                  Functor::ExpEuclideanTensorFunction<Vector<T, 6> > > Superclass;
 
   typedef SmartPointer<Self>       Pointer;
   typedef SmartPointer<const Self> ConstPointer;
@@ -123,6 +125,9 @@ public:
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
 
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ExpEuclideanTensorImageFilter, UnaryFunctorImageFilter);
+
   /** Print internal ivars */
   void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE
   {
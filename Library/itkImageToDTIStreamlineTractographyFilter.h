@@ -3,6 +3,7 @@
 
 // Base class
 #include "itkImageToDTITubeSpatialObjectFilter.h"
+#include "itkDTITubeSpatialObjectSink.h"
 
 #include <itkGroupSpatialObject.h>
 #include <itkDTITubeSpatialObject.h>
@@ -10,7 +11,13 @@
 #include <itkVectorLinearInterpolateImageFunction.h>
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkTensorLinearInterpolateImageFunction.h>
+#include <itkTensorBrickedLinearInterpolateImageFunction.h>
 #include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkMultiThreader.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkMersenneTwisterRandomVariateGenerator.h>
+
+#include <vector>
 
 namespace itk
 {
@@ -41,25 +48,68 @@ public:
   // Point and index types
   typedef typename TensorImageType::IndexType IndexType;
   typedef typename TensorImageType::PointType PointType;
+  typedef ContinuousIndex<double, 3>          ContinuousIndexType;
 
-  typedef TensorLinearInterpolateImageFunction<TensorImageType, double> TensorInterpolateType;
-  typedef typename TensorInterpolateType::Pointer                       TensorInterpolatePointer;
+  typedef TensorInterpolateImageFunction<TensorImageType, double>             TensorInterpolateBaseType;
+  typedef typename TensorInterpolateBaseType::Pointer                         TensorInterpolatePointer;
+  typedef TensorLinearInterpolateImageFunction<TensorImageType, double>       TensorInterpolateType;
+  typedef TensorBrickedLinearInterpolateImageFunction<TensorImageType, double> TensorBrickedInterpolateType;
   typedef NearestNeighborInterpolateImageFunction<ROIImageType, double> ROIInterpolateType;
   typedef typename ROIInterpolateType::Pointer                          ROIInterpolatePointer;
 
+  // Principal eigenvector (components 0 to 2) and fractional anisotropy
+  // (component 3) of every voxel
+  typedef Image<Vector<float, 4>, 3>           DirectionImageType;
+  typedef typename DirectionImageType::Pointer DirectionImagePointer;
+
   // Spatial object Types
   typedef DTITubeSpatialObject<3>                   DTITubeSpatialObjectType;
   typedef typename DTITubeSpatialObject<3>::Pointer DTITubeSpatialObjectTypePointer;
 
   typedef DTITubeSpatialObjectPoint<3> DTITubeSpatialObjectPointType;
+  typedef typename DTITubeSpatialObjectType::PointListType TubePointListType;
+
+  typedef DTITubeSpatialObjectSink<3> FiberSinkType;
+
+  // Fraction of the probabilistic streamlines through each voxel
+  typedef Image<float, 3>                         ConnectivityImageType;
+  typedef typename ConnectivityImageType::Pointer ConnectivityImagePointer;
+
+  typedef Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
+
+  /** Integration scheme of the streamlines.  Euler, Midpoint and RK4
+   * take fixed steps of StepSize.  RK45 is the embedded Cash-Karp
+   * Runge-Kutta pair: the difference of its 4th and 5th order solutions
+   * estimates the local error, which grows with the curvature of the
+   * tract, and the step is adapted to keep it below ErrorTolerance and
+   * the turn within a step below half of MaximumAngleChange.  Straight
+   * tracts are then followed with large steps and bends with small
+   * ones. */
+  typedef enum { Euler, Midpoint, RK4, RK45 } IntegratorType;
 
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
   itkTypeMacro(ImageToDTIStreamlineTractographyFilter, ImageToDTITubeSpatialObjectFilter);
 
+  /** Default is RK4. */
+  itkGetMacro( Integrator, IntegratorType );
+  itkSetMacro( Integrator, IntegratorType );
+
+  /** Step size in mm, the initial step size of RK45. */
   itkGetMacro( StepSize, double );
   itkSetMacro( StepSize, double );
 
+  /** Largest local error of an RK45 step in mm.  Default is 0.01. */
+  itkGetMacro( ErrorTolerance, double );
+  itkSetMacro( ErrorTolerance, double );
+
+  /** Bounds of the RK45 step size in mm.  Defaults are 0.1 and 2. */
+  itkGetMacro( MinimumStepSize, double );
+  itkSetMacro( MinimumStepSize, double );
+
+  itkGetMacro( MaximumStepSize, double );
+  itkSetMacro( MaximumStepSize, double );
+
   itkGetMacro( MinimumFractionalAnisotropy, double );
   itkSetMacro( MinimumFractionalAnisotropy, double );
 
@@ -79,6 +129,92 @@ public:
   itkSetMacro( WholeBrain, bool );
   itkBooleanMacro( WholeBrain );
 
+  /** End each half of a fiber at its first point in the target region
+   * instead of tracking it through.  Off by default. */
+  itkGetMacro( StopAtTarget, bool );
+  itkSetMacro( StopAtTarget, bool );
+  itkBooleanMacro( StopAtTarget );
+
+  /** Interpolate the tensors from a copy of the tensor image stored by
+   * bricks of 8x8x8 voxels (see BrickedTensorVolume), which keeps the
+   * corners of most interpolations in one brick.  The fibers are the
+   * same, the tensors take twice the memory.  Off by default. */
+  itkGetMacro( BrickedLayout, bool );
+  itkSetMacro( BrickedLayout, bool );
+  itkBooleanMacro( BrickedLayout );
+
+  /** Compute the principal eigenvector and the FA of every voxel once,
+   * in a multithreaded pass before tracking.  The directions of the
+   * integration stages are then interpolated from this field, with the
+   * signs aligned to the tracking direction, instead of interpolating
+   * and decomposing a tensor at each stage, and the FA threshold uses
+   * the interpolated FA.  The fibers differ slightly from the ones
+   * tracked in the tensor field.  Off by default. */
+  itkGetMacro( PrecomputeDirections, bool );
+  itkSetMacro( PrecomputeDirections, bool );
+  itkBooleanMacro( PrecomputeDirections );
+
+  /** If a sink is set, the fibers are passed to it in seed order as
+   * they are tracked and the output group stays empty.  The tubes
+   * passed have no parent: their offset is the origin of the tensor
+   * image. */
+  itkSetObjectMacro( FiberSink, FiberSinkType );
+  itkGetObjectMacro( FiberSink, FiberSinkType );
+
+  /** Number of seeds tracked before the fibers are merged and passed
+   * on, which bounds the number of fibers held in memory.  Default is
+   * 10000. */
+  itkGetMacro( FiberBufferSize, SizeValueType );
+  itkSetClampMacro( FiberBufferSize, SizeValueType, 1, NumericTraits<SizeValueType>::max() );
+
+  /** Track only one shard of the seeds, to split a run between
+   * processes.  The seeds, in image order, are cut in NumberOfShards
+   * contiguous ranges of nearly equal size and only the range Shard
+   * (from 0) is tracked, so the fiber files of the shards concatenated
+   * in shard order hold the fibers of an unsharded run, in the same
+   * order.  Only deterministic tracking can be sharded.  Defaults are
+   * 1 and 0. */
+  itkGetMacro( NumberOfShards, unsigned int );
+  itkSetClampMacro( NumberOfShards, unsigned int, 1, NumericTraits<unsigned int>::max() );
+
+  itkGetMacro( Shard, unsigned int );
+  itkSetMacro( Shard, unsigned int );
+
+  /** Probabilistic tracking.  NumberOfSamples streamlines are started
+   * from each seed and followed with Euler steps of StepSize.  At each
+   * step the direction is drawn around the principal eigenvector of
+   * the interpolated tensor, with gaussian deviations along the second
+   * and third eigenvectors whose standard deviations are
+   * DirectionDispersion * sqrt(l2 / l1) and
+   * DirectionDispersion * sqrt(l3 / l1): a small angle Bingham cone,
+   * wide where the tensor is planar or isotropic.  The streamlines are
+   * accepted with the same source and target rules as the
+   * deterministic ones but are not kept; the output is the
+   * connectivity image, the fraction of all the samples which passed
+   * through each voxel.  Off by default. */
+  itkGetMacro( Probabilistic, bool );
+  itkSetMacro( Probabilistic, bool );
+  itkBooleanMacro( Probabilistic );
+
+  /** Streamlines per seed.  Default is 100. */
+  itkGetMacro( NumberOfSamples, unsigned int );
+  itkSetClampMacro( NumberOfSamples, unsigned int, 1, NumericTraits<unsigned int>::max() );
+
+  /** Default is 0.5. */
+  itkGetMacro( DirectionDispersion, double );
+  itkSetMacro( DirectionDispersion, double );
+
+  /** Every seed voxel draws its samples from its own random stream,
+   * derived from this value and the index of the seed, so the
+   * connectivity image does not depend on the number of threads. */
+  itkGetMacro( RandomSeed, unsigned int );
+  itkSetMacro( RandomSeed, unsigned int );
+
+  virtual ConnectivityImageType * GetConnectivityImage()
+  {
+    return m_ConnectivityImage.GetPointer();
+  }
+
   virtual void SetTensorImage(const TTensorImage* timage);
 
   virtual void SetROIImage(const TROIImage* roiimage);
@@ -105,26 +241,139 @@ protected:
   {
   };                                           // do nothing
 
-  virtual DTITubeSpatialObjectTypePointer TrackFromPoint(PointType pt, EigenVectorType vec) const;
+  // Tracks from a seed voxel in both directions.  Returns false if no
+  // fiber is kept for this seed.  Called concurrently by the threads, so
+  // it must not modify the filter.
+  virtual bool TrackFromSeed(const IndexType & seed, TubePointListType & points) const;
+
+  // Tracks half a fiber.  The source and target labels met on the way
+  // are recorded in sawsource and sawtarget.
+  virtual void TrackFromPoint(PointType pt, EigenVectorType vec, TubePointListType & pointlist,
+                              bool & sawtarget, bool & sawsource) const;
+
+  // One step from pt to nextpt.  Returns false if a stage of the step
+  // leaves the tensor buffer, which ends the fiber.
+  virtual bool IntegrateOneStep(const PointType& pt, const EigenVectorType& vec, double stepsize,
+                                PointType & nextpt) const;
+
+  // One accepted RK45 step from pt.  stepsize is the size to try first
+  // and is updated with the size proposed for the next step.
+  virtual bool IntegrateAdaptiveStep(const PointType& pt, const EigenVectorType& vec, double & stepsize,
+                                     PointType & nextpt) const;
+
+  // Computes pt + stepsize * direction.  If check is set, returns false
+  // when the result is outside the tensor buffer.
+  bool StepPoint(const PointType& pt, const EigenVectorType& direction, double stepsize, bool check,
+                 PointType & result) const;
+
+  // Returns false if every point within reach mm of pt is inside the
+  // tensor buffer, so that the stages of a step need no bounds check.
+  bool NeedsBoundsCheck(const PointType& pt, double reach) const;
+
+  // Same test as IsInsideBuffer of the interpolators, on precomputed
+  // bounds
+  bool IsInsideTensorBuffer(const ContinuousIndexType & cind) const
+  {
+    return cind[0] >= m_BufferStart[0] && cind[0] < m_BufferEnd[0]
+           && cind[1] >= m_BufferStart[1] && cind[1] < m_BufferEnd[1]
+           && cind[2] >= m_BufferStart[2] && cind[2] < m_BufferEnd[2];
+  }
 
-  virtual PointType IntegrateOneStep(const PointType& pt, const EigenVectorType& vec, double stepsize) const;
+  // Whether a fiber may continue through pt, at continuous index cind
+  // of the tensor image and with anisotropy fa.  The cheap tests come
+  // first, so most fibers end on a comparison.  If the fiber may
+  // continue, label is the ROI label at pt.
+  bool IsTrackable(const PointType & pt, const ContinuousIndexType & cind, double fa, ROIPixelType & label) const
+  {
+    if( fa < m_MinimumFractionalAnisotropy || !this->IsInsideTensorBuffer(cind) )
+      {
+      return false;
+      }
+    label = static_cast<ROIPixelType>( m_ROIInterpolator->Evaluate(pt) );
+    return !(m_ForbiddenLabel && label == m_ForbiddenLabel);
+  }
 
   // Preprocess tensor field to extract necessary information
   virtual void PreprocessTensorImage();
 
   virtual EigenVectorType EvaluatePrincipalDiffusionDirectionAt(const PointType& pt, const EigenVectorType& vec) const;
 
+  // Samples of probabilistic tracking from the seed m_Seeds[seed].
+  // Appends the tensor buffer offsets of the voxels visited by each
+  // accepted streamline to visits, once per streamline.
+  virtual void TrackProbabilisticFromSeed(SizeValueType seed, RandomGeneratorType * rng,
+                                          std::vector<OffsetValueType> & visits) const;
+
+  // One half of a probabilistic streamline.  The visited voxels are
+  // appended to streamline and the labels seen are recorded.
+  virtual void TrackProbabilisticFromPoint(PointType pt, EigenVectorType vec, RandomGeneratorType * rng,
+                                           std::vector<OffsetValueType> & streamline,
+                                           bool & sawtarget, bool & sawsource) const;
+
+  // Draws a unit direction around the principal eigenvector of tensor,
+  // on the side of vec.  Returns false if the largest eigenvalue is not
+  // positive.
+  virtual bool SampleDirection(const TensorType & tensor, const EigenVectorType & vec, RandomGeneratorType * rng,
+                               EigenVectorType & direction) const;
+
+  // Trilinear interpolation of the precomputed direction field.  The
+  // neighbour directions are flipped to agree with vec before they are
+  // averaged.
+  virtual void InterpolateDirectionField(const PointType& pt, const EigenVectorType& vec,
+                                         EigenVectorType & direction, double & fa) const;
+
   ImageToDTIStreamlineTractographyFilter();
   virtual ~ImageToDTIStreamlineTractographyFilter()
   {
   };
 private:
+  // Tracks the seeds from m_NextSeed to m_SeedEnd in parallel and
+  // passes the fibers, in seed order, to the sink or the output group
+  void TrackSeedBlock();
+
+  // Runs the probabilistic tracking of all the seeds and fills the
+  // connectivity image
+  void TrackProbabilistic();
+
+  // Fiber tracked by a thread with the index of its seed, used to merge
+  // the fibers of all the threads in seed order
+  struct SeededFiber
+    {
+    SizeValueType     seed;
+    TubePointListType points;
+    };
+
+  typedef std::vector<SeededFiber> SeededFiberListType;
+
+  struct TrackerThreadStruct
+    {
+    Self *Filter;
+    };
+
+  static ITK_THREAD_RETURN_TYPE TrackerThreaderCallback(void *arg);
+
+  void ThreadedTrack(ThreadIdType threadId);
+
+  void ThreadedTrackProbabilistic(ThreadIdType threadId);
+
+  // Adds the visits of a thread to the counts and clears them
+  void AddVisits(std::vector<OffsetValueType> & visits);
+
+  // Hands out the next chunk of seeds, returns false when all the seeds
+  // have been taken
+  bool GetNextSeedChunk(SizeValueType & begin, SizeValueType & end);
+
   ImageToDTIStreamlineTractographyFilter(const Self &); // purposely
   // not
   // implemented
   void operator=(const Self &); // purposely not implemented
 
+  IntegratorType m_Integrator;
+
   double m_StepSize;
+  double m_ErrorTolerance;
+  double m_MinimumStepSize;
+  double m_MaximumStepSize;
   double m_MinimumFractionalAnisotropy;
   double m_MaximumAngleChange;
 
@@ -132,11 +381,41 @@ private:
   ROIPixelType m_TargetLabel;
   ROIPixelType m_ForbiddenLabel;
   bool         m_WholeBrain;
+  bool         m_BrickedLayout;
+  bool         m_PrecomputeDirections;
+  unsigned int m_NumberOfShards;
+  unsigned int m_Shard;
+  bool         m_Probabilistic;
+  unsigned int m_NumberOfSamples;
+  double       m_DirectionDispersion;
+  unsigned int m_RandomSeed;
+  bool         m_StopAtTarget;
 
   TensorInterpolatePointer m_TensorInterpolator;
   ROIInterpolatePointer    m_ROIInterpolator;
+  DirectionImagePointer    m_DirectionImage;
+
+  // Continuous index bounds of the tensor buffer and smallest spacing,
+  // set by PreprocessTensorImage
+  double m_BufferStart[3];
+  double m_BufferEnd[3];
+  double m_MinimumSpacing;
 
   OutputGroupSpatialObjectPointer m_TubeGroup;
+  typename FiberSinkType::Pointer m_FiberSink;
+  SizeValueType                   m_FiberBufferSize;
+
+  std::vector<IndexType>           m_Seeds;
+  SizeValueType                    m_ShardBegin;
+  SizeValueType                    m_ShardEnd;
+  SizeValueType                    m_NextSeed;
+  SizeValueType                    m_SeedEnd;
+  SimpleFastMutexLock              m_SeedLock;
+  std::vector<SeededFiberListType> m_ThreadFibers;
+
+  ConnectivityImagePointer  m_ConnectivityImage;
+  std::vector<unsigned int> m_VisitCounts;
+  SimpleFastMutexLock       m_VisitLock;
 
 }; // end class
 
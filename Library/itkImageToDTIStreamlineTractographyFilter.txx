@@ -1,8 +1,14 @@
 
 #include <itkImageRegionConstIteratorWithIndex.h>
 
+#include <algorithm>
+#include <cmath>
+
 #include "itkImageToDTIStreamlineTractographyFilter.h"
 #include "itkTensorPrincipalEigenvectorImageFilter.h"
+#include "itkSymmetricMatrixFunction3x3.h"
+
+#include <itkMath.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265359
@@ -14,8 +20,12 @@ namespace itk
 template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
 ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
 ::ImageToDTIStreamlineTractographyFilter()
-  : m_StepSize(0.5), m_MinimumFractionalAnisotropy(0.2), m_MaximumAngleChange(M_PI / 4),
-  m_SourceLabel(2), m_TargetLabel(1), m_ForbiddenLabel(0), m_WholeBrain(false)
+  : m_Integrator(RK4), m_StepSize(0.5), m_ErrorTolerance(0.01), m_MinimumStepSize(0.1), m_MaximumStepSize(2.0),
+  m_MinimumFractionalAnisotropy(0.2), m_MaximumAngleChange(M_PI / 4),
+  m_SourceLabel(2), m_TargetLabel(1), m_ForbiddenLabel(0), m_WholeBrain(false),
+  m_BrickedLayout(false), m_PrecomputeDirections(false), m_NumberOfShards(1), m_Shard(0), m_Probabilistic(false), m_NumberOfSamples(100), m_DirectionDispersion(0.5),
+  m_RandomSeed(0), m_StopAtTarget(false), m_FiberBufferSize(10000), m_ShardBegin(0), m_ShardEnd(0), m_NextSeed(0),
+  m_SeedEnd(0)
 {
   this->SetNumberOfRequiredInputs(2);
 
@@ -64,15 +74,29 @@ void
 ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
 ::GenerateData()
 {
+  if( m_Shard >= m_NumberOfShards )
+    {
+    itkExceptionMacro(<< "Shard " << m_Shard << " of " << m_NumberOfShards << " does not exist");
+    }
+  // Each shard would normalise its connectivity image by its own
+  // number of samples, which cannot be merged
+  if( m_Probabilistic && m_NumberOfShards > 1 )
+    {
+    itkExceptionMacro(<< "Probabilistic tracking cannot be sharded");
+    }
+
   // Preprocessing:
   this->PreprocessTensorImage();
 
-  // Loop over ROI image
+  // Collect the seed voxels of the ROI image.  The fibers are tracked in
+  // parallel and merged back in this order, so the output does not
+  // depend on the number of threads.
   typedef ImageRegionConstIteratorWithIndex<TensorImageType> TensorIteratorType;
   typedef ImageRegionConstIterator<ROIImageType>             ROIIteratorType;
 
   TensorIteratorType tensorit(this->GetTensorImage(), this->GetTensorImage()->GetLargestPossibleRegion() );
   ROIIteratorType    roiit(this->GetROIImage(), this->GetROIImage()->GetLargestPossibleRegion() );
+  m_Seeds.clear();
   for( tensorit.GoToBegin(), roiit.GoToBegin();
        !tensorit.IsAtEnd();
        ++tensorit, ++roiit )
@@ -80,104 +104,487 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
     // For each pixel which is a source region
     if( m_WholeBrain || roiit.Get() == m_SourceLabel )
       {
-      IndexType ind = tensorit.GetIndex();
-      itkDebugMacro(<< "Initalizing fiber from " << ind);
+      m_Seeds.push_back(tensorit.GetIndex() );
+      }
+    }
 
-      PointType pt;
-      this->GetTensorImage()->TransformIndexToPhysicalPoint(ind, pt);
+  // The seeds keep their index in the whole set, which orders the
+  // fibers and derives the random streams, so a shard gives the same
+  // fibers as the same seeds of an unsharded run
+  const SizeValueType numberOfSeeds = m_Seeds.size();
+  m_ShardBegin = numberOfSeeds * m_Shard / m_NumberOfShards;
+  m_ShardEnd = numberOfSeeds * (m_Shard + 1) / m_NumberOfShards;
 
-      // Find two initial starting directions
-      TensorType tens = tensorit.Get();
-      if( tens.GetFractionalAnisotropy() < m_MinimumFractionalAnisotropy )
-        {
-        continue;
-        }
-      itkDebugMacro(<< "Pretensor: " << tens);
+  if( m_Probabilistic )
+    {
+    this->TrackProbabilistic();
+    m_Seeds.clear();
+    return;
+    }
 
-      EigenVectorType evec;
-      try
-        {
-        evec = Functor::TensorPrincipalEigenvectorFunction<TensorType, double>() (tens);
-        }
-      catch( const ExceptionObject & e )
+  if( m_FiberSink )
+    {
+    m_FiberSink->Begin();
+    }
+
+  // The seeds are tracked by blocks so that at most the fibers of one
+  // block are held in memory when they go to a sink
+  for( SizeValueType begin = m_ShardBegin; begin < m_ShardEnd; begin += m_FiberBufferSize )
+    {
+    m_NextSeed = begin;
+    m_SeedEnd = std::min(begin + m_FiberBufferSize, m_ShardEnd);
+    this->TrackSeedBlock();
+    }
+  m_Seeds.clear();
+
+  if( m_FiberSink )
+    {
+    m_FiberSink->End();
+    }
+
+  // Update spacing of tube group
+  m_TubeGroup->ComputeObjectToWorldTransform();
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackSeedBlock()
+{
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  m_ThreadFibers.assign(numberOfThreads, SeededFiberListType() );
+
+  TrackerThreadStruct str;
+  str.Filter = this;
+  this->GetMultiThreader()->SetNumberOfThreads(numberOfThreads);
+  this->GetMultiThreader()->SetSingleMethod(this->TrackerThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  // Each thread took its seeds in increasing order, so merging the
+  // thread lists by seed index gives the order of a serial run
+  std::vector<typename SeededFiberListType::iterator> heads(numberOfThreads);
+  for( ThreadIdType t = 0; t < numberOfThreads; ++t )
+    {
+    heads[t] = m_ThreadFibers[t].begin();
+    }
+  for( ;; )
+    {
+    ThreadIdType next = numberOfThreads;
+    for( ThreadIdType t = 0; t < numberOfThreads; ++t )
+      {
+      if( heads[t] != m_ThreadFibers[t].end()
+          && (next == numberOfThreads || heads[t]->seed < heads[next]->seed) )
         {
-        // Abort tracking fiber if we start in an elliptical region
-        continue;
+        next = t;
         }
+      }
+    if( next == numberOfThreads )
+      {
+      break;
+      }
 
-      typename DTITubeSpatialObjectType::Pointer fiba, fibb, fib;
-
-      // Track in first direction
-      fiba = this->TrackFromPoint(pt,  evec);
-
-      // Track in second direction
-      fibb = this->TrackFromPoint(pt, -evec);
-
-      // TODO ::: CHECK MEMORY ALLOCATION
-      fib = DTITubeSpatialObjectType::New();
-      typedef DTITubeSpatialObjectType::PointListType PointListType;
-
-      // new points is sum of two half minus one for the repeated
-      // start point
-      PointListType newpoints(fiba->GetNumberOfPoints() + fibb->GetNumberOfPoints() - 1);
-      std::copy(fiba->GetPoints().rbegin(), fiba->GetPoints().rend(),
-                newpoints.begin() );
-      //  Plus one avoids double entering the start point
-      std::copy(fibb->GetPoints().begin() + 1, fibb->GetPoints().end(),
-                (newpoints.begin() + fiba->GetNumberOfPoints() ) );
-      fib->SetPoints(newpoints);
-
-      // Need to set spacing
-      fib->SetSpacing(this->GetROIImage()->GetSpacing().GetDataPointer() );
-
-      // Iterate over fiber and test if passed through target
-      // region.  If m_TargetLabel is zero accept all fibers.
-      bool sawtarget = !m_TargetLabel;
-      bool sawsource = false;
-      // Iterate over points in fiber
-      for( PointListType::const_iterator it = newpoints.begin();
-           it != newpoints.end(); ++it )
+    typename DTITubeSpatialObjectType::Pointer fib = DTITubeSpatialObjectType::New();
+    fib->SetPoints(heads[next]->points);
+
+    // Need to set spacing
+    fib->SetSpacing(this->GetROIImage()->GetSpacing().GetDataPointer() );
+    if( m_FiberSink )
+      {
+      // The tube has no parent group to carry the image origin
+      fib->GetObjectToParentTransform()->SetOffset(this->GetTensorImage()->GetOrigin().GetDataPointer() );
+      m_FiberSink->AddFiber(fib);
+      }
+    else
+      {
+      m_TubeGroup->AddSpatialObject(fib);
+      }
+
+    TubePointListType().swap(heads[next]->points);
+    ++heads[next];
+    }
+  m_ThreadFibers.clear();
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+ITK_THREAD_RETURN_TYPE
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackerThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info = static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  TrackerThreadStruct *             str = static_cast<TrackerThreadStruct *>( info->UserData );
+
+  if( str->Filter->m_Probabilistic )
+    {
+    str->Filter->ThreadedTrackProbabilistic(info->ThreadID);
+    }
+  else
+    {
+    str->Filter->ThreadedTrack(info->ThreadID);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::GetNextSeedChunk(SizeValueType & begin, SizeValueType & end)
+{
+  // Fiber lengths vary a lot, so the seeds are handed out in small
+  // chunks rather than split evenly between the threads
+  const SizeValueType chunkSize = 16;
+
+  m_SeedLock.Lock();
+  begin = m_NextSeed;
+  end = std::min(begin + chunkSize, m_SeedEnd);
+  m_NextSeed = end;
+  m_SeedLock.Unlock();
+  return begin < end;
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::ThreadedTrack(ThreadIdType threadId)
+{
+  SeededFiberListType & fibers = m_ThreadFibers[threadId];
+  TubePointListType     points;
+  SizeValueType         begin, end;
+
+  while( this->GetNextSeedChunk(begin, end) )
+    {
+    for( SizeValueType i = begin; i < end; ++i )
+      {
+      if( this->TrackFromSeed(m_Seeds[i], points) )
         {
-        ContinuousIndex<double, 3> cind;
-        cind[0] = it->GetPosition()[0];
-        cind[1] = it->GetPosition()[1];
-        cind[2] = it->GetPosition()[2];
-        PointType ptest;
-        this->GetTensorImage()->TransformContinuousIndexToPhysicalPoint(cind, ptest);
-
-        sawtarget = sawtarget || (m_ROIInterpolator->Evaluate(ptest) == m_TargetLabel);
-        sawsource = sawsource || (m_ROIInterpolator->Evaluate(ptest) == m_SourceLabel);
+        fibers.push_back(SeededFiber() );
+        fibers.back().seed = i;
+        fibers.back().points.swap(points);
         }
+      points.clear();
+      }
+    }
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackProbabilistic()
+{
+  const TensorImageType * tensorimage = this->GetTensorImage();
+
+  m_VisitCounts.assign(tensorimage->GetBufferedRegion().GetNumberOfPixels(), 0);
+  m_NextSeed = m_ShardBegin;
+  m_SeedEnd = m_ShardEnd;
+
+  TrackerThreadStruct str;
+  str.Filter = this;
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod(this->TrackerThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
 
-      // If not whole brain and we 've seen the target keep fiber
-      // If whole brain we need to see source and target
-      if( (sawtarget && !m_WholeBrain) || (sawtarget && sawsource) )
+  m_ConnectivityImage = ConnectivityImageType::New();
+  m_ConnectivityImage->CopyInformation(tensorimage);
+  m_ConnectivityImage->SetRegions(tensorimage->GetBufferedRegion() );
+  m_ConnectivityImage->Allocate();
+
+  const double samples = static_cast<double>( m_ShardEnd - m_ShardBegin ) * m_NumberOfSamples;
+  float *      buffer = m_ConnectivityImage->GetBufferPointer();
+  for( SizeValueType i = 0; i < m_VisitCounts.size(); ++i )
+    {
+    buffer[i] = samples > 0 ? m_VisitCounts[i] / samples : 0.0;
+    }
+  std::vector<unsigned int>().swap(m_VisitCounts);
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::ThreadedTrackProbabilistic(ThreadIdType)
+{
+  // The visits are buffered so that the threads rarely take the lock
+  const SizeValueType visitBufferSize = 65536;
+
+  // New() returns the global generator, shared by all the threads
+  typename RandomGeneratorType::Pointer rng = RandomGeneratorType::CreateInstance();
+  std::vector<OffsetValueType>          visits;
+  SizeValueType                         begin, end;
+
+  visits.reserve(visitBufferSize);
+  while( this->GetNextSeedChunk(begin, end) )
+    {
+    for( SizeValueType i = begin; i < end; ++i )
+      {
+      this->TrackProbabilisticFromSeed(i, rng, visits);
+      if( visits.size() >= visitBufferSize )
         {
-        m_TubeGroup->AddSpatialObject(fib);
+        this->AddVisits(visits);
         }
-      } // end if in source region
+      }
+    }
+  this->AddVisits(visits);
+}
 
-    } /// end loop over pixels
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::AddVisits(std::vector<OffsetValueType> & visits)
+{
+  m_VisitLock.Lock();
+  for( typename std::vector<OffsetValueType>::const_iterator it = visits.begin(); it != visits.end(); ++it )
+    {
+    ++m_VisitCounts[*it];
+    }
+  m_VisitLock.Unlock();
+  visits.clear();
+}
 
-  // Update spacing of tube group
-  m_TubeGroup->ComputeObjectToWorldTransform();
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackProbabilisticFromSeed(SizeValueType seed,
+                             RandomGeneratorType * rng,
+                             std::vector<OffsetValueType> & visits) const
+{
+  const IndexType & ind = m_Seeds[seed];
+  const TensorType  tens = this->GetTensorImage()->GetPixel(ind);
+  if( tens.GetFractionalAnisotropy() < m_MinimumFractionalAnisotropy )
+    {
+    return;
+    }
+
+  PointType pt;
+  this->GetTensorImage()->TransformIndexToPhysicalPoint(ind, pt);
+  const ROIPixelType label = static_cast<ROIPixelType>( m_ROIInterpolator->Evaluate(pt) );
+
+  // Stream of this seed, independent of the thread tracking it
+  rng->Initialize(static_cast<typename RandomGeneratorType::IntegerType>( m_RandomSeed + 2654435761u * (seed + 1) ) );
+
+  std::vector<OffsetValueType> streamline;
+  for( unsigned int s = 0; s < m_NumberOfSamples; ++s )
+    {
+    EigenVectorType vec;
+    if( !this->SampleDirection(tens, EigenVectorType(0.0), rng, vec) )
+      {
+      return;
+      }
+
+    bool sawtarget = !m_TargetLabel || label == m_TargetLabel;
+    bool sawsource = label == m_SourceLabel;
+
+    streamline.clear();
+    streamline.push_back(this->GetTensorImage()->ComputeOffset(ind) );
+    this->TrackProbabilisticFromPoint(pt,  vec, rng, streamline, sawtarget, sawsource);
+    this->TrackProbabilisticFromPoint(pt, -vec, rng, streamline, sawtarget, sawsource);
+
+    // Same acceptance as TrackFromSeed
+    if( (sawtarget && !m_WholeBrain) || (sawtarget && sawsource) )
+      {
+      // A voxel counts once per streamline
+      std::sort(streamline.begin(), streamline.end() );
+      visits.insert(visits.end(), streamline.begin(), std::unique(streamline.begin(), streamline.end() ) );
+      }
+    }
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackProbabilisticFromPoint(PointType pt,
+                              EigenVectorType vec,
+                              RandomGeneratorType * rng,
+                              std::vector<OffsetValueType> & streamline,
+                              bool & sawtarget, bool & sawsource) const
+{
+  // Random walks can circle, so the length is bounded
+  const unsigned int maximumNumberOfSteps = 20000;
+  const double       maxdotprod = cos(m_MaximumAngleChange);
+
+  ContinuousIndexType cind;
+  for( unsigned int n = 0; n < maximumNumberOfSteps; ++n )
+    {
+    PointType nextpt;
+    for( unsigned int i = 0; i < PointType::Dimension; ++i )
+      {
+      nextpt[i] = pt[i] + m_StepSize * vec[i];
+      }
+    this->GetTensorImage()->TransformPhysicalPointToContinuousIndex(nextpt, cind);
+    if( !this->IsInsideTensorBuffer(cind) )
+      {
+      return;
+      }
+
+    const TensorType t = m_TensorInterpolator->EvaluateAtContinuousIndex(cind);
+    EigenVectorType  nextvec;
+    ROIPixelType     label;
+    if( !this->IsTrackable(nextpt, cind, t.GetFractionalAnisotropy(), label)
+        || !this->SampleDirection(t, vec, rng, nextvec)
+        || nextvec * vec < maxdotprod )
+      {
+      return;
+      }
+
+    IndexType index;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      index[i] = Math::RoundHalfIntegerUp<IndexValueType>(cind[i]);
+      }
+    streamline.push_back(this->GetTensorImage()->ComputeOffset(index) );
+
+    sawtarget = sawtarget || label == m_TargetLabel;
+    sawsource = sawsource || label == m_SourceLabel;
+
+    pt = nextpt;
+    vec = nextvec;
+    }
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::SampleDirection(const TensorType & tensor,
+                  const EigenVectorType & vec,
+                  RandomGeneratorType * rng,
+                  EigenVectorType & direction) const
+{
+  double matrix[6];
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    matrix[i] = static_cast<double>( tensor[i] );
+    }
+
+  double eigenvalues[3];
+  double eigenvectors[3][3];
+  ComputeSymmetricEigenSystem3x3(matrix, eigenvalues, eigenvectors);
+
+  // Eigenvalues in decreasing order
+  unsigned int order[3] = { 0, 1, 2 };
+  if( eigenvalues[order[0]] < eigenvalues[order[1]] )
+    {
+    std::swap(order[0], order[1]);
+    }
+  if( eigenvalues[order[1]] < eigenvalues[order[2]] )
+    {
+    std::swap(order[1], order[2]);
+    }
+  if( eigenvalues[order[0]] < eigenvalues[order[1]] )
+    {
+    std::swap(order[0], order[1]);
+    }
+
+  const double l1 = eigenvalues[order[0]];
+  if( l1 <= 0.0 )
+    {
+    return false;
+    }
+  const double d2 = m_DirectionDispersion * std::sqrt(std::max(eigenvalues[order[1]], 0.0) / l1)
+    * rng->GetNormalVariate();
+  const double d3 = m_DirectionDispersion * std::sqrt(std::max(eigenvalues[order[2]], 0.0) / l1)
+    * rng->GetNormalVariate();
+
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    direction[i] = eigenvectors[i][order[0]] + d2 * eigenvectors[i][order[1]] + d3 * eigenvectors[i][order[2]];
+    }
+  direction.Normalize();
+  if( direction * vec < 0.0 )
+    {
+    direction = -direction;
+    }
+  return true;
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::TrackFromSeed(const IndexType & ind, TubePointListType & newpoints) const
+{
+  itkDebugMacro(<< "Initalizing fiber from " << ind);
+
+  PointType pt;
+  this->GetTensorImage()->TransformIndexToPhysicalPoint(ind, pt);
+
+  // Find two initial starting directions
+  EigenVectorType evec;
+  if( m_DirectionImage )
+    {
+    const typename DirectionImageType::PixelType & direction = m_DirectionImage->GetPixel(ind);
+    if( direction[3] < m_MinimumFractionalAnisotropy )
+      {
+      return false;
+      }
+    evec[0] = direction[0];
+    evec[1] = direction[1];
+    evec[2] = direction[2];
+    }
+  else
+    {
+    TensorType tens = this->GetTensorImage()->GetPixel(ind);
+    if( tens.GetFractionalAnisotropy() < m_MinimumFractionalAnisotropy )
+      {
+      return false;
+      }
+    itkDebugMacro(<< "Pretensor: " << tens);
+
+    try
+      {
+      evec = Functor::TensorPrincipalEigenvectorFunction<TensorType, double>() (tens);
+      }
+    catch( const ExceptionObject & e )
+      {
+      // Abort tracking fiber if we start in an elliptical region
+      return false;
+      }
+    }
+
+  // The labels are recorded as the fiber grows.  If m_TargetLabel is
+  // zero accept all fibers.
+  const ROIPixelType label = static_cast<ROIPixelType>( m_ROIInterpolator->Evaluate(pt) );
+  bool               sawtarget = !m_TargetLabel || label == m_TargetLabel;
+  bool               sawsource = label == m_SourceLabel;
+
+  TubePointListType fiba, fibb;
+
+  // Track in first direction
+  this->TrackFromPoint(pt,  evec, fiba, sawtarget, sawsource);
+
+  // Track in second direction
+  this->TrackFromPoint(pt, -evec, fibb, sawtarget, sawsource);
+
+  // If not whole brain and we 've seen the target keep fiber
+  // If whole brain we need to see source and target
+  if( !( (sawtarget && !m_WholeBrain) || (sawtarget && sawsource) ) )
+    {
+    return false;
+    }
+
+  // new points is sum of two half minus one for the repeated
+  // start point
+  newpoints.resize(fiba.size() + fibb.size() - 1);
+  std::copy(fiba.rbegin(), fiba.rend(), newpoints.begin() );
+  //  Plus one avoids double entering the start point
+  std::copy(fibb.begin() + 1, fibb.end(), newpoints.begin() + fiba.size() );
+  return true;
 }
 
 template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
-typename DTITubeSpatialObject<3>::Pointer
+void
 ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
 ::TrackFromPoint(PointType pt,
-                 EigenVectorType vec) const
+                 EigenVectorType vec,
+                 TubePointListType & pointlist,
+                 bool & sawtarget, bool & sawsource) const
 {
   const double maxdotprod = cos(m_MaximumAngleChange);
 
   itkDebugMacro(<< "Tracking from " << pt << " in direction " << vec);
 
-  std::vector<DTITubeSpatialObjectPointType> pointlist;
-  DTITubeSpatialObjectTypePointer            tube = DTITubeSpatialObjectType::New();
+  pointlist.clear();
 
   bool stoppingcond = false;
 
+  // Step size of the next RK45 step, adapted along the fiber
+  double stepsize = m_StepSize;
+
   EigenVectorType nextvec;
 
   DTITubeSpatialObjectPointType tubept;
@@ -200,32 +607,35 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
 
   do
     {
-    PointType nextpt;
-    try
-      {
-      nextpt = this->IntegrateOneStep(pt, vec, m_StepSize);
-      nextvec = nextpt - pt;
-      }
-    catch( itk::ExceptionObject e )
+    PointType  nextpt;
+    const bool inside = m_Integrator == RK45 ?
+      this->IntegrateAdaptiveStep(pt, vec, stepsize, nextpt) :
+      this->IntegrateOneStep(pt, vec, m_StepSize, nextpt);
+    if( !inside )
       {
       break;
       }
+    nextvec = nextpt - pt;
 
-    const TensorType nextt = m_TensorInterpolator->Evaluate(nextpt);
+    this->GetTensorImage()->TransformPhysicalPointToContinuousIndex(nextpt, nextpointind);
+    const TensorType nextt = m_TensorInterpolator->EvaluateAtContinuousIndex(nextpointind);
+    double           nextfa = nextt.GetFractionalAnisotropy();
+    if( m_DirectionImage )
+      {
+      EigenVectorType direction;
+      this->InterpolateDirectionField(nextpt, vec, direction, nextfa);
+      }
 
-    // Anisotropy too low
-    if( nextt.GetFractionalAnisotropy() < m_MinimumFractionalAnisotropy ||
+    // Outside the buffer, in the forbidden region or anisotropy too low
+    ROIPixelType label;
+    if( !this->IsTrackable(nextpt, nextpointind, nextfa, label) ||
         // Angle changes too much
-        dot_product(nextvec.GetVnlVector().normalize(), vec.GetVnlVector().normalize() ) < maxdotprod ||
-        // Forbidden label is not zero and point is in the forbidden region
-        (m_ForbiddenLabel && m_ROIInterpolator->Evaluate(nextpt) == m_ForbiddenLabel) )
+        dot_product(nextvec.GetVnlVector().normalize(), vec.GetVnlVector().normalize() ) < maxdotprod )
       {
       stoppingcond = true;
       }
     else
       {
-      this->GetTensorImage()->TransformPhysicalPointToContinuousIndex(nextpt, nextpointind);
-
       tubept.SetPosition(nextpointind[0], nextpointind[1], nextpointind[2]);
       tubept.SetTensorMatrix(nextt);
       tubept.SetField("fa", nextt.GetFractionalAnisotropy() );
@@ -236,6 +646,11 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
       pointlist.push_back(tubept);
       pt = nextpt;
       vec = nextvec;
+
+      sawtarget = sawtarget || label == m_TargetLabel;
+      sawsource = sawsource || label == m_SourceLabel;
+      // The fiber keeps its first point in the target
+      stoppingcond = m_StopAtTarget && m_TargetLabel && label == m_TargetLabel;
       }
 
     if( pointlist.size() > 20000 )
@@ -245,71 +660,226 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
 
     }
   while( !stoppingcond );
-
-  tube->SetPoints(pointlist);
-
-  return tube;
 }
 
 template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
-typename TTensorImage::PointType
+bool
 ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
-::IntegrateOneStep(const PointType& pt,
-                   const EigenVectorType& vec,
-                   double /* h */) const
+::StepPoint(const PointType& pt,
+            const EigenVectorType& direction,
+            double stepsize,
+            bool check,
+            PointType & result) const
 {
-  // Implement rk4
-  EigenVectorType k1, k2, k3, k4;
-  // EigenVectorType k1;
-
-  PointType testpoint;
-
-  // Evaluate next point using 4-order runge-kutta integrationn
-  k1 = this->EvaluatePrincipalDiffusionDirectionAt(pt, vec);
   for( unsigned int i = 0; i < PointType::Dimension; ++i )
     {
-    testpoint[i] = pt[i] + m_StepSize * k1[i] / 2;
+    result[i] = pt[i] + stepsize * direction[i];
     }
-  if( !m_TensorInterpolator->IsInsideBuffer(testpoint) )
+  if( !check )
     {
-    throw itk::ExceptionObject("Tracked outside image buffer");
+    return true;
     }
 
-  k2 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
-  for( unsigned int i = 0; i < PointType::Dimension; ++i )
-    {
-    testpoint[i] = pt[i] + m_StepSize * k2[i] / 2;
-    }
-  if( !m_TensorInterpolator->IsInsideBuffer(testpoint) )
-    {
-    throw itk::ExceptionObject("Tracked outside image buffer");
-    }
+  ContinuousIndexType cind;
+  this->GetTensorImage()->TransformPhysicalPointToContinuousIndex(result, cind);
+  return this->IsInsideTensorBuffer(cind);
+}
 
-  k3 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
-  for( unsigned int i = 0; i < PointType::Dimension; ++i )
-    {
-    testpoint[i] = pt[i] + m_StepSize * k3[i];
-    }
-  if( !m_TensorInterpolator->IsInsideBuffer(testpoint) )
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::NeedsBoundsCheck(const PointType& pt, double reach) const
+{
+  ContinuousIndexType cind;
+  this->GetTensorImage()->TransformPhysicalPointToContinuousIndex(pt, cind);
+
+  double border = NumericTraits<double>::max();
+  for( unsigned int i = 0; i < 3; ++i )
     {
-    throw itk::ExceptionObject("Tracked outside image buffer");
+    border = std::min(border, std::min(cind[i] - m_BufferStart[i], m_BufferEnd[i] - cind[i]) );
     }
 
-  k4 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+  // A physical distance d is at most d / (smallest spacing) voxels
+  return border * m_MinimumSpacing <= reach;
+}
 
-  PointType geompoint;
-  for( unsigned int i = 0; i < PointType::Dimension; ++i )
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::IntegrateOneStep(const PointType& pt,
+                   const EigenVectorType& vec,
+                   double h,
+                   PointType & geompoint) const
+{
+  PointType testpoint;
+
+  // The stages of these schemes stay within h of pt, away from the
+  // border of the buffer none of them is checked
+  const bool check = this->NeedsBoundsCheck(pt, h);
+
+  switch( m_Integrator )
     {
-    geompoint[i] = pt[i] + m_StepSize * (k1[i] / 6 + k2[i] / 3 + k3[i] / 3 + k4[i] / 6);
-//   geompoint[i] = pt[i] + m_StepSize*k1[i];
+    case Euler:
+      {
+      const EigenVectorType k1 = this->EvaluatePrincipalDiffusionDirectionAt(pt, vec);
+      if( !this->StepPoint(pt, k1, h, check, geompoint) )
+        {
+        return false;
+        }
+      break;
+      }
+    case Midpoint:
+      {
+      const EigenVectorType k1 = this->EvaluatePrincipalDiffusionDirectionAt(pt, vec);
+      if( !this->StepPoint(pt, k1, h / 2, check, testpoint) )
+        {
+        return false;
+        }
+      const EigenVectorType k2 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+      if( !this->StepPoint(pt, k2, h, check, geompoint) )
+        {
+        return false;
+        }
+      break;
+      }
+    case RK45:
+      {
+      double stepsize = h;
+      return this->IntegrateAdaptiveStep(pt, vec, stepsize, geompoint);
+      }
+    case RK4:
+    default:
+      {
+      // Evaluate next point using 4-order runge-kutta integrationn
+      EigenVectorType k1, k2, k3, k4;
+
+      k1 = this->EvaluatePrincipalDiffusionDirectionAt(pt, vec);
+      if( !this->StepPoint(pt, k1, h / 2, check, testpoint) )
+        {
+        return false;
+        }
+
+      k2 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+      if( !this->StepPoint(pt, k2, h / 2, check, testpoint) )
+        {
+        return false;
+        }
+
+      k3 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+      if( !this->StepPoint(pt, k3, h, check, testpoint) )
+        {
+        return false;
+        }
+
+      k4 = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+
+      EigenVectorType direction;
+      for( unsigned int i = 0; i < PointType::Dimension; ++i )
+        {
+        direction[i] = k1[i] / 6 + k2[i] / 3 + k3[i] / 3 + k4[i] / 6;
+        }
+      if( !this->StepPoint(pt, direction, h, check, geompoint) )
+        {
+        return false;
+        }
+      break;
+      }
     }
 
-  if( !m_TensorInterpolator->IsInsideBuffer(geompoint) )
+  return true;
+}
+
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+bool
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::IntegrateAdaptiveStep(const PointType& pt,
+                        const EigenVectorType& vec,
+                        double & h,
+                        PointType & geompoint) const
+{
+  // Cash-Karp coefficients
+  static const double a[6][5] = {
+      { 0.0, 0.0, 0.0, 0.0, 0.0 },
+      { 1.0 / 5.0, 0.0, 0.0, 0.0, 0.0 },
+      { 3.0 / 40.0, 9.0 / 40.0, 0.0, 0.0, 0.0 },
+      { 3.0 / 10.0, -9.0 / 10.0, 6.0 / 5.0, 0.0, 0.0 },
+      { -11.0 / 54.0, 5.0 / 2.0, -70.0 / 27.0, 35.0 / 27.0, 0.0 },
+      { 1631.0 / 55296.0, 175.0 / 512.0, 575.0 / 13824.0, 44275.0 / 110592.0, 253.0 / 4096.0 }
+    };
+  static const double b5[6] = { 37.0 / 378.0, 0.0, 250.0 / 621.0, 125.0 / 594.0, 0.0, 512.0 / 1771.0 };
+  static const double b4[6] = { 2825.0 / 27648.0, 0.0, 18575.0 / 48384.0, 13525.0 / 55296.0,
+                                277.0 / 14336.0, 1.0 / 4.0 };
+
+  // Largest sum of |a| over the rows of the tableau: no stage is
+  // further than reach * h from pt
+  const double reach = 6.6;
+  const double maxturn = cos(m_MaximumAngleChange / 2);
+
+  h = std::min(std::max(h, m_MinimumStepSize), m_MaximumStepSize);
+  for( ;; )
     {
-    throw itk::ExceptionObject("Tracked outside image buffer");
-    }
+    const bool      check = this->NeedsBoundsCheck(pt, reach * h);
+    EigenVectorType k[6];
+    PointType       testpoint;
+    bool            inside = true;
+    for( unsigned int s = 0; s < 6 && inside; ++s )
+      {
+      EigenVectorType direction;
+      direction.Fill(0.0);
+      for( unsigned int j = 0; j < s; ++j )
+        {
+        direction += k[j] * a[s][j];
+        }
+      inside = this->StepPoint(pt, direction, h, check, testpoint);
+      if( inside )
+        {
+        k[s] = this->EvaluatePrincipalDiffusionDirectionAt(testpoint, vec);
+        }
+      }
 
-  return geompoint;
+    if( inside )
+      {
+      EigenVectorType direction, error;
+      direction.Fill(0.0);
+      error.Fill(0.0);
+      for( unsigned int s = 0; s < 6; ++s )
+        {
+        direction += k[s] * b5[s];
+        error += k[s] * (b5[s] - b4[s]);
+        }
+      inside = this->StepPoint(pt, direction, h, check, geompoint);
+
+      // The turn within a step is also kept below half the maximum angle
+      // change, so that the angle test between successive steps measures
+      // the tract rather than the step size.  k[4] is the direction at
+      // the end of the step.
+      const double errorNorm = h * error.GetNorm();
+      const bool   tooCurved = k[0][0] * k[4][0] + k[0][1] * k[4][1] + k[0][2] * k[4][2] < maxturn;
+      if( inside && ( (errorNorm <= m_ErrorTolerance && !tooCurved) || h <= m_MinimumStepSize) )
+        {
+        // Accepted, propose a larger step if the error allows it
+        const double growth = errorNorm > 0.0 ?
+          0.9 * std::pow(m_ErrorTolerance / errorNorm, 0.2) : 4.0;
+        h = std::min(std::max(h * std::min(growth, 4.0), m_MinimumStepSize), m_MaximumStepSize);
+        return true;
+        }
+      if( inside )
+        {
+        const double shrink = errorNorm > m_ErrorTolerance ?
+          0.9 * std::pow(m_ErrorTolerance / errorNorm, 0.25) : 0.5;
+        h = std::max(h * std::max(shrink, 0.2), m_MinimumStepSize);
+        continue;
+        }
+      }
+
+    // A stage left the image, the border may still be reached with a
+    // smaller step
+    if( h <= m_MinimumStepSize )
+      {
+      return false;
+      }
+    h = std::max(h / 2, m_MinimumStepSize);
+    }
 }
 
 template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
@@ -318,6 +888,14 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
 ::EvaluatePrincipalDiffusionDirectionAt(const PointType& pt,
                                         const EigenVectorType& vec) const
 {
+  if( m_DirectionImage )
+    {
+    EigenVectorType direction;
+    double          fa;
+    this->InterpolateDirectionField(pt, vec, direction, fa);
+    return direction;
+    }
+
   TensorType tens = m_TensorInterpolator->Evaluate(pt);
 
   EigenVectorType pdd = Functor::TensorPrincipalEigenvectorFunction<TensorType, double>() (tens);
@@ -330,14 +908,119 @@ ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialOb
   return pdd;
 }
 
+template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
+void
+ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
+::InterpolateDirectionField(const PointType& pt,
+                            const EigenVectorType& vec,
+                            EigenVectorType & direction,
+                            double & fa) const
+{
+  typedef typename DirectionImageType::RegionType RegionType;
+
+  ContinuousIndex<double, 3> cind;
+  m_DirectionImage->TransformPhysicalPointToContinuousIndex(pt, cind);
+
+  const RegionType & region = m_DirectionImage->GetBufferedRegion();
+  IndexValueType     lower[3];
+  IndexValueType     upper[3];
+  double             distance[3];
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    const IndexValueType first = region.GetIndex(i);
+    const IndexValueType last = first + static_cast<IndexValueType>( region.GetSize(i) ) - 1;
+    const IndexValueType base = static_cast<IndexValueType>( vcl_floor(cind[i]) );
+
+    // Clamp at the border of the buffer
+    lower[i] = std::min(std::max(base, first), last);
+    upper[i] = std::min(std::max(base + 1, first), last);
+    distance[i] = cind[i] - base;
+    }
+
+  direction.Fill(0.0);
+  fa = 0.0;
+  for( unsigned int counter = 0; counter < 8; ++counter )
+    {
+    IndexType neighIndex;
+    double    overlap = 1.0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      if( counter & (1 << i) )
+        {
+        neighIndex[i] = upper[i];
+        overlap *= distance[i];
+        }
+      else
+        {
+        neighIndex[i] = lower[i];
+        overlap *= 1.0 - distance[i];
+        }
+      }
+    if( overlap == 0.0 )
+      {
+      continue;
+      }
+
+    const typename DirectionImageType::PixelType & neighbor = m_DirectionImage->GetPixel(neighIndex);
+    // Eigenvectors are only defined up to their sign
+    if( neighbor[0] * vec[0] + neighbor[1] * vec[1] + neighbor[2] * vec[2] < 0 )
+      {
+      overlap = -overlap;
+      }
+    direction[0] += overlap * neighbor[0];
+    direction[1] += overlap * neighbor[1];
+    direction[2] += overlap * neighbor[2];
+    fa += std::fabs(overlap) * neighbor[3];
+    }
+
+  const double norm = direction.GetNorm();
+  if( norm > 0.0 )
+    {
+    direction /= norm;
+    }
+}
+
 template <class TTensorImage, class TROIImage, class TOutputSpatialObject>
 void
 ImageToDTIStreamlineTractographyFilter<TTensorImage, TROIImage, TOutputSpatialObject>
 ::PreprocessTensorImage() // BeforeThreadedGenerateData
 {
+  if( m_BrickedLayout )
+    {
+    m_TensorInterpolator = TensorBrickedInterpolateType::New();
+    }
+  else
+    {
+    m_TensorInterpolator = TensorInterpolateType::New();
+    }
   m_TensorInterpolator->SetInputImage(this->GetTensorImage() );
   m_ROIInterpolator->SetInputImage(this->GetROIImage() );
 
+  // Continuous index bounds of the buffer, as in IsInsideBuffer
+  const typename TensorImageType::RegionType & region = this->GetTensorImage()->GetBufferedRegion();
+  m_MinimumSpacing = NumericTraits<double>::max();
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_BufferStart[i] = region.GetIndex(i) - 0.5;
+    m_BufferEnd[i] = region.GetIndex(i) + static_cast<double>( region.GetSize(i) ) - 0.5;
+    m_MinimumSpacing = std::min(m_MinimumSpacing, static_cast<double>( this->GetTensorImage()->GetSpacing()[i] ) );
+    }
+
+  m_DirectionImage = ITK_NULLPTR;
+  if( m_PrecomputeDirections )
+    {
+    typedef Functor::TensorPrincipalEigenvectorFAFunction<TensorType, typename DirectionImageType::PixelType>
+      DirectionFunctionType;
+    typedef UnaryFunctorImageFilter<TensorImageType, DirectionImageType, DirectionFunctionType>
+      DirectionFilterType;
+
+    typename DirectionFilterType::Pointer directions = DirectionFilterType::New();
+    directions->SetInput(this->GetTensorImage() );
+    directions->SetNumberOfThreads(this->GetNumberOfThreads() );
+    directions->Update();
+    m_DirectionImage = directions->GetOutput();
+    }
+
   // TODO: this should not be here
   m_TubeGroup->SetSpacing(this->GetTensorImage()->GetSpacing().GetDataPointer() );
   m_TubeGroup->GetObjectToParentTransform()->SetOffset(this->GetTensorImage()->GetOrigin().GetDataPointer() );
@@ -18,14 +18,15 @@
 #define __itkLogEuclideanTensorImageFilter_h
 
 #include <itkUnaryFunctorImageFilter.h>
-#include <vnl/vnl_double_3x3.h>
 #include <itkDiffusionTensor3D.h>
+#include <vnl/vnl_math.h>
+#include "itkSymmetricMatrixFunction3x3.h"
 
 namespace itk
 {
 
-// This functor class invokes the computation of fractional anisotropy from
-// every pixel.
+// This functor class computes the unique elements of the matrix
+// logarithm of every pixel.
 namespace Functor
 {
 
@@ -36,8 +37,6 @@ public:
   typedef typename TInput::RealValueType          RealValueType;
   typedef typename itk::Vector<RealValueType, 6>  OutputType;
   typedef TInput                                  TensorType;
-  typedef typename TInput::EigenVectorsMatrixType EigenVectorType;
-  typedef typename TInput::EigenValuesArrayType   EigenValueType;
 
   LogEuclideanTensorFunction()
   {
@@ -47,33 +46,87 @@ public:
   {
   }
 
-  OutputType operator()( const TInput & x )
+  bool operator!=( const LogEuclideanTensorFunction & ) const
   {
-    EigenValueType  D;
-    EigenVectorType U;
+    return false;
+  }
 
-    x.ComputeEigenAnalysis(D, U);
+  bool operator==( const LogEuclideanTensorFunction & other ) const
+  {
+    return !(*this != other);
+  }
 
-    vnl_matrix_fixed<RealValueType, 3, 3> m;
-    m.fill(0);
-    m(0, 0) = D[0] > 0 ? log(D[0]) : -10;
-    m(1, 1) = D[1] > 0 ? log(D[1]) : -10;
-    m(2, 2) = D[2] > 0 ? log(D[2]) : -10;
+  inline OutputType operator()( const TInput & x ) const
+  {
+    RealValueType tensor[6];
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      tensor[i] = static_cast<RealValueType>( x[i] );
+      }
+
+    RealValueType matlog[6];
+    ApplySymmetricMatrixFunction3x3(tensor, matlog, &LogEuclideanTensorFunction::Log);
+
+    const RealValueType sqrt2 = vnl_math::sqrt2;
+    OutputType          op;
+    op[0] = matlog[0];
+    op[1] = matlog[1] * sqrt2;
+    op[2] = matlog[2] * sqrt2;
+    op[3] = matlog[3];
+    op[4] = matlog[4] * sqrt2;
+    op[5] = matlog[5];
 
-    vnl_matrix_fixed<RealValueType, 3, 3> matlog;
-    matlog = U.GetVnlMatrix().transpose() * m * U.GetVnlMatrix();
+    return op;
+  }
 
-    OutputType op;
-    op[0] = matlog(0, 0);
-    op[1] = matlog(0, 1) * sqrt(2.0);
-    op[2] = matlog(0, 2) * sqrt(2.0);
-    op[3] = matlog(1, 1);
-    op[4] = matlog(1, 2) * sqrt(2.0);
-    op[5] = matlog(2, 2);
+private:
+  // Non positive eigenvalues are clamped to exp(-10)
+  static RealValueType Log(RealValueType lambda)
+  {
+    return lambda > 0 ? std::log(lambda) : -10;
+  }
+
+};
 
+// Adds the matrix logarithm of a tensor to a running Log-Euclidean
+// sum.  Used in place on the sum image to average tensor fields in a
+// single pass per input.
+template <typename TSum, typename TInput>
+class LogEuclideanTensorAccumulateFunction
+{
+public:
+  LogEuclideanTensorAccumulateFunction()
+  {
+  }
+
+  ~LogEuclideanTensorAccumulateFunction()
+  {
+  }
+
+  bool operator!=( const LogEuclideanTensorAccumulateFunction & ) const
+  {
+    return false;
+  }
+
+  bool operator==( const LogEuclideanTensorAccumulateFunction & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline TSum operator()( const TSum & sum, const TInput & x ) const
+  {
+    const typename LogEuclideanTensorFunction<TInput>::OutputType logtensor = m_Log(x);
+
+    TSum op;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      op[i] = sum[i] + logtensor[i];
+      }
     return op;
   }
 
+private:
+  LogEuclideanTensorFunction<TInput> m_Log;
 };
 
 }  // end namespace functor
@@ -83,7 +136,9 @@ public:
  * elements of the matrix-logarithm of the tensor field.
  *
  * LogEuclideanImageFilter applies pixel-wise the invokation for
- * computing the matrix logarithm of every pixel.
+ * computing the matrix logarithm of every pixel. The eigen
+ * decomposition is done with fixed size arrays on the stack so the
+ * threads do not contend on the heap.
  *
  * \sa DiffusionTensor3D
  *
@@ -102,8 +157,9 @@ public:
   typedef Image<Vector<T, 6>, 3>         OutputImageType;
 
   /** Standard class typedefs. */
-  typedef LogEuclideanTensorImageFilter                       Self;
-  typedef ImageToImageFilter<InputImageType, OutputImageType> Superclass;
+  typedef LogEuclideanTensorImageFilter Self;
+  typedef UnaryFunctorImageFilter<InputImageType, OutputImageType,
+                                  Functor::LogEuclideanTensorFunction<DiffusionTensor3D<T> > > Superclass;
 
   typedef SmartPointer<Self>       Pointer;
   typedef SmartPointer<const Self> ConstPointer;
@@ -111,6 +167,9 @@ public:
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
 
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(LogEuclideanTensorImageFilter, UnaryFunctorImageFilter);
+
   /** Print internal ivars */
   void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE
   {
@@ -18,110 +18,52 @@
 #ifndef __itkNaryTensorAverageImageFilter_h
 #define __itkNaryTensorAverageImageFilter_h
 
-#include "itkVectorNaryFunctorImageFilter.h"
-#include "itkNumericTraits.h"
-
-#include "SymmetricSpaceTensorGeometry.h"
-#include "TensorStatistics.h"
+#include "itkTensorKarcherMeanImageFilter.h"
 
 namespace itk
 {
 
 /** \class NaryTensorAverageImageFilter
- * \brief Implements an operator computing the pixel-wise maximum of several images.
- *
- * This class is parametrized over the types of the input images and the type
- * of the output image.  Numeric conversions (castings) are done by the C++
- * defaults.
- *
- * The pixel type of the output images must have a valid defintion of the
- * operator<. This condition is required because internally this filter will
- * perform an operation similar to:
- *
- *    const OutputPixelType query_value = static_cast<OutputPixelType>(pixel_from_input_n);
- *    if(current_maximum < query_value)
- *      {
- *      current_maximum = query_value;
- *      }
- * (where current_maximum is also of type OutputPixelType)
+ * \brief Computes the pixel-wise Riemannian mean of several tensor
+ * images.
  *
- * for each of the n input images.
+ * The mean of every pixel is the affine-invariant (Karcher) mean of the
+ * corresponding input tensors. It is computed by
+ * TensorKarcherMeanImageFilter: each thread copies the input tensors of
+ * a pixel into one scratch buffer reused for the whole region, the
+ * iteration starts from the Log-Euclidean mean and uses a backtracking
+ * line search that keeps the progress made before a step is rejected.
+ * The number of iterations of every pixel is available from
+ * GetIterationsOutput().
  *
- * For example, this filter could be used directly to find a "maximum projection"
- * of a series of images, often used in preliminary analysis of time-series data.
- *
- * \author Zachary Pincus
- *
- * This filter was contributed by Zachary Pincus from the Department of
- * Biochemistry and Program in Biomedical Informatics at Stanford University
- * School of Medicine
+ * Nothing is allocated per pixel, so means of a hundred or more
+ * subjects are practical.
  *
+ * \sa TensorKarcherMeanImageFilter
  * \ingroup IntensityImageFilters  Multithreaded
  */
-
-namespace Functor
-{
-
-template <class TInput, class TOutput>
-class TensorAverage
-{
-public:
-  typedef typename NumericTraits<TOutput>::ValueType OutputValueType;
-  // not sure if this typedef really makes things more clear... could just use TOutput?
-
-  TensorAverage()
-  {
-  }
-
-  ~TensorAverage()
-  {
-  }
-
-  TOutput operator()( const typename VectorContainer<unsigned int, TInput>::Pointer & B)
-  {
-    TOutput mean;
-
-    SymmetricSpaceTensorGeometry<double> ssg;
-    TensorStatistics<double>             ts(&ssg);
-
-    ts.ComputeMean(B, mean);
-    return mean;
-  }
-
-  bool operator==(const TensorAverage &) const
-  {
-    return true;
-  }
-
-  bool operator!=(const TensorAverage &) const
-  {
-    return false;
-  }
-
-};
-
-}
 template <class TInputImage, class TOutputImage>
 class ITK_EXPORT NaryTensorAverageImageFilter :
   public
-  VectorNaryFunctorImageFilter<TInputImage, TOutputImage,
-                               Functor::TensorAverage<typename TInputImage::PixelType,
-                                                      typename TInputImage::PixelType> >
+  TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
 {
 public:
   /** Standard class typedefs. */
-  typedef NaryTensorAverageImageFilter Self;
-  typedef VectorNaryFunctorImageFilter<TInputImage, TOutputImage,
-                                       Functor::TensorAverage<typename TInputImage::PixelType,
-                                                              typename TInputImage::PixelType> >  Superclass;
-  typedef SmartPointer<Self>       Pointer;
-  typedef SmartPointer<const Self> ConstPointer;
+  typedef NaryTensorAverageImageFilter                            Self;
+  typedef TensorKarcherMeanImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef SmartPointer<Self>                                      Pointer;
+  typedef SmartPointer<const Self>                                ConstPointer;
 
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(NaryTensorAverageImageFilter, TensorKarcherMeanImageFilter);
 protected:
   NaryTensorAverageImageFilter()
   {
+    // Like the other n-ary filters, at least two images are averaged
+    this->SetNumberOfRequiredInputs(2);
   }
 
   virtual ~NaryTensorAverageImageFilter()
@@ -0,0 +1,186 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkSymmetricMatrixFunction3x3.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkSymmetricMatrixFunction3x3_h
+#define __itkSymmetricMatrixFunction3x3_h
+
+#include "itkNumericTraits.h"
+#include <cmath>
+
+namespace itk
+{
+
+/** Eigen decomposition of a symmetric 3x3 matrix by cyclic Jacobi
+ * rotations.
+ *
+ * The matrix is given by its unique elements in the DiffusionTensor3D
+ * order (xx, xy, xz, yy, yz, zz). On return eigenvalues holds the
+ * eigenvalues (unsorted) and the columns of eigenvectors the
+ * corresponding unit eigenvectors.
+ *
+ * Everything is done on the stack, unlike
+ * SymmetricEigenAnalysis which allocates its work arrays on the heap
+ * for every call. This matters for per-voxel functors.
+ */
+template <class TReal>
+void
+ComputeSymmetricEigenSystem3x3(const TReal matrix[6], TReal eigenvalues[3], TReal eigenvectors[3][3])
+{
+  TReal a[3][3];
+
+  a[0][0] = matrix[0]; a[0][1] = matrix[1]; a[0][2] = matrix[2];
+  a[1][0] = matrix[1]; a[1][1] = matrix[3]; a[1][2] = matrix[4];
+  a[2][0] = matrix[2]; a[2][1] = matrix[4]; a[2][2] = matrix[5];
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      eigenvectors[i][j] = (i == j) ? 1 : 0;
+      }
+    }
+
+  TReal norm = 0;
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    norm += matrix[i] * matrix[i];
+    }
+  const TReal tolerance = NumericTraits<TReal>::epsilon() * NumericTraits<TReal>::epsilon() * norm;
+
+  // Jacobi converges quadratically, a 3x3 matrix needs a handful of
+  // sweeps
+  for( unsigned int sweep = 0; sweep < 20; ++sweep )
+    {
+    const TReal off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if( off <= tolerance )
+      {
+      break;
+      }
+    for( unsigned int p = 0; p < 2; ++p )
+      {
+      for( unsigned int q = p + 1; q < 3; ++q )
+        {
+        if( a[p][q] == 0 )
+          {
+          continue;
+          }
+        // Rotation annihilating a[p][q]
+        const TReal theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+        TReal       t;
+        if( std::fabs(theta) > 1e100 )
+          {
+          t = 0.5 / theta;
+          }
+        else
+          {
+          t = 1 / (std::fabs(theta) + std::sqrt(theta * theta + 1) );
+          if( theta < 0 )
+            {
+            t = -t;
+            }
+          }
+        const TReal c = 1 / std::sqrt(t * t + 1);
+        const TReal s = t * c;
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          const TReal akp = a[k][p];
+          const TReal akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+          }
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          const TReal apk = a[p][k];
+          const TReal aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+          }
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          const TReal vkp = eigenvectors[k][p];
+          const TReal vkq = eigenvectors[k][q];
+          eigenvectors[k][p] = c * vkp - s * vkq;
+          eigenvectors[k][q] = s * vkp + c * vkq;
+          }
+        }
+      }
+    }
+
+  eigenvalues[0] = a[0][0];
+  eigenvalues[1] = a[1][1];
+  eigenvalues[2] = a[2][2];
+}
+
+/** Applies a scalar function to the eigenvalues of a symmetric 3x3
+ * matrix: result = V f(D) V^T. Both matrices are given by their
+ * unique elements in the DiffusionTensor3D order. This is how the
+ * matrix logarithm and exponential of tensors are computed. */
+template <class TReal, class TFunction>
+void
+ApplySymmetricMatrixFunction3x3(const TReal matrix[6], TReal result[6], TFunction function)
+{
+  TReal eigenvalues[3];
+  TReal eigenvectors[3][3];
+
+  ComputeSymmetricEigenSystem3x3(matrix, eigenvalues, eigenvectors);
+
+  TReal f[3];
+  for( unsigned int k = 0; k < 3; ++k )
+    {
+    f[k] = function(eigenvalues[k]);
+    }
+
+  unsigned int n = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = i; j < 3; ++j, ++n )
+      {
+      result[n] = eigenvectors[i][0] * f[0] * eigenvectors[j][0]
+        + eigenvectors[i][1] * f[1] * eigenvectors[j][1]
+        + eigenvectors[i][2] * f[2] * eigenvectors[j][2];
+      }
+    }
+}
+
+/** Congruence of symmetric 3x3 matrices: result = G X G, with G, X
+ * and the result in the DiffusionTensor3D order. Used to whiten a
+ * tensor by the inverse square root of another one. */
+template <class TReal>
+void
+SymmetricMatrixCongruence3x3(const TReal g[6], const TReal x[6], TReal result[6])
+{
+  const TReal G[3][3] = { { g[0], g[1], g[2] }, { g[1], g[3], g[4] }, { g[2], g[4], g[5] } };
+  const TReal X[3][3] = { { x[0], x[1], x[2] }, { x[1], x[3], x[4] }, { x[2], x[4], x[5] } };
+
+  TReal GX[3][3];
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      GX[i][j] = G[i][0] * X[0][j] + G[i][1] * X[1][j] + G[i][2] * X[2][j];
+      }
+    }
+
+  unsigned int n = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = i; j < 3; ++j, ++n )
+      {
+      result[n] = GX[i][0] * G[0][j] + GX[i][1] * G[1][j] + GX[i][2] * G[2][j];
+      }
+    }
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,95 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorBrickedLinearInterpolateImageFunction.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTensorBrickedLinearInterpolateImageFunction_h
+#define __itkTensorBrickedLinearInterpolateImageFunction_h
+
+#include "itkTensorInterpolateImageFunction.h"
+#include "itkBrickedTensorVolume.h"
+
+namespace itk
+{
+
+/**
+ * \class TensorBrickedLinearInterpolateImageFunction
+ * \brief Linear interpolation of a 3D tensor image from a bricked copy.
+ *
+ * Gives the same values as TensorLinearInterpolateImageFunction, with
+ * the corners clamped to the buffer in the same way, but reads them from
+ * a BrickedTensorVolume copy of the image made by SetInputImage().  The
+ * accesses of tractography or fiber sampling, local but in any
+ * direction, then mostly stay within one brick.
+ *
+ * The copy doubles the memory used by the tensors, and is not updated
+ * if the image is modified after SetInputImage().
+ *
+ * \ingroup ImageFunctions ImageInterpolators
+ */
+template <class TInputImage, class TCoordRep = float>
+class ITK_EXPORT TensorBrickedLinearInterpolateImageFunction :
+  public         TensorInterpolateImageFunction<TInputImage, TCoordRep>
+{
+public:
+  /** Standard class typedefs. */
+  typedef TensorBrickedLinearInterpolateImageFunction            Self;
+  typedef TensorInterpolateImageFunction<TInputImage, TCoordRep> Superclass;
+  typedef SmartPointer<Self>                                     Pointer;
+  typedef SmartPointer<const Self>                               ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorBrickedLinearInterpolateImageFunction,
+               TensorInterpolateImageFunction);
+
+  typedef typename Superclass::InputImageType      InputImageType;
+  typedef typename Superclass::PixelType           PixelType;
+  typedef typename Superclass::ValueType           ValueType;
+  typedef typename Superclass::RealType            RealType;
+  typedef typename Superclass::ContinuousIndexType ContinuousIndexType;
+  typedef typename Superclass::OutputType          OutputType;
+
+  itkStaticConstMacro(Dimension, unsigned int, Superclass::Dimension);
+
+  /** Sets the image and makes its bricked copy */
+  virtual void SetInputImage(const InputImageType * ptr) ITK_OVERRIDE;
+
+  /** Evaluate the function at a ContinuousIndex position.  The corners
+   * are clamped to the buffer. */
+  virtual OutputType EvaluateAtContinuousIndex(const ContinuousIndexType & index ) const ITK_OVERRIDE;
+
+protected:
+  TensorBrickedLinearInterpolateImageFunction()
+  {
+  }
+
+  ~TensorBrickedLinearInterpolateImageFunction()
+  {
+  }
+
+private:
+  TensorBrickedLinearInterpolateImageFunction(const Self &); // purposely not implemented
+  void operator=(const Self &);                              // purposely not implemented
+
+  BrickedTensorVolume<PixelType> m_Volume;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTensorBrickedLinearInterpolateImageFunction.txx"
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorBrickedLinearInterpolateImageFunction.txx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTensorBrickedLinearInterpolateImageFunction_txx
+#define __itkTensorBrickedLinearInterpolateImageFunction_txx
+
+#include "itkTensorBrickedLinearInterpolateImageFunction.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template <class TInputImage, class TCoordRep>
+void
+TensorBrickedLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::SetInputImage(const InputImageType * ptr)
+{
+  this->Superclass::SetInputImage(ptr);
+  if( ptr )
+    {
+    m_Volume.CopyImage(ptr);
+    }
+}
+
+template <class TInputImage, class TCoordRep>
+typename TensorBrickedLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::OutputType
+TensorBrickedLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::EvaluateAtContinuousIndex(const ContinuousIndexType & index) const
+{
+  const typename InputImageType::RegionType & region = this->GetInputImage()->GetBufferedRegion();
+
+  /**
+   * Lower and upper neighbours along each axis, relative to the start of
+   * the buffer and clamped to it, as in
+   * TensorLinearInterpolateImageFunction.
+   */
+  IndexValueType corner[2][3];
+  double         distance[3];
+  for( unsigned int dim = 0; dim < 3; dim++ )
+    {
+    const IndexValueType baseIndex = (IndexValueType) vcl_floor(index[dim] );
+    const IndexValueType last = static_cast<IndexValueType>( region.GetSize(dim) ) - 1;
+    const IndexValueType lower = baseIndex - region.GetIndex(dim);
+
+    distance[dim] = index[dim] - double( baseIndex );
+    corner[0][dim] = std::min(std::max(lower, IndexValueType(0) ), last);
+    corner[1][dim] = std::min(std::max(lower + 1, IndexValueType(0) ), last);
+    }
+
+  /**
+   * Blend the 8 corners, with the weights multiplied and summed in the
+   * same order as TensorLinearInterpolateImageFunction so both give the
+   * same values.
+   */
+  const PixelType * buffer = m_Volume.GetBufferPointer();
+  RealType          sum[Dimension];
+  for( unsigned int k = 0; k < Dimension; k++ )
+    {
+    sum[k] = 0.0;
+    }
+  for( unsigned int counter = 0; counter < 8; counter++ )
+    {
+    double       overlap = 1.0;
+    unsigned int upper[3];
+    for( unsigned int dim = 0; dim < 3; dim++ )
+      {
+      upper[dim] = (counter >> dim) & 1;
+      overlap *= upper[dim] ? distance[dim] : 1.0 - distance[dim];
+      }
+
+    // get neighbor value only if overlap is not zero
+    if( overlap == 0.0 )
+      {
+      continue;
+      }
+    const ValueType * input = buffer[m_Volume.ComputeOffset(corner[upper[0]][0], corner[upper[1]][1],
+                                                            corner[upper[2]][2])].GetDataPointer();
+    const RealType weight = overlap;
+    for( unsigned int k = 0; k < Dimension; k++ )
+      {
+      sum[k] += weight * static_cast<RealType>( input[k] );
+      }
+    }
+
+  OutputType output;
+  for( unsigned int k = 0; k < Dimension; k++ )
+    {
+    output[k] = sum[k];
+    }
+  return output;
+}
+
+} // end namespace itk
+
+#endif
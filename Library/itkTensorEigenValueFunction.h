@@ -0,0 +1,115 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorEigenValueFunction.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTensorEigenValueFunction_h
+#define __itkTensorEigenValueFunction_h
+
+namespace itk
+{
+
+// Functors computing eigenvalue based measures of a tensor in a
+// single pass, without an intermediate eigenvalue image.
+namespace Functor
+{
+
+/** \class TensorEigenValueFunction
+ * \brief Returns one eigenvalue of a tensor.
+ *
+ * Index 0 is the largest eigenvalue (lambda 1, the axial
+ * diffusivity) and index 2 the smallest.
+ */
+template <typename TInput>
+class TensorEigenValueFunction
+{
+public:
+  typedef typename TInput::RealValueType        RealValueType;
+  typedef typename TInput::EigenValuesArrayType EigenValuesArrayType;
+
+  TensorEigenValueFunction() : m_Index(0)
+  {
+  }
+
+  ~TensorEigenValueFunction()
+  {
+  }
+
+  void SetIndex(unsigned int index)
+  {
+    m_Index = index;
+  }
+
+  bool operator!=( const TensorEigenValueFunction & other ) const
+  {
+    return m_Index != other.m_Index;
+  }
+
+  bool operator==( const TensorEigenValueFunction & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline RealValueType operator()( const TInput & x ) const
+  {
+    EigenValuesArrayType lambdas;
+    x.ComputeEigenValues(lambdas);
+    // ITK sorts the eigenvalues in increasing order
+    return lambdas[2 - m_Index];
+  }
+
+private:
+  unsigned int m_Index;
+};
+
+/** \class TensorRadialDiffusivityFunction
+ * \brief Returns the mean of the two smallest eigenvalues of a tensor.
+ */
+template <typename TInput>
+class TensorRadialDiffusivityFunction
+{
+public:
+  typedef typename TInput::RealValueType        RealValueType;
+  typedef typename TInput::EigenValuesArrayType EigenValuesArrayType;
+
+  TensorRadialDiffusivityFunction()
+  {
+  }
+
+  ~TensorRadialDiffusivityFunction()
+  {
+  }
+
+  bool operator!=( const TensorRadialDiffusivityFunction & ) const
+  {
+    return false;
+  }
+
+  bool operator==( const TensorRadialDiffusivityFunction & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline RealValueType operator()( const TInput & x ) const
+  {
+    EigenValuesArrayType lambdas;
+    x.ComputeEigenValues(lambdas);
+    return (lambdas[0] + lambdas[1]) * 0.5;
+  }
+
+};
+
+}  // end namespace functor
+
+} // end namespace itk
+
+#endif
@@ -147,6 +147,30 @@ public:
     return output;
   }
 
+  /** Interpolate the image at n continuous index positions, e.g. the
+   * points of a whole fiber.  No bounds checking is done.
+   *
+   * The default loops over EvaluateAtContinuousIndex(); subclasses may
+   * override it to look up the image buffer once. */
+  virtual void EvaluateAtContinuousIndexBatch(const ContinuousIndexType * indices, OutputType * values,
+                                              unsigned int n) const
+  {
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      values[i] = this->EvaluateAtContinuousIndex( indices[i] );
+      }
+  }
+
+  /** Interpolate the image at n physical points.  No bounds checking
+   * is done. */
+  virtual void EvaluateBatch(const PointType * points, OutputType * values, unsigned int n) const
+  {
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      values[i] = this->Evaluate( points[i] );
+      }
+  }
+
 protected:
   TensorInterpolateImageFunction()
   {
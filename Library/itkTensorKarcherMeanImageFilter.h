@@ -0,0 +1,416 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorKarcherMeanImageFilter.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTensorKarcherMeanImageFilter_h
+#define __itkTensorKarcherMeanImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkSymmetricMatrixFunction3x3.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+
+namespace Functor
+{
+
+/** \class TensorKarcherMean
+ * \brief Affine-invariant (Riemannian) Frechet mean of a set of
+ * tensors.
+ *
+ * The mean is found with the Karcher fixed-point iteration
+ *
+ *   M <- M^1/2 exp( 1/n sum_i log(M^-1/2 X_i M^-1/2) ) M^1/2
+ *
+ * started from the Log-Euclidean mean, which is usually within a few
+ * iterations of the solution. Each update is a geodesic step along the
+ * mean tangent vector with a backtracking line search on the sum of
+ * squared distances, which keeps the iteration monotone for spread out
+ * or badly conditioned inputs. The iteration stops when the Frobenius
+ * norm of the mean tangent vector is below the tolerance.
+ *
+ * Tensors are passed as packed arrays of 6 values in the
+ * DiffusionTensor3D order. Non positive eigenvalues of the inputs are
+ * clamped to exp(-10), as in the Log-Euclidean filters. All the
+ * matrix math is done on the stack; the caller provides the scratch
+ * space so that nothing is allocated per voxel.
+ */
+template <class TReal>
+class TensorKarcherMean
+{
+public:
+  TensorKarcherMean() : m_Tolerance(1e-8), m_MaximumNumberOfIterations(50)
+  {
+  }
+
+  void SetTolerance(TReal tolerance)
+  {
+    m_Tolerance = tolerance;
+  }
+
+  TReal GetTolerance() const
+  {
+    return m_Tolerance;
+  }
+
+  void SetMaximumNumberOfIterations(unsigned int iterations)
+  {
+    m_MaximumNumberOfIterations = iterations;
+  }
+
+  unsigned int GetMaximumNumberOfIterations() const
+  {
+    return m_MaximumNumberOfIterations;
+  }
+
+  bool operator!=( const TensorKarcherMean & other ) const
+  {
+    return m_Tolerance != other.m_Tolerance
+           || m_MaximumNumberOfIterations != other.m_MaximumNumberOfIterations;
+  }
+
+  bool operator==( const TensorKarcherMean & other ) const
+  {
+    return !(*this != other);
+  }
+
+  /** Computes the mean of the n tensors stored in tensors (6 * n
+   * values). The inputs are projected in place onto the positive
+   * definite tensors if necessary. Returns the number of Karcher
+   * iterations done after the Log-Euclidean initialization. */
+  unsigned int Compute(TReal * tensors, unsigned int n, TReal mean[6]) const
+  {
+    if( n == 0 )
+      {
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        mean[j] = 0;
+        }
+      return 0;
+      }
+
+    // Log-Euclidean mean as the starting point
+    TReal logmean[6] = { 0, 0, 0, 0, 0, 0 };
+    for( unsigned int i = 0; i < n; ++i )
+      {
+      TReal * x = tensors + 6 * i;
+      TReal   eigenvalues[3];
+      TReal   eigenvectors[3][3];
+      ComputeSymmetricEigenSystem3x3(x, eigenvalues, eigenvectors);
+
+      bool  positive = true;
+      TReal f[3];
+      for( unsigned int k = 0; k < 3; ++k )
+        {
+        positive = positive && eigenvalues[k] > 0;
+        f[k] = eigenvalues[k] > 0 ? std::log(eigenvalues[k]) : -10;
+        }
+
+      TReal logx[6];
+      Reconstruct(eigenvectors, f, logx);
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        logmean[j] += logx[j];
+        }
+
+      if( !positive )
+        {
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          f[k] = std::exp(f[k]);
+          }
+        Reconstruct(eigenvectors, f, x);
+        }
+      }
+    for( unsigned int j = 0; j < 6; ++j )
+      {
+      logmean[j] /= n;
+      }
+    ApplySymmetricMatrixFunction3x3(logmean, mean, &TensorKarcherMean::Exp);
+
+    if( n == 1 )
+      {
+      return 0;
+      }
+
+    TReal root[6];
+    TReal rootinv[6];
+    TReal tangent[6];
+    TReal cost = Evaluate(tensors, n, mean, root, rootinv, tangent);
+
+    // Gradient descent along geodesics; a step of length 1 is the
+    // Karcher fixed-point update.  A step that does not lower the sum of
+    // squared distances is retried from the same mean with half the
+    // length, and the length grows back after a successful step, so no
+    // progress is thrown away.
+    TReal        stepSize = 1;
+    unsigned int iteration = 0;
+    while( iteration < m_MaximumNumberOfIterations
+           && NormSquared(tangent) >= m_Tolerance * m_Tolerance )
+      {
+      ++iteration;
+
+      TReal candidate[6];
+      TReal candidateRoot[6];
+      TReal candidateRootInv[6];
+      TReal candidateTangent[6];
+      TReal candidateCost;
+      for( ;; )
+        {
+        TReal scaled[6];
+        TReal step[6];
+        for( unsigned int j = 0; j < 6; ++j )
+          {
+          scaled[j] = stepSize * tangent[j];
+          }
+        ApplySymmetricMatrixFunction3x3(scaled, step, &TensorKarcherMean::Exp);
+        SymmetricMatrixCongruence3x3(root, step, candidate);
+
+        candidateCost = Evaluate(tensors, n, candidate, candidateRoot, candidateRootInv, candidateTangent);
+        if( candidateCost <= cost )
+          {
+          break;
+          }
+        stepSize *= 0.5;
+        if( stepSize < MinimumStepSize() )
+          {
+          // No descent left at this precision, the mean is converged
+          return iteration;
+          }
+        }
+
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        mean[j] = candidate[j];
+        root[j] = candidateRoot[j];
+        rootinv[j] = candidateRootInv[j];
+        tangent[j] = candidateTangent[j];
+        }
+      cost = candidateCost;
+      stepSize = std::min(stepSize * 2, static_cast<TReal>( 1 ) );
+      }
+    return iteration;
+  }
+
+private:
+  static TReal Log(TReal lambda)
+  {
+    return lambda > 0 ? std::log(lambda) : -10;
+  }
+
+  static TReal Exp(TReal lambda)
+  {
+    return std::exp(lambda);
+  }
+
+  static TReal MinimumStepSize()
+  {
+    return 1.0 / 1024;
+  }
+
+  static TReal NormSquared(const TReal v[6])
+  {
+    return v[0] * v[0] + v[3] * v[3] + v[5] * v[5]
+           + 2 * (v[1] * v[1] + v[2] * v[2] + v[4] * v[4]);
+  }
+
+  // Computes the square root and inverse square root of point, the mean
+  // of the inputs in the tangent space at point (the negative gradient of
+  // the cost) and returns the cost, half the mean squared geodesic
+  // distance to the inputs.
+  static TReal Evaluate(const TReal * tensors, unsigned int n, const TReal point[6],
+                        TReal root[6], TReal rootinv[6], TReal tangent[6])
+  {
+    TReal eigenvalues[3];
+    TReal eigenvectors[3][3];
+    ComputeSymmetricEigenSystem3x3(point, eigenvalues, eigenvectors);
+
+    TReal f[3];
+    TReal finv[3];
+    for( unsigned int k = 0; k < 3; ++k )
+      {
+      f[k] = std::sqrt(eigenvalues[k]);
+      finv[k] = 1 / f[k];
+      }
+    Reconstruct(eigenvectors, f, root);
+    Reconstruct(eigenvectors, finv, rootinv);
+
+    TReal cost = 0;
+    for( unsigned int j = 0; j < 6; ++j )
+      {
+      tangent[j] = 0;
+      }
+    for( unsigned int i = 0; i < n; ++i )
+      {
+      TReal whitened[6];
+      TReal logw[6];
+      SymmetricMatrixCongruence3x3(rootinv, tensors + 6 * i, whitened);
+      ApplySymmetricMatrixFunction3x3(whitened, logw, &TensorKarcherMean::Log);
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        tangent[j] += logw[j];
+        }
+      cost += NormSquared(logw);
+      }
+    for( unsigned int j = 0; j < 6; ++j )
+      {
+      tangent[j] /= n;
+      }
+    return cost / (2 * n);
+  }
+
+  // V diag(f) V^T in packed form
+  static void Reconstruct(const TReal eigenvectors[3][3], const TReal f[3], TReal result[6])
+  {
+    unsigned int n = 0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = i; j < 3; ++j, ++n )
+        {
+        result[n] = eigenvectors[i][0] * f[0] * eigenvectors[j][0]
+          + eigenvectors[i][1] * f[1] * eigenvectors[j][1]
+          + eigenvectors[i][2] * f[2] * eigenvectors[j][2];
+        }
+      }
+  }
+
+  TReal        m_Tolerance;
+  unsigned int m_MaximumNumberOfIterations;
+};
+
+} // end namespace Functor
+
+/** \class TensorKarcherMeanImageFilter
+ * \brief Computes the pixel-wise affine-invariant (Riemannian) mean of
+ * several tensor images.
+ *
+ * Each output pixel is the Frechet mean of the corresponding input
+ * pixels for the affine-invariant metric, computed by
+ * Functor::TensorKarcherMean. All the inputs must have the same
+ * size. The filter is multithreaded and only allocates one scratch
+ * buffer per thread.
+ *
+ * Only the requested region of the output is computed, so a large
+ * mean can be produced slab by slab from inputs that only hold that
+ * slab.
+ *
+ * The second output, GetIterationsOutput(), holds the number of
+ * Karcher iterations used at every pixel, to find where the mean is
+ * slow to converge or hit the iteration limit.
+ *
+ * \sa LogEuclideanTensorImageFilter
+ * \ingroup IntensityImageFilters  Multithreaded  TensorObjects
+ */
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT TensorKarcherMeanImageFilter :
+  public         ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef TensorKarcherMeanImageFilter                   Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorKarcherMeanImageFilter, ImageToImageFilter);
+
+  typedef TInputImage                                InputImageType;
+  typedef typename InputImageType::PixelType         InputPixelType;
+  typedef TOutputImage                               OutputImageType;
+  typedef typename OutputImageType::PixelType        OutputPixelType;
+  typedef typename OutputImageType::RegionType       OutputImageRegionType;
+  typedef Functor::TensorKarcherMean<double>         MeanFunctionType;
+
+  typedef Image<unsigned short, OutputImageType::ImageDimension> IterationsImageType;
+
+  typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+
+  /** Convergence threshold on the norm of the mean tangent vector.
+   * Default is 1e-8. */
+  void SetTolerance(double tolerance)
+  {
+    if( tolerance != m_MeanFunction.GetTolerance() )
+      {
+      m_MeanFunction.SetTolerance(tolerance);
+      this->Modified();
+      }
+  }
+
+  double GetTolerance() const
+  {
+    return m_MeanFunction.GetTolerance();
+  }
+
+  /** Default is 50. */
+  void SetMaximumNumberOfIterations(unsigned int iterations)
+  {
+    if( iterations != m_MeanFunction.GetMaximumNumberOfIterations() )
+      {
+      m_MeanFunction.SetMaximumNumberOfIterations(iterations);
+      this->Modified();
+      }
+  }
+
+  unsigned int GetMaximumNumberOfIterations() const
+  {
+    return m_MeanFunction.GetMaximumNumberOfIterations();
+  }
+
+  /** Largest number of Karcher iterations needed by a pixel during the
+   * last update. */
+  itkGetConstMacro(MaximumIterationsUsed, unsigned int);
+
+  /** Number of Karcher iterations used at every pixel. */
+  IterationsImageType * GetIterationsOutput();
+
+  using Superclass::MakeOutput;
+  virtual DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx) ITK_OVERRIDE;
+
+protected:
+  TensorKarcherMeanImageFilter();
+  virtual ~TensorKarcherMeanImageFilter()
+  {
+  }
+
+  void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                            ThreadIdType threadId) ITK_OVERRIDE;
+
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+private:
+  TensorKarcherMeanImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);               // purposely not implemented
+
+  MeanFunctionType          m_MeanFunction;
+  std::vector<unsigned int> m_ThreadIterations;
+  unsigned int              m_MaximumIterationsUsed;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTensorKarcherMeanImageFilter.txx"
+#endif
+
+#endif
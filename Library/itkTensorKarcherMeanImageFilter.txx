@@ -0,0 +1,157 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorKarcherMeanImageFilter.txx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkTensorKarcherMeanImageFilter_txx
+#define _itkTensorKarcherMeanImageFilter_txx
+
+#include "itkTensorKarcherMeanImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkProgressReporter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage>
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::TensorKarcherMeanImageFilter() : m_MaximumIterationsUsed(0)
+{
+  this->SetNumberOfRequiredInputs(1);
+  this->SetNumberOfRequiredOutputs(2);
+  this->SetNthOutput(1, this->MakeOutput(1) );
+}
+
+template <class TInputImage, class TOutputImage>
+DataObject::Pointer
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::MakeOutput(DataObjectPointerArraySizeType idx)
+{
+  if( idx == 1 )
+    {
+    return IterationsImageType::New().GetPointer();
+    }
+  return Superclass::MakeOutput(idx);
+}
+
+template <class TInputImage, class TOutputImage>
+typename TensorKarcherMeanImageFilter<TInputImage, TOutputImage>::IterationsImageType *
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::GetIterationsOutput()
+{
+  return static_cast<IterationsImageType *>( this->ProcessObject::GetOutput(1) );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  const unsigned int numberOfInputs = this->GetNumberOfIndexedInputs();
+  for( unsigned int i = 0; i < numberOfInputs; ++i )
+    {
+    const InputImageType * input = this->GetInput(i);
+    if( !input )
+      {
+      itkExceptionMacro(<< "Input " << i << " is not set");
+      }
+    if( input->GetLargestPossibleRegion() != this->GetInput(0)->GetLargestPossibleRegion() )
+      {
+      itkExceptionMacro(<< "All the tensor images must have the same size");
+      }
+    }
+
+  m_ThreadIterations.assign(this->GetNumberOfThreads(), 0);
+  m_MaximumIterationsUsed = 0;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                       ThreadIdType threadId)
+{
+  typedef ImageRegionConstIterator<InputImageType> InputIteratorType;
+
+  const unsigned int numberOfInputs = this->GetNumberOfIndexedInputs();
+
+  std::vector<InputIteratorType> inputIts;
+  inputIts.reserve(numberOfInputs);
+  for( unsigned int i = 0; i < numberOfInputs; ++i )
+    {
+    inputIts.push_back(InputIteratorType(this->GetInput(i), outputRegionForThread) );
+    }
+  ImageRegionIterator<OutputImageType>     oit(this->GetOutput(), outputRegionForThread);
+  ImageRegionIterator<IterationsImageType> iit(this->GetIterationsOutput(), outputRegionForThread);
+
+  ProgressReporter progress(this, threadId, outputRegionForThread.GetNumberOfPixels() );
+
+  // One scratch buffer per thread, reused for every pixel
+  std::vector<double> tensors(6 * numberOfInputs);
+  unsigned int        maximumIterations = 0;
+  for( oit.GoToBegin(), iit.GoToBegin(); !oit.IsAtEnd(); ++oit, ++iit, progress.CompletedPixel() )
+    {
+    for( unsigned int i = 0; i < numberOfInputs; ++i )
+      {
+      const InputPixelType & pixel = inputIts[i].Get();
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        tensors[6 * i + j] = static_cast<double>( pixel[j] );
+        }
+      ++inputIts[i];
+      }
+
+    double             mean[6];
+    const unsigned int iterations = m_MeanFunction.Compute(&tensors[0], numberOfInputs, mean);
+    maximumIterations = std::max(maximumIterations, iterations);
+    iit.Set(static_cast<typename IterationsImageType::PixelType>( iterations ) );
+
+    OutputPixelType op;
+    for( unsigned int j = 0; j < 6; ++j )
+      {
+      op[j] = mean[j];
+      }
+    oit.Set(op);
+    }
+  m_ThreadIterations[threadId] = maximumIterations;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::AfterThreadedGenerateData()
+{
+  for( unsigned int t = 0; t < m_ThreadIterations.size(); ++t )
+    {
+    m_MaximumIterationsUsed = std::max(m_MaximumIterationsUsed, m_ThreadIterations[t]);
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TensorKarcherMeanImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "Tolerance: " << this->GetTolerance() << std::endl;
+  os << indent << "MaximumNumberOfIterations: " << this->GetMaximumNumberOfIterations() << std::endl;
+  os << indent << "MaximumIterationsUsed: " << m_MaximumIterationsUsed << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,229 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorLabelStatisticsImageFilter.h,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTensorLabelStatisticsImageFilter_h
+#define __itkTensorLabelStatisticsImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkDiffusionTensor3D.h"
+#include "itkNumericTraits.h"
+
+#include <map>
+#include <vector>
+
+namespace itk
+{
+
+/** \class TensorLabelStatisticsImageFilter
+ * \brief Computes per-label statistics of the scalar measures of a
+ * diffusion tensor image.
+ *
+ * For every label of the label input (except the background value)
+ * the filter computes the number of voxels and the mean, standard
+ * deviation, minimum, maximum and percentiles of the fractional
+ * anisotropy, the mean, axial (lambda 1) and radial diffusivities and
+ * the two smallest eigenvalues. The Log-Euclidean mean tensor of each
+ * label is computed as well.
+ *
+ * Voxels whose tensor is not finite, e.g. NaNs, are counted but add no
+ * sample. Measures and log tensors that are not finite are dropped the
+ * same way. The statistics of a measure without any finite sample are
+ * NaN.
+ *
+ * All the measures are gathered in a single multithreaded pass over
+ * the image. Each thread accumulates into its own set of label
+ * statistics which are merged in AfterThreadedGenerateData(), so no
+ * locking is required.
+ *
+ * The input tensor image is passed through unchanged as the output.
+ *
+ * \sa LabelStatisticsImageFilter
+ * \ingroup IntensityImageFilters  Multithreaded  TensorObjects
+ */
+template <class TInputImage, class TLabelImage>
+class ITK_EXPORT TensorLabelStatisticsImageFilter :
+  public         ImageToImageFilter<TInputImage, TInputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef TensorLabelStatisticsImageFilter              Self;
+  typedef ImageToImageFilter<TInputImage, TInputImage> Superclass;
+  typedef SmartPointer<Self>                            Pointer;
+  typedef SmartPointer<const Self>                      ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TensorLabelStatisticsImageFilter, ImageToImageFilter);
+
+  /** Image related typedefs. */
+  typedef TInputImage                              InputImageType;
+  typedef typename InputImageType::Pointer         InputImagePointer;
+  typedef typename InputImageType::RegionType      RegionType;
+  typedef typename InputImageType::PixelType       TensorType;
+  typedef TLabelImage                              LabelImageType;
+  typedef typename LabelImageType::PixelType       LabelPixelType;
+  typedef DiffusionTensor3D<double>                RealTensorType;
+  typedef typename RealTensorType::EigenValuesArrayType EigenValuesArrayType;
+
+  /** Measures gathered for every label. Lambda 1 is the axial
+   * diffusivity. */
+  enum MeasureType { FA = 0, MD, AD, RD, Lambda2, Lambda3, NumberOfMeasures };
+
+  /** Summary of one measure within one label. */
+  struct MeasureStatistics
+    {
+    double              Mean;
+    double              Sigma;
+    double              Minimum;
+    double              Maximum;
+    std::vector<double> Percentiles;
+    };
+
+  /** Summary of one label. NonFiniteCount voxels have a tensor or a
+   * measure that is not finite. */
+  struct LabelStatistics
+    {
+    SizeValueType     Count;
+    SizeValueType     NonFiniteCount;
+    MeasureStatistics Measures[NumberOfMeasures];
+    RealTensorType    LogEuclideanMean;
+    };
+
+  typedef std::map<LabelPixelType, LabelStatistics> StatisticsMapType;
+  typedef std::vector<LabelPixelType>               ValidLabelValuesContainerType;
+
+  /** Set the label image. */
+  void SetLabelInput(const TLabelImage *input)
+  {
+    this->SetNthInput(1, const_cast<TLabelImage *>(input) );
+  }
+
+  /** Get the label image. */
+  const LabelImageType * GetLabelInput() const
+  {
+    return static_cast<const LabelImageType *>(this->ProcessObject::GetInput(1) );
+  }
+
+  /** Voxels carrying this label are ignored. Default is 0. */
+  itkSetMacro(BackgroundValue, LabelPixelType);
+  itkGetConstMacro(BackgroundValue, LabelPixelType);
+
+  /** Percentiles, in [0,100], reported for every measure. Default is
+   * 5, 25, 50, 75 and 95. */
+  void SetPercentiles(const std::vector<double> & percentiles)
+  {
+    m_Percentiles = percentiles;
+    this->Modified();
+  }
+
+  const std::vector<double> & GetPercentiles() const
+  {
+    return m_Percentiles;
+  }
+
+  /** Name of a measure as used in reports. */
+  static const char * GetMeasureName(unsigned int measure);
+
+  /** Labels found in the label image after Update(), in increasing
+   * order. */
+  const ValidLabelValuesContainerType & GetValidLabelValues() const
+  {
+    return m_ValidLabelValues;
+  }
+
+  bool HasLabel(LabelPixelType label) const
+  {
+    return m_LabelStatistics.find(label) != m_LabelStatistics.end();
+  }
+
+  /** Statistics of a label. The label must be valid. */
+  const LabelStatistics & GetLabelStatistics(LabelPixelType label) const;
+
+protected:
+  TensorLabelStatisticsImageFilter();
+  virtual ~TensorLabelStatisticsImageFilter()
+  {
+  }
+
+  void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
+
+  /** Pass the input through unmodified. Do this by grafting in the
+   * AllocateOutputs method. */
+  void AllocateOutputs() ITK_OVERRIDE;
+
+  /** Both inputs are needed in their entirety. */
+  void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  void EnlargeOutputRequestedRegion(DataObject *data) ITK_OVERRIDE;
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  void ThreadedGenerateData(const RegionType & outputRegionForThread, ThreadIdType threadId) ITK_OVERRIDE;
+
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+private:
+  TensorLabelStatisticsImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);                   // purposely not implemented
+
+  /** Running sums of one label in one thread, of the finite values
+   * only. The samples are kept for the percentiles. */
+  struct LabelAccumulator
+    {
+    LabelAccumulator() : Count(0), NonFiniteCount(0), LogCount(0)
+    {
+      for( unsigned int m = 0; m < NumberOfMeasures; ++m )
+        {
+        MeasureCount[m] = 0;
+        Sum[m] = 0.0;
+        SumOfSquares[m] = 0.0;
+        Minimum[m] = NumericTraits<double>::max();
+        Maximum[m] = NumericTraits<double>::NonpositiveMin();
+        }
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        LogSum[i] = 0.0;
+        }
+    }
+
+    SizeValueType      Count;
+    SizeValueType      NonFiniteCount;
+    SizeValueType      LogCount;
+    SizeValueType      MeasureCount[NumberOfMeasures];
+    double             Sum[NumberOfMeasures];
+    double             SumOfSquares[NumberOfMeasures];
+    double             Minimum[NumberOfMeasures];
+    double             Maximum[NumberOfMeasures];
+    double             LogSum[6];
+    std::vector<float> Samples[NumberOfMeasures];
+    };
+
+  typedef std::map<LabelPixelType, LabelAccumulator> AccumulatorMapType;
+
+  LabelPixelType                  m_BackgroundValue;
+  std::vector<double>             m_Percentiles;
+  std::vector<AccumulatorMapType> m_ThreadAccumulators;
+  StatisticsMapType               m_LabelStatistics;
+  ValidLabelValuesContainerType   m_ValidLabelValues;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTensorLabelStatisticsImageFilter.txx"
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTensorLabelStatisticsImageFilter.txx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkTensorLabelStatisticsImageFilter_txx
+#define _itkTensorLabelStatisticsImageFilter_txx
+
+#include "itkTensorLabelStatisticsImageFilter.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkProgressReporter.h"
+#include "itkLogEuclideanTensorImageFilter.h"
+#include "itkExpEuclideanTensorImageFilter.h"
+
+#include <vnl/vnl_math.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace itk
+{
+
+template <class TInputImage, class TLabelImage>
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::TensorLabelStatisticsImageFilter()
+  : m_BackgroundValue(NumericTraits<LabelPixelType>::ZeroValue() )
+{
+  this->SetNumberOfRequiredInputs(2);
+
+  m_Percentiles.push_back(5.0);
+  m_Percentiles.push_back(25.0);
+  m_Percentiles.push_back(50.0);
+  m_Percentiles.push_back(75.0);
+  m_Percentiles.push_back(95.0);
+}
+
+template <class TInputImage, class TLabelImage>
+const char *
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::GetMeasureName(unsigned int measure)
+{
+  static const char * const names[NumberOfMeasures] = { "fa", "md", "ad", "rd", "l2", "l3" };
+
+  return measure < NumberOfMeasures ? names[measure] : "";
+}
+
+template <class TInputImage, class TLabelImage>
+const typename TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>::LabelStatistics
+& TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::GetLabelStatistics(LabelPixelType label) const
+{
+  typename StatisticsMapType::const_iterator it = m_LabelStatistics.find(label);
+  if( it == m_LabelStatistics.end() )
+    {
+    itkExceptionMacro(<< "Label " << static_cast<typename NumericTraits<LabelPixelType>::PrintType>(label)
+                      << " is not present in the label image");
+    }
+  return it->second;
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::AllocateOutputs()
+{
+  // Pass the input through as the output
+  InputImagePointer image = const_cast<TInputImage *>( this->GetInput() );
+
+  this->GraftOutput( image );
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImageType * input = const_cast<InputImageType *>( this->GetInput() );
+  if( input )
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+  LabelImageType * labels = const_cast<LabelImageType *>( this->GetLabelInput() );
+  if( labels )
+    {
+    labels->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::EnlargeOutputRequestedRegion(DataObject *data)
+{
+  Superclass::EnlargeOutputRequestedRegion(data);
+  data->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::BeforeThreadedGenerateData()
+{
+  if( this->GetInput()->GetLargestPossibleRegion() != this->GetLabelInput()->GetLargestPossibleRegion() )
+    {
+    itkExceptionMacro(<< "Tensor image and label image must have the same size");
+    }
+
+  // One independent accumulator map per thread, merged afterwards
+  m_ThreadAccumulators.clear();
+  m_ThreadAccumulators.resize(this->GetNumberOfThreads() );
+  m_LabelStatistics.clear();
+  m_ValidLabelValues.clear();
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::ThreadedGenerateData(const RegionType & outputRegionForThread,
+                       ThreadIdType threadId)
+{
+  ImageRegionConstIterator<InputImageType> it(this->GetInput(), outputRegionForThread);
+  ImageRegionConstIterator<LabelImageType> lit(this->GetLabelInput(), outputRegionForThread);
+
+  ProgressReporter progress(this, threadId, outputRegionForThread.GetNumberOfPixels() );
+
+  AccumulatorMapType &                               accumulators = m_ThreadAccumulators[threadId];
+  Functor::LogEuclideanTensorFunction<RealTensorType> logfunction;
+
+  // Cache the last accumulator to avoid a map lookup for every voxel
+  // inside the same region
+  LabelAccumulator * current = ITK_NULLPTR;
+  LabelPixelType     currentLabel = m_BackgroundValue;
+  for( it.GoToBegin(), lit.GoToBegin(); !it.IsAtEnd(); ++it, ++lit, progress.CompletedPixel() )
+    {
+    const LabelPixelType label = lit.Get();
+    if( label == m_BackgroundValue )
+      {
+      continue;
+      }
+    if( !current || label != currentLabel )
+      {
+      current = &accumulators[label];
+      currentLabel = label;
+      }
+
+    ++current->Count;
+
+    // Invalid tensors, e.g. NaNs outside the brain, are counted and
+    // have no measure
+    RealTensorType     tensor;
+    const TensorType & pixel = it.Get();
+    bool               finite = true;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      tensor[i] = static_cast<double>( pixel[i] );
+      finite = finite && vnl_math_isfinite(tensor[i]);
+      }
+    if( !finite )
+      {
+      ++current->NonFiniteCount;
+      continue;
+      }
+
+    EigenValuesArrayType lambdas;
+    tensor.ComputeEigenValues(lambdas);
+
+    double values[NumberOfMeasures];
+    values[FA] = tensor.GetFractionalAnisotropy();
+    values[MD] = tensor.GetTrace() / 3.0;
+    values[AD] = lambdas[2];
+    values[RD] = (lambdas[0] + lambdas[1]) / 2.0;
+    values[Lambda2] = lambdas[1];
+    values[Lambda3] = lambdas[0];
+
+    // A measure that is not finite, e.g. the FA of a null tensor, is
+    // dropped from its own statistics only
+    for( unsigned int m = 0; m < NumberOfMeasures; ++m )
+      {
+      const double v = values[m];
+      if( !vnl_math_isfinite(v) )
+        {
+        finite = false;
+        continue;
+        }
+      ++current->MeasureCount[m];
+      current->Sum[m] += v;
+      current->SumOfSquares[m] += v * v;
+      current->Minimum[m] = std::min(current->Minimum[m], v);
+      current->Maximum[m] = std::max(current->Maximum[m], v);
+      current->Samples[m].push_back(static_cast<float>(v) );
+      }
+
+    // The log of a tensor that is not positive definite is not finite
+    const typename Functor::LogEuclideanTensorFunction<RealTensorType>::OutputType logtensor = logfunction(tensor);
+    bool finitelog = true;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      finitelog = finitelog && vnl_math_isfinite(logtensor[i]);
+      }
+    if( finitelog )
+      {
+      ++current->LogCount;
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        current->LogSum[i] += logtensor[i];
+        }
+      }
+    if( !finite || !finitelog )
+      {
+      ++current->NonFiniteCount;
+      }
+    }
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::AfterThreadedGenerateData()
+{
+  // Merge the per-thread accumulators
+  AccumulatorMapType merged;
+  for( unsigned int t = 0; t < m_ThreadAccumulators.size(); ++t )
+    {
+    for( typename AccumulatorMapType::iterator it = m_ThreadAccumulators[t].begin();
+         it != m_ThreadAccumulators[t].end(); ++it )
+      {
+      LabelAccumulator &       dst = merged[it->first];
+      const LabelAccumulator & src = it->second;
+      dst.Count += src.Count;
+      dst.NonFiniteCount += src.NonFiniteCount;
+      dst.LogCount += src.LogCount;
+      for( unsigned int m = 0; m < NumberOfMeasures; ++m )
+        {
+        dst.MeasureCount[m] += src.MeasureCount[m];
+        dst.Sum[m] += src.Sum[m];
+        dst.SumOfSquares[m] += src.SumOfSquares[m];
+        dst.Minimum[m] = std::min(dst.Minimum[m], src.Minimum[m]);
+        dst.Maximum[m] = std::max(dst.Maximum[m], src.Maximum[m]);
+        dst.Samples[m].insert(dst.Samples[m].end(), src.Samples[m].begin(), src.Samples[m].end() );
+        }
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        dst.LogSum[i] += src.LogSum[i];
+        }
+      }
+    m_ThreadAccumulators[t].clear();
+    }
+  m_ThreadAccumulators.clear();
+
+  // The statistics of a measure without any finite sample are NaN
+  const double                                           nan = std::numeric_limits<double>::quiet_NaN();
+  Functor::ExpEuclideanTensorFunction<Vector<double, 6> > expfunction;
+  for( typename AccumulatorMapType::iterator it = merged.begin(); it != merged.end(); ++it )
+    {
+    LabelAccumulator & acc = it->second;
+    LabelStatistics    stats;
+    stats.Count = acc.Count;
+    stats.NonFiniteCount = acc.NonFiniteCount;
+
+    for( unsigned int m = 0; m < NumberOfMeasures; ++m )
+      {
+      MeasureStatistics & ms = stats.Measures[m];
+      if( acc.MeasureCount[m] == 0 )
+        {
+        ms.Mean = ms.Sigma = ms.Minimum = ms.Maximum = nan;
+        ms.Percentiles.assign(m_Percentiles.size(), nan);
+        continue;
+        }
+
+      const double n = static_cast<double>(acc.MeasureCount[m]);
+      ms.Mean = acc.Sum[m] / n;
+      ms.Sigma = 0.0;
+      if( acc.MeasureCount[m] > 1 )
+        {
+        const double variance = (acc.SumOfSquares[m] - n * ms.Mean * ms.Mean) / (n - 1.0);
+        ms.Sigma = variance > 0.0 ? std::sqrt(variance) : 0.0;
+        }
+      ms.Minimum = acc.Minimum[m];
+      ms.Maximum = acc.Maximum[m];
+
+      // Percentiles by linear interpolation between order statistics
+      std::vector<float> & samples = acc.Samples[m];
+      std::sort(samples.begin(), samples.end() );
+      for( unsigned int p = 0; p < m_Percentiles.size(); ++p )
+        {
+        const double pos = std::min(std::max(m_Percentiles[p], 0.0), 100.0) / 100.0 * (samples.size() - 1);
+        const size_t lower = static_cast<size_t>(std::floor(pos) );
+        const size_t upper = std::min(lower + 1, samples.size() - 1);
+        const double frac = pos - lower;
+        ms.Percentiles.push_back( (1.0 - frac) * samples[lower] + frac * samples[upper]);
+        }
+      std::vector<float>().swap(samples);
+      }
+
+    if( acc.LogCount == 0 )
+      {
+      stats.LogEuclideanMean.Fill(nan);
+      }
+    else
+      {
+      Vector<double, 6> logmean;
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        logmean[i] = acc.LogSum[i] / acc.LogCount;
+        }
+      stats.LogEuclideanMean = expfunction(logmean);
+      }
+
+    m_LabelStatistics[it->first] = stats;
+    m_ValidLabelValues.push_back(it->first);
+    }
+}
+
+template <class TInputImage, class TLabelImage>
+void
+TensorLabelStatisticsImageFilter<TInputImage, TLabelImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "BackgroundValue: "
+     << static_cast<typename NumericTraits<LabelPixelType>::PrintType>(m_BackgroundValue) << std::endl;
+  os << indent << "Number of labels: " << m_ValidLabelValues.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -30,7 +30,10 @@ namespace itk
  * image intensity non-integer pixel position. This class is templated
  * over the input image type and the coordinate representation type.
  *
- * This function works for N-dimensional images.
+ * This function works for N-dimensional images. 3D images use a
+ * specialized kernel that computes the buffer offsets of the 8 corners
+ * once and blends the contiguous tensor components directly from the
+ * buffer; the corners are clamped to the buffer.
  *
  * \warning This function work only for Tensor images. For
  * scalar images use LinearInterpolateImageFunction.
@@ -78,6 +81,11 @@ public:
   /** Output type is Tensor<double,Dimension> */
   typedef typename Superclass::OutputType OutputType;
 
+  /** Point typedef support. */
+  typedef typename Superclass::PointType PointType;
+
+  typedef typename InputImageType::RegionType ImageRegionType;
+
   /** Evaluate the function at a ContinuousIndex position
    *
    * Returns the linearly interpolated image intensity at a
@@ -88,6 +96,15 @@ public:
    * calling the method. */
   virtual OutputType EvaluateAtContinuousIndex(const ContinuousIndexType & index ) const ITK_OVERRIDE;
 
+  /** Evaluate the function at n continuous index positions.  The image
+   * buffer and its offset table are only looked up once, e.g. to sample
+   * the tensors along a whole fiber. */
+  virtual void EvaluateAtContinuousIndexBatch(const ContinuousIndexType * indices, OutputType * values,
+                                              unsigned int n) const ITK_OVERRIDE;
+
+  /** Evaluate the function at n physical points. */
+  virtual void EvaluateBatch(const PointType * points, OutputType * values, unsigned int n) const ITK_OVERRIDE;
+
 protected:
   TensorLinearInterpolateImageFunction();
   ~TensorLinearInterpolateImageFunction()
@@ -99,6 +116,14 @@ private:
   TensorLinearInterpolateImageFunction(const Self &); // purposely not implemented
   void operator=(const Self &);                       // purposely not implemented
 
+  /** Trilinear kernel for 3D images */
+  void EvaluateTrilinear(const ContinuousIndexType & index, const PixelType * buffer,
+                         const OffsetValueType * offsetTable, const ImageRegionType & region,
+                         OutputType & output) const;
+
+  /** Generic loop over the 2^N neighbors */
+  OutputType EvaluateNeighborhood(const ContinuousIndexType & index) const;
+
   /** Number of neighbors used in the interpolation */
   static const unsigned long m_Neighbors;
 
@@ -21,6 +21,8 @@
 
 #include "vnl/vnl_math.h"
 
+#include <algorithm>
+
 namespace itk
 {
 
@@ -62,6 +64,171 @@ typename TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
 TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
 ::EvaluateAtContinuousIndex(
   const ContinuousIndexType& index) const
+{
+  if( ImageDimension == 3 )
+    {
+    const InputImageType * image = this->GetInputImage();
+    OutputType             output;
+    this->EvaluateTrilinear(index, image->GetBufferPointer(), image->GetOffsetTable(),
+                            image->GetBufferedRegion(), output);
+    return output;
+    }
+  return this->EvaluateNeighborhood(index);
+}
+
+/**
+ * Evaluate at many continuous index positions
+ */
+template <class TInputImage, class TCoordRep>
+void
+TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::EvaluateAtContinuousIndexBatch(const ContinuousIndexType * indices,
+                                 OutputType * values,
+                                 unsigned int n) const
+{
+  if( ImageDimension != 3 )
+    {
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      values[i] = this->EvaluateNeighborhood(indices[i]);
+      }
+    return;
+    }
+
+  const InputImageType *  image = this->GetInputImage();
+  const PixelType *       buffer = image->GetBufferPointer();
+  const OffsetValueType * offsetTable = image->GetOffsetTable();
+  const ImageRegionType & region = image->GetBufferedRegion();
+  for( unsigned int i = 0; i < n; i++ )
+    {
+    this->EvaluateTrilinear(indices[i], buffer, offsetTable, region, values[i]);
+    }
+}
+
+/**
+ * Evaluate at many physical points
+ */
+template <class TInputImage, class TCoordRep>
+void
+TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::EvaluateBatch(const PointType * points,
+                OutputType * values,
+                unsigned int n) const
+{
+  const InputImageType * image = this->GetInputImage();
+  for( unsigned int i = 0; i < n; i++ )
+    {
+    ContinuousIndexType index;
+    image->TransformPhysicalPointToContinuousIndex(points[i], index);
+    if( ImageDimension == 3 )
+      {
+      this->EvaluateTrilinear(index, image->GetBufferPointer(), image->GetOffsetTable(),
+                              image->GetBufferedRegion(), values[i]);
+      }
+    else
+      {
+      values[i] = this->EvaluateNeighborhood(index);
+      }
+    }
+}
+
+/**
+ * Specialized 3D kernel
+ */
+template <class TInputImage, class TCoordRep>
+void
+TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::EvaluateTrilinear(const ContinuousIndexType & index,
+                    const PixelType * buffer,
+                    const OffsetValueType * offsetTable,
+                    const ImageRegionType & region,
+                    OutputType & output) const
+{
+  /**
+   * Buffer offsets of the lower and upper neighbours along each axis.
+   * The neighbours are clamped to the buffer, so points within half a
+   * voxel of the border are safe to evaluate.
+   */
+  OffsetValueType lowerOffset[3];
+  OffsetValueType upperOffset[3];
+  double          distance[3];
+  for( unsigned int dim = 0; dim < 3; dim++ )
+    {
+    const IndexValueType baseIndex = (IndexValueType) vcl_floor(index[dim] );
+    const IndexValueType last = static_cast<IndexValueType>( region.GetSize(dim) ) - 1;
+    const IndexValueType lower = baseIndex - region.GetIndex(dim);
+
+    distance[dim] = index[dim] - double( baseIndex );
+    lowerOffset[dim] = std::min(std::max(lower, IndexValueType(0) ), last) * offsetTable[dim];
+    upperOffset[dim] = std::min(std::max(lower + 1, IndexValueType(0) ), last) * offsetTable[dim];
+    }
+
+  /**
+   * The 8 corner offsets and weights, with the weights multiplied in
+   * the same order as the generic N-dimensional loop.
+   */
+  OffsetValueType offsets[8];
+  double          weights[8];
+  for( unsigned int counter = 0; counter < 8; counter++ )
+    {
+    double          overlap = 1.0;
+    OffsetValueType offset = 0;
+    for( unsigned int dim = 0; dim < 3; dim++ )
+      {
+      if( counter & (1 << dim) )
+        {
+        offset += upperOffset[dim];
+        overlap *= distance[dim];
+        }
+      else
+        {
+        offset += lowerOffset[dim];
+        overlap *= 1.0 - distance[dim];
+        }
+      }
+    offsets[counter] = offset;
+    weights[counter] = overlap;
+    }
+
+  /**
+   * Blend the tensor components.  The components of a pixel are
+   * contiguous, the fixed length inner loop is vectorized by the
+   * compiler.
+   */
+  RealType sum[Dimension];
+  for( unsigned int k = 0; k < Dimension; k++ )
+    {
+    sum[k] = 0.0;
+    }
+  for( unsigned int counter = 0; counter < 8; counter++ )
+    {
+    // get neighbor value only if overlap is not zero
+    if( weights[counter] == 0.0 )
+      {
+      continue;
+      }
+    const ValueType * input = buffer[offsets[counter]].GetDataPointer();
+    const RealType    weight = weights[counter];
+    for( unsigned int k = 0; k < Dimension; k++ )
+      {
+      sum[k] += weight * static_cast<RealType>( input[k] );
+      }
+    }
+  for( unsigned int k = 0; k < Dimension; k++ )
+    {
+    output[k] = sum[k];
+    }
+}
+
+/**
+ * Generic N-dimensional interpolation
+ */
+template <class TInputImage, class TCoordRep>
+typename TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::OutputType
+TensorLinearInterpolateImageFunction<TInputImage, TCoordRep>
+::EvaluateNeighborhood(
+  const ContinuousIndexType& index) const
 {
   unsigned int dim;  // index over dimension
 
@@ -104,6 +104,47 @@ public:
 
 };
 
+// Packs the principal eigenvector and the fractional anisotropy of a
+// tensor in a 4 component vector, so that both can be computed in one
+// pass and interpolated together.
+template <typename TInput, typename TOutput>
+class TensorPrincipalEigenvectorFAFunction
+{
+public:
+  TensorPrincipalEigenvectorFAFunction()
+  {
+  }
+
+  ~TensorPrincipalEigenvectorFAFunction()
+  {
+  }
+
+  bool operator!=( const TensorPrincipalEigenvectorFAFunction & ) const
+  {
+    return false;
+  }
+
+  bool operator==( const TensorPrincipalEigenvectorFAFunction & other ) const
+  {
+    return !(*this != other);
+  }
+
+  TOutput operator()( const TInput & x ) const
+  {
+    const CovariantVector<double, 3> evec = m_Eigenvector(x);
+
+    TOutput op;
+    op[0] = evec[0];
+    op[1] = evec[1];
+    op[2] = evec[2];
+    op[3] = x.GetFractionalAnisotropy();
+    return op;
+  }
+
+private:
+  TensorPrincipalEigenvectorFunction<TInput, double> m_Eigenvector;
+};
+
 }  // end namespace functor
 
 /** \class TensorPrincipalEigenvectorImageFilter
@@ -19,6 +19,7 @@
 #include <vnl/vnl_det.h>
 #include <vnl/vnl_trace.h>
 #include "TensorGeometry.h"
+#include "itkSymmetricMatrixFunction3x3.h"
 
 template <class T, unsigned int dimension = 3>
 class SymmetricSpaceTensorGeometry : public TensorGeometry<T, dimension>
@@ -56,6 +57,63 @@ private:
 
 };
 
+// Specialization for 3x3 diffusion tensors.  The maps are computed with
+// the symmetric square root of the base point, p^1/2 exp(p^-1/2 v
+// p^-1/2) p^1/2, which is equal to the generic formula.  All the
+// matrices are fixed size arrays on the stack and the eigen
+// decompositions use the Jacobi solver of itkSymmetricMatrixFunction3x3,
+// so no call allocates memory.  The batch maps compute the roots of the
+// base point once for the whole array.
+template <class T>
+class SymmetricSpaceTensorGeometry<T, 3> : public TensorGeometry<T, 3>
+{
+public:
+  typedef TensorGeometry<T, 3>             SuperClass;
+  typedef typename SuperClass::TensorType  TensorType;
+  typedef typename SuperClass::TangentType TangentType;
+
+  typedef itk::Matrix<T, 3> MatrixType;
+
+  SymmetricSpaceTensorGeometry()
+  {
+  }
+
+  virtual T InnerProduct(const TensorType & base, const TangentType & v, const TangentType & w);
+
+  virtual TensorType ExpMap(const TensorType & base, const TangentType & v);
+
+  virtual TangentType LogMap(const TensorType & base, const TensorType & p);
+
+  virtual T Distance(const TensorType & a, const TensorType & b);
+
+  virtual void ExpMapBatch(const TensorType & base, const TangentType * v, TensorType * result, unsigned int n);
+
+  virtual void LogMapBatch(const TensorType & base, const TensorType * p, TangentType * result, unsigned int n);
+
+  virtual void DistanceBatch(const TensorType & base, const TensorType * p, T * result, unsigned int n);
+
+  TensorType GroupAction(const TensorType & p, const MatrixType & g);
+
+private:
+  // Square root and inverse square root of base.  Returns false if base
+  // is not positive definite.
+  static bool ComputeRoots(const TensorType & base, T root[6], T rootInv[6]);
+
+  // Frobenius norm of the logarithm of the whitened tensor
+  static T WhitenedDistance(const T rootInv[6], const TensorType & p);
+
+  static T Log(T x)
+  {
+    return std::log(x);
+  }
+
+  static T Exp(T x)
+  {
+    return std::exp(x);
+  }
+
+};
+
 #include "SymmetricSpaceTensorGeometry.txx"
 
 #endif
@@ -20,8 +20,8 @@ SymmetricSpaceTensorGeometry<T, dimension>
     {
     if( eigenValues[i] <= 0.0 )
       {
-      return 0; // Need to add error handling here!!
-
+      this->AddFallbacks(1);
+      return 0;
       }
     diag[i][i] = sqrt(eigenValues[i]);
     diagInv[i][i] = (1.0 / diag[i][i]);
@@ -63,8 +63,8 @@ SymmetricSpaceTensorGeometry<T, dimension>
     {
     if( eigenValues[i] <= 0.0 )
       {
-      return tensor; // Need to add error handling here!!
-
+      this->AddFallbacks(1);
+      return TensorType(0.0);
       }
     diag[i][i] = sqrt(eigenValues[i]);
     diagInv[i][i] = 1.0 / diag[i][i];
@@ -114,8 +114,8 @@ SymmetricSpaceTensorGeometry<T, dimension>
     {
     if( eigenValues[i] <= 0.0 )
       {
-      return tensor; // Need to add error handling here!!
-
+      this->AddFallbacks(1);
+      return TensorType(0.0);
       }
     diag[i][i] = sqrt(eigenValues[i]);
     diagInv[i][i] = 1.0 / diag[i][i];
@@ -224,3 +224,269 @@ SymmetricSpaceTensorGeometry<T, dimension>
       }
     }
 }
+
+// Specialization for 3x3 tensors
+
+template <class T>
+bool
+SymmetricSpaceTensorGeometry<T, 3>
+::ComputeRoots(const TensorType & base, T root[6], T rootInv[6])
+{
+  T            matrix[6];
+  T            eigenValues[3];
+  T            eigenVectors[3][3];
+  T            sqrtValues[3];
+  T            invSqrtValues[3];
+  unsigned int i, j, k;
+
+  for( i = 0; i < 6; i++ )
+    {
+    matrix[i] = base[i];
+    }
+  itk::ComputeSymmetricEigenSystem3x3(matrix, eigenValues, eigenVectors);
+  for( i = 0; i < 3; i++ )
+    {
+    if( eigenValues[i] <= 0.0 )
+      {
+      return false;
+      }
+    sqrtValues[i] = sqrt(eigenValues[i]);
+    invSqrtValues[i] = 1.0 / sqrtValues[i];
+    }
+
+  k = 0;
+  for( i = 0; i < 3; i++ )
+    {
+    for( j = i; j < 3; j++, k++ )
+      {
+      root[k] = eigenVectors[i][0] * sqrtValues[0] * eigenVectors[j][0]
+        + eigenVectors[i][1] * sqrtValues[1] * eigenVectors[j][1]
+        + eigenVectors[i][2] * sqrtValues[2] * eigenVectors[j][2];
+      rootInv[k] = eigenVectors[i][0] * invSqrtValues[0] * eigenVectors[j][0]
+        + eigenVectors[i][1] * invSqrtValues[1] * eigenVectors[j][1]
+        + eigenVectors[i][2] * invSqrtValues[2] * eigenVectors[j][2];
+      }
+    }
+  return true;
+}
+
+template <class T>
+T
+SymmetricSpaceTensorGeometry<T, 3>
+::InnerProduct(const TensorType & base, const TangentType & v,
+               const TangentType & w)
+{
+  T            root[6], rootInv[6];
+  T            vMatrix[6], wMatrix[6];
+  T            vWhite[6], wWhite[6];
+  unsigned int i;
+
+  if( !ComputeRoots(base, root, rootInv) )
+    {
+    this->AddFallbacks(1);
+    return 0;
+    }
+  for( i = 0; i < 6; i++ )
+    {
+    vMatrix[i] = v[i];
+    wMatrix[i] = w[i];
+    }
+
+  // tr(p^-1 v p^-1 w) is the Frobenius product of the whitened vectors
+  itk::SymmetricMatrixCongruence3x3(rootInv, vMatrix, vWhite);
+  itk::SymmetricMatrixCongruence3x3(rootInv, wMatrix, wWhite);
+
+  return vWhite[0] * wWhite[0] + vWhite[3] * wWhite[3] + vWhite[5] * wWhite[5]
+         + 2.0 * (vWhite[1] * wWhite[1] + vWhite[2] * wWhite[2] + vWhite[4] * wWhite[4]);
+}
+
+template <class T>
+typename SymmetricSpaceTensorGeometry<T, 3>::TensorType
+SymmetricSpaceTensorGeometry<T, 3>
+::ExpMap(const TensorType & base, const TangentType & v)
+{
+  TensorType tensor;
+
+  ExpMapBatch(base, &v, &tensor, 1);
+  return tensor;
+}
+
+template <class T>
+typename SymmetricSpaceTensorGeometry<T, 3>::TangentType
+SymmetricSpaceTensorGeometry<T, 3>
+::LogMap(const TensorType & base, const TensorType & p)
+{
+  TangentType tangent;
+
+  LogMapBatch(base, &p, &tangent, 1);
+  return tangent;
+}
+
+template <class T>
+T
+SymmetricSpaceTensorGeometry<T, 3>
+::Distance(const TensorType & a, const TensorType & b)
+{
+  T distance;
+
+  DistanceBatch(a, &b, &distance, 1);
+  return distance;
+}
+
+template <class T>
+void
+SymmetricSpaceTensorGeometry<T, 3>
+::ExpMapBatch(const TensorType & base, const TangentType * v,
+              TensorType * result, unsigned int n)
+{
+  T            root[6], rootInv[6];
+  T            vMatrix[6], y[6], expY[6], tensor[6];
+  unsigned int i, j;
+
+  if( !ComputeRoots(base, root, rootInv) )
+    {
+    for( i = 0; i < n; i++ )
+      {
+      result[i] = TensorType(0.0);
+      }
+    this->AddFallbacks(n);
+    return;
+    }
+  for( i = 0; i < n; i++ )
+    {
+    for( j = 0; j < 6; j++ )
+      {
+      vMatrix[j] = v[i][j];
+      }
+    itk::SymmetricMatrixCongruence3x3(rootInv, vMatrix, y);
+    itk::ApplySymmetricMatrixFunction3x3(y, expY, &SymmetricSpaceTensorGeometry::Exp);
+    itk::SymmetricMatrixCongruence3x3(root, expY, tensor);
+    for( j = 0; j < 6; j++ )
+      {
+      result[i][j] = tensor[j];
+      }
+    }
+}
+
+template <class T>
+void
+SymmetricSpaceTensorGeometry<T, 3>
+::LogMapBatch(const TensorType & base, const TensorType * p,
+              TangentType * result, unsigned int n)
+{
+  T            root[6], rootInv[6];
+  T            pMatrix[6], y[6], logY[6], tangent[6];
+  unsigned int i, j;
+
+  if( !ComputeRoots(base, root, rootInv) )
+    {
+    for( i = 0; i < n; i++ )
+      {
+      result[i] = TangentType(0.0);
+      }
+    this->AddFallbacks(n);
+    return;
+    }
+  for( i = 0; i < n; i++ )
+    {
+    for( j = 0; j < 6; j++ )
+      {
+      pMatrix[j] = p[i][j];
+      }
+    itk::SymmetricMatrixCongruence3x3(rootInv, pMatrix, y);
+    itk::ApplySymmetricMatrixFunction3x3(y, logY, &SymmetricSpaceTensorGeometry::Log);
+    itk::SymmetricMatrixCongruence3x3(root, logY, tangent);
+    for( j = 0; j < 6; j++ )
+      {
+      result[i][j] = tangent[j];
+      }
+    }
+}
+
+template <class T>
+T
+SymmetricSpaceTensorGeometry<T, 3>
+::WhitenedDistance(const T rootInv[6], const TensorType & p)
+{
+  T            pMatrix[6], y[6];
+  T            eigenValues[3];
+  T            eigenVectors[3][3];
+  T            distance = 0.0;
+  unsigned int i;
+
+  for( i = 0; i < 6; i++ )
+    {
+    pMatrix[i] = p[i];
+    }
+  itk::SymmetricMatrixCongruence3x3(rootInv, pMatrix, y);
+  itk::ComputeSymmetricEigenSystem3x3(y, eigenValues, eigenVectors);
+  for( i = 0; i < 3; i++ )
+    {
+    const T logValue = log(eigenValues[i]);
+    distance += logValue * logValue;
+    }
+  return sqrt(distance);
+}
+
+template <class T>
+void
+SymmetricSpaceTensorGeometry<T, 3>
+::DistanceBatch(const TensorType & base, const TensorType * p,
+                T * result, unsigned int n)
+{
+  T            root[6], rootInv[6];
+  unsigned int i;
+
+  if( !ComputeRoots(base, root, rootInv) )
+    {
+    for( i = 0; i < n; i++ )
+      {
+      result[i] = 0;
+      }
+    this->AddFallbacks(n);
+    return;
+    }
+  for( i = 0; i < n; i++ )
+    {
+    result[i] = WhitenedDistance(rootInv, p[i]);
+    }
+}
+
+template <class T>
+typename SymmetricSpaceTensorGeometry<T, 3>::TensorType
+SymmetricSpaceTensorGeometry<T, 3>
+::GroupAction(const TensorType & p, const MatrixType & g)
+{
+  T            pMatrix[3][3];
+  T            gp[3][3];
+  TensorType   resultTensor;
+  unsigned int i, j, k;
+
+  k = 0;
+  for( i = 0; i < 3; i++ )
+    {
+    for( j = i; j < 3; j++, k++ )
+      {
+      pMatrix[i][j] = p[k];
+      pMatrix[j][i] = p[k];
+      }
+    }
+  for( i = 0; i < 3; i++ )
+    {
+    for( j = 0; j < 3; j++ )
+      {
+      gp[i][j] = g(i, 0) * pMatrix[0][j] + g(i, 1) * pMatrix[1][j] + g(i, 2) * pMatrix[2][j];
+      }
+    }
+
+  // g p g^T is symmetric, only the upper triangle is computed
+  k = 0;
+  for( i = 0; i < 3; i++ )
+    {
+    for( j = i; j < 3; j++, k++ )
+      {
+      resultTensor[k] = gp[i][0] * g(j, 0) + gp[i][1] * g(j, 1) + gp[i][2] * g(j, 2);
+      }
+    }
+  return resultTensor;
+}
@@ -25,7 +25,7 @@ public:
   typedef itk::DiffusionTensor3D<T> TensorType;
   typedef itk::DiffusionTensor3D<T> TangentType;
 
-  TensorGeometry()
+  TensorGeometry() : numberOfFallbacks(0)
   {
   }
 
@@ -47,6 +47,37 @@ public:
   // Geodesic distance between tensors a and b.
   virtual T Distance(const TensorType & a, const TensorType & b);
 
+  // Batch versions of the maps from a single base point, applied to
+  // arrays of n tangent vectors or tensors.  Geometries may override
+  // them to do the work that only depends on the base point once.
+  virtual void ExpMapBatch(const TensorType & base, const TangentType * v, TensorType * result, unsigned int n);
+
+  virtual void LogMapBatch(const TensorType & base, const TensorType * p, TangentType * result, unsigned int n);
+
+  virtual void DistanceBatch(const TensorType & base, const TensorType * p, T * result, unsigned int n);
+
+  // Number of results set to zero since the last reset because the base
+  // point was not positive definite.  A geometry must not be shared by
+  // several threads.
+  unsigned long GetNumberOfFallbacks() const
+  {
+    return numberOfFallbacks;
+  }
+
+  void ResetNumberOfFallbacks()
+  {
+    numberOfFallbacks = 0;
+  }
+
+protected:
+  void AddFallbacks(unsigned long n)
+  {
+    numberOfFallbacks += n;
+  }
+
+private:
+  unsigned long numberOfFallbacks;
+
 };
 
 template <class T, unsigned int dimension>
@@ -70,4 +101,40 @@ T TensorGeometry<T, dimension>::Distance(const TensorType & a,
   return Norm(a, LogMap(a, b) );
 }
 
+template <class T, unsigned int dimension>
+void TensorGeometry<T, dimension>::ExpMapBatch(const TensorType & base,
+                                               const TangentType * v,
+                                               TensorType * result,
+                                               unsigned int n)
+{
+  for( unsigned int i = 0; i < n; i++ )
+    {
+    result[i] = ExpMap(base, v[i]);
+    }
+}
+
+template <class T, unsigned int dimension>
+void TensorGeometry<T, dimension>::LogMapBatch(const TensorType & base,
+                                               const TensorType * p,
+                                               TangentType * result,
+                                               unsigned int n)
+{
+  for( unsigned int i = 0; i < n; i++ )
+    {
+    result[i] = LogMap(base, p[i]);
+    }
+}
+
+template <class T, unsigned int dimension>
+void TensorGeometry<T, dimension>::DistanceBatch(const TensorType & base,
+                                                 const TensorType * p,
+                                                 T * result,
+                                                 unsigned int n)
+{
+  for( unsigned int i = 0; i < n; i++ )
+    {
+    result[i] = Distance(base, p[i]);
+    }
+}
+
 #endif
@@ -20,6 +20,7 @@
 #ifndef __TensorStatistics_h
 #define __TensorStatistics_h
 
+#include <vector>
 #include <itkVectorContainer.h>
 #include "TensorGeometry.h"
 #include <itkDiffusionTensor3D.h>
@@ -41,8 +42,13 @@ public:
   typedef typename CovarianceType::EigenValuesArrayType   PGAVariancesArrayType;
   typedef typename CovarianceType::EigenVectorsMatrixType PGAVectorsMatrixType;
 
+  // The log maps of each iteration are computed with a single batch
+  // call of the geometry.  Tensors that are not positive definite make
+  // the maps return zero; GetNumberOfFallbacks() of the geometry counts
+  // them.
   TensorStatistics(TensorGeometry<T, dimension> * _tensGeometry,
                    const T & _stepSize = 1.0)
+    : EPSILON(1.0e-12)
   {
     tensGeometry = _tensGeometry;
     stepSize = _stepSize;
@@ -64,10 +70,16 @@ public:
   TensorType RandomGaussianTensor(const TensorType & mean, T variance) const;
 
 private:
+  // Sum of the log maps of the tensors at base, weighted if weightList
+  // is set.  The tensor list must not be empty; logs holds one tangent
+  // per tensor and is overwritten.
+  TangentType SumLogMaps(const TensorType & base, const TensorListPointerType tensorList,
+                         const ScalarListPointerType weightList, std::vector<TangentType> & logs) const;
+
   TensorGeometry<T, dimension> * tensGeometry;
   T                              stepSize;
 
-  static const T EPSILON = 1.0e-12;
+  const T EPSILON;
 };
 
 #include "TensorStatistics.txx"
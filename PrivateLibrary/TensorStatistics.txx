@@ -1,12 +1,36 @@
 // -*- Mode: C++ -*-
 
+template <class T, unsigned int dimension>
+typename TensorStatistics<T, dimension>::TangentType
+TensorStatistics<T, dimension>
+::SumLogMaps(const TensorType & base, const TensorListPointerType tensorList,
+             const ScalarListPointerType weightList, std::vector<TangentType> & logs) const
+{
+  TangentType sum(0.0);
+
+  tensGeometry->LogMapBatch(base, &tensorList->ElementAt(0), &logs[0], tensorList->Size() );
+  for( unsigned int i = 0; i < tensorList->Size(); i++ )
+    {
+    if( weightList )
+      {
+      sum += weightList->ElementAt(i) * logs[i];
+      }
+    else
+      {
+      sum += logs[i];
+      }
+    }
+  return sum;
+}
+
 template <class T, unsigned int dimension>
 void
 TensorStatistics<T, dimension>
 ::ComputeMean(const TensorListPointerType tensorList, TensorType & mean) const
 {
-  TangentType tangent(0.0), initialTangent;
-  T           lastNormSquared, normSquared, initialNormSquared;
+  TangentType tangent(0.0), lastTangent;
+  TensorType  lastMean;
+  T           lastNormSquared, normSquared;
   T           currStepSize = stepSize;
 
   if( tensorList->Size() == 0 )
@@ -14,36 +38,31 @@ TensorStatistics<T, dimension>
     return;
     }
 
+  std::vector<TangentType> logs(tensorList->Size() );
+
   mean = tensorList->ElementAt(0);
-  for( unsigned int i = 0; i < tensorList->Size(); i++ )
-    {
-    tangent += tensGeometry->LogMap(mean, tensorList->ElementAt(i) );
-    }
+  tangent = SumLogMaps(mean, tensorList, ScalarListPointerType(), logs);
 
   tangent = tangent * (1.0 / ( (T) tensorList->Size() ) );
-  initialTangent = tangent;
 
-  initialNormSquared = tensGeometry->NormSquared(mean, tangent);
-  lastNormSquared = initialNormSquared;
-  while( lastNormSquared >= EPSILON )
+  lastNormSquared = tensGeometry->NormSquared(mean, tangent);
+  while( lastNormSquared >= EPSILON && currStepSize >= EPSILON )
     {
+    lastMean = mean;
+    lastTangent = tangent;
     mean = tensGeometry->ExpMap(mean, tangent * currStepSize);
 
-    tangent.Fill(0.0);
-    for( unsigned int i = 0; i < tensorList->Size(); i++ )
-      {
-      tangent += tensGeometry->LogMap(mean, tensorList->ElementAt(i) );
-      }
+    tangent = SumLogMaps(mean, tensorList, ScalarListPointerType(), logs);
 
     tangent = tangent * (1.0 / ( (T) tensorList->Size() ) );
 
     normSquared = tensGeometry->NormSquared(mean, tangent);
     if( normSquared >= lastNormSquared )
       {
+      // Retry from the last accepted mean with a shorter step
       currStepSize *= 0.5;
-      mean = tensorList->ElementAt(0);
-      lastNormSquared = initialNormSquared;
-      tangent = initialTangent;
+      mean = lastMean;
+      tangent = lastTangent;
       }
     else
       {
@@ -59,8 +78,9 @@ TensorStatistics<T, dimension>
                      const TensorListPointerType tensorList,
                      TensorType & weightedAve) const
 {
-  TangentType tangent(0.0), initialTangent;
-  T           lastNormSquared, normSquared, initialNormSquared;
+  TangentType tangent(0.0), lastTangent;
+  TensorType  lastAve;
+  T           lastNormSquared, normSquared;
   T           currStepSize = stepSize;
 
   if( tensorList->Size() == 0 ||
@@ -69,35 +89,27 @@ TensorStatistics<T, dimension>
     return;
     }
 
-  weightedAve = tensorList->ElementAt(0);
-  for( unsigned int i = 0; i < tensorList->Size(); i++ )
-    {
-    tangent += weightList->ElementAt(i)
-      * tensGeometry->LogMap(weightedAve, tensorList->ElementAt(i) );
-    }
+  std::vector<TangentType> logs(tensorList->Size() );
 
-  initialTangent = tangent;
+  weightedAve = tensorList->ElementAt(0);
+  tangent = SumLogMaps(weightedAve, tensorList, weightList, logs);
 
-  initialNormSquared = tensGeometry->NormSquared(weightedAve, tangent);
-  lastNormSquared = initialNormSquared;
-  while( lastNormSquared >= EPSILON )
+  lastNormSquared = tensGeometry->NormSquared(weightedAve, tangent);
+  while( lastNormSquared >= EPSILON && currStepSize >= EPSILON )
     {
+    lastAve = weightedAve;
+    lastTangent = tangent;
     weightedAve = tensGeometry->ExpMap(weightedAve, tangent * currStepSize);
 
-    tangent.Fill(0.0);
-    for( unsigned int i = 0; i < tensorList->Size(); i++ )
-      {
-      tangent += weightList->ElementAt(i)
-        * tensGeometry->LogMap(weightedAve, tensorList->ElementAt(i) );
-      }
+    tangent = SumLogMaps(weightedAve, tensorList, weightList, logs);
 
     normSquared = tensGeometry->NormSquared(weightedAve, tangent);
     if( normSquared >= lastNormSquared )
       {
+      // Retry from the last accepted average with a shorter step
       currStepSize *= 0.5;
-      weightedAve = tensorList->ElementAt(0);
-      lastNormSquared = initialNormSquared;
-      tangent = initialTangent;
+      weightedAve = lastAve;
+      tangent = lastTangent;
       }
     else
       {
@@ -113,15 +125,20 @@ TensorStatistics<T, dimension>
                            TensorType & mean,
                            CovarianceType & covariance) const
 {
-  const int    size = dimension * (dimension + 1) / 2;
-  TensorType   logTens;
-  unsigned int i, j, k, index;
+  const int                size = dimension * (dimension + 1) / 2;
+  std::vector<TangentType> logs(tensorList->Size() );
+  unsigned int             i, j, k, index;
 
   ComputeMean(tensorList, mean);
   covariance.Fill(0.0);
+  if( tensorList->Size() == 0 )
+    {
+    return;
+    }
+  tensGeometry->LogMapBatch(mean, &tensorList->ElementAt(0), &logs[0], tensorList->Size() );
   for( i = 0; i < tensorList->Size(); i++ )
     {
-    logTens = tensGeometry->LogMap(mean, tensorList->ElementAt(i) );
+    const TangentType & logTens = logs[i];
 
     index = 0;
     for( j = 0; j < size; j++ )
@@ -0,0 +1,28 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+#include "accumulatorstate.h"
+#include "tensorio.h"
+
+const char* const ACCUMULATOR_STATE_KEY = "DTIProcess_AccumulatorState";
+const char* const ACCUMULATOR_COUNT_KEY = "DTIProcess_AccumulatorCount";
+
+void copyAccumulatorMetaData(const itk::MetaDataDictionary & from, itk::MetaDataDictionary & to)
+{
+  for( itk::MetaDataDictionary::ConstIterator it = from.Begin(); it != from.End(); ++it )
+    {
+    if( it->first != ACCUMULATOR_STATE_KEY && it->first != ACCUMULATOR_COUNT_KEY
+        && it->first != LOGEUCLIDEAN_KEY )
+      {
+      to[it->first] = it->second;
+      }
+    }
+}
@@ -0,0 +1,47 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef ACCUMULATORSTATE_H
+#define ACCUMULATORSTATE_H
+
+#include <string>
+#include <itkMetaDataDictionary.h>
+#include <itkSmartPointer.h>
+
+// Partial averages (running sums and the number of subjects they
+// hold) are saved as double precision vector images.  The header
+// records the kind of state and the count, so that a state can be
+// resumed or merged with states computed elsewhere.
+extern const char* const ACCUMULATOR_STATE_KEY;
+extern const char* const ACCUMULATOR_COUNT_KEY;
+
+// Copies the entries of from to to, except the state and count keys
+// and the Log-Euclidean file key: a state is not a Log-Euclidean
+// tensor file even if its inputs were, and the images derived from a
+// state are not states.
+void copyAccumulatorMetaData(const itk::MetaDataDictionary & from, itk::MetaDataDictionary & to);
+
+// Writes state with the kind of state and the count in its header.
+// The state image itself is not modified: it is written from an image
+// sharing its buffer.
+template <typename TImage>
+void writeAccumulatorState(const std::string & filename, itk::SmartPointer<TImage> state,
+                           const std::string & type, unsigned int count);
+
+// Reads a state written by writeAccumulatorState.  Throws if the file
+// does not hold a state of the given type.  The state and count keys
+// are removed from the dictionary of the image returned.
+template <typename TImage>
+itk::SmartPointer<TImage> readAccumulatorState(const std::string & filename,
+                                               const std::string & type, unsigned int & count);
+
+#include "accumulatorstate.txx"
+
+#endif
@@ -0,0 +1,76 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+#include "accumulatorstate.h"
+
+#include <sstream>
+
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkMetaDataObject.h>
+
+template <typename TImage>
+void writeAccumulatorState(const std::string & filename, itk::SmartPointer<TImage> state,
+                           const std::string & type, unsigned int count)
+{
+  std::ostringstream oss;
+
+  oss << count;
+
+  itk::MetaDataDictionary dict;
+  copyAccumulatorMetaData(state->GetMetaDataDictionary(), dict);
+  itk::EncapsulateMetaData<std::string>(dict, ACCUMULATOR_STATE_KEY, type);
+  itk::EncapsulateMetaData<std::string>(dict, ACCUMULATOR_COUNT_KEY, oss.str() );
+
+  typename TImage::Pointer copy = TImage::New();
+  copy->Graft(state);
+  copy->SetMetaDataDictionary(dict);
+
+  typedef itk::ImageFileWriter<TImage> ImageWriterType;
+  typename ImageWriterType::Pointer writer = ImageWriterType::New();
+  writer->SetUseCompression(true);
+  writer->SetInput(copy);
+  writer->SetFileName(filename.c_str() );
+  writer->Update();
+}
+
+template <typename TImage>
+itk::SmartPointer<TImage> readAccumulatorState(const std::string & filename,
+                                               const std::string & type, unsigned int & count)
+{
+  typedef itk::ImageFileReader<TImage> ImageReaderType;
+  typename ImageReaderType::Pointer reader = ImageReaderType::New();
+  reader->SetFileName(filename.c_str() );
+  reader->Update();
+
+  itk::SmartPointer<TImage>       state = reader->GetOutput();
+  const itk::MetaDataDictionary & dict = state->GetMetaDataDictionary();
+  std::string                     value;
+  if( !itk::ExposeMetaData<std::string>(dict, ACCUMULATOR_STATE_KEY, value) || value != type )
+    {
+    throw itk::ExceptionObject( ("Not a " + type + " state file: " + filename).c_str() );
+    }
+  if( !itk::ExposeMetaData<std::string>(dict, ACCUMULATOR_COUNT_KEY, value) )
+    {
+    throw itk::ExceptionObject( ("Missing subject count in state file: " + filename).c_str() );
+    }
+  std::istringstream iss(value);
+  if( !(iss >> count) )
+    {
+    throw itk::ExceptionObject( ("Invalid subject count in state file: " + filename).c_str() );
+    }
+  state->DisconnectPipeline();
+
+  itk::MetaDataDictionary clean;
+  copyAccumulatorMetaData(dict, clean);
+  state->SetMetaDataDictionary(clean);
+  return state;
+}
@@ -30,6 +30,12 @@ typedef itk::CovariantVector<double, 3> GradientPixelType;
 
 typedef itk::VectorImage<ScalarPixelType, DIM> VectorImageType;
 typedef itk::Image<TensorPixelType, DIM>       TensorImageType;
+typedef itk::Image<itk::DiffusionTensor3D<float>, DIM> TensorFloatImageType;
+
+// Log-Euclidean tensors: unique elements of the matrix logarithm with
+// the off-diagonal terms scaled by sqrt(2)
+typedef itk::Vector<double, 6>             LogTensorPixelType;
+typedef itk::Image<LogTensorPixelType, DIM> LogTensorImageType;
 
 typedef itk::Image<DeformationPixelType, DIM> DeformationImageType;
 typedef itk::Image<GradientPixelType, DIM>    GradientImageType;
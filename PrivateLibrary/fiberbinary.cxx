@@ -0,0 +1,540 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <itkByteSwapper.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fiberbinary.h"
+
+// hide function to this compilation unit
+namespace
+{
+const char         Magic[8] = { 'D', 'T', 'I', 'F', 'I', 'B', 'E', 'R' };
+const itk::uint32_t Version = 1;
+const std::size_t   HeaderSize = 80;
+const std::size_t   NameSize = 64;
+
+itk::uint64_t Align8(itk::uint64_t n)
+{
+  return (n + 7) & ~itk::uint64_t(7);
+}
+
+template <class T>
+void WriteLittleEndian(std::ofstream & file, const T * values, std::size_t n)
+{
+  if( !itk::ByteSwapper<T>::SystemIsBigEndian() )
+    {
+    file.write(reinterpret_cast<const char *>( values ), n * sizeof(T) );
+    return;
+    }
+
+  T buffer[4096];
+  while( n > 0 )
+    {
+    const std::size_t m = std::min(n, sizeof(buffer) / sizeof(T) );
+    std::copy(values, values + m, buffer);
+    itk::ByteSwapper<T>::SwapRangeFromSystemToLittleEndian(buffer, m);
+    file.write(reinterpret_cast<const char *>( buffer ), m * sizeof(T) );
+    values += m;
+    n -= m;
+    }
+}
+
+template <class T>
+void WriteLittleEndian(std::ofstream & file, const std::vector<T> & values)
+{
+  if( !values.empty() )
+    {
+    WriteLittleEndian(file, &values[0], values.size() );
+    }
+}
+
+// Zeros up to the next 8 byte boundary
+void WritePadding(std::ofstream & file, itk::uint64_t size)
+{
+  const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  file.write(zeros, Align8(size) - size);
+}
+
+// Header and scalar names
+void WriteHeader(std::ofstream & file, itk::uint64_t nfibers, itk::uint64_t npoints, const double * spacing,
+                 const double * origin, const std::vector<std::string> & names)
+{
+  const itk::uint32_t counts[2] = { Version, static_cast<itk::uint32_t>( names.size() ) };
+  const itk::uint64_t sizes[2] = { nfibers, npoints };
+  file.write(Magic, sizeof(Magic) );
+  WriteLittleEndian(file, counts, 2);
+  WriteLittleEndian(file, sizes, 2);
+  WriteLittleEndian(file, spacing, 3);
+  WriteLittleEndian(file, origin, 3);
+
+  for( unsigned int j = 0; j < names.size(); ++j )
+    {
+    if( names[j].size() >= NameSize )
+      {
+      throw itk::ExceptionObject("Scalar name too long for a binary fiber file: " + names[j]);
+      }
+    char name[NameSize];
+    std::fill(name, name + NameSize, 0);
+    std::copy(names[j].begin(), names[j].end(), name);
+    file.write(name, NameSize);
+    }
+}
+
+template <class T>
+void SpillLittleEndian(std::FILE * file, const T * values, std::size_t n)
+{
+  T buffer[4096];
+  while( n > 0 )
+    {
+    const std::size_t m = std::min(n, sizeof(buffer) / sizeof(T) );
+    std::copy(values, values + m, buffer);
+    itk::ByteSwapper<T>::SwapRangeFromSystemToLittleEndian(buffer, m);
+    if( std::fwrite(buffer, sizeof(T), m, file) != m )
+      {
+      throw itk::ExceptionObject("Cannot write temporary fiber data");
+      }
+    values += m;
+    n -= m;
+    }
+}
+
+void AppendFile(std::FILE * from, std::ofstream & to)
+{
+  char        buffer[65536];
+  std::size_t n;
+
+  std::rewind(from);
+  while( (n = std::fread(buffer, 1, sizeof(buffer), from) ) > 0 )
+    {
+    to.write(buffer, n);
+    }
+}
+
+template <class T>
+T ReadLittleEndian(const char * data)
+{
+  T value;
+  std::memcpy(&value, data, sizeof(T) );
+  itk::ByteSwapper<T>::SwapFromSystemToLittleEndian(&value);
+  return value;
+}
+
+};
+
+void writeFiberBinaryFile(const std::string & filename, const FiberBundle & bundle)
+{
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+  if( !file )
+    {
+    throw itk::ExceptionObject("Cannot open fiber file for writing");
+    }
+
+  const FiberBundle::ScalarMapType & scalars = bundle.GetScalars();
+  std::vector<std::string>           names;
+  for( FiberBundle::ScalarMapType::const_iterator it = scalars.begin(); it != scalars.end(); ++it )
+    {
+    names.push_back(it->first);
+    }
+  WriteHeader(file, bundle.GetNumberOfFibers(), bundle.GetNumberOfPoints(), bundle.GetSpacing(),
+              bundle.GetOrigin(), names);
+
+  const std::vector<unsigned long> & offsets = bundle.GetFiberOffsets();
+  WriteLittleEndian(file, std::vector<itk::uint64_t>(offsets.begin(), offsets.end() ) );
+
+  const itk::uint64_t npoints = bundle.GetNumberOfPoints();
+  WriteLittleEndian(file, bundle.GetPositions() );
+  WritePadding(file, 3 * sizeof(float) * npoints);
+  WriteLittleEndian(file, bundle.GetTensors() );
+  WritePadding(file, 6 * sizeof(float) * npoints);
+  for( FiberBundle::ScalarMapType::const_iterator it = scalars.begin(); it != scalars.end(); ++it )
+    {
+    WriteLittleEndian(file, it->second);
+    WritePadding(file, sizeof(float) * npoints);
+    }
+
+  if( !file )
+    {
+    throw itk::ExceptionObject("Cannot write fiber file");
+    }
+}
+
+FiberBinaryFileWriter::FiberBinaryFileWriter()
+  : m_Started(false), m_NumberOfFibers(0), m_NumberOfPoints(0)
+{
+}
+
+FiberBinaryFileWriter::~FiberBinaryFileWriter()
+{
+  this->CloseSpillFiles();
+}
+
+void FiberBinaryFileWriter::CloseSpillFiles()
+{
+  for( unsigned int i = 0; i < m_Spill.size(); ++i )
+    {
+    std::fclose(m_Spill[i]);
+    }
+  m_Spill.clear();
+}
+
+void FiberBinaryFileWriter::Open(const std::string & filename)
+{
+  this->CloseSpillFiles();
+  m_FileName = filename;
+  m_Started = false;
+  m_ScalarNames.clear();
+  m_NumberOfFibers = 0;
+  m_NumberOfPoints = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Spacing[i] = 1.0;
+    m_Origin[i] = 0.0;
+    }
+}
+
+void FiberBinaryFileWriter::WriteFibers(const FiberBundle & fibers)
+{
+  if( !m_Started )
+    {
+    std::copy(fibers.GetSpacing(), fibers.GetSpacing() + 3, m_Spacing);
+    std::copy(fibers.GetOrigin(), fibers.GetOrigin() + 3, m_Origin);
+    for( FiberBundle::ScalarMapType::const_iterator it = fibers.GetScalars().begin();
+         it != fibers.GetScalars().end(); ++it )
+      {
+      m_ScalarNames.push_back(it->first);
+      }
+    for( unsigned int i = 0; i < 3 + m_ScalarNames.size(); ++i )
+      {
+      // Removed automatically when closed
+      std::FILE * spill = std::tmpfile();
+      if( !spill )
+        {
+        this->CloseSpillFiles();
+        throw itk::ExceptionObject("Cannot create temporary fiber data file");
+        }
+      m_Spill.push_back(spill);
+      }
+    m_Started = true;
+    }
+
+  const unsigned long npoints = fibers.GetNumberOfPoints();
+  for( unsigned long f = 0; f < fibers.GetNumberOfFibers(); ++f )
+    {
+    const itk::uint64_t end = m_NumberOfPoints + fibers.GetFiberEnd(f);
+    SpillLittleEndian(m_Spill[0], &end, 1);
+    }
+
+  if( std::equal(m_Spacing, m_Spacing + 3, fibers.GetSpacing() )
+      && std::equal(m_Origin, m_Origin + 3, fibers.GetOrigin() ) )
+    {
+    SpillLittleEndian(m_Spill[1], fibers.GetPositions().empty() ? ITK_NULLPTR : &fibers.GetPositions()[0],
+                      3 * npoints);
+    }
+  else
+    {
+    for( unsigned long i = 0; i < npoints; ++i )
+      {
+      double world[3];
+      float  position[3];
+      fibers.GetWorldPosition(i, world);
+      for( unsigned int j = 0; j < 3; ++j )
+        {
+        position[j] = static_cast<float>( (world[j] - m_Origin[j]) / m_Spacing[j]);
+        }
+      SpillLittleEndian(m_Spill[1], position, 3);
+      }
+    }
+  SpillLittleEndian(m_Spill[2], fibers.GetTensors().empty() ? ITK_NULLPTR : &fibers.GetTensors()[0], 6 * npoints);
+
+  for( unsigned int j = 0; j < m_ScalarNames.size(); ++j )
+    {
+    if( fibers.HasScalar(m_ScalarNames[j]) && npoints > 0 )
+      {
+      SpillLittleEndian(m_Spill[3 + j], &fibers.GetScalar(m_ScalarNames[j])[0], npoints);
+      }
+    else
+      {
+      const std::vector<float> zeros(npoints, 0.0f);
+      SpillLittleEndian(m_Spill[3 + j], zeros.empty() ? ITK_NULLPTR : &zeros[0], npoints);
+      }
+    }
+
+  m_NumberOfFibers += fibers.GetNumberOfFibers();
+  m_NumberOfPoints += npoints;
+}
+
+void FiberBinaryFileWriter::Close()
+{
+  std::ofstream file(m_FileName.c_str(), std::ios::out | std::ios::binary);
+  if( !file )
+    {
+    this->CloseSpillFiles();
+    throw itk::ExceptionObject("Cannot open fiber file for writing");
+    }
+
+  WriteHeader(file, m_NumberOfFibers, m_NumberOfPoints, m_Spacing, m_Origin, m_ScalarNames);
+  const itk::uint64_t zero = 0;
+  WriteLittleEndian(file, &zero, 1);
+  if( m_Started )
+    {
+    AppendFile(m_Spill[0], file);
+    AppendFile(m_Spill[1], file);
+    WritePadding(file, 3 * sizeof(float) * m_NumberOfPoints);
+    AppendFile(m_Spill[2], file);
+    WritePadding(file, 6 * sizeof(float) * m_NumberOfPoints);
+    for( unsigned int j = 0; j < m_ScalarNames.size(); ++j )
+      {
+      AppendFile(m_Spill[3 + j], file);
+      WritePadding(file, sizeof(float) * m_NumberOfPoints);
+      }
+    }
+  this->CloseSpillFiles();
+  m_Started = false;
+
+  if( !file )
+    {
+    throw itk::ExceptionObject("Cannot write fiber file");
+    }
+}
+
+FiberBinaryFile::FiberBinaryFile()
+  : m_Data(ITK_NULLPTR), m_Size(0), m_Mapped(false)
+{
+  this->Close();
+}
+
+FiberBinaryFile::~FiberBinaryFile()
+{
+  this->Close();
+}
+
+void FiberBinaryFile::Close()
+{
+#ifndef _WIN32
+  if( m_Mapped )
+    {
+    munmap(const_cast<char *>( m_Data ), m_Size);
+    }
+#endif
+  std::vector<char>().swap(m_Buffer);
+  m_Data = ITK_NULLPTR;
+  m_Size = 0;
+  m_Mapped = false;
+
+  m_NumberOfFibers = 0;
+  m_NumberOfPoints = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Spacing[i] = 1.0;
+    m_Origin[i] = 0.0;
+    }
+  m_FiberOffsets = ITK_NULLPTR;
+  m_Positions = ITK_NULLPTR;
+  m_Tensors = ITK_NULLPTR;
+  m_ScalarNames.clear();
+  m_Scalars.clear();
+}
+
+void FiberBinaryFile::Open(const std::string & filename)
+{
+  this->Close();
+
+#ifndef _WIN32
+  // The sections can only be used in place on little endian systems
+  if( !itk::ByteSwapper<float>::SystemIsBigEndian() )
+    {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if( fd < 0 )
+      {
+      throw itk::ExceptionObject("Cannot open fiber file " + filename);
+      }
+    struct stat status;
+    if( fstat(fd, &status) != 0 || status.st_size == 0 )
+      {
+      close(fd);
+      throw itk::ExceptionObject("Not a binary fiber file: " + filename);
+      }
+    void * data = mmap(ITK_NULLPTR, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( data == MAP_FAILED )
+      {
+      throw itk::ExceptionObject("Cannot map fiber file " + filename);
+      }
+    m_Data = static_cast<const char *>( data );
+    m_Size = status.st_size;
+    m_Mapped = true;
+    }
+#endif
+
+  if( !m_Mapped )
+    {
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if( !file )
+      {
+      throw itk::ExceptionObject("Cannot open fiber file " + filename);
+      }
+    file.seekg(0, std::ios::end);
+    m_Buffer.resize(static_cast<std::size_t>( file.tellg() ) );
+    file.seekg(0, std::ios::beg);
+    if( m_Buffer.empty() || !file.read(&m_Buffer[0], m_Buffer.size() ) )
+      {
+      this->Close();
+      throw itk::ExceptionObject("Not a binary fiber file: " + filename);
+      }
+    m_Data = &m_Buffer[0];
+    m_Size = m_Buffer.size();
+    }
+
+  try
+    {
+    this->ParseFile();
+    }
+  catch( itk::ExceptionObject & )
+    {
+    this->Close();
+    throw itk::ExceptionObject("Not a binary fiber file: " + filename);
+    }
+}
+
+void FiberBinaryFile::ParseFile()
+{
+  if( m_Size < HeaderSize || !std::equal(Magic, Magic + sizeof(Magic), m_Data)
+      || ReadLittleEndian<itk::uint32_t>(m_Data + 8) != Version )
+    {
+    throw itk::ExceptionObject("Bad binary fiber file header");
+    }
+
+  const itk::uint64_t nscalars = ReadLittleEndian<itk::uint32_t>(m_Data + 12);
+  m_NumberOfFibers = ReadLittleEndian<itk::uint64_t>(m_Data + 16);
+  m_NumberOfPoints = ReadLittleEndian<itk::uint64_t>(m_Data + 24);
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Spacing[i] = ReadLittleEndian<double>(m_Data + 32 + 8 * i);
+    m_Origin[i] = ReadLittleEndian<double>(m_Data + 56 + 8 * i);
+    }
+
+  // Checked one at a time so the sizes below cannot overflow
+  if( nscalars > m_Size / NameSize || m_NumberOfFibers >= m_Size / 8 || m_NumberOfPoints > m_Size / 4 )
+    {
+    throw itk::ExceptionObject("Truncated binary fiber file");
+    }
+  const itk::uint64_t namesStart = HeaderSize;
+  const itk::uint64_t offsetsStart = namesStart + NameSize * nscalars;
+  const itk::uint64_t positionsStart = offsetsStart + 8 * (m_NumberOfFibers + 1);
+  const itk::uint64_t tensorsStart = positionsStart + Align8(3 * sizeof(float) * m_NumberOfPoints);
+  const itk::uint64_t scalarsStart = tensorsStart + Align8(6 * sizeof(float) * m_NumberOfPoints);
+  const itk::uint64_t scalarSize = Align8(sizeof(float) * m_NumberOfPoints);
+  if( scalarsStart + scalarSize * nscalars > m_Size )
+    {
+    throw itk::ExceptionObject("Truncated binary fiber file");
+    }
+
+  if( !m_Mapped )
+    {
+    char * data = &m_Buffer[0];
+    itk::ByteSwapper<itk::uint64_t>::SwapRangeFromSystemToLittleEndian(
+      reinterpret_cast<itk::uint64_t *>( data + offsetsStart ), m_NumberOfFibers + 1);
+    itk::ByteSwapper<float>::SwapRangeFromSystemToLittleEndian(
+      reinterpret_cast<float *>( data + positionsStart ), 3 * m_NumberOfPoints);
+    itk::ByteSwapper<float>::SwapRangeFromSystemToLittleEndian(
+      reinterpret_cast<float *>( data + tensorsStart ), 6 * m_NumberOfPoints);
+    for( itk::uint64_t j = 0; j < nscalars; ++j )
+      {
+      itk::ByteSwapper<float>::SwapRangeFromSystemToLittleEndian(
+        reinterpret_cast<float *>( data + scalarsStart + j * scalarSize ), m_NumberOfPoints);
+      }
+    }
+
+  m_FiberOffsets = reinterpret_cast<const itk::uint64_t *>( m_Data + offsetsStart );
+  m_Positions = reinterpret_cast<const float *>( m_Data + positionsStart );
+  m_Tensors = reinterpret_cast<const float *>( m_Data + tensorsStart );
+  for( itk::uint64_t j = 0; j < nscalars; ++j )
+    {
+    const char * name = m_Data + namesStart + NameSize * j;
+    m_ScalarNames.push_back(std::string(name, std::find(name, name + NameSize, '\0') ) );
+    m_Scalars.push_back(reinterpret_cast<const float *>( m_Data + scalarsStart + j * scalarSize ) );
+    }
+
+  if( m_FiberOffsets[0] != 0 || m_FiberOffsets[m_NumberOfFibers] != m_NumberOfPoints )
+    {
+    throw itk::ExceptionObject("Bad fiber offsets in binary fiber file");
+    }
+}
+
+const float * FiberBinaryFile::GetScalar(const std::string & name) const
+{
+  for( unsigned int j = 0; j < m_ScalarNames.size(); ++j )
+    {
+    if( m_ScalarNames[j] == name )
+      {
+      return m_Scalars[j];
+      }
+    }
+  return ITK_NULLPTR;
+}
+
+void FiberBinaryFile::ReadFibers(unsigned long first, unsigned long last, FiberBundle & bundle) const
+{
+  if( first > last || last > this->GetNumberOfFibers() )
+    {
+    throw itk::ExceptionObject("Fibers outside the binary fiber file");
+    }
+
+  if( bundle.GetNumberOfFibers() == 0 )
+    {
+    bundle.SetSpacing(m_Spacing);
+    bundle.SetOrigin(m_Origin);
+    }
+  const bool samespace = std::equal(m_Spacing, m_Spacing + 3, bundle.GetSpacing() )
+    && std::equal(m_Origin, m_Origin + 3, bundle.GetOrigin() );
+
+  std::vector<FiberBundle::ArrayType *> scalars;
+  for( unsigned int j = 0; j < m_ScalarNames.size(); ++j )
+    {
+    scalars.push_back(&bundle.GetScalar(m_ScalarNames[j]) );
+    }
+
+  for( unsigned long f = first; f < last; ++f )
+    {
+    const unsigned long begin = this->GetFiberBegin(f);
+    const unsigned long end = this->GetFiberEnd(f);
+    if( begin > end || end > this->GetNumberOfPoints() )
+      {
+      throw itk::ExceptionObject("Bad fiber offsets in binary fiber file");
+      }
+
+    const unsigned long k = bundle.AddFiber(end - begin);
+    if( samespace )
+      {
+      std::copy(m_Positions + 3 * begin, m_Positions + 3 * end, bundle.GetPositions().begin() + 3 * k);
+      }
+    else
+      {
+      // Through world coordinates, as FiberBundle::AppendFibers does
+      const double *           spacing = bundle.GetSpacing();
+      const double *           origin = bundle.GetOrigin();
+      FiberBundle::ArrayType & positions = bundle.GetPositions();
+      for( unsigned long i = begin; i < end; ++i )
+        {
+        for( unsigned int j = 0; j < 3; ++j )
+          {
+          const double world = m_Positions[3 * i + j] * m_Spacing[j] + m_Origin[j];
+          positions[3 * (k + i - begin) + j] = static_cast<float>( (world - origin[j]) / spacing[j]);
+          }
+        }
+      }
+    std::copy(m_Tensors + 6 * begin, m_Tensors + 6 * end, bundle.GetTensors().begin() + 6 * k);
+    for( unsigned int j = 0; j < scalars.size(); ++j )
+      {
+      std::copy(m_Scalars[j] + begin, m_Scalars[j] + end, scalars[j]->begin() + k);
+      }
+    }
+}
@@ -0,0 +1,163 @@
+#ifndef FIBERBINARY_H
+#define FIBERBINARY_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <itkIntTypes.h>
+
+#include "fiberbundle.h"
+
+// Binary fiber files (.fbin) hold the columns of a FiberBundle as they
+// are in memory, so they can be mapped and used without parsing:
+//
+//   header     "DTIFIBER", uint32 version (1), uint32 number of scalars,
+//              uint64 number of fibers, uint64 number of points,
+//              double spacing[3], double origin[3]
+//   names      64 bytes per scalar, nul padded
+//   offsets    uint64 per fiber + 1, the fiber offsets of FiberBundle
+//   positions  3 floats per point
+//   tensors    6 floats per point
+//   scalars    1 float per point for each scalar, in the order of the
+//              names
+//
+// All values are little endian, and each section starts on an 8 byte
+// boundary.
+void writeFiberBinaryFile(const std::string & filename, const FiberBundle & bundle);
+
+// Writes a binary fiber file a chunk of fibers at a time.  The columns
+// are spilled to temporary files as the chunks arrive and assembled by
+// Close(), so the memory used does not depend on the number of fibers.
+// The spacing, origin and scalars of the file are those of the first
+// chunk: the positions of the later chunks are converted to its object
+// space, their other scalars are dropped and the ones they lack are
+// written as zeros.
+class FiberBinaryFileWriter
+{
+public:
+  FiberBinaryFileWriter();
+  ~FiberBinaryFileWriter();
+
+  void Open(const std::string & filename);
+
+  void WriteFibers(const FiberBundle & fibers);
+
+  // Throws itk::ExceptionObject if the file cannot be written
+  void Close();
+
+private:
+  FiberBinaryFileWriter(const FiberBinaryFileWriter &); // purposely not implemented
+  void operator=(const FiberBinaryFileWriter &);        // purposely not implemented
+
+  void CloseSpillFiles();
+
+  std::string              m_FileName;
+  bool                     m_Started;
+  double                   m_Spacing[3];
+  double                   m_Origin[3];
+  std::vector<std::string> m_ScalarNames;
+
+  // Offsets, positions, tensors then one file per scalar
+  std::vector<std::FILE *> m_Spill;
+  itk::uint64_t            m_NumberOfFibers;
+  itk::uint64_t            m_NumberOfPoints;
+};
+
+// Read only view of a binary fiber file.  On little endian POSIX
+// systems the file is mapped, so opening it does not read it and only
+// the pages of the fibers used are loaded.  Elsewhere it is read, and
+// swapped if needed, when opened.  The pointers returned are valid
+// until the file is closed.
+class FiberBinaryFile
+{
+public:
+  FiberBinaryFile();
+  ~FiberBinaryFile();
+
+  // Throws itk::ExceptionObject if the file cannot be opened or is not
+  // a binary fiber file
+  void Open(const std::string & filename);
+
+  void Close();
+
+  unsigned long GetNumberOfFibers() const
+  {
+    return static_cast<unsigned long>( m_NumberOfFibers );
+  }
+
+  unsigned long GetNumberOfPoints() const
+  {
+    return static_cast<unsigned long>( m_NumberOfPoints );
+  }
+
+  unsigned long GetFiberBegin(unsigned long i) const
+  {
+    return static_cast<unsigned long>( m_FiberOffsets[i] );
+  }
+
+  unsigned long GetFiberEnd(unsigned long i) const
+  {
+    return static_cast<unsigned long>( m_FiberOffsets[i + 1] );
+  }
+
+  const float * GetPositions() const
+  {
+    return m_Positions;
+  }
+
+  const float * GetTensors() const
+  {
+    return m_Tensors;
+  }
+
+  const std::vector<std::string> & GetScalarNames() const
+  {
+    return m_ScalarNames;
+  }
+
+  // Null if the file does not have the scalar
+  const float * GetScalar(const std::string & name) const;
+
+  const double * GetSpacing() const
+  {
+    return m_Spacing;
+  }
+
+  const double * GetOrigin() const
+  {
+    return m_Origin;
+  }
+
+  // Appends the fibers first to last - 1 to bundle.  The spacing and
+  // origin of an empty bundle are set to the ones of the file, the
+  // positions are converted to the object space of a bundle that is
+  // not empty.
+  void ReadFibers(unsigned long first, unsigned long last, FiberBundle & bundle) const;
+
+private:
+  FiberBinaryFile(const FiberBinaryFile &);   // purposely not implemented
+  void operator=(const FiberBinaryFile &);    // purposely not implemented
+
+  // Sets the section pointers, swapping the sections of a file read on
+  // a big endian system
+  void ParseFile();
+
+  // Mapped file, or the copy of the file read when it cannot be mapped
+  const char *      m_Data;
+  std::size_t       m_Size;
+  bool              m_Mapped;
+  std::vector<char> m_Buffer;
+
+  itk::uint64_t              m_NumberOfFibers;
+  itk::uint64_t              m_NumberOfPoints;
+  double                     m_Spacing[3];
+  double                     m_Origin[3];
+  const itk::uint64_t *      m_FiberOffsets;
+  const float *              m_Positions;
+  const float *              m_Tensors;
+  std::vector<std::string>   m_ScalarNames;
+  std::vector<const float *> m_Scalars;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <itkSymmetricSecondRankTensor.h>
+
+#include "fiberbundle.h"
+
+FiberBundle::FiberBundle()
+{
+  this->Clear();
+}
+
+void FiberBundle::Clear()
+{
+  ArrayType().swap(m_Positions);
+  ArrayType().swap(m_Tensors);
+  std::vector<unsigned long>(1, 0).swap(m_FiberOffsets);
+  m_Scalars.clear();
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Spacing[i] = 1.0;
+    m_Origin[i] = 0.0;
+    }
+  m_DeferTensorScalars = false;
+  std::vector<bool>().swap(m_TensorScalarsComputed);
+}
+
+void FiberBundle::SetSpacing(const double spacing[3])
+{
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Spacing[i] = spacing[i];
+    }
+}
+
+void FiberBundle::SetOrigin(const double origin[3])
+{
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    m_Origin[i] = origin[i];
+    }
+}
+
+unsigned long FiberBundle::AddFiber(unsigned long n)
+{
+  const unsigned long first = this->GetNumberOfPoints();
+  const unsigned long npoints = first + n;
+
+  m_FiberOffsets.push_back(npoints);
+  m_Positions.resize(3 * npoints, 0.0f);
+  m_Tensors.resize(6 * npoints, 0.0f);
+  for( ScalarMapType::iterator it = m_Scalars.begin(); it != m_Scalars.end(); ++it )
+    {
+    it->second.resize(npoints, 0.0f);
+    }
+  if( m_DeferTensorScalars )
+    {
+    m_TensorScalarsComputed.push_back(false);
+    }
+  return first;
+}
+
+FiberBundle::ArrayType & FiberBundle::FindScalar(const std::string & name) const
+{
+  ScalarMapType::iterator it = m_Scalars.find(name);
+  if( it == m_Scalars.end() )
+    {
+    it = m_Scalars.insert(std::make_pair(name, ArrayType() ) ).first;
+    it->second.resize(this->GetNumberOfPoints(), 0.0f);
+    }
+  return it->second;
+}
+
+bool FiberBundle::IsTensorScalar(const std::string & name)
+{
+  return name == "fa" || name == "ga" || name == "md" || name == "fro" || name == "l1" || name == "l2"
+         || name == "l3" || name == "ad" || name == "rd";
+}
+
+FiberBundle::ArrayType & FiberBundle::GetScalar(const std::string & name)
+{
+  if( m_DeferTensorScalars && IsTensorScalar(name) )
+    {
+    this->ComputeTensorScalars(0, this->GetNumberOfFibers() );
+    }
+  return this->FindScalar(name);
+}
+
+const FiberBundle::ArrayType & FiberBundle::GetScalar(const std::string & name) const
+{
+  if( !this->HasScalar(name) )
+    {
+    throw itk::ExceptionObject("Fiber bundle has no scalar " + name);
+    }
+  if( m_DeferTensorScalars && IsTensorScalar(name) )
+    {
+    this->ComputeTensorScalars(0, this->GetNumberOfFibers() );
+    }
+  return this->FindScalar(name);
+}
+
+const float * FiberBundle::GetFiberScalar(const std::string & name, unsigned long i) const
+{
+  if( !this->HasScalar(name) )
+    {
+    throw itk::ExceptionObject("Fiber bundle has no scalar " + name);
+    }
+  if( m_DeferTensorScalars && IsTensorScalar(name) )
+    {
+    this->ComputeTensorScalars(i, i + 1);
+    }
+  const ArrayType & values = this->FindScalar(name);
+  return values.empty() ? ITK_NULLPTR : &values[0] + this->GetFiberBegin(i);
+}
+
+const FiberBundle::ScalarMapType & FiberBundle::GetScalars() const
+{
+  if( m_DeferTensorScalars )
+    {
+    this->ComputeTensorScalars(0, this->GetNumberOfFibers() );
+    }
+  return m_Scalars;
+}
+
+void FiberBundle::DeferTensorScalars()
+{
+  m_DeferTensorScalars = true;
+  m_TensorScalarsComputed.assign(this->GetNumberOfFibers(), false);
+}
+
+void FiberBundle::AddTube(DTITubeType * tube)
+{
+  const double *               tubespacing = tube->GetSpacing();
+  const itk::Vector<double, 3> tubeorigin(tube->GetObjectToWorldTransform()->GetOffset() );
+  if( this->GetNumberOfFibers() == 0 )
+    {
+    this->SetSpacing(tubespacing);
+    this->SetOrigin(tubeorigin.GetDataPointer() );
+    }
+
+  const DTIPointListType & points = tube->GetPoints();
+  const unsigned long      first = this->AddFiber(points.size() );
+
+  // The points of a tube usually all have the same fields in the same
+  // order, so the arrays are looked up once per field position
+  std::vector<std::string> names;
+  std::vector<ArrayType *> arrays;
+
+  unsigned long i = first;
+  for( DTIPointListType::const_iterator pit = points.begin(); pit != points.end(); ++pit, ++i )
+    {
+    const DTIPointType::PointType & p = pit->GetPosition();
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      m_Positions[3 * i + j] = static_cast<float>(
+          (p[j] * tubespacing[j] + tubeorigin[j] - m_Origin[j]) / m_Spacing[j]);
+      }
+
+    const float * tensor = pit->GetTensorMatrix();
+    for( unsigned int j = 0; j < 6; ++j )
+      {
+      m_Tensors[6 * i + j] = tensor[j];
+      }
+
+    // Deferred tensor scalars are computed from the tensors instead
+    const DTIPointType::FieldListType & fields = pit->GetFields();
+    for( unsigned int j = 0; j < fields.size(); ++j )
+      {
+      if( j == names.size() || names[j] != fields[j].first )
+        {
+        names.resize(std::max<std::size_t>(names.size(), j + 1) );
+        arrays.resize(names.size() );
+        names[j] = fields[j].first;
+        arrays[j] = m_DeferTensorScalars && IsTensorScalar(names[j]) ? ITK_NULLPTR : &this->FindScalar(names[j]);
+        }
+      if( arrays[j] )
+        {
+        (*arrays[j])[i] = fields[j].second;
+        }
+      }
+    }
+}
+
+void FiberBundle::AppendFibers(const FiberBundle & other, unsigned long first, unsigned long last)
+{
+  if( this->GetNumberOfFibers() == 0 )
+    {
+    this->SetSpacing(other.GetSpacing() );
+    this->SetOrigin(other.GetOrigin() );
+    if( other.m_DeferTensorScalars )
+      {
+      this->DeferTensorScalars();
+      }
+    }
+  else if( other.m_DeferTensorScalars && !m_DeferTensorScalars )
+    {
+    other.ComputeTensorScalars(first, last);
+    }
+  const bool samespace = std::equal(m_Spacing, m_Spacing + 3, other.GetSpacing() )
+    && std::equal(m_Origin, m_Origin + 3, other.GetOrigin() );
+
+  std::vector<std::pair<ArrayType *, const ArrayType *> > scalars;
+  for( ScalarMapType::const_iterator it = other.m_Scalars.begin(); it != other.m_Scalars.end(); ++it )
+    {
+    // Deferred tensor scalars are computed from the tensors instead
+    if( !(m_DeferTensorScalars && IsTensorScalar(it->first) ) )
+      {
+      scalars.push_back(std::make_pair(&this->FindScalar(it->first), &it->second) );
+      }
+    }
+
+  for( unsigned long f = first; f < last; ++f )
+    {
+    const unsigned long begin = other.GetFiberBegin(f);
+    const unsigned long end = other.GetFiberEnd(f);
+    const unsigned long k = this->AddFiber(end - begin);
+    if( samespace )
+      {
+      std::copy(other.m_Positions.begin() + 3 * begin, other.m_Positions.begin() + 3 * end,
+                m_Positions.begin() + 3 * k);
+      }
+    else
+      {
+      for( unsigned long i = begin; i < end; ++i )
+        {
+        double world[3];
+        other.GetWorldPosition(i, world);
+        for( unsigned int j = 0; j < 3; ++j )
+          {
+          m_Positions[3 * (k + i - begin) + j] = static_cast<float>( (world[j] - m_Origin[j]) / m_Spacing[j]);
+          }
+        }
+      }
+    std::copy(other.m_Tensors.begin() + 6 * begin, other.m_Tensors.begin() + 6 * end, m_Tensors.begin() + 6 * k);
+    for( unsigned int j = 0; j < scalars.size(); ++j )
+      {
+      std::copy(scalars[j].second->begin() + begin, scalars[j].second->begin() + end,
+                scalars[j].first->begin() + k);
+      }
+    }
+}
+
+void FiberBundle::FromGroup(GroupType::Pointer group)
+{
+  this->Clear();
+
+  // Make sure origins are updated
+  group->ComputeObjectToWorldTransform();
+
+  std::auto_ptr<ChildrenListType> children(group->GetChildren(0) );
+  for( ChildrenListType::const_iterator it = children->begin(); it != children->end(); ++it )
+    {
+    this->AddTube(dynamic_cast<DTITubeType *>( it->GetPointer() ) );
+    }
+}
+
+GroupType::Pointer FiberBundle::ToGroup() const
+{
+  GroupType::Pointer group = GroupType::New();
+  group->SetSpacing(m_Spacing);
+  group->GetObjectToParentTransform()->SetOffset(m_Origin);
+  group->ComputeObjectToWorldTransform();
+
+  const ScalarMapType & scalars = this->GetScalars();
+  for( unsigned long f = 0; f < this->GetNumberOfFibers(); ++f )
+    {
+    DTIPointListType points(this->GetFiberEnd(f) - this->GetFiberBegin(f) );
+    for( unsigned long i = this->GetFiberBegin(f); i < this->GetFiberEnd(f); ++i )
+      {
+      DTIPointType & pt = points[i - this->GetFiberBegin(f)];
+      pt.SetPosition(m_Positions[3 * i], m_Positions[3 * i + 1], m_Positions[3 * i + 2]);
+      pt.SetRadius(0.5);
+      pt.SetTensorMatrix(&m_Tensors[6 * i]);
+      for( ScalarMapType::const_iterator it = scalars.begin(); it != scalars.end(); ++it )
+        {
+        pt.AddField(it->first.c_str(), it->second[i]);
+        }
+      }
+
+    DTITubeType::Pointer tube = DTITubeType::New();
+    tube->SetSpacing(m_Spacing);
+    tube->SetId(static_cast<int>(f + 1) );
+    tube->SetPoints(points);
+    group->AddSpatialObject(tube);
+    }
+  return group;
+}
+
+void FiberBundle::ComputeTensorScalars(unsigned long first, unsigned long last) const
+{
+  typedef itk::SymmetricSecondRankTensor<double, 3> ITKTensorType;
+  typedef ITKTensorType::EigenValuesArrayType       LambdaArrayType;
+
+  enum { FA, GA, MD, FRO, L1, L2, L3, AD, RD, NumberOfTensorScalars };
+  const char * const names[NumberOfTensorScalars] = { "fa", "ga", "md", "fro", "l1", "l2", "l3", "ad", "rd" };
+  ArrayType *        scalars[NumberOfTensorScalars];
+  for( unsigned int j = 0; j < NumberOfTensorScalars; ++j )
+    {
+    scalars[j] = &this->FindScalar(names[j]);
+    }
+
+  for( unsigned long f = first; f < last; ++f )
+    {
+    if( m_TensorScalarsComputed[f] )
+      {
+      continue;
+      }
+    for( unsigned long i = this->GetFiberBegin(f); i < this->GetFiberEnd(f); ++i )
+      {
+      const float * t = &m_Tensors[6 * i];
+      ITKTensorType itktensor;
+      for( unsigned int j = 0; j < 6; ++j )
+        {
+        itktensor[j] = t[j];
+        }
+
+      LambdaArrayType lambdas;
+      itktensor.ComputeEigenValues(lambdas);
+
+      const float md = (lambdas[0] + lambdas[1] + lambdas[2]) / 3;
+      const float fa = std::sqrt(1.5) * std::sqrt( (lambdas[0] - md) * (lambdas[0] - md)
+                                                   + (lambdas[1] - md) * (lambdas[1] - md)
+                                                   + (lambdas[2] - md) * (lambdas[2] - md) )
+        / std::sqrt(lambdas[0] * lambdas[0] + lambdas[1] * lambdas[1] + lambdas[2] * lambdas[2]);
+
+      const float logavg = (std::log(lambdas[0]) + std::log(lambdas[1]) + std::log(lambdas[2]) ) / 3;
+      const float ga = std::sqrt( (std::log(lambdas[0]) - logavg) * (std::log(lambdas[0]) - logavg)
+                                  + (std::log(lambdas[1]) - logavg) * (std::log(lambdas[1]) - logavg)
+                                  + (std::log(lambdas[2]) - logavg) * (std::log(lambdas[2]) - logavg) );
+
+      (*scalars[FA])[i] = fa;
+      (*scalars[GA])[i] = ga;
+      (*scalars[MD])[i] = md;
+      (*scalars[FRO])[i] = std::sqrt(t[0] * t[0] + 2 * t[1] * t[1] + 2 * t[2] * t[2]
+                                     + t[3] * t[3] + 2 * t[4] * t[4] + t[5] * t[5]);
+      (*scalars[L1])[i] = lambdas[2];
+      (*scalars[L2])[i] = lambdas[1];
+      (*scalars[L3])[i] = lambdas[0];
+      (*scalars[AD])[i] = lambdas[2];
+      (*scalars[RD])[i] = (lambdas[1] + lambdas[0]) / 2;
+      }
+    m_TensorScalarsComputed[f] = true;
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef FIBERBUNDLE_H
+#define FIBERBUNDLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dtitypes.h"
+
+// Fiber bundle stored by columns: the coordinates of all the points in
+// one contiguous array, the offset of the first point of each fiber in
+// another, and one contiguous array per tensor or scalar attribute.
+// The points of fiber i are the points GetFiberBegin(i) to
+// GetFiberEnd(i) - 1 of every array.
+//
+// As in the spatial objects, the positions are in the object space of
+// the bundle: the LPS world position of a point is
+// position * spacing + origin.
+class FiberBundle
+{
+public:
+  typedef std::vector<float>               ArrayType;
+  typedef std::map<std::string, ArrayType> ScalarMapType;
+
+  FiberBundle();
+
+  // Removes all the fibers and attributes, and resets the spacing and
+  // origin
+  void Clear();
+
+  unsigned long GetNumberOfFibers() const
+  {
+    return m_FiberOffsets.size() - 1;
+  }
+
+  unsigned long GetNumberOfPoints() const
+  {
+    return m_FiberOffsets.back();
+  }
+
+  // Index of the first point of fiber i
+  unsigned long GetFiberBegin(unsigned long i) const
+  {
+    return m_FiberOffsets[i];
+  }
+
+  // Index after the last point of fiber i
+  unsigned long GetFiberEnd(unsigned long i) const
+  {
+    return m_FiberOffsets[i + 1];
+  }
+
+  // Offsets of the fibers in the point arrays, GetNumberOfFibers() + 1
+  // values starting at 0
+  const std::vector<unsigned long> & GetFiberOffsets() const
+  {
+    return m_FiberOffsets;
+  }
+
+  // Appends a fiber of n points and returns the index of its first
+  // point.  The positions, tensors and scalars of the new points are
+  // zero.  Pointers into the arrays are invalidated.
+  unsigned long AddFiber(unsigned long n);
+
+  // Appends a tube, converting its points to the object space of the
+  // bundle.  The object to world transform of the tube must be up to
+  // date.  The spacing and origin of the bundle are taken from the
+  // first tube added.
+  void AddTube(DTITubeType * tube);
+
+  // 3 coordinates per point
+  ArrayType & GetPositions()
+  {
+    return m_Positions;
+  }
+
+  const ArrayType & GetPositions() const
+  {
+    return m_Positions;
+  }
+
+  // 6 components per point, in the order of itk::DiffusionTensor3D
+  ArrayType & GetTensors()
+  {
+    return m_Tensors;
+  }
+
+  const ArrayType & GetTensors() const
+  {
+    return m_Tensors;
+  }
+
+  bool HasScalar(const std::string & name) const
+  {
+    return m_Scalars.count(name) != 0 || (m_DeferTensorScalars && IsTensorScalar(name) );
+  }
+
+  // One value per point.  The array is created, filled with zeros, if
+  // the bundle does not have it yet.
+  ArrayType & GetScalar(const std::string & name);
+
+  // Throws itk::ExceptionObject if the bundle does not have the scalar
+  const ArrayType & GetScalar(const std::string & name) const;
+
+  // Values of the scalar at the points of fiber i.  A deferred tensor
+  // scalar is only computed for this fiber.  Throws
+  // itk::ExceptionObject if the bundle does not have the scalar.
+  const float * GetFiberScalar(const std::string & name, unsigned long i) const;
+
+  // Computes the deferred tensor scalars of all the fibers
+  const ScalarMapType & GetScalars() const;
+
+  // The tensor scalars (fa, ga, md, fro, l1, l2, l3, ad and rd) are
+  // computed from the tensors when they are first requested, for the
+  // fibers they are requested for, instead of being stored.  Reading
+  // the positions or tensors only never computes them.  The tensors of
+  // a fiber must be set before its scalars are requested, and the
+  // scalars are not updated if the tensors change afterwards.  The
+  // const accessors fill the cache, so they must not be called from
+  // several threads at once.
+  void DeferTensorScalars();
+
+  const double * GetSpacing() const
+  {
+    return m_Spacing;
+  }
+
+  void SetSpacing(const double spacing[3]);
+
+  const double * GetOrigin() const
+  {
+    return m_Origin;
+  }
+
+  void SetOrigin(const double origin[3]);
+
+  // LPS world position of point i
+  void GetWorldPosition(unsigned long i, double world[3]) const
+  {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      world[j] = m_Positions[3 * i + j] * m_Spacing[j] + m_Origin[j];
+      }
+  }
+
+  // Appends the fibers first to last - 1 of other, converting their
+  // positions to the object space of this bundle.  An empty bundle
+  // takes the spacing and origin of other, and defers its tensor
+  // scalars if other does.  The scalars this bundle has and other does
+  // not are zero for the new points.
+  void AppendFibers(const FiberBundle & other, unsigned long first, unsigned long last);
+
+  // Replaces the fibers by the tubes of group
+  void FromGroup(GroupType::Pointer group);
+
+  // Group of tubes with the same fibers, spacing and origin
+  GroupType::Pointer ToGroup() const;
+
+private:
+  static bool IsTensorScalar(const std::string & name);
+
+  // Array of the scalar, created filled with zeros if missing, without
+  // computing the deferred tensor scalars
+  ArrayType & FindScalar(const std::string & name) const;
+
+  // Computes the deferred tensor scalars of the fibers first to
+  // last - 1 that do not have them yet
+  void ComputeTensorScalars(unsigned long first, unsigned long last) const;
+
+  ArrayType                  m_Positions;
+  ArrayType                  m_Tensors;
+  std::vector<unsigned long> m_FiberOffsets;
+  mutable ScalarMapType      m_Scalars;
+  double                     m_Spacing[3];
+  double                     m_Origin[3];
+
+  // Whether the tensor scalars of each fiber are computed, when they
+  // are deferred
+  bool                      m_DeferTensorScalars;
+  mutable std::vector<bool> m_TensorScalarsComputed;
+};
+
+#endif
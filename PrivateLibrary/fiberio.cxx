@@ -1,7 +1,10 @@
 #include <string>
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <fstream>
 
+#include <itkByteSwapper.h>
 #include <itkSpatialObjectReader.h>
 #include <itkSpatialObjectWriter.h>
 #include <vtkVersion.h>
@@ -13,6 +16,7 @@
 #include <vtkXMLPolyDataWriter.h>
 #include <vtkSmartPointer.h>
 #include <vtkCell.h>
+#include <vtkCellArray.h>
 #include <vtkFloatArray.h>
 
 #include "fiberio.h"
@@ -20,9 +24,48 @@
 // hide function to this compilation unit
 namespace
 {
-inline double SQ2(double x)
+// Binary legacy VTK files are big endian
+template <class T>
+void WriteBigEndian(std::FILE * file, T * values, unsigned int n)
 {
-  return x * x;
+  itk::ByteSwapper<T>::SwapRangeFromSystemToBigEndian(values, n);
+  if( std::fwrite(values, sizeof(T), n, file) != n )
+    {
+    throw itk::ExceptionObject("Cannot write temporary fiber data");
+    }
+}
+
+// Point data array of a scalar of the bundle, -1 where the bundle does
+// not have it as for the missing fields of spatial object points
+vtkSmartPointer<vtkFloatArray> ScalarArray(const FiberBundle & bundle, const std::string & scalar, const char * name)
+{
+  vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+  const vtkIdType                npoints = bundle.GetNumberOfPoints();
+
+  array->SetNumberOfComponents(1);
+  array->SetName(name);
+  array->SetNumberOfTuples(npoints);
+  if( bundle.HasScalar(scalar) )
+    {
+    std::copy(bundle.GetScalar(scalar).begin(), bundle.GetScalar(scalar).end(), array->GetPointer(0) );
+    }
+  else
+    {
+    std::fill(array->GetPointer(0), array->GetPointer(0) + npoints, -1.0f);
+    }
+  return array;
+}
+
+void AppendFile(std::FILE * from, std::ofstream & to)
+{
+  char        buffer[65536];
+  std::size_t n;
+
+  std::rewind(from);
+  while( (n = std::fread(buffer, 1, sizeof(buffer), from) ) > 0 )
+    {
+    to.write(buffer, n);
+    }
 }
 
 };
@@ -32,8 +75,15 @@ void writeFiberFile(const std::string & filename, GroupType::Pointer fibergroup,
   // Make sure origins are updated
   fibergroup->ComputeObjectToWorldTransform();
 
+  // Binary fiber file
+  if( filename.rfind(".fbin") != std::string::npos )
+    {
+    FiberBundle bundle;
+    bundle.FromGroup(fibergroup);
+    writeFiberBinaryFile(filename, bundle);
+    }
   // ITK Spatial Object
-  if( filename.rfind(".fib") != std::string::npos )
+  else if( filename.rfind(".fib") != std::string::npos )
     {
     typedef itk::SpatialObjectWriter<3> WriterType;
     WriterType::Pointer writer  = WriterType::New();
@@ -44,142 +94,133 @@ void writeFiberFile(const std::string & filename, GroupType::Pointer fibergroup,
   // VTK Poly Data
   else if( filename.rfind(".vt") != std::string::npos )
     {
-    // Build VTK data structure
-    vtkSmartPointer<vtkPolyData>   polydata(vtkPolyData::New() );
-    vtkSmartPointer<vtkFloatArray> tensorsdata(vtkFloatArray::New() );
-    vtkSmartPointer<vtkIdList>     ids(vtkIdList::New() );
-    vtkSmartPointer<vtkPoints>     pts(vtkPoints::New() );
-
-    tensorsdata->SetNumberOfComponents(9);
-    polydata->SetPoints(pts);
-
-    ids->SetNumberOfIds(0);
-    pts->SetNumberOfPoints(0);
-    polydata->Allocate();
-    vtkFloatArray *scalarFA = vtkFloatArray::New();
-    vtkFloatArray *scalarMD = vtkFloatArray::New();
-    vtkFloatArray *scalarRD = vtkFloatArray::New();
-    vtkFloatArray *scalarAD = vtkFloatArray::New();
-    scalarFA->SetNumberOfComponents(1);
-    scalarFA->SetName("FA");
-    scalarMD->SetNumberOfComponents(1);
-    scalarMD->SetName("MD");
-    scalarAD->SetNumberOfComponents(1);
-    scalarAD->SetName("AD");
-    scalarRD->SetNumberOfComponents(1);
-    scalarRD->SetName("RD");
-
-    std::auto_ptr<ChildrenListType> children(fibergroup->GetChildren(0) );
-    typedef ChildrenListType::const_iterator IteratorType;
-    for( IteratorType it = children->begin(); it != children->end(); it++ )
-      {
-      itk::SpatialObject<3>*        tmp = (*it).GetPointer();
-      itk::DTITubeSpatialObject<3>* tube = dynamic_cast<itk::DTITubeSpatialObject<3> *>(tmp);
-      unsigned int                  nPointsOnFiber = tube->GetNumberOfPoints();
-      vtkIdType                     currentId = ids->GetNumberOfIds();
-      for( unsigned int k = 0; k < nPointsOnFiber; k++ )
-        {
-        itk::Point<double, 3>  v(tube->GetPoint(k)->GetPosition() );
-        itk::Vector<double, 3> spacing(tube->GetSpacing() );
-        itk::Vector<double, 3> origin(tube->GetObjectToWorldTransform()->GetOffset() );
-
-        // convert origin from LPS -> RAS
-        origin[0] = -origin[0];
-        origin[1] = -origin[1];
-
-        vtkIdType id;
-        // Need to multiply v by spacing and origin
-        // Also negate the first to convert from LPS -> RAS
-        // for slicer 3
-        id = pts->InsertNextPoint(-v[0] * spacing[0] + origin[0],
-                                  -v[1] * spacing[1] + origin[1],
-                                  v[2] * spacing[2] + origin[2]);
-
-        ids->InsertNextId(id);
-
-        itk::DTITubeSpatialObjectPoint<3>* sopt = dynamic_cast<itk::DTITubeSpatialObjectPoint<3> *>(tube->GetPoint(k) );
-        float                              vtktensor[9];
-        vtktensor[0] = sopt->GetTensorMatrix()[0];
-        vtktensor[1] = sopt->GetTensorMatrix()[1];
-        vtktensor[2] = sopt->GetTensorMatrix()[2];
-        vtktensor[3] = sopt->GetTensorMatrix()[1];
-        vtktensor[4] = sopt->GetTensorMatrix()[3];
-        vtktensor[5] = sopt->GetTensorMatrix()[4];
-        vtktensor[6] = sopt->GetTensorMatrix()[2];
-        vtktensor[7] = sopt->GetTensorMatrix()[4];
-        vtktensor[8] = sopt->GetTensorMatrix()[5];
-
-	//std::cout << "MD = " << sopt->GetField("md") << ", " ;
-
-        scalarFA->InsertNextValue(sopt->GetField("fa"));
-        scalarMD->InsertNextValue(sopt->GetField("md"));
-        scalarAD->InsertNextValue(sopt->GetField("ad"));
-        scalarRD->InsertNextValue(sopt->GetField("rd"));
-
-        tensorsdata->InsertNextTupleValue(vtktensor);
+    FiberBundle bundle;
+    bundle.FromGroup(fibergroup);
+    writeFiberFile(filename, bundle, saveProperties, encoding);
+    }
+  else
+    {
+    throw itk::ExceptionObject("Unknown file format for fibers");
+    }
+}
 
-        }
-      polydata->InsertNextCell(VTK_POLY_LINE, nPointsOnFiber, ids->GetPointer(currentId) );
-      }
+void writeFiberFile(const std::string & filename, const FiberBundle & bundle, bool saveProperties, std::string encoding)
+{
+  // Binary fiber file
+  if( filename.rfind(".fbin") != std::string::npos )
+    {
+    writeFiberBinaryFile(filename, bundle);
+    return;
+    }
+  // ITK Spatial Object
+  else if( filename.rfind(".fib") != std::string::npos )
+    {
+    writeFiberFile(filename, bundle.ToGroup(), saveProperties, encoding);
+    return;
+    }
+  else if( filename.rfind(".vt") == std::string::npos )
+    {
+    throw itk::ExceptionObject("Unknown file format for fibers");
+    }
+
+  // Build VTK data structure
+  const vtkIdType                npoints = bundle.GetNumberOfPoints();
+  vtkSmartPointer<vtkPolyData>   polydata = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPoints>     pts = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkCellArray>  lines = vtkSmartPointer<vtkCellArray>::New();
+  vtkSmartPointer<vtkFloatArray> tensorsdata = vtkSmartPointer<vtkFloatArray>::New();
 
-    polydata->GetPointData()->SetTensors(tensorsdata);
-    if (saveProperties) 
+  pts->SetDataTypeToFloat();
+  pts->SetNumberOfPoints(npoints);
+  for( vtkIdType i = 0; i < npoints; ++i )
+    {
+    // Convert from LPS -> RAS for slicer 3
+    double world[3];
+    bundle.GetWorldPosition(i, world);
+    pts->SetPoint(i, -world[0], -world[1], world[2]);
+    }
+  polydata->SetPoints(pts);
+
+  for( unsigned long f = 0; f < bundle.GetNumberOfFibers(); ++f )
+    {
+    lines->InsertNextCell(bundle.GetFiberEnd(f) - bundle.GetFiberBegin(f) );
+    for( unsigned long i = bundle.GetFiberBegin(f); i < bundle.GetFiberEnd(f); ++i )
       {
-	polydata->GetPointData()->AddArray(scalarFA);
-	polydata->GetPointData()->AddArray(scalarMD);
-	polydata->GetPointData()->AddArray(scalarAD);
-	polydata->GetPointData()->AddArray(scalarRD);
+      lines->InsertCellPoint(i);
       }
+    }
+  polydata->SetLines(lines);
 
-    // Legacy
-    if( filename.rfind(".vtk") != std::string::npos )
-      {
-      vtkSmartPointer<vtkPolyDataWriter> fiberwriter = vtkPolyDataWriter::New();
-      fiberwriter->SetFileTypeToBinary();
-      fiberwriter->SetFileName(filename.c_str() );
+  tensorsdata->SetNumberOfComponents(9);
+  tensorsdata->SetNumberOfTuples(npoints);
+  const FiberBundle::ArrayType & tensors = bundle.GetTensors();
+  float *                        vtktensor = tensorsdata->GetPointer(0);
+  for( vtkIdType i = 0; i < npoints; ++i, vtktensor += 9 )
+    {
+    const float * t = &tensors[6 * i];
+    vtktensor[0] = t[0];
+    vtktensor[1] = t[1];
+    vtktensor[2] = t[2];
+    vtktensor[3] = t[1];
+    vtktensor[4] = t[3];
+    vtktensor[5] = t[4];
+    vtktensor[6] = t[2];
+    vtktensor[7] = t[4];
+    vtktensor[8] = t[5];
+    }
+  polydata->GetPointData()->SetTensors(tensorsdata);
+
+  if( saveProperties )
+    {
+    polydata->GetPointData()->AddArray(ScalarArray(bundle, "fa", "FA") );
+    polydata->GetPointData()->AddArray(ScalarArray(bundle, "md", "MD") );
+    polydata->GetPointData()->AddArray(ScalarArray(bundle, "ad", "AD") );
+    polydata->GetPointData()->AddArray(ScalarArray(bundle, "rd", "RD") );
+    }
+
+  // Legacy
+  if( filename.rfind(".vtk") != std::string::npos )
+    {
+    vtkSmartPointer<vtkPolyDataWriter> fiberwriter = vtkSmartPointer<vtkPolyDataWriter>::New();
+    fiberwriter->SetFileName(filename.c_str() );
 #if (VTK_MAJOR_VERSION < 6)
-      fiberwriter->SetInput(polydata);
+    fiberwriter->SetInput(polydata);
 #else
-      fiberwriter->SetInputData(polydata);
+    fiberwriter->SetInputData(polydata);
 #endif
-      if( encoding == "binary" )
+    if( encoding == "binary" )
       {
-        fiberwriter->SetFileTypeToBinary();
+      fiberwriter->SetFileTypeToBinary();
       }
-      else
+    else
       {
-        fiberwriter->SetFileTypeToASCII() ;
+      fiberwriter->SetFileTypeToASCII();
       }
-      fiberwriter->Update();
-      }
-    // XML
-    else if( filename.rfind(".vtp") != std::string::npos )
-      {
-      vtkSmartPointer<vtkXMLPolyDataWriter> fiberwriter = vtkXMLPolyDataWriter::New();
-      fiberwriter->SetFileName(filename.c_str() );
+    fiberwriter->Update();
+    }
+  // XML
+  else if( filename.rfind(".vtp") != std::string::npos )
+    {
+    vtkSmartPointer<vtkXMLPolyDataWriter> fiberwriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+    fiberwriter->SetFileName(filename.c_str() );
 #if (VTK_MAJOR_VERSION < 6)
-      fiberwriter->SetInput(polydata);
+    fiberwriter->SetInput(polydata);
 #else
-      fiberwriter->SetInputData(polydata);
+    fiberwriter->SetInputData(polydata);
 #endif
-      if( encoding == "binary" )
-      {
-        fiberwriter->SetDataModeToBinary() ;
-      }
-      else if( encoding == "appended" )
+    if( encoding == "binary" )
       {
-        fiberwriter->SetDataModeToAppended() ;
+      fiberwriter->SetDataModeToBinary();
       }
-      else
+    else if( encoding == "appended" )
       {
-        fiberwriter->SetDataModeToAscii() ;
-      }
-      fiberwriter->Update();
+      fiberwriter->SetDataModeToAppended();
       }
     else
       {
-      throw itk::ExceptionObject("Unknown file format for fibers");
+      fiberwriter->SetDataModeToAscii();
       }
+    fiberwriter->Update();
     }
   else
     {
@@ -189,7 +230,6 @@ void writeFiberFile(const std::string & filename, GroupType::Pointer fibergroup,
 
 GroupType::Pointer readFiberFile(const std::string & filename)
 {
-
   // ITK Spatial Object
   if( filename.rfind(".fib") != std::string::npos )
     {
@@ -203,127 +243,371 @@ GroupType::Pointer readFiberFile(const std::string & filename)
 
     return soreader->GetGroup();
     }
-  // VTK Poly Data
-  else if( filename.rfind(".vt") != std::string::npos )
+  // VTK Poly Data and binary fiber file.  The tensor scalars are
+  // stored as fields of the points, so they are all computed here.
+  else if( filename.rfind(".vt") != std::string::npos || filename.rfind(".fbin") != std::string::npos )
+    {
+    FiberBundle bundle;
+    readFiberFile(filename, bundle);
+    return bundle.ToGroup();
+    }
+  else
     {
-    // Build up the principal data structure for fiber tracts
-    GroupType::Pointer fibergroup = GroupType::New();
+    throw itk::ExceptionObject("Unknown fiber file");
+    }
+}
 
-    vtkSmartPointer<vtkPolyData> fibdata(ITK_NULLPTR);
+void readFiberFile(const std::string & filename, FiberBundle & bundle)
+{
+  // Binary fiber file
+  if( filename.rfind(".fbin") != std::string::npos )
+    {
+    FiberBinaryFile file;
+    file.Open(filename);
+    bundle.Clear();
+    file.ReadFibers(0, file.GetNumberOfFibers(), bundle);
+    return;
+    }
+  // ITK Spatial Object
+  else if( filename.rfind(".fib") != std::string::npos )
+    {
+    bundle.FromGroup(readFiberFile(filename) );
+    return;
+    }
+  else if( filename.rfind(".vt") == std::string::npos )
+    {
+    throw itk::ExceptionObject("Unknown fiber file");
+    }
+
+  vtkSmartPointer<vtkPolyData> fibdata(ITK_NULLPTR);
+
+  // Legacy
+  if( filename.rfind(".vtk") != std::string::npos )
+    {
+    vtkSmartPointer<vtkPolyDataReader> reader = vtkSmartPointer<vtkPolyDataReader>::New();
+    reader->SetFileName(filename.c_str() );
+    reader->Update();
+    fibdata = reader->GetOutput();
+    }
+  else if( filename.rfind(".vtp") != std::string::npos )
+    {
+    vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+    reader->SetFileName(filename.c_str() );
+    reader->Update();
+    fibdata = reader->GetOutput();
+    }
+  else
+    {
+    throw itk::ExceptionObject("Unknown file format for fibers");
+    }
 
-    // Legacy
-    if( filename.rfind(".vtk") != std::string::npos )
+  // The coordinates are world coordinates
+  bundle.Clear();
+
+  vtkDataArray * fibtensordata = fibdata->GetPointData()->GetTensors();
+  vtkCellArray * lines = fibdata->GetLines();
+  vtkIdType      npts;
+  vtkIdType *    pts;
+  for( lines->InitTraversal(); lines->GetNextCell(npts, pts); )
+    {
+    const unsigned long first = bundle.AddFiber(npts);
+    float *             position = &bundle.GetPositions()[3 * first];
+    float *             tensor = &bundle.GetTensors()[6 * first];
+    for( vtkIdType j = 0; j < npts; ++j, position += 3, tensor += 6 )
       {
-      vtkSmartPointer<vtkPolyDataReader> reader(vtkPolyDataReader::New() );
-      reader->SetFileName(filename.c_str() );
-      reader->Update();
-      fibdata = reader->GetOutput();
+      // Convert from RAS to LPS for vtk
+      const double * coordinates = fibdata->GetPoint(pts[j]);
+      position[0] = -coordinates[0];
+      position[1] = -coordinates[1];
+      position[2] = coordinates[2];
 
+      if( fibtensordata )
+        {
+        const double * vtktensor = fibtensordata->GetTuple9(pts[j]);
+        tensor[0] = vtktensor[0];
+        tensor[1] = vtktensor[1];
+        tensor[2] = vtktensor[2];
+        tensor[3] = vtktensor[4];
+        tensor[4] = vtktensor[5];
+        tensor[5] = vtktensor[8];
+        }
+      else
+        {
+        tensor[0] = tensor[3] = tensor[5] = 1.0;
+        }
       }
-    else if( filename.rfind(".vtp") != std::string::npos )
+    }
+
+  // FA, MD and the other tensor scalars are only computed if used
+  bundle.DeferTensorScalars();
+}
+
+FiberFileReader::FiberFileReader()
+  : m_Binary(false), m_NextFiber(0)
+{
+}
+
+void FiberFileReader::Open(const std::string & filename)
+{
+  this->Close();
+  m_Binary = filename.rfind(".fbin") != std::string::npos;
+  if( m_Binary )
+    {
+    m_BinaryFile.Open(filename);
+    }
+  else
+    {
+    readFiberFile(filename, m_Bundle);
+    }
+}
+
+void FiberFileReader::Close()
+{
+  m_BinaryFile.Close();
+  m_Bundle.Clear();
+  m_Binary = false;
+  m_NextFiber = 0;
+}
+
+unsigned long FiberFileReader::GetNumberOfFibers() const
+{
+  return m_Binary ? m_BinaryFile.GetNumberOfFibers() : m_Bundle.GetNumberOfFibers();
+}
+
+bool FiberFileReader::ReadFibers(unsigned long n, FiberBundle & chunk)
+{
+  const unsigned long last = std::min(m_NextFiber + n, this->GetNumberOfFibers() );
+
+  chunk.Clear();
+  if( m_NextFiber == last )
+    {
+    return false;
+    }
+  if( m_Binary )
+    {
+    m_BinaryFile.ReadFibers(m_NextFiber, last, chunk);
+    }
+  else
+    {
+    chunk.AppendFibers(m_Bundle, m_NextFiber, last);
+    }
+  m_NextFiber = last;
+  return true;
+}
+
+FiberFileWriter::FiberFileWriter()
+  : m_SaveProperties(true), m_Encoding("binary"), m_Mode(Buffered), m_NumberOfPoints(0), m_NumberOfFibers(0)
+{
+  for( unsigned int i = 0; i < NumberOfSpillFiles; ++i )
+    {
+    m_Spill[i] = ITK_NULLPTR;
+    }
+}
+
+FiberFileWriter::~FiberFileWriter()
+{
+  this->CloseSpillFiles();
+}
+
+void FiberFileWriter::CloseSpillFiles()
+{
+  for( unsigned int i = 0; i < NumberOfSpillFiles; ++i )
+    {
+    if( m_Spill[i] )
       {
-      vtkSmartPointer<vtkXMLPolyDataReader> reader(vtkXMLPolyDataReader::New() );
-      reader->SetFileName(filename.c_str() );
-      reader->Update();
-      fibdata = reader->GetOutput();
+      std::fclose(m_Spill[i]);
+      m_Spill[i] = ITK_NULLPTR;
       }
-    else
+    }
+}
+
+void FiberFileWriter::Open(const std::string & filename, bool saveProperties, const std::string & encoding)
+{
+  this->CloseSpillFiles();
+  m_FileName = filename;
+  m_SaveProperties = saveProperties;
+  m_Encoding = encoding;
+  m_Bundle.Clear();
+  m_NumberOfPoints = 0;
+  m_NumberOfFibers = 0;
+
+  if( filename.rfind(".fbin") != std::string::npos )
+    {
+    m_Mode = Binary;
+    m_BinaryWriter.Open(filename);
+    }
+  else if( filename.rfind(".vtk") != std::string::npos && encoding == "binary" )
+    {
+    m_Mode = LegacyVTK;
+    for( unsigned int i = 0; i < NumberOfSpillFiles; ++i )
       {
-      throw itk::ExceptionObject("Unknown file format for fibers");
+      // Removed automatically when closed
+      m_Spill[i] = std::tmpfile();
+      if( !m_Spill[i] )
+        {
+        this->CloseSpillFiles();
+        throw itk::ExceptionObject("Cannot create temporary fiber data file");
+        }
       }
+    }
+  else
+    {
+    m_Mode = Buffered;
+    }
+}
 
-    typedef  itk::SymmetricSecondRankTensor<double, 3> ITKTensorType;
-    typedef  ITKTensorType::EigenValuesArrayType       LambdaArrayType;
+void FiberFileWriter::WriteFibers(const FiberBundle & fibers)
+{
+  if( m_Mode == Buffered )
+    {
+    m_Bundle.AppendFibers(fibers, 0, fibers.GetNumberOfFibers() );
+    return;
+    }
+  else if( m_Mode == Binary )
+    {
+    m_BinaryWriter.WriteFibers(fibers);
+    return;
+    }
 
-    // Iterate over VTK data
-    const int nfib = fibdata->GetNumberOfCells();
-    int       pindex = -1;
-    for( int i = 0; i < nfib; ++i )
+  // Same conversion as writeFiberFile
+  for( unsigned long f = 0; f < fibers.GetNumberOfFibers(); ++f )
+    {
+    int cellsize = static_cast<int>( fibers.GetFiberEnd(f) - fibers.GetFiberBegin(f) );
+    WriteBigEndian(m_Spill[1], &cellsize, 1);
+    for( unsigned long k = fibers.GetFiberBegin(f); k < fibers.GetFiberEnd(f); ++k )
       {
-      itk::DTITubeSpatialObject<3>::Pointer dtiTube = itk::DTITubeSpatialObject<3>::New();
-      vtkSmartPointer<vtkCell>              fib = fibdata->GetCell(i);
-
-      vtkSmartPointer<vtkPoints> points = fib->GetPoints();
-
-      typedef itk::DTITubeSpatialObjectPoint<3> DTIPointType;
-      std::vector<DTIPointType> pointsToAdd;
-
-      vtkSmartPointer<vtkDataArray> fibtensordata = fibdata->GetPointData()->GetTensors();
-      for( int j = 0; j < points->GetNumberOfPoints(); ++j )
-	{
-	  ++pindex;
-	  
-	  double * coordinates = points->GetPoint(j);
-	  DTIPointType          pt;
-	  // Convert from RAS to LPS for vtk
-	  pt.SetPosition(-coordinates[0], -coordinates[1], coordinates[2]);
-	  pt.SetRadius(0.5);
-	  pt.SetColor(0.0, 1.0, 0.0);
-	  double * vtktensor;
-	  float                 floattensor[6];
-	  ITKTensorType         itktensor;
-	  
-	  if (fibtensordata) {
-	    vtktensor = fibtensordata->GetTuple9(pindex);
-	    floattensor[0] = itktensor[0] = vtktensor[0];
-	    floattensor[1] = itktensor[1] = vtktensor[1];
-	    floattensor[2] = itktensor[2] = vtktensor[2];
-	    floattensor[3] = itktensor[3] = vtktensor[4];
-	    floattensor[4] = itktensor[4] = vtktensor[5];
-	    floattensor[5] = itktensor[5] = vtktensor[8];
-	  } else {
-	    vtktensor = new double[9];
-	    floattensor[0] = itktensor[0] = vtktensor[0] = 1.0;
-	    floattensor[1] = itktensor[1] = vtktensor[1] = 0.0;
-	    floattensor[2] = itktensor[2] = vtktensor[2] = 0.0;
-	    floattensor[3] = itktensor[3] = vtktensor[4] = 1.0;
-	    floattensor[4] = itktensor[4] = vtktensor[5] = 0.0;
-	    floattensor[5] = itktensor[5] = vtktensor[8] = 1.0;
-	  }
-	  
-	  pt.SetTensorMatrix(floattensor);
-	  
-	  LambdaArrayType lambdas;
-	  
-	  // Need to do do eigenanalysis of the tensor
-	  itktensor.ComputeEigenValues(lambdas);
-	  
-	  // FIXME: We should not be repeating this code here.  The code
-	  // for all these computations should be re-factored into a
-	  // common library.
-	  
-	  float md = (lambdas[0] + lambdas[1] + lambdas[2]) / 3;
-	  float fa = sqrt(1.5) * sqrt( (lambdas[0] - md) * (lambdas[0] - md)
-				       + (lambdas[1] - md) * (lambdas[1] - md)
-				       + (lambdas[2] - md) * (lambdas[2] - md) )
-	    / sqrt(lambdas[0] * lambdas[0] + lambdas[1] * lambdas[1] + lambdas[2] * lambdas[2]);
-	  
-	  float logavg = (log(lambdas[0]) + log(lambdas[1]) + log(lambdas[2]) ) / 3;
-	  
-	  float ga =  sqrt( SQ2(log(lambdas[0]) - logavg) \
-			    + SQ2(log(lambdas[1]) - logavg)	\
-			    + SQ2(log(lambdas[2]) - logavg) );
-	  
-	  float rd = (lambdas[1] + lambdas[0])/2;
-	  
-	  pt.AddField("fa", fa);
-	  pt.AddField("ga", ga);
-	  pt.AddField("md", md);
-	  pt.AddField("l1", lambdas[2]);
-	  pt.AddField("l2", lambdas[1]);
-	  pt.AddField("l3", lambdas[0]);
-	  pt.AddField("rd", rd);
-	  
-	  pointsToAdd.push_back(pt);
-        }
+      int id = static_cast<int>( m_NumberOfPoints + k );
+      WriteBigEndian(m_Spill[1], &id, 1);
+      }
+    }
 
-      dtiTube->SetPoints(pointsToAdd);
-      fibergroup->AddSpatialObject(dtiTube);
+  const unsigned long            npoints = fibers.GetNumberOfPoints();
+  const FiberBundle::ArrayType & tensors = fibers.GetTensors();
+  for( unsigned long k = 0; k < npoints; ++k )
+    {
+    // Convert from LPS -> RAS for slicer 3
+    double world[3];
+    fibers.GetWorldPosition(k, world);
+    float position[3];
+    position[0] = -world[0];
+    position[1] = -world[1];
+    position[2] = world[2];
+    WriteBigEndian(m_Spill[0], position, 3);
+
+    const float * t = &tensors[6 * k];
+    float         vtktensor[9];
+    vtktensor[0] = t[0];
+    vtktensor[1] = t[1];
+    vtktensor[2] = t[2];
+    vtktensor[3] = t[1];
+    vtktensor[4] = t[3];
+    vtktensor[5] = t[4];
+    vtktensor[6] = t[2];
+    vtktensor[7] = t[4];
+    vtktensor[8] = t[5];
+    WriteBigEndian(m_Spill[2], vtktensor, 9);
+    }
+
+  const char * const names[4] = { "fa", "md", "ad", "rd" };
+  for( unsigned int j = 0; j < 4 && m_SaveProperties; ++j )
+    {
+    // -1 as for the missing fields of spatial object points
+    std::vector<float> values(npoints, -1.0f);
+    if( fibers.HasScalar(names[j]) )
+      {
+      values = fibers.GetScalar(names[j]);
       }
-    return fibergroup;
-    } // end process .vtk .vtp
-  else
+    if( npoints > 0 )
+      {
+      WriteBigEndian(m_Spill[3 + j], &values[0], npoints);
+      }
+    }
+
+  m_NumberOfPoints += npoints;
+  m_NumberOfFibers += fibers.GetNumberOfFibers();
+}
+
+void FiberFileWriter::Close()
+{
+  if( m_Mode == Buffered )
     {
-    throw itk::ExceptionObject("Unknown fiber file");
+    writeFiberFile(m_FileName, m_Bundle, m_SaveProperties, m_Encoding);
+    m_Bundle.Clear();
+    return;
+    }
+  else if( m_Mode == Binary )
+    {
+    m_BinaryWriter.Close();
+    return;
+    }
+
+  std::ofstream fiberfile(m_FileName.c_str(), std::ios::out | std::ios::binary);
+  if( !fiberfile )
+    {
+    this->CloseSpillFiles();
+    throw itk::ExceptionObject("Cannot open fiber file for writing");
     }
+
+  // Same layout as vtkPolyDataWriter
+  fiberfile << "# vtk DataFile Version 3.0\nvtk output\nBINARY\nDATASET POLYDATA\n";
+  fiberfile << "POINTS " << m_NumberOfPoints << " float\n";
+  AppendFile(m_Spill[0], fiberfile);
+  fiberfile << "\nLINES " << m_NumberOfFibers << " " << m_NumberOfFibers + m_NumberOfPoints << "\n";
+  AppendFile(m_Spill[1], fiberfile);
+  fiberfile << "\nPOINT_DATA " << m_NumberOfPoints << "\nTENSORS tensors float\n";
+  AppendFile(m_Spill[2], fiberfile);
+  fiberfile << "\n";
+  if( m_SaveProperties )
+    {
+    const char * const names[4] = { "FA", "MD", "AD", "RD" };
+    fiberfile << "FIELD FieldData 4\n";
+    for( unsigned int j = 0; j < 4; ++j )
+      {
+      fiberfile << names[j] << " 1 " << m_NumberOfPoints << " float\n";
+      AppendFile(m_Spill[3 + j], fiberfile);
+      fiberfile << "\n";
+      }
+    }
+  this->CloseSpillFiles();
+
+  if( !fiberfile )
+    {
+    throw itk::ExceptionObject("Cannot write fiber file");
+    }
+}
+
+FiberFileSink::FiberFileSink()
+  : m_SaveProperties(true), m_Encoding("binary")
+{
+}
+
+FiberFileSink::~FiberFileSink()
+{
+}
+
+void FiberFileSink::Begin()
+{
+  m_Chunk.Clear();
+  m_Writer.Open(m_FileName, m_SaveProperties, m_Encoding);
+}
+
+void FiberFileSink::AddFiber(TubeType * tube)
+{
+  // Points passed on to the writer at once
+  const unsigned long ChunkSize = 65536;
+
+  tube->ComputeObjectToWorldTransform();
+  m_Chunk.AddTube(tube);
+  if( m_Chunk.GetNumberOfPoints() >= ChunkSize )
+    {
+    m_Writer.WriteFibers(m_Chunk);
+    m_Chunk.Clear();
+    }
+}
+
+void FiberFileSink::End()
+{
+  m_Writer.WriteFibers(m_Chunk);
+  m_Chunk.Clear();
+  m_Writer.Close();
 }
@@ -2,9 +2,144 @@
 #define FIBERIO_H
 
 #include "dtitypes.h"
+#include "fiberbundle.h"
+#include "fiberbinary.h"
+#include "itkDTITubeSpatialObjectSink.h"
+
+#include <cstdio>
 
 GroupType::Pointer readFiberFile(const std::string & filename);
 
 void writeFiberFile(const std::string & filename, GroupType::Pointer fibergroup, bool saveProperties = true ,  std::string encoding = "binary" );
 
+// Same as readFiberFile and writeFiberFile, for the columnar form of
+// the fibers.  The .vtk, .vtp and binary .fbin files are read and
+// written without building spatial objects.
+void readFiberFile(const std::string & filename, FiberBundle & bundle);
+
+void writeFiberFile(const std::string & filename, const FiberBundle & bundle, bool saveProperties = true, std::string encoding = "binary" );
+
+// Reads a fiber file a chunk of fibers at a time.  Binary .fbin files
+// are mapped and only the fibers of the current chunk are copied, so
+// the memory used does not depend on the size of the file.  The other
+// formats are read in full by Open().
+class FiberFileReader
+{
+public:
+  FiberFileReader();
+
+  void Open(const std::string & filename);
+
+  void Close();
+
+  unsigned long GetNumberOfFibers() const;
+
+  // Replaces the fibers of chunk by the next ones, at most n.  Returns
+  // false, with chunk empty, once all the fibers have been read.
+  bool ReadFibers(unsigned long n, FiberBundle & chunk);
+
+private:
+  FiberFileReader(const FiberFileReader &); // purposely not implemented
+  void operator=(const FiberFileReader &);  // purposely not implemented
+
+  bool            m_Binary;
+  FiberBinaryFile m_BinaryFile;
+  FiberBundle     m_Bundle;
+  unsigned long   m_NextFiber;
+};
+
+// Writes a fiber file a chunk of fibers at a time, in the same format
+// as writeFiberFile.  Binary legacy .vtk and .fbin files are written
+// incrementally: the points, lines and point data are spilled to
+// temporary files as the chunks arrive and assembled by Close(), so the
+// memory used does not depend on the number of fibers.  The other
+// formats are collected in a FiberBundle and written by Close().
+class FiberFileWriter
+{
+public:
+  FiberFileWriter();
+  ~FiberFileWriter();
+
+  void Open(const std::string & filename, bool saveProperties = true, const std::string & encoding = "binary");
+
+  void WriteFibers(const FiberBundle & fibers);
+
+  // Throws itk::ExceptionObject if the file cannot be written
+  void Close();
+
+private:
+  FiberFileWriter(const FiberFileWriter &); // purposely not implemented
+  void operator=(const FiberFileWriter &);  // purposely not implemented
+
+  void CloseSpillFiles();
+
+  enum ModeType { Buffered, LegacyVTK, Binary };
+
+  std::string m_FileName;
+  bool        m_SaveProperties;
+  std::string m_Encoding;
+  ModeType    m_Mode;
+
+  // Fibers of the non streamed formats
+  FiberBundle           m_Bundle;
+  FiberBinaryFileWriter m_BinaryWriter;
+
+  // Points, lines, tensors then the FA, MD, AD and RD arrays of the
+  // legacy .vtk files
+  enum { NumberOfSpillFiles = 7 };
+  std::FILE *   m_Spill[NumberOfSpillFiles];
+  unsigned long m_NumberOfPoints;
+  unsigned long m_NumberOfFibers;
+};
+
+// Writes the fibers it receives to a fiber file with a FiberFileWriter,
+// passing them on by chunks.
+class FiberFileSink : public itk::DTITubeSpatialObjectSink<3>
+{
+public:
+  typedef FiberFileSink                   Self;
+  typedef itk::DTITubeSpatialObjectSink<3> Superclass;
+  typedef itk::SmartPointer<Self>         Pointer;
+  typedef itk::SmartPointer<const Self>   ConstPointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(FiberFileSink, DTITubeSpatialObjectSink);
+
+  void SetFileName(const std::string & filename)
+  {
+    m_FileName = filename;
+  }
+
+  void SetSaveProperties(bool saveProperties)
+  {
+    m_SaveProperties = saveProperties;
+  }
+
+  void SetEncoding(const std::string & encoding)
+  {
+    m_Encoding = encoding;
+  }
+
+  virtual void Begin() ITK_OVERRIDE;
+
+  virtual void AddFiber(TubeType * tube) ITK_OVERRIDE;
+
+  virtual void End() ITK_OVERRIDE;
+
+protected:
+  FiberFileSink();
+  virtual ~FiberFileSink();
+
+private:
+  FiberFileSink(const Self &);  // purposely not implemented
+  void operator=(const Self &); // purposely not implemented
+
+  std::string m_FileName;
+  bool        m_SaveProperties;
+  std::string m_Encoding;
+
+  FiberFileWriter m_Writer;
+  FiberBundle     m_Chunk;
+};
+
 #endif
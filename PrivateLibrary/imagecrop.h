@@ -0,0 +1,44 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef IMAGECROP_H
+#define IMAGECROP_H
+
+#include <itkSmartPointer.h>
+
+// Bounding box of the non-zero voxels of mask grown by margin voxels
+// in every direction and clipped to the image.  If the mask is empty
+// the whole image is returned.
+template <typename TMaskImage>
+typename TMaskImage::RegionType computeMaskBoundingBox(itk::SmartPointer<TMaskImage> mask,
+                                                       unsigned int margin);
+
+// Extracts region from image.  The index and the physical position of
+// every voxel are preserved, so the result can be pasted back with
+// uncropImage.
+template <typename TImage>
+itk::SmartPointer<TImage> cropImage(itk::SmartPointer<TImage> image,
+                                    const typename TImage::RegionType & region);
+
+// Pastes image into a new image with the grid of reference.  Voxels
+// that are not covered by image are set to defaultValue.  If image
+// already covers reference it is returned unchanged.
+template <typename TImage, typename TReferenceImage>
+itk::SmartPointer<TImage> uncropImage(itk::SmartPointer<TImage> image,
+                                      itk::SmartPointer<TReferenceImage> reference,
+                                      const typename TImage::PixelType & defaultValue);
+
+template <typename TImage, typename TReferenceImage>
+itk::SmartPointer<TImage> uncropImage(itk::SmartPointer<TImage> image,
+                                      itk::SmartPointer<TReferenceImage> reference);
+
+#include "imagecrop.txx"
+
+#endif
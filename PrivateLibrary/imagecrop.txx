@@ -0,0 +1,127 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+#include "imagecrop.h"
+#include <itkExtractImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
+#include <itkNumericTraits.h>
+
+#include <algorithm>
+
+template <typename TMaskImage>
+typename TMaskImage::RegionType computeMaskBoundingBox(itk::SmartPointer<TMaskImage> mask,
+                                                       unsigned int margin)
+{
+  typedef typename TMaskImage::RegionType RegionType;
+  typedef typename TMaskImage::IndexType  IndexType;
+  const unsigned int Dimension = TMaskImage::ImageDimension;
+
+  const RegionType largest = mask->GetLargestPossibleRegion();
+
+  IndexType lower = largest.GetUpperIndex();
+  IndexType upper = largest.GetIndex();
+  bool      empty = true;
+
+  typedef itk::ImageRegionConstIteratorWithIndex<TMaskImage> IteratorType;
+  for( IteratorType it(mask, largest); !it.IsAtEnd(); ++it )
+    {
+    if( it.Get() != itk::NumericTraits<typename TMaskImage::PixelType>::ZeroValue() )
+      {
+      const IndexType & index = it.GetIndex();
+      for( unsigned int d = 0; d < Dimension; ++d )
+        {
+        lower[d] = std::min(lower[d], index[d]);
+        upper[d] = std::max(upper[d], index[d]);
+        }
+      empty = false;
+      }
+    }
+
+  if( empty )
+    {
+    return largest;
+    }
+
+  RegionType box;
+  for( unsigned int d = 0; d < Dimension; ++d )
+    {
+    lower[d] -= margin;
+    upper[d] += margin;
+    }
+  box.SetIndex(lower);
+  box.SetUpperIndex(upper);
+  box.Crop(largest);
+
+  return box;
+}
+
+template <typename TImage>
+itk::SmartPointer<TImage> cropImage(itk::SmartPointer<TImage> image,
+                                    const typename TImage::RegionType & region)
+{
+  if( region == image->GetLargestPossibleRegion() )
+    {
+    return image;
+    }
+
+  typedef itk::ExtractImageFilter<TImage, TImage> ExtractFilterType;
+  typename ExtractFilterType::Pointer extract = ExtractFilterType::New();
+  extract->SetInput(image);
+  extract->SetExtractionRegion(region);
+#if ITK_VERSION_MAJOR >= 4
+  extract->SetDirectionCollapseToSubmatrix();
+#endif
+  extract->Update();
+
+  itk::SmartPointer<TImage> output = extract->GetOutput();
+  output->SetMetaDataDictionary(image->GetMetaDataDictionary() );
+  return output;
+}
+
+template <typename TImage, typename TReferenceImage>
+itk::SmartPointer<TImage> uncropImage(itk::SmartPointer<TImage> image,
+                                      itk::SmartPointer<TReferenceImage> reference,
+                                      const typename TImage::PixelType & defaultValue)
+{
+  const typename TImage::RegionType region = image->GetLargestPossibleRegion();
+  if( region == reference->GetLargestPossibleRegion() )
+    {
+    return image;
+    }
+
+  itk::SmartPointer<TImage> output = TImage::New();
+  output->CopyInformation(reference);
+  output->SetRegions(reference->GetLargestPossibleRegion() );
+  output->SetNumberOfComponentsPerPixel(image->GetNumberOfComponentsPerPixel() );
+  output->Allocate();
+  output->FillBuffer(defaultValue);
+  output->SetMetaDataDictionary(image->GetMetaDataDictionary() );
+
+  itk::ImageRegionConstIterator<TImage> in(image, region);
+  itk::ImageRegionIterator<TImage>      out(output, region);
+  for( ; !in.IsAtEnd(); ++in, ++out )
+    {
+    out.Set(in.Get() );
+    }
+
+  return output;
+}
+
+template <typename TImage, typename TReferenceImage>
+itk::SmartPointer<TImage> uncropImage(itk::SmartPointer<TImage> image,
+                                      itk::SmartPointer<TReferenceImage> reference)
+{
+  typename TImage::PixelType zero;
+  zero = itk::NumericTraits<typename TImage::PixelType>::ZeroValue();
+  return uncropImage(image, reference, zero);
+}
@@ -0,0 +1,178 @@
+#include "regionstatistics.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <itkExceptionObject.h>
+#include <vnl/vnl_math.h>
+
+#include "itkTensorLabelStatisticsImageFilter.h"
+
+typedef itk::TensorLabelStatisticsImageFilter<TensorImageType, IntImageType> StatisticsFilterType;
+
+namespace
+{
+
+// Column suffix of a percentile, e.g. 5 -> p5, 2.5 -> p2.5
+std::string percentileName(double p)
+{
+  std::ostringstream oss;
+  oss << "p" << p;
+  return oss.str();
+}
+
+const char* const logEuclideanNames[6] = { "xx", "xy", "xz", "yy", "yz", "zz" };
+
+// The statistics of invalid tensors are empty CSV fields
+struct CSVNumber
+{
+  explicit CSVNumber(double v) : value(v)
+  {
+  }
+
+  double value;
+};
+
+std::ostream & operator<<(std::ostream & os, const CSVNumber & n)
+{
+  if( !vnl_math_isfinite(n.value) )
+    {
+    return os;
+    }
+  return os << n.value;
+}
+
+void writeCSV(std::ostream & os, const StatisticsFilterType * stats)
+{
+  const std::vector<double> & percentiles = stats->GetPercentiles();
+
+  os << "label,count,nonfinite";
+  for( unsigned int m = 0; m < StatisticsFilterType::NumberOfMeasures; ++m )
+    {
+    const std::string name = StatisticsFilterType::GetMeasureName(m);
+    os << "," << name << "_mean," << name << "_std,"
+       << name << "_min," << name << "_max";
+    for( unsigned int p = 0; p < percentiles.size(); ++p )
+      {
+      os << "," << name << "_" << percentileName(percentiles[p]);
+      }
+    }
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    os << ",le_" << logEuclideanNames[i];
+    }
+  os << std::endl;
+
+  const StatisticsFilterType::ValidLabelValuesContainerType & labels = stats->GetValidLabelValues();
+  for( unsigned int l = 0; l < labels.size(); ++l )
+    {
+    const StatisticsFilterType::LabelStatistics & ls = stats->GetLabelStatistics(labels[l]);
+    os << labels[l] << "," << ls.Count << "," << ls.NonFiniteCount;
+    for( unsigned int m = 0; m < StatisticsFilterType::NumberOfMeasures; ++m )
+      {
+      const StatisticsFilterType::MeasureStatistics & ms = ls.Measures[m];
+      os << "," << CSVNumber(ms.Mean) << "," << CSVNumber(ms.Sigma) << "," << CSVNumber(ms.Minimum) << ","
+         << CSVNumber(ms.Maximum);
+      for( unsigned int p = 0; p < ms.Percentiles.size(); ++p )
+        {
+        os << "," << CSVNumber(ms.Percentiles[p]);
+        }
+      }
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      os << "," << CSVNumber(ls.LogEuclideanMean[i]);
+      }
+    os << std::endl;
+    }
+}
+
+// JSON has no NaN or infinity: the statistics of labels with too few
+// voxels, or of invalid tensors, are written as null
+struct JSONNumber
+{
+  explicit JSONNumber(double v) : value(v)
+  {
+  }
+
+  double value;
+};
+
+std::ostream & operator<<(std::ostream & os, const JSONNumber & n)
+{
+  if( !vnl_math_isfinite(n.value) )
+    {
+    return os << "null";
+    }
+  return os << n.value;
+}
+
+void writeJSON(std::ostream & os, const StatisticsFilterType * stats)
+{
+  const std::vector<double> & percentiles = stats->GetPercentiles();
+
+  os << "{" << std::endl << "  \"labels\": [";
+  const StatisticsFilterType::ValidLabelValuesContainerType & labels = stats->GetValidLabelValues();
+  for( unsigned int l = 0; l < labels.size(); ++l )
+    {
+    const StatisticsFilterType::LabelStatistics & ls = stats->GetLabelStatistics(labels[l]);
+    os << (l ? "," : "") << std::endl
+       << "    {" << std::endl
+       << "      \"label\": " << labels[l] << "," << std::endl
+       << "      \"count\": " << ls.Count << "," << std::endl
+       << "      \"nonfinite\": " << ls.NonFiniteCount << "," << std::endl;
+    for( unsigned int m = 0; m < StatisticsFilterType::NumberOfMeasures; ++m )
+      {
+      const StatisticsFilterType::MeasureStatistics & ms = ls.Measures[m];
+      os << "      \"" << StatisticsFilterType::GetMeasureName(m) << "\": {"
+         << "\"mean\": " << JSONNumber(ms.Mean) << ", \"std\": " << JSONNumber(ms.Sigma)
+         << ", \"min\": " << JSONNumber(ms.Minimum) << ", \"max\": " << JSONNumber(ms.Maximum);
+      for( unsigned int p = 0; p < ms.Percentiles.size(); ++p )
+        {
+        os << ", \"" << percentileName(percentiles[p]) << "\": " << JSONNumber(ms.Percentiles[p]);
+        }
+      os << "}," << std::endl;
+      }
+    os << "      \"logeuclidean_mean\": [";
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      os << (i ? ", " : "") << JSONNumber(ls.LogEuclideanMean[i]);
+      }
+    os << "]" << std::endl << "    }";
+    }
+  os << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+}
+
+void writeRegionStatistics(const std::string & filename,
+                           TensorImageType::Pointer tensors,
+                           IntImageType::Pointer labels,
+                           const std::vector<double> & percentiles)
+{
+  StatisticsFilterType::Pointer stats = StatisticsFilterType::New();
+  stats->SetInput(tensors);
+  stats->SetLabelInput(labels);
+  if( !percentiles.empty() )
+    {
+    stats->SetPercentiles(percentiles);
+    }
+  stats->Update();
+
+  std::ofstream out(filename.c_str() );
+  if( !out )
+    {
+    throw itk::ExceptionObject(__FILE__, __LINE__, "Could not open statistics output file " + filename);
+    }
+  out << std::setprecision(10);
+
+  const std::string::size_type dot = filename.find_last_of('.');
+  if( dot != std::string::npos && filename.substr(dot) == ".json" )
+    {
+    writeJSON(out, stats);
+    }
+  else
+    {
+    writeCSV(out, stats);
+    }
+}
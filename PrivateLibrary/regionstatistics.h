@@ -0,0 +1,20 @@
+#ifndef REGIONSTATISTICS_H
+#define REGIONSTATISTICS_H
+
+#include "dtitypes.h"
+
+#include <string>
+#include <vector>
+
+// Computes the tensor measures of every label of the label image and
+// writes them to filename.  The report is JSON if the filename ends
+// in .json and CSV (one row per label) otherwise.  Label 0 is
+// ignored.  The voxels of invalid tensors are counted as nonfinite
+// and left out of the statistics, which are null in JSON and empty in
+// CSV when no valid voxel remains.
+void writeRegionStatistics(const std::string & filename,
+                           TensorImageType::Pointer tensors,
+                           IntImageType::Pointer labels,
+                           const std::vector<double> & percentiles);
+
+#endif
@@ -0,0 +1,201 @@
+#include "tensoraverage.h"
+
+#include <itkBinaryFunctorImageFilter.h>
+#include <itkUnaryFunctorImageFilter.h>
+#include <itkAddImageFilter.h>
+#include <itkImageDuplicator.h>
+
+#include "itkComposeFunctor.h"
+#include "itkLogEuclideanTensorImageFilter.h"
+#include "itkExpEuclideanTensorImageFilter.h"
+#include "accumulatorstate.h"
+
+namespace
+{
+
+// Multiplies a Log-Euclidean vector by a constant
+class LogTensorScale
+{
+public:
+  LogTensorScale() : m_Scale(1.0)
+  {
+  }
+
+  void SetScale(double scale)
+  {
+    m_Scale = scale;
+  }
+
+  bool operator!=( const LogTensorScale & other ) const
+  {
+    return m_Scale != other.m_Scale;
+  }
+
+  bool operator==( const LogTensorScale & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline LogTensorPixelType operator()( const LogTensorPixelType & x ) const
+  {
+    return x * m_Scale;
+  }
+
+private:
+  double m_Scale;
+};
+
+}
+
+LogEuclideanSum::LogEuclideanSum() : m_Count(0)
+{
+}
+
+void LogEuclideanSum::CheckGrid(const itk::ImageBase<DIM> * image) const
+{
+  if( m_Sum && image->GetLargestPossibleRegion() != m_Sum->GetLargestPossibleRegion() )
+    {
+    throw itk::ExceptionObject("Tensor fields to average must have the same size");
+    }
+}
+
+void LogEuclideanSum::Add(TensorImageType::Pointer tensors)
+{
+  CheckGrid(tensors);
+
+  if( !m_Sum )
+    {
+    typedef itk::LogEuclideanTensorImageFilter<double> LogEuclideanFilterType;
+    LogEuclideanFilterType::Pointer logf = LogEuclideanFilterType::New();
+    logf->SetInput(tensors);
+    logf->Update();
+
+    m_Sum = logf->GetOutput();
+    m_Sum->DisconnectPipeline();
+    }
+  else
+    {
+    typedef itk::Functor::LogEuclideanTensorAccumulateFunction<LogTensorPixelType, TensorPixelType> FunctorType;
+    typedef itk::BinaryFunctorImageFilter<LogTensorImageType, TensorImageType, LogTensorImageType,
+                                          FunctorType> AccumulateFilterType;
+    AccumulateFilterType::Pointer accumulate = AccumulateFilterType::New();
+    accumulate->SetInput1(m_Sum);
+    accumulate->SetInput2(tensors);
+    accumulate->InPlaceOn();
+    accumulate->Update();
+
+    m_Sum = accumulate->GetOutput();
+    m_Sum->DisconnectPipeline();
+    }
+  ++m_Count;
+}
+
+void LogEuclideanSum::Add(LogTensorImageType::Pointer logtensors)
+{
+  AddSum(logtensors, 1);
+}
+
+void LogEuclideanSum::AddSum(LogTensorImageType::Pointer sum, unsigned int count)
+{
+  CheckGrid(sum);
+
+  if( !m_Sum )
+    {
+    m_Sum = sum;
+    }
+  else
+    {
+    typedef itk::AddImageFilter<LogTensorImageType, LogTensorImageType, LogTensorImageType> AddFilterType;
+    AddFilterType::Pointer add = AddFilterType::New();
+    add->SetInput1(m_Sum);
+    add->SetInput2(sum);
+    add->InPlaceOn();
+    add->Update();
+
+    m_Sum = add->GetOutput();
+    m_Sum->DisconnectPipeline();
+    }
+  m_Count += count;
+}
+
+void LogEuclideanSum::Merge(const LogEuclideanSum & other)
+{
+  if( !other.m_Count )
+    {
+    return;
+    }
+
+  LogTensorImageType::Pointer sum = other.m_Sum;
+  if( !m_Sum )
+    {
+    // The first sum becomes the accumulation buffer, do not modify the
+    // other one
+    typedef itk::ImageDuplicator<LogTensorImageType> DuplicatorType;
+    DuplicatorType::Pointer dup = DuplicatorType::New();
+    dup->SetInputImage(other.m_Sum);
+    dup->Update();
+    sum = dup->GetOutput();
+    }
+  AddSum(sum, other.m_Count);
+}
+
+void LogEuclideanSum::Save(const std::string & filename) const
+{
+  if( !m_Count )
+    {
+    throw itk::ExceptionObject("No tensor field to save in the state");
+    }
+  writeAccumulatorState(filename, m_Sum, "LogEuclideanSum", m_Count);
+}
+
+void LogEuclideanSum::Merge(const std::string & filename)
+{
+  unsigned int                count = 0;
+  LogTensorImageType::Pointer sum = readAccumulatorState<LogTensorImageType>(filename, "LogEuclideanSum", count);
+
+  AddSum(sum, count);
+}
+
+LogTensorImageType::Pointer LogEuclideanSum::GetLogMean() const
+{
+  if( !m_Count )
+    {
+    throw itk::ExceptionObject("No tensor field to average");
+    }
+
+  typedef itk::UnaryFunctorImageFilter<LogTensorImageType, LogTensorImageType, LogTensorScale> ScaleFilterType;
+  LogTensorScale scale;
+  scale.SetScale(1.0 / m_Count);
+
+  ScaleFilterType::Pointer filter = ScaleFilterType::New();
+  filter->SetInput(m_Sum);
+  filter->SetFunctor(scale);
+  filter->Update();
+
+  LogTensorImageType::Pointer mean = filter->GetOutput();
+  mean->SetMetaDataDictionary(m_Sum->GetMetaDataDictionary() );
+  return mean;
+}
+
+TensorImageType::Pointer LogEuclideanSum::GetMean() const
+{
+  if( !m_Count )
+    {
+    throw itk::ExceptionObject("No tensor field to average");
+    }
+
+  typedef itk::Functor::ExpEuclideanTensorFunction<LogTensorPixelType> ExpFunctionType;
+  typedef itk::Functor::Compose<LogTensorScale, ExpFunctionType,
+                                LogTensorPixelType, TensorPixelType> FunctorType;
+  typedef itk::UnaryFunctorImageFilter<LogTensorImageType, TensorImageType, FunctorType> MeanFilterType;
+
+  FunctorType functor;
+  functor.GetFirst().SetScale(1.0 / m_Count);
+
+  MeanFilterType::Pointer filter = MeanFilterType::New();
+  filter->SetInput(m_Sum);
+  filter->SetFunctor(functor);
+  filter->Update();
+
+  return filter->GetOutput();
+}
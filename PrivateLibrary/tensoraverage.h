@@ -0,0 +1,62 @@
+#ifndef TENSORAVERAGE_H
+#define TENSORAVERAGE_H
+
+#include "dtitypes.h"
+#include <string>
+
+// Running sum of the matrix logarithms of a series of tensor fields,
+// used to compute their Log-Euclidean mean one input at a time.
+//
+// The sum is a single buffer updated in place: each tensor input goes
+// through one multithreaded pass that computes the logarithm and adds
+// it, so memory does not grow with the number of inputs and no
+// intermediate image is allocated or copied.
+class LogEuclideanSum
+{
+public:
+  LogEuclideanSum();
+
+  // Add a tensor field.  All the inputs must share the same grid.
+  void Add(TensorImageType::Pointer tensors);
+
+  // Add a field already in the Log-Euclidean domain.  The first image
+  // added this way becomes the accumulation buffer and is modified.
+  void Add(LogTensorImageType::Pointer logtensors);
+
+  // Add the subjects of another sum.  Merging is associative, so sums
+  // of disjoint groups of subjects can be computed separately.
+  void Merge(const LogEuclideanSum & other);
+
+  // Save the sum and the count to a state file, and merge a saved
+  // state.  A saved state can be resumed by merging it into an empty
+  // sum.
+  void Save(const std::string & filename) const;
+
+  void Merge(const std::string & filename);
+
+  unsigned int GetCount() const
+  {
+    return m_Count;
+  }
+
+  LogTensorImageType::Pointer GetSum() const
+  {
+    return m_Sum;
+  }
+
+  // Mean in the Log-Euclidean domain
+  LogTensorImageType::Pointer GetLogMean() const;
+
+  // exp of the mean, with the division fused in the same pass
+  TensorImageType::Pointer GetMean() const;
+
+private:
+  void CheckGrid(const itk::ImageBase<DIM> * image) const;
+
+  void AddSum(LogTensorImageType::Pointer sum, unsigned int count);
+
+  LogTensorImageType::Pointer m_Sum;
+  unsigned int                m_Count;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "tensorcorrection.h"
+
+#include <itkUnaryFunctorImageFilter.h>
+#include <itkBinaryFunctorImageFilter.h>
+
+#include "itkComposeFunctor.h"
+#include "itkVectorMaskImageFilter.h"
+#include "itkDiffusionTensor3DZeroCorrection.h"
+#include "itkDiffusionTensor3DAbsCorrection.h"
+#include "itkDiffusionTensor3DNearestCorrection.h"
+
+namespace
+{
+
+// Component-wise cast used when no correction is requested.
+template <class TInput, class TOutput>
+class TensorCast
+{
+public:
+  bool operator!=( const TensorCast & ) const
+  {
+    return false;
+  }
+
+  bool operator==( const TensorCast & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline itk::DiffusionTensor3D<TOutput> operator()( const itk::DiffusionTensor3D<TInput> & A ) const
+  {
+    itk::DiffusionTensor3D<TOutput> tensor;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      tensor[i] = static_cast<TOutput>( A[i] );
+      }
+    return tensor;
+  }
+
+};
+
+template <class TOutputImage, class TCorrection>
+typename TOutputImage::Pointer applyCorrection(TensorImageType::Pointer tensors,
+                                               LabelImageType::Pointer mask)
+{
+  typedef typename TOutputImage::PixelType OutputPixelType;
+
+  if( mask )
+    {
+    typedef itk::Functor::VectorMaskInput<OutputPixelType, LabelType, OutputPixelType> MaskType;
+    typedef itk::Functor::ComposeBinary<TCorrection, MaskType,
+                                        TensorPixelType, LabelType, OutputPixelType> FunctorType;
+    typedef itk::BinaryFunctorImageFilter<TensorImageType, LabelImageType, TOutputImage,
+                                          FunctorType> FilterType;
+    typename FilterType::Pointer filter = FilterType::New();
+    filter->SetInput1(tensors);
+    filter->SetInput2(mask);
+    filter->Update();
+
+    return filter->GetOutput();
+    }
+
+  typedef itk::UnaryFunctorImageFilter<TensorImageType, TOutputImage, TCorrection> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(tensors);
+  filter->Update();
+
+  return filter->GetOutput();
+}
+
+}
+
+template <class TOutputImage>
+typename TOutputImage::Pointer correctTensors(TensorImageType::Pointer tensors,
+                                              const std::string & correction,
+                                              LabelImageType::Pointer mask)
+{
+  typedef typename TOutputImage::PixelType::ComponentType ComponentType;
+
+  if( correction == "zero" )
+    {
+    return applyCorrection<TOutputImage,
+                           itk::Functor::DiffusionTensor3DZero<double, ComponentType> >(tensors, mask);
+    }
+  else if( correction == "abs" )
+    {
+    return applyCorrection<TOutputImage,
+                           itk::Functor::DiffusionTensor3DAbs<double, ComponentType> >(tensors, mask);
+    }
+  else if( correction == "nearest" )
+    {
+    return applyCorrection<TOutputImage,
+                           itk::Functor::DiffusionTensor3DNearest<double, ComponentType> >(tensors, mask);
+    }
+  return applyCorrection<TOutputImage, TensorCast<double, ComponentType> >(tensors, mask);
+}
+
+template TensorImageType::Pointer correctTensors<TensorImageType>(TensorImageType::Pointer,
+                                                                  const std::string &,
+                                                                  LabelImageType::Pointer);
+
+template TensorFloatImageType::Pointer correctTensors<TensorFloatImageType>(TensorImageType::Pointer,
+                                                                            const std::string &,
+                                                                            LabelImageType::Pointer);
@@ -0,0 +1,16 @@
+#ifndef TENSORCORRECTION_H
+#define TENSORCORRECTION_H
+
+#include "dtitypes.h"
+#include <string>
+
+// Applies the eigenvalue correction ("none", "zero", "abs" or
+// "nearest") and the mask (if not null) to the tensors, and casts them
+// to the tensor type of the output image.  All the steps are fused in
+// a single pass over the image.
+template <class TOutputImage>
+typename TOutputImage::Pointer correctTensors(TensorImageType::Pointer tensors,
+                                              const std::string & correction,
+                                              LabelImageType::Pointer mask);
+
+#endif
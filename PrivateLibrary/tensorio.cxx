@@ -1,11 +1,273 @@
 #include "tensorio.h"
 
-// TensorImageType::Pointer readTensors(const std::string & filename)
-// {
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkImageIOFactory.h>
+#include <itkMetaDataObject.h>
+#include <itkCastImageFilter.h>
 
-// }
+#include "itkLogEuclideanTensorImageFilter.h"
+#include "itkExpEuclideanTensorImageFilter.h"
+#include "imagecrop.h"
 
-// void writeTensors(const std::string & filename, tensorimage)
-// {
+const char* const LOGEUCLIDEAN_KEY = "DTIProcess_LogEuclidean";
 
-// }
+namespace
+{
+
+// Image IO of filename with the header read
+itk::ImageIOBase::Pointer readTensorFileInformation(const std::string & filename)
+{
+  itk::ImageIOBase::Pointer io =
+    itk::ImageIOFactory::CreateImageIO(filename.c_str(), itk::ImageIOFactory::ReadMode);
+
+  if( !io )
+    {
+    throw itk::ExceptionObject("Unknown tensor file format");
+    }
+  io->SetFileName(filename);
+  io->ReadImageInformation();
+  return io;
+}
+
+}
+
+bool isLogEuclideanFile(const std::string & filename)
+{
+  itk::ImageIOBase::Pointer io = readTensorFileInformation(filename);
+
+  std::string value;
+  return itk::ExposeMetaData<std::string>(io->GetMetaDataDictionary(), LOGEUCLIDEAN_KEY, value)
+         && value == "true";
+}
+
+LogTensorImageType::Pointer logTensors(TensorImageType::Pointer tensors)
+{
+  typedef itk::LogEuclideanTensorImageFilter<double> LogEuclideanFilterType;
+  LogEuclideanFilterType::Pointer logf = LogEuclideanFilterType::New();
+  logf->SetInput(tensors);
+  logf->Update();
+
+  LogTensorImageType::Pointer logtensors = logf->GetOutput();
+  logtensors->SetMetaDataDictionary(tensors->GetMetaDataDictionary() );
+  return logtensors;
+}
+
+TensorImageType::Pointer expTensors(LogTensorImageType::Pointer logtensors)
+{
+  typedef itk::ExpEuclideanTensorImageFilter<double> ExpEuclideanFilterType;
+  ExpEuclideanFilterType::Pointer expf = ExpEuclideanFilterType::New();
+  expf->SetInput(logtensors);
+  expf->Update();
+
+  TensorImageType::Pointer tensors = expf->GetOutput();
+  tensors->SetMetaDataDictionary(logtensors->GetMetaDataDictionary() );
+  if( tensors->GetMetaDataDictionary().HasKey(LOGEUCLIDEAN_KEY) )
+    {
+    itk::EncapsulateMetaData<std::string>(tensors->GetMetaDataDictionary(), LOGEUCLIDEAN_KEY, "false");
+    }
+  return tensors;
+}
+
+TensorImageType::Pointer readTensors(const std::string & filename)
+{
+  if( isLogEuclideanFile(filename) )
+    {
+    return expTensors(readLogTensors(filename) );
+    }
+
+  typedef itk::ImageFileReader<TensorImageType> TensorFileReaderType;
+  TensorFileReaderType::Pointer reader = TensorFileReaderType::New();
+  reader->SetFileName(filename.c_str() );
+  reader->Update();
+
+  return reader->GetOutput();
+}
+
+LogTensorImageType::Pointer readLogTensors(const std::string & filename)
+{
+  if( !isLogEuclideanFile(filename) )
+    {
+    return logTensors(readTensors(filename) );
+    }
+
+  typedef itk::ImageFileReader<LogTensorImageType> LogTensorFileReaderType;
+  LogTensorFileReaderType::Pointer reader = LogTensorFileReaderType::New();
+  reader->SetFileName(filename.c_str() );
+  reader->Update();
+
+  return reader->GetOutput();
+}
+
+void writeLogTensors(const std::string & filename, LogTensorImageType::Pointer logtensors,
+                     bool doublePrecision)
+{
+  itk::MetaDataDictionary dict = logtensors->GetMetaDataDictionary();
+  itk::EncapsulateMetaData<std::string>(dict, LOGEUCLIDEAN_KEY, "true");
+
+  if( doublePrecision )
+    {
+    typedef itk::ImageFileWriter<LogTensorImageType> LogTensorFileWriterType;
+    LogTensorFileWriterType::Pointer writer = LogTensorFileWriterType::New();
+    logtensors->SetMetaDataDictionary(dict);
+    writer->SetInput(logtensors);
+    writer->SetFileName(filename.c_str() );
+    writer->SetUseCompression(true);
+    writer->Update();
+    }
+  else
+    {
+    typedef itk::Image<itk::Vector<float, 6>, DIM>                           LogTensorFloatImageType;
+    typedef itk::CastImageFilter<LogTensorImageType, LogTensorFloatImageType> CastFilterType;
+    CastFilterType::Pointer cast = CastFilterType::New();
+    cast->SetInput(logtensors);
+    cast->Update();
+
+    LogTensorFloatImageType::Pointer logfloat = cast->GetOutput();
+    logfloat->SetMetaDataDictionary(dict);
+
+    typedef itk::ImageFileWriter<LogTensorFloatImageType> LogTensorFileWriterType;
+    LogTensorFileWriterType::Pointer writer = LogTensorFileWriterType::New();
+    writer->SetInput(logfloat);
+    writer->SetFileName(filename.c_str() );
+    writer->SetUseCompression(true);
+    writer->Update();
+    }
+}
+
+TensorImageType::RegionType readTensorFileRegion(const std::string & filename)
+{
+  typedef itk::ImageFileReader<TensorImageType> TensorFileReaderType;
+  TensorFileReaderType::Pointer reader = TensorFileReaderType::New();
+  reader->SetFileName(filename.c_str() );
+  reader->UpdateOutputInformation();
+
+  return reader->GetOutput()->GetLargestPossibleRegion();
+}
+
+namespace
+{
+
+template <class TImage>
+typename TImage::Pointer readImageRegion(const std::string & filename,
+                                         const typename TImage::RegionType & region)
+{
+  typedef itk::ImageFileReader<TImage> FileReaderType;
+  typename FileReaderType::Pointer reader = FileReaderType::New();
+  reader->SetFileName(filename.c_str() );
+  reader->UpdateOutputInformation();
+  if( !reader->GetOutput()->GetLargestPossibleRegion().IsInside(region) )
+    {
+    throw itk::ExceptionObject("Requested region is outside of the tensor file");
+    }
+
+  // The extraction only requests region from the reader
+  typename TImage::Pointer image = cropImage<TImage>(reader->GetOutput(), region);
+  if( image == reader->GetOutput() )
+    {
+    reader->Update();
+    }
+  image->DisconnectPipeline();
+  return image;
+}
+
+}
+
+bool canStreamReadTensorFile(const std::string & filename)
+{
+  return readTensorFileInformation(filename)->CanStreamRead();
+}
+
+TensorImageType::Pointer readTensorRegion(const std::string & filename,
+                                          const TensorImageType::RegionType & region)
+{
+  if( isLogEuclideanFile(filename) )
+    {
+    return expTensors(readImageRegion<LogTensorImageType>(filename, region) );
+    }
+  return readImageRegion<TensorImageType>(filename, region);
+}
+
+void readTensorFile(const std::string & filename, TensorImageType::Pointer & tensors,
+                    LogTensorImageType::Pointer & logtensors)
+{
+  tensors = ITK_NULLPTR;
+  logtensors = ITK_NULLPTR;
+  if( isLogEuclideanFile(filename) )
+    {
+    logtensors = readLogTensors(filename);
+    }
+  else
+    {
+    tensors = readTensors(filename);
+    }
+}
+
+TensorFilePrefetcher::TensorFilePrefetcher()
+  : m_Threader(itk::MultiThreader::New() ), m_ThreadId(0), m_Running(false), m_Failed(false)
+{
+}
+
+TensorFilePrefetcher::~TensorFilePrefetcher()
+{
+  if( m_Running )
+    {
+    m_Threader->TerminateThread(m_ThreadId);
+    }
+}
+
+void TensorFilePrefetcher::Start(const std::string & filename)
+{
+  if( m_Running )
+    {
+    throw itk::ExceptionObject("A tensor file is already being read");
+    }
+  m_FileName = filename;
+  m_Tensors = ITK_NULLPTR;
+  m_LogTensors = ITK_NULLPTR;
+  m_Failed = false;
+  m_ThreadId = m_Threader->SpawnThread(&TensorFilePrefetcher::ReadThread, this);
+  m_Running = true;
+}
+
+void TensorFilePrefetcher::Wait(TensorImageType::Pointer & tensors, LogTensorImageType::Pointer & logtensors)
+{
+  if( !m_Running )
+    {
+    throw itk::ExceptionObject("No tensor file is being read");
+    }
+  // Joins the reading thread
+  m_Threader->TerminateThread(m_ThreadId);
+  m_Running = false;
+
+  if( m_Failed )
+    {
+    throw m_Exception;
+    }
+  tensors = m_Tensors;
+  logtensors = m_LogTensors;
+  m_Tensors = ITK_NULLPTR;
+  m_LogTensors = ITK_NULLPTR;
+}
+
+ITK_THREAD_RETURN_TYPE TensorFilePrefetcher::ReadThread(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  TensorFilePrefetcher *                 self = static_cast<TensorFilePrefetcher *>(info->UserData);
+
+  try
+    {
+    readTensorFile(self->m_FileName, self->m_Tensors, self->m_LogTensors);
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    self->m_Exception = e;
+    self->m_Failed = true;
+    }
+  catch( std::exception & e )
+    {
+    self->m_Exception = itk::ExceptionObject(__FILE__, __LINE__, e.what() );
+    self->m_Failed = true;
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
@@ -2,9 +2,90 @@
 #define TENSORIO_H
 
 #include "dtitypes.h"
+#include <string>
 
-// IO functions
-// TensorImageType::Pointer readTensors(const std::string & filename);
-// void writeTensors(const std:string& filename, TensorImageType::Pointer tensorimage);
+#include <itkMultiThreader.h>
+
+// Log-Euclidean tensor files are 6-component vector images (nrrd)
+// holding the unique elements of the matrix logarithm of the tensors,
+// as computed by LogEuclideanTensorImageFilter.  The header carries
+// the LOGEUCLIDEAN_KEY field so that the tools can read them in place
+// of tensor files and skip the log/exp conversions.
+extern const char* const LOGEUCLIDEAN_KEY;
+
+// Returns true if the header of filename marks it as a Log-Euclidean
+// tensor file.  Only the header is read.
+bool isLogEuclideanFile(const std::string & filename);
+
+// Matrix logarithm and exponential of a tensor image.  The metadata
+// dictionary is preserved.
+LogTensorImageType::Pointer logTensors(TensorImageType::Pointer tensors);
+
+TensorImageType::Pointer expTensors(LogTensorImageType::Pointer logtensors);
+
+// Read a tensor or Log-Euclidean tensor file, converting it to the
+// requested domain only if necessary.
+TensorImageType::Pointer readTensors(const std::string & filename);
+
+LogTensorImageType::Pointer readLogTensors(const std::string & filename);
+
+// Write a Log-Euclidean tensor file.  Components are stored as float
+// unless doublePrecision is set.
+void writeLogTensors(const std::string & filename, LogTensorImageType::Pointer logtensors,
+                     bool doublePrecision = false);
+
+// Largest possible region of a tensor or Log-Euclidean tensor file.
+// Only the header is read.
+TensorImageType::RegionType readTensorFileRegion(const std::string & filename);
+
+// Whether the image IO of filename can read a region without decoding
+// the whole file.  Compressed files and most formats cannot.  Only the
+// header is read.
+bool canStreamReadTensorFile(const std::string & filename);
+
+// Read region of a tensor or Log-Euclidean tensor file, converted to
+// tensors.  The result covers exactly region with the indices of the
+// full image.  Only region is read from formats that support
+// streaming, others are read entirely and cropped, see
+// canStreamReadTensorFile().
+TensorImageType::Pointer readTensorRegion(const std::string & filename,
+                                          const TensorImageType::RegionType & region);
+
+// Read a tensor or Log-Euclidean tensor file without any conversion.
+// Exactly one of tensors and logtensors is set on return.
+void readTensorFile(const std::string & filename, TensorImageType::Pointer & tensors,
+                    LogTensorImageType::Pointer & logtensors);
+
+// Reads a tensor file on a background thread so that the next input of
+// a series can be loaded while the current one is processed.
+class TensorFilePrefetcher
+{
+public:
+  TensorFilePrefetcher();
+  ~TensorFilePrefetcher();
+
+  // Start reading filename.  Must not be called again before Wait().
+  void Start(const std::string & filename);
+
+  // Wait for the read to finish and return the image as
+  // readTensorFile() does.  Read errors are rethrown here.
+  void Wait(TensorImageType::Pointer & tensors, LogTensorImageType::Pointer & logtensors);
+
+private:
+  TensorFilePrefetcher(const TensorFilePrefetcher &); // purposely not implemented
+  void operator=(const TensorFilePrefetcher &);       // purposely not implemented
+
+  static ITK_THREAD_RETURN_TYPE ReadThread(void* arg);
+
+  itk::MultiThreader::Pointer m_Threader;
+  itk::ThreadIdType           m_ThreadId;
+  bool                        m_Running;
+
+  std::string                 m_FileName;
+  TensorImageType::Pointer    m_Tensors;
+  LogTensorImageType::Pointer m_LogTensors;
+  bool                        m_Failed;
+  itk::ExceptionObject        m_Exception;
+};
 
 #endif
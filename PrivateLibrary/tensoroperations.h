@@ -3,6 +3,8 @@
 
 #include "tensorscalars.h"
 #include "tensordeformation.h"
+#include "tensorcorrection.h"
+#include "regionstatistics.h"
 #include "tensorio.h"
 
 #endif
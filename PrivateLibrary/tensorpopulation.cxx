@@ -0,0 +1,476 @@
+#include "tensorpopulation.h"
+
+#include <itkBinaryFunctorImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkSymmetricSecondRankTensor.h>
+#include <itkImageDuplicator.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "itkLogEuclideanTensorImageFilter.h"
+#include "itkExpEuclideanTensorImageFilter.h"
+#include "accumulatorstate.h"
+
+typedef LogEuclideanPopulationStatistics::StatePixelType        StatePixelType;
+typedef LogEuclideanPopulationStatistics::StateImageType        StateImageType;
+typedef LogEuclideanPopulationStatistics::OutputVectorImageType OutputVectorImageType;
+
+namespace
+{
+
+// Number of unique elements of the 6x6 covariance
+const unsigned int CovarianceSize = 21;
+
+class LogTensorIdentity
+{
+public:
+  bool operator!=( const LogTensorIdentity & ) const
+  {
+    return false;
+  }
+
+  inline LogTensorPixelType operator()( const LogTensorPixelType & x ) const
+  {
+    return x;
+  }
+
+};
+
+// Welford update of the running mean (components 0-5) and scatter
+// matrix (components 6-26) of the log vectors with one more subject.
+template <class TInput, class TToLog>
+class WelfordLogTensorUpdate
+{
+public:
+  WelfordLogTensorUpdate() : m_Count(1)
+  {
+  }
+
+  // Number of subjects including the one being added
+  void SetCount(unsigned int count)
+  {
+    m_Count = count;
+  }
+
+  bool operator!=( const WelfordLogTensorUpdate & other ) const
+  {
+    return m_Count != other.m_Count;
+  }
+
+  bool operator==( const WelfordLogTensorUpdate & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline StatePixelType operator()( const StatePixelType & state, const TInput & x ) const
+  {
+    const LogTensorPixelType logx = m_ToLog(x);
+
+    StatePixelType op;
+    double         delta[6];
+    double         delta2[6];
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      delta[i] = logx[i] - state[i];
+      op[i] = state[i] + delta[i] / m_Count;
+      delta2[i] = logx[i] - op[i];
+      }
+
+    unsigned int index = 6;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      for( unsigned int j = i; j < 6; ++j, ++index )
+        {
+        op[index] = state[index] + delta[i] * delta2[j];
+        }
+      }
+    return op;
+  }
+
+private:
+  unsigned int m_Count;
+  TToLog       m_ToLog;
+};
+
+// Pairwise merge of two (mean, scatter) states holding countA and
+// countB subjects
+class MergeStates
+{
+public:
+  MergeStates() : m_CountA(0), m_CountB(0)
+  {
+  }
+
+  void SetCounts(unsigned int countA, unsigned int countB)
+  {
+    m_CountA = countA;
+    m_CountB = countB;
+  }
+
+  bool operator!=( const MergeStates & other ) const
+  {
+    return m_CountA != other.m_CountA || m_CountB != other.m_CountB;
+  }
+
+  bool operator==( const MergeStates & other ) const
+  {
+    return !(*this != other);
+  }
+
+  inline StatePixelType operator()( const StatePixelType & a, const StatePixelType & b ) const
+  {
+    const double n = static_cast<double>(m_CountA) + m_CountB;
+    const double weight = static_cast<double>(m_CountA) * m_CountB / n;
+
+    StatePixelType op;
+    double         delta[6];
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      delta[i] = b[i] - a[i];
+      op[i] = a[i] + delta[i] * m_CountB / n;
+      }
+
+    unsigned int index = 6;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      for( unsigned int j = i; j < 6; ++j, ++index )
+        {
+        op[index] = a[index] + b[index] + delta[i] * delta[j] * weight;
+        }
+      }
+    return op;
+  }
+
+private:
+  unsigned int m_CountA;
+  unsigned int m_CountB;
+};
+
+template <class TImage>
+struct LogTensorTraits;
+
+template <>
+struct LogTensorTraits<TensorImageType>
+  {
+  typedef itk::Functor::LogEuclideanTensorFunction<TensorPixelType> ToLogType;
+  };
+
+template <>
+struct LogTensorTraits<LogTensorImageType>
+  {
+  typedef LogTensorIdentity ToLogType;
+  };
+
+// Determinant of the 6x6 covariance given by the upper triangle of its
+// scatter matrix, row by row, and the scale of the scatter, by Gaussian
+// elimination with partial pivoting
+double covarianceDeterminant(const double * scatter, double scale)
+{
+  double       a[6][6];
+  unsigned int index = 0;
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    for( unsigned int j = i; j < 6; ++j, ++index )
+      {
+      a[i][j] = a[j][i] = scatter[index] * scale;
+      }
+    }
+
+  double det = 1.0;
+  for( unsigned int k = 0; k < 6; ++k )
+    {
+    unsigned int pivot = k;
+    for( unsigned int i = k + 1; i < 6; ++i )
+      {
+      if( std::fabs(a[i][k]) > std::fabs(a[pivot][k]) )
+        {
+        pivot = i;
+        }
+      }
+    if( a[pivot][k] == 0.0 )
+      {
+      return 0.0;
+      }
+    if( pivot != k )
+      {
+      std::swap_ranges(a[k] + k, a[k] + 6, a[pivot] + k);
+      det = -det;
+      }
+    det *= a[k][k];
+    for( unsigned int i = k + 1; i < 6; ++i )
+      {
+      const double factor = a[i][k] / a[k][k];
+      for( unsigned int j = k + 1; j < 6; ++j )
+        {
+        a[i][j] -= factor * a[k][j];
+        }
+      }
+    }
+  return det;
+}
+
+OutputVectorImageType::Pointer createVectorImage(const StateImageType * state, unsigned int components)
+{
+  OutputVectorImageType::Pointer image = OutputVectorImageType::New();
+
+  image->CopyInformation(state);
+  image->SetRegions(state->GetLargestPossibleRegion() );
+  image->SetNumberOfComponentsPerPixel(components);
+  image->Allocate();
+  return image;
+}
+
+}
+
+LogEuclideanPopulationStatistics::LogEuclideanPopulationStatistics() : m_Count(0)
+{
+}
+
+template <class TImage>
+void LogEuclideanPopulationStatistics::Update(TImage * image)
+{
+  if( !m_State )
+    {
+    m_State = StateImageType::New();
+    m_State->CopyInformation(image);
+    m_State->SetRegions(image->GetLargestPossibleRegion() );
+    m_State->Allocate();
+    m_State->FillBuffer(StatePixelType(0.0) );
+    }
+  else if( image->GetLargestPossibleRegion() != m_State->GetLargestPossibleRegion() )
+    {
+    throw itk::ExceptionObject("Tensor fields of a population must have the same size");
+    }
+
+  typedef WelfordLogTensorUpdate<typename TImage::PixelType,
+                                 typename LogTensorTraits<TImage>::ToLogType> FunctorType;
+  typedef itk::BinaryFunctorImageFilter<StateImageType, TImage, StateImageType, FunctorType> UpdateFilterType;
+
+  FunctorType functor;
+  functor.SetCount(m_Count + 1);
+
+  typename UpdateFilterType::Pointer update = UpdateFilterType::New();
+  update->SetInput1(m_State);
+  update->SetInput2(image);
+  update->SetFunctor(functor);
+  update->InPlaceOn();
+  update->Update();
+
+  m_State = update->GetOutput();
+  m_State->DisconnectPipeline();
+  ++m_Count;
+}
+
+void LogEuclideanPopulationStatistics::Add(TensorImageType::Pointer tensors)
+{
+  Update(tensors.GetPointer() );
+}
+
+void LogEuclideanPopulationStatistics::Add(LogTensorImageType::Pointer logtensors)
+{
+  Update(logtensors.GetPointer() );
+}
+
+void LogEuclideanPopulationStatistics::MergeState(StateImageType::Pointer state, unsigned int count, bool copy)
+{
+  if( !count )
+    {
+    return;
+    }
+  if( !m_State )
+    {
+    if( copy )
+      {
+      typedef itk::ImageDuplicator<StateImageType> DuplicatorType;
+      DuplicatorType::Pointer dup = DuplicatorType::New();
+      dup->SetInputImage(state);
+      dup->Update();
+      state = dup->GetOutput();
+      }
+    m_State = state;
+    m_Count = count;
+    return;
+    }
+  if( state->GetLargestPossibleRegion() != m_State->GetLargestPossibleRegion() )
+    {
+    throw itk::ExceptionObject("Tensor fields of a population must have the same size");
+    }
+
+  typedef itk::BinaryFunctorImageFilter<StateImageType, StateImageType, StateImageType, MergeStates> MergeFilterType;
+  MergeStates functor;
+  functor.SetCounts(m_Count, count);
+
+  MergeFilterType::Pointer merge = MergeFilterType::New();
+  merge->SetInput1(m_State);
+  merge->SetInput2(state);
+  merge->SetFunctor(functor);
+  merge->InPlaceOn();
+  merge->Update();
+
+  m_State = merge->GetOutput();
+  m_State->DisconnectPipeline();
+  m_Count += count;
+}
+
+void LogEuclideanPopulationStatistics::Merge(const LogEuclideanPopulationStatistics & other)
+{
+  MergeState(other.m_State, other.m_Count, true);
+}
+
+void LogEuclideanPopulationStatistics::Save(const std::string & filename) const
+{
+  if( !m_Count )
+    {
+    throw itk::ExceptionObject("No subject to save in the state");
+    }
+  writeAccumulatorState(filename, m_State, "LogEuclideanMoments", m_Count);
+}
+
+void LogEuclideanPopulationStatistics::Merge(const std::string & filename)
+{
+  unsigned int            count = 0;
+  StateImageType::Pointer state = readAccumulatorState<StateImageType>(filename, "LogEuclideanMoments", count);
+
+  MergeState(state, count, false);
+}
+
+LogTensorImageType::Pointer LogEuclideanPopulationStatistics::GetLogMean() const
+{
+  if( !m_Count )
+    {
+    throw itk::ExceptionObject("No subject in the population");
+    }
+
+  LogTensorImageType::Pointer mean = LogTensorImageType::New();
+  mean->CopyInformation(m_State);
+  mean->SetRegions(m_State->GetLargestPossibleRegion() );
+  mean->Allocate();
+
+  itk::ImageRegionConstIterator<StateImageType> in(m_State, m_State->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<LogTensorImageType>  out(mean, mean->GetLargestPossibleRegion() );
+  for( ; !in.IsAtEnd(); ++in, ++out )
+    {
+    const StatePixelType & state = in.Get();
+    LogTensorPixelType     logmean;
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      logmean[i] = state[i];
+      }
+    out.Set(logmean);
+    }
+  return mean;
+}
+
+TensorImageType::Pointer LogEuclideanPopulationStatistics::GetMean() const
+{
+  typedef itk::ExpEuclideanTensorImageFilter<double> ExpEuclideanFilterType;
+  ExpEuclideanFilterType::Pointer expf = ExpEuclideanFilterType::New();
+  expf->SetInput(this->GetLogMean() );
+  expf->Update();
+
+  return expf->GetOutput();
+}
+
+OutputVectorImageType::Pointer LogEuclideanPopulationStatistics::GetCovariance() const
+{
+  if( m_Count < 2 )
+    {
+    throw itk::ExceptionObject("The covariance needs at least two subjects");
+    }
+
+  OutputVectorImageType::Pointer covariance = createVectorImage(m_State, CovarianceSize);
+  const double                   scale = 1.0 / (m_Count - 1);
+
+  itk::ImageRegionConstIterator<StateImageType>   in(m_State, m_State->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<OutputVectorImageType> out(covariance, covariance->GetLargestPossibleRegion() );
+  OutputVectorImageType::PixelType                pixel(CovarianceSize);
+  for( ; !in.IsAtEnd(); ++in, ++out )
+    {
+    const StatePixelType & state = in.Get();
+    for( unsigned int i = 0; i < CovarianceSize; ++i )
+      {
+      pixel[i] = static_cast<float>(state[6 + i] * scale);
+      }
+    out.Set(pixel);
+    }
+  return covariance;
+}
+
+RealImageType::Pointer LogEuclideanPopulationStatistics::GetGeneralizedVariance() const
+{
+  if( m_Count < 2 )
+    {
+    throw itk::ExceptionObject("The generalized variance needs at least two subjects");
+    }
+
+  RealImageType::Pointer generalized = RealImageType::New();
+  generalized->CopyInformation(m_State);
+  generalized->SetRegions(m_State->GetLargestPossibleRegion() );
+  generalized->Allocate();
+
+  const double scale = 1.0 / (m_Count - 1);
+
+  itk::ImageRegionConstIterator<StateImageType> in(m_State, m_State->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<RealImageType>       out(generalized, generalized->GetLargestPossibleRegion() );
+  for( ; !in.IsAtEnd(); ++in, ++out )
+    {
+    out.Set(covarianceDeterminant(in.Get().GetDataPointer() + 6, scale) );
+    }
+  return generalized;
+}
+
+void LogEuclideanPopulationStatistics::GetPrincipalModes(unsigned int numberOfModes,
+                                                        OutputVectorImageType::Pointer & variances,
+                                                        OutputVectorImageType::Pointer & modes) const
+{
+  if( m_Count < 2 )
+    {
+    throw itk::ExceptionObject("The principal modes need at least two subjects");
+    }
+  if( numberOfModes < 1 || numberOfModes > 6 )
+    {
+    throw itk::ExceptionObject("The number of principal modes must be between 1 and 6");
+    }
+
+  // Same decomposition as TensorStatistics::ComputeMeanAndPGA
+  typedef itk::SymmetricSecondRankTensor<double, 6> CovarianceType;
+
+  variances = createVectorImage(m_State, numberOfModes);
+  modes = createVectorImage(m_State, 6 * numberOfModes);
+
+  const double scale = 1.0 / (m_Count - 1);
+
+  itk::ImageRegionConstIterator<StateImageType>   in(m_State, m_State->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<OutputVectorImageType> vit(variances, variances->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<OutputVectorImageType> mit(modes, modes->GetLargestPossibleRegion() );
+  OutputVectorImageType::PixelType                variance(numberOfModes);
+  OutputVectorImageType::PixelType                mode(6 * numberOfModes);
+  for( ; !in.IsAtEnd(); ++in, ++vit, ++mit )
+    {
+    const StatePixelType & state = in.Get();
+    CovarianceType         covariance;
+    for( unsigned int i = 0; i < CovarianceSize; ++i )
+      {
+      covariance[i] = state[6 + i] * scale;
+      }
+
+    CovarianceType::EigenValuesArrayType   eigenValues;
+    CovarianceType::EigenVectorsMatrixType eigenVectors;
+    covariance.ComputeEigenAnalysis(eigenValues, eigenVectors);
+
+    // Eigenvalues are in ascending order, the eigenvectors are the rows
+    for( unsigned int m = 0; m < numberOfModes; ++m )
+      {
+      const unsigned int e = 5 - m;
+      variance[m] = static_cast<float>(std::max(eigenValues[e], 0.0) );
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        mode[6 * m + i] = static_cast<float>(eigenVectors[e][i]);
+        }
+      }
+    vit.Set(variance);
+    mit.Set(mode);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef TENSORPOPULATION_H
+#define TENSORPOPULATION_H
+
+#include "dtitypes.h"
+#include <string>
+
+// Voxelwise statistics of a population of tensor fields in the
+// Log-Euclidean domain: mean, 6x6 covariance of the log vectors and
+// principal modes of variation (principal geodesic analysis in the
+// tangent space at the identity).
+//
+// The subjects are added one at a time with Welford's online update,
+// so a single pass over the population is needed and memory does not
+// depend on the number of subjects: the state is the running mean and
+// the 21 unique elements of the scatter matrix of every voxel.  States
+// of disjoint groups of subjects can be merged (Chan et al. pairwise
+// update) and saved to resume the accumulation later.
+class LogEuclideanPopulationStatistics
+{
+public:
+  typedef itk::Vector<double, 27>             StatePixelType;
+  typedef itk::Image<StatePixelType, DIM>     StateImageType;
+  typedef itk::VectorImage<float, DIM>        OutputVectorImageType;
+
+  LogEuclideanPopulationStatistics();
+
+  // Add a subject.  All the subjects must share the same grid.
+  void Add(TensorImageType::Pointer tensors);
+
+  void Add(LogTensorImageType::Pointer logtensors);
+
+  void Merge(const LogEuclideanPopulationStatistics & other);
+
+  void Save(const std::string & filename) const;
+
+  void Merge(const std::string & filename);
+
+  unsigned int GetCount() const
+  {
+    return m_Count;
+  }
+
+  // Log-Euclidean mean
+  TensorImageType::Pointer GetMean() const;
+
+  LogTensorImageType::Pointer GetLogMean() const;
+
+  // Unbiased covariance of the log vectors, 21 components (upper
+  // triangle of the 6x6 matrix, row by row).  Needs two subjects.
+  OutputVectorImageType::Pointer GetCovariance() const;
+
+  // Determinant of the covariance, computed in double precision from
+  // the scatter matrix.  Zero, up to rounding, with fewer than 7
+  // subjects.  Needs two subjects.
+  RealImageType::Pointer GetGeneralizedVariance() const;
+
+  // Top numberOfModes principal modes: variances (numberOfModes
+  // components, decreasing) and unit directions in the log domain
+  // (6 components per mode).
+  void GetPrincipalModes(unsigned int numberOfModes,
+                         OutputVectorImageType::Pointer & variances,
+                         OutputVectorImageType::Pointer & modes) const;
+
+private:
+  template <class TImage>
+  void Update(TImage * image);
+
+  void MergeState(StateImageType::Pointer state, unsigned int count, bool copy);
+
+  StateImageType::Pointer m_State;
+  unsigned int            m_Count;
+};
+
+#endif
@@ -4,19 +4,10 @@
 
 // Filters
 #include <itkTensorFractionalAnisotropyImageFilter.h>
-#include <itkShiftScaleImageFilter.h>
 #include <itkGradientMagnitudeRecursiveGaussianImageFilter.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
-#include "itkSymmetricEigenAnalysisImageFilter.h"
-#include "itkVectorIndexSelectionCastImageFilter.h"
-#include <itkAddImageFilter.h>
-
-#if ITK_VERSION_MAJOR < 4
-#include <itkMultiplyByConstantImageFilter.h>
-#else
-#include <itkMultiplyImageFilter.h>
-#endif
+#include <itkUnaryFunctorImageFilter.h>
 
 // My ITK Filters
 #include "itkVectorMaskNegatedImageFilter.h"
@@ -28,189 +19,124 @@
 #include "itkVectorClosestDotProductImageFilter.h"
 #include "itkTensorFAGradientImageFilter.h"
 #include "itkTensorRotateImageFilter.h"
+#include "itkTensorEigenValueFunction.h"
+#include "itkComposeFunctor.h"
 
 // Global constants
 const char* NRRD_MEASUREMENT_KEY = "NRRD_measurement frame";
 
+namespace
+{
+
+// Runs a pixel-wise functor on the tensor image as a single
+// multithreaded pass.
+template <class TOutputImage, class TFunctor>
+typename TOutputImage::Pointer applyTensorFunctor(TensorImageType::Pointer timg,
+                                                  const TFunctor & functor)
+{
+  typedef itk::UnaryFunctorImageFilter<TensorImageType, TOutputImage, TFunctor> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(timg);
+  filter->SetFunctor(functor);
+  filter->Update();
+
+  return filter->GetOutput();
+}
+
+// Computes a scalar measure and scales it. The measure and the
+// scaling are fused in one pass, instead of a measure filter followed
+// by a ShiftScaleImageFilter.
+template <class TOutputImage, class TMeasure>
+typename TOutputImage::Pointer createScaledMeasure(TensorImageType::Pointer timg,
+                                                   const TMeasure & measure,
+                                                   double scale)
+{
+  typedef typename TOutputImage::PixelType                                             OutputPixelType;
+  typedef itk::Functor::ShiftScale<RealType, OutputPixelType>                          ScaleType;
+  typedef itk::Functor::Compose<TMeasure, ScaleType, TensorPixelType, OutputPixelType> FunctorType;
+  FunctorType functor;
+  functor.GetFirst() = measure;
+  functor.GetSecond().SetShift(0);
+  functor.GetSecond().SetScale(scale);
+
+  return applyTensorFunctor<TOutputImage>(timg, functor);
+}
+
+typedef itk::Functor::TensorFractionalAnisotropyFunction<TensorPixelType> FAFunctionType;
+typedef itk::Functor::TensorMeanDiffusivityFunction<TensorPixelType>      MDFunctionType;
+typedef itk::Functor::TensorFrobeniusNormFunction<TensorPixelType>        FroFunctionType;
+typedef itk::Functor::TensorEigenValueFunction<TensorPixelType>           LambdaFunctionType;
+typedef itk::Functor::TensorRadialDiffusivityFunction<TensorPixelType>    RDFunctionType;
+
+}
+
 template <>
 itk::Image<double, 3>::Pointer createFA<double>(TensorImageType::Pointer timg) // Tensor image
 {
-  typedef itk::TensorFractionalAnisotropyImageFilter<TensorImageType, RealImageType> FAFilterType;
-  FAFilterType::Pointer fafilter = FAFilterType::New();
-  fafilter->SetInput(timg);
-  fafilter->Update();
-
-  return fafilter->GetOutput();
+  return applyTensorFunctor<RealImageType>(timg, FAFunctionType() );
 }
 
 template <>
 itk::Image<unsigned short, 3>::Pointer createFA<unsigned short>(TensorImageType::Pointer timg)      // Tensor image
 {
-  RealImageType::Pointer realfa = createFA<double>(timg);
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, IntImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(realfa);
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(10000);
-  scalefilter->Update();
-
-  return scalefilter->GetOutput();
+  return createScaledMeasure<IntImageType>(timg, FAFunctionType(), 10000);
 }
 
 template <>
 itk::Image<double, 3>::Pointer createMD<double>(TensorImageType::Pointer timg) // Tensor image
 {
-  typedef itk::TensorMeanDiffusivityImageFilter<TensorImageType, RealImageType> MDFilterType;
-  MDFilterType::Pointer mdfilter = MDFilterType::New();
-  mdfilter->SetInput(timg);
-  mdfilter->Update();
-
-  return mdfilter->GetOutput();
+  return applyTensorFunctor<RealImageType>(timg, MDFunctionType() );
 }
 
 template <>
 itk::Image<unsigned short, 3>::Pointer createMD<unsigned short>(TensorImageType::Pointer timg)      // Tensor image
 {
-  RealImageType::Pointer realmd = createMD<double>(timg);
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, IntImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(realmd);
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(100000);
-  scalefilter->Update();
-
-  return scalefilter->GetOutput();
+  return createScaledMeasure<IntImageType>(timg, MDFunctionType(), 100000);
 }
 
 template <>
 itk::Image<double, 3>::Pointer createLambda<double>(TensorImageType::Pointer timg, // Tensor image
                                                     EigenValueIndex lambdaind)     // Lambda index
 {
-  // Not really a deformation image output jsut a 3-vector of doubles.
-  typedef itk::SymmetricEigenAnalysisImageFilter<TensorImageType, DeformationImageType> LambdaFilterType;
-  LambdaFilterType::Pointer lambdafilter = LambdaFilterType::New();
-  lambdafilter->SetInput(timg);
-  lambdafilter->OrderEigenValuesBy(LambdaFilterType::FunctorType::OrderByValue);
-  lambdafilter->SetDimension(3);
-  lambdafilter->Update();
-
-  typedef itk::VectorIndexSelectionCastImageFilter<LambdaFilterType::OutputImageType,
-                                                   RealImageType> ElementSelectAdaptorType;
-  ElementSelectAdaptorType::Pointer elementSelect = ElementSelectAdaptorType::New();
-  elementSelect->SetInput(lambdafilter->GetOutput() );
-  // Reverse semanatics of lambda_1 from ITK.
-  // In our convention lambda_1 is the largest eigenvalue whereas in
-  // ITK its the smallest
-  elementSelect->SetIndex(2 - lambdaind);
-  elementSelect->Update();
-
-  return elementSelect->GetOutput();
+  // In our convention lambda_1 is the largest eigenvalue
+  LambdaFunctionType lambda;
+  lambda.SetIndex(lambdaind);
+
+  return applyTensorFunctor<RealImageType>(timg, lambda);
 }
 
 template <>
 itk::Image<unsigned short, 3>::Pointer createLambda<unsigned short>(TensorImageType::Pointer timg, // Tensor image
                                                                     EigenValueIndex lambdaind)     // Lambda index
 {
-  RealImageType::Pointer reallambda = createLambda<double>(timg, lambdaind);
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, IntImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(reallambda);
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(100000);
-  scalefilter->Update();
+  LambdaFunctionType lambda;
+  lambda.SetIndex(lambdaind);
 
-  return scalefilter->GetOutput();
+  return createScaledMeasure<IntImageType>(timg, lambda, 100000);
 }
 
 template <>
 itk::Image<double, 3>::Pointer createRD<double>(TensorImageType::Pointer timg) // Tensor image
 {
-  typedef itk::SymmetricEigenAnalysisImageFilter<TensorImageType, DeformationImageType> LambdaFilterType;
-  LambdaFilterType::Pointer lambdafilter = LambdaFilterType::New();
-  lambdafilter->SetInput(timg);
-  lambdafilter->OrderEigenValuesBy(LambdaFilterType::FunctorType::OrderByValue);
-  lambdafilter->SetDimension(3);
-  lambdafilter->Update();
-
-  typedef itk::AddImageFilter<RealImageType, RealImageType, RealImageType> RDFilterType;
-  RDFilterType::Pointer rdfilter = RDFilterType::New();
-
-  typedef itk::VectorIndexSelectionCastImageFilter<LambdaFilterType::OutputImageType,
-                                                   RealImageType> ElementSelectAdaptorType;
-  ElementSelectAdaptorType::Pointer elementSelect1 = ElementSelectAdaptorType::New();
-  elementSelect1->SetInput(lambdafilter->GetOutput() );
-  // lambda3
-  elementSelect1->SetIndex(0);
-  elementSelect1->Update();
-  rdfilter->SetInput1(elementSelect1->GetOutput() );
-
-  ElementSelectAdaptorType::Pointer elementSelect2 = ElementSelectAdaptorType::New();
-  elementSelect2->SetInput(lambdafilter->GetOutput() );
-  // lambda2
-  elementSelect2->SetIndex(1);
-  elementSelect2->Update();
-  rdfilter->SetInput2(elementSelect2->GetOutput() );
-
-  rdfilter->Update();
-
-#if ITK_VERSION_MAJOR < 4
-  typedef itk::MultiplyByConstantImageFilter<RDFilterType::OutputImageType, float, RealImageType>
-    DivideFilterType;
-#else
-  typedef itk::MultiplyImageFilter<RDFilterType::OutputImageType,
-    RDFilterType::OutputImageType, RealImageType> DivideFilterType;
-#endif
-  DivideFilterType::Pointer dividefilter = DivideFilterType::New();
-  dividefilter->SetInput(rdfilter->GetOutput() );
-  dividefilter->SetConstant(0.5);
-  dividefilter->Update();
-
-  return dividefilter->GetOutput();
-
+  return applyTensorFunctor<RealImageType>(timg, RDFunctionType() );
 }
 
 template <>
 itk::Image<unsigned short, 3>::Pointer createRD<unsigned short>(TensorImageType::Pointer timg)      // Tensor image
 {
-  RealImageType::Pointer realfro = createRD<double>(timg);
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, IntImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(realfro);
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(100000);
-  scalefilter->Update();
-
-  return scalefilter->GetOutput();
+  return createScaledMeasure<IntImageType>(timg, RDFunctionType(), 100000);
 }
 
 template <>
 itk::Image<double, 3>::Pointer createFro<double>(TensorImageType::Pointer timg) // Tensor image
 {
-  typedef itk::TensorFrobeniusNormImageFilter<TensorImageType, RealImageType> MDFilterType;
-  MDFilterType::Pointer mdfilter = MDFilterType::New();
-  mdfilter->SetInput(timg);
-  mdfilter->Update();
-
-  return mdfilter->GetOutput();
+  return applyTensorFunctor<RealImageType>(timg, FroFunctionType() );
 }
 
 template <>
 itk::Image<unsigned short, 3>::Pointer createFro<unsigned short>(TensorImageType::Pointer timg)      // Tensor image
 {
-  RealImageType::Pointer realfro = createFro<double>(timg);
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, IntImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(realfro);
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(100000);
-  scalefilter->Update();
-
-  return scalefilter->GetOutput();
+  return createScaledMeasure<IntImageType>(timg, FroFunctionType(), 100000);
 }
 
 GradientImageType::Pointer createFAGradient(TensorImageType::Pointer timg, // Tensor image
@@ -228,21 +154,12 @@ GradientImageType::Pointer createFAGradient(TensorImageType::Pointer timg, // Te
 RealImageType::Pointer createFAGradMag(TensorImageType::Pointer timg,      // Tensor image
                                        double sigma)
 {
-  typedef itk::TensorFractionalAnisotropyImageFilter<TensorImageType, RealImageType> FAFilterType;
-  FAFilterType::Pointer fafilter = FAFilterType::New();
-  fafilter->SetInput(timg);
-
-  // If scale option set scale fa, and write out an integer image
-
-  typedef itk::ShiftScaleImageFilter<RealImageType, RealImageType> ShiftScaleFilterType;
-  ShiftScaleFilterType::Pointer scalefilter = ShiftScaleFilterType::New();
-  scalefilter->SetInput(fafilter->GetOutput() );
-  scalefilter->SetShift(0);
-  scalefilter->SetScale(10000);
+  // FA scaled by 10000
+  RealImageType::Pointer scaledfa = createScaledMeasure<RealImageType>(timg, FAFunctionType(), 10000);
 
   typedef itk::GradientMagnitudeRecursiveGaussianImageFilter<RealImageType, RealImageType> GradMagFilterType;
   GradMagFilterType::Pointer gradmag = GradMagFilterType::New();
-  gradmag->SetInput(scalefilter->GetOutput() );
+  gradmag->SetInput(scaledfa);
   gradmag->SetSigma(sigma);
   gradmag->SetNormalizeAcrossScale(false);
   gradmag->Update();
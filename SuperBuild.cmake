@@ -172,8 +172,8 @@ ExternalProject_Add_Step(${proj} forcebuild
 #-----------------------------------------------------------------------------
 
 if( DTIProcess_BUILD_SLICER_EXTENSION )
-  set(EXTENSION_CLIS dtiaverage dtiestim dtiprocess fiberprocess fiberstats polydatamerge polydatatransform)
-  set(TESTS dtiaverageTest dtiestimTest dtiprocessTest TestHomemadeRoundFunction)
+  set(EXTENSION_CLIS dtiaverage dtiestim dtipopulationstats dtiprocess fiberprocess fiberstats polydatamerge polydatatransform)
+  set(TESTS dtiaverageTest dtiestimTest dtipopulationstatsTest dtiprocessTest TestHomemadeRoundFunction)
   # Manual creation of imported targets for the tests
   # It is not possible to import the targets directly using "include(DTIProcess-targets.cmake)" because
   # that file is only created at compilation time and we need to know where the targets will be at configuration time.
@@ -0,0 +1,95 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Saves the Log-Euclidean sum of a Log-Euclidean tensor file and
+// checks that saving does not change the dictionary of the mean, that
+// the state is not marked as a Log-Euclidean tensor file, and that
+// resuming the state gives the mean of all the inputs.
+//
+// Usage: AccumulatorStateTest state.nrrd
+
+#include "accumulatorstate.h"
+#include "tensoraverage.h"
+#include "tensorio.h"
+
+#include <itkMetaDataObject.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static LogTensorImageType::Pointer MakeLogTensors(double value)
+{
+  LogTensorImageType::SizeType size;
+  size.Fill(3);
+  LogTensorImageType::Pointer image = LogTensorImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(LogTensorPixelType(value) );
+  itk::EncapsulateMetaData<std::string>(image->GetMetaDataDictionary(), LOGEUCLIDEAN_KEY, "true");
+  itk::EncapsulateMetaData<std::string>(image->GetMetaDataDictionary(), "Subject", "test");
+  return image;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " state.nrrd" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  try
+    {
+    LogEuclideanSum saved;
+    saved.Add(MakeLogTensors(-7.0) );
+    saved.Add(MakeLogTensors(-6.0) );
+    saved.Save(argv[1]);
+
+    const itk::MetaDataDictionary & dict = saved.GetLogMean()->GetMetaDataDictionary();
+    if( dict.HasKey(ACCUMULATOR_STATE_KEY) || dict.HasKey(ACCUMULATOR_COUNT_KEY) )
+      {
+      std::cerr << "Saving the state changed the dictionary of the mean" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( isLogEuclideanFile(argv[1]) )
+      {
+      std::cerr << "The state is marked as a Log-Euclidean tensor file" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    LogEuclideanSum resumed;
+    resumed.Merge(argv[1]);
+    resumed.Add(MakeLogTensors(-8.0) );
+
+    LogTensorImageType::Pointer   mean = resumed.GetLogMean();
+    LogTensorImageType::IndexType index;
+    index.Fill(1);
+    std::string value;
+    if( resumed.GetCount() != 3 || std::fabs(mean->GetPixel(index)[0] + 7.0) > 1e-12
+        || itk::ExposeMetaData<std::string>(mean->GetMetaDataDictionary(), ACCUMULATOR_COUNT_KEY, value) )
+      {
+      std::cerr << "Wrong resumed mean: " << resumed.GetCount() << " fields, "
+                << mean->GetPixel(index) << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( !itk::ExposeMetaData<std::string>(mean->GetMetaDataDictionary(), "Subject", value) || value != "test" )
+      {
+      std::cerr << "The state lost the dictionary of its inputs" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
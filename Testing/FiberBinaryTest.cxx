@@ -0,0 +1,196 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Writes a fiber bundle to a binary fiber file, and fails if the file
+// mapped, the fibers read from it at random and the bundle read back
+// are not the bundle written, or if fibers read into a bundle of
+// another space do not keep their world positions.
+//
+// Usage: FiberBinaryTest output.fbin
+
+#include "fiberbinary.h"
+#include "fiberio.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static void MakeFibers(FiberBundle & bundle)
+{
+  const double spacing[3] = { 1.5, 2.0, 2.5 };
+  const double origin[3] = { -120.0, 64.5, 33.25 };
+  bundle.SetSpacing(spacing);
+  bundle.SetOrigin(origin);
+
+  // Fibers of 5, 1 and 12 points
+  const unsigned long lengths[3] = { 5, 1, 12 };
+  for( unsigned int f = 0; f < 3; ++f )
+    {
+    bundle.AddFiber(lengths[f]);
+    }
+  FiberBundle::ArrayType & positions = bundle.GetPositions();
+  FiberBundle::ArrayType & tensors = bundle.GetTensors();
+  FiberBundle::ArrayType & fa = bundle.GetScalar("fa");
+  FiberBundle::ArrayType & label = bundle.GetScalar("label");
+  for( unsigned long k = 0; k < bundle.GetNumberOfPoints(); ++k )
+    {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      positions[3 * k + i] = 0.25f * k + i;
+      }
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      tensors[6 * k + i] = 1e-4f * (k + 1) + 1e-5f * i;
+      }
+    fa[k] = 0.01f * k;
+    label[k] = static_cast<float>(k % 3);
+    }
+}
+
+static bool SameArray(const float * values, const FiberBundle::ArrayType & expected, unsigned long begin,
+                      unsigned long end, unsigned int components, const char * name)
+{
+  for( unsigned long i = components * begin; i < components * end; ++i )
+    {
+    if( values[i - components * begin] != expected[i] )
+      {
+      std::cerr << "Wrong " << name << " at " << i << ": " << values[i - components * begin] << " instead of "
+                << expected[i] << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+static bool SameBundle(const FiberBundle & bundle, const FiberBundle & expected, unsigned long first)
+{
+  const unsigned long begin = expected.GetFiberBegin(first);
+  for( unsigned long f = 0; f < bundle.GetNumberOfFibers(); ++f )
+    {
+    if( bundle.GetFiberBegin(f) + begin != expected.GetFiberBegin(first + f)
+        || bundle.GetFiberEnd(f) + begin != expected.GetFiberEnd(first + f) )
+      {
+      std::cerr << "Wrong points of fiber " << f << std::endl;
+      return false;
+      }
+    }
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    if( bundle.GetSpacing()[i] != expected.GetSpacing()[i] || bundle.GetOrigin()[i] != expected.GetOrigin()[i] )
+      {
+      std::cerr << "Wrong spacing or origin" << std::endl;
+      return false;
+      }
+    }
+  const unsigned long end = begin + bundle.GetNumberOfPoints();
+  return SameArray(&bundle.GetPositions()[0], expected.GetPositions(), begin, end, 3, "positions")
+         && SameArray(&bundle.GetTensors()[0], expected.GetTensors(), begin, end, 6, "tensors")
+         && SameArray(&bundle.GetScalar("fa")[0], expected.GetScalar("fa"), begin, end, 1, "fa")
+         && SameArray(&bundle.GetScalar("label")[0], expected.GetScalar("label"), begin, end, 1, "label");
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " output.fbin" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  try
+    {
+    FiberBundle written;
+    MakeFibers(written);
+    writeFiberBinaryFile(argv[1], written);
+
+    // Mapped file
+    FiberBinaryFile file;
+    file.Open(argv[1]);
+    if( file.GetNumberOfFibers() != written.GetNumberOfFibers()
+        || file.GetNumberOfPoints() != written.GetNumberOfPoints()
+        || file.GetScalarNames().size() != 2 || !file.GetScalar("fa") || file.GetScalar("md") )
+      {
+      std::cerr << "Wrong header: " << file.GetNumberOfFibers() << " fibers, " << file.GetNumberOfPoints()
+                << " points, " << file.GetScalarNames().size() << " scalars" << std::endl;
+      return EXIT_FAILURE;
+      }
+    for( unsigned long f = 0; f < file.GetNumberOfFibers(); ++f )
+      {
+      if( file.GetFiberBegin(f) != written.GetFiberBegin(f) || file.GetFiberEnd(f) != written.GetFiberEnd(f) )
+        {
+        std::cerr << "Wrong points of fiber " << f << " in the file" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    const unsigned long npoints = written.GetNumberOfPoints();
+    if( !SameArray(file.GetPositions(), written.GetPositions(), 0, npoints, 3, "mapped positions")
+        || !SameArray(file.GetTensors(), written.GetTensors(), 0, npoints, 6, "mapped tensors")
+        || !SameArray(file.GetScalar("label"), written.GetScalar("label"), 0, npoints, 1, "mapped label") )
+      {
+      return EXIT_FAILURE;
+      }
+
+    // Random access to the last two fibers
+    FiberBundle last;
+    file.ReadFibers(1, 3, last);
+    if( last.GetNumberOfFibers() != 2 || !SameBundle(last, written, 1) )
+      {
+      std::cerr << "Wrong fibers read at random" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // Appended to a bundle of another space
+    const double spacing[3] = { 1.0, 0.5, 3.0 };
+    const double origin[3] = { 10.0, -5.0, 0.0 };
+    FiberBundle  other;
+    other.SetSpacing(spacing);
+    other.SetOrigin(origin);
+    other.AddFiber(2);
+    file.ReadFibers(1, 3, other);
+    if( other.GetNumberOfFibers() != 3 || other.GetSpacing()[1] != spacing[1] || other.GetOrigin()[0] != origin[0] )
+      {
+      std::cerr << "Wrong bundle of another space" << std::endl;
+      return EXIT_FAILURE;
+      }
+    for( unsigned long k = other.GetFiberBegin(1); k < other.GetNumberOfPoints(); ++k )
+      {
+      const unsigned long expected = k - other.GetFiberBegin(1) + written.GetFiberBegin(1);
+      double              world[3];
+      double              writtenworld[3];
+      other.GetWorldPosition(k, world);
+      written.GetWorldPosition(expected, writtenworld);
+      for( unsigned int i = 0; i < 6; ++i )
+        {
+        if( (i < 3 && std::fabs(world[i] - writtenworld[i]) > 1e-4)
+            || other.GetTensors()[6 * k + i] != written.GetTensors()[6 * expected + i] )
+          {
+          std::cerr << "Point " << k << " of the bundle of another space is wrong" << std::endl;
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    file.Close();
+
+    // Whole bundle
+    FiberBundle read;
+    readFiberFile(argv[1], read);
+    if( read.GetNumberOfFibers() != written.GetNumberOfFibers() || !SameBundle(read, written, 0) )
+      {
+      std::cerr << "Wrong bundle read back" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Appends fibers to a bundle of another spacing and origin, and converts
+// a bundle to a group of tubes and back.  Fails if the points do not
+// keep their world positions, tensors and scalars.
+//
+// Usage: FiberBundleTest
+
+#include "fiberbundle.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static void MakeFibers(FiberBundle & bundle)
+{
+  const double spacing[3] = { 1.5, 2.0, 2.5 };
+  const double origin[3] = { -120.0, 64.5, 33.25 };
+  bundle.SetSpacing(spacing);
+  bundle.SetOrigin(origin);
+
+  // Fibers of 4, 1, 9 and 6 points
+  const unsigned long lengths[4] = { 4, 1, 9, 6 };
+  for( unsigned int f = 0; f < 4; ++f )
+    {
+    bundle.AddFiber(lengths[f]);
+    }
+  FiberBundle::ArrayType & positions = bundle.GetPositions();
+  FiberBundle::ArrayType & tensors = bundle.GetTensors();
+  FiberBundle::ArrayType & label = bundle.GetScalar("label");
+  for( unsigned long k = 0; k < bundle.GetNumberOfPoints(); ++k )
+    {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      positions[3 * k + i] = 0.75f * k - i;
+      }
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      tensors[6 * k + i] = 1e-4f * (k + 1) + 1e-5f * i;
+      }
+    label[k] = static_cast<float>(k % 4 + 1);
+    }
+}
+
+// Point k of bundle is point expected of other
+static bool SamePoint(const FiberBundle & bundle, unsigned long k, const FiberBundle & other, unsigned long expected)
+{
+  double world[3];
+  double otherworld[3];
+  bundle.GetWorldPosition(k, world);
+  other.GetWorldPosition(expected, otherworld);
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    if( std::fabs(world[i] - otherworld[i]) > 1e-4 )
+      {
+      std::cerr << "Point " << k << " is at " << world[i] << " instead of " << otherworld[i] << std::endl;
+      return false;
+      }
+    }
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    if( bundle.GetTensors()[6 * k + i] != other.GetTensors()[6 * expected + i] )
+      {
+      std::cerr << "Wrong tensor at point " << k << std::endl;
+      return false;
+      }
+    }
+  if( bundle.GetScalar("label")[k] != other.GetScalar("label")[expected] )
+    {
+    std::cerr << "Wrong label at point " << k << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int, char* [])
+{
+  try
+    {
+    FiberBundle fibers;
+    MakeFibers(fibers);
+
+    // Fibers 1 to 3 appended after a fiber of 2 points in another space
+    const double spacing[3] = { 1.0, 0.5, 3.0 };
+    const double origin[3] = { 10.0, -5.0, 0.0 };
+    FiberBundle appended;
+    appended.SetSpacing(spacing);
+    appended.SetOrigin(origin);
+    appended.AddFiber(2);
+    appended.AppendFibers(fibers, 1, 4);
+    if( appended.GetNumberOfFibers() != 4 || appended.GetSpacing()[1] != spacing[1]
+        || appended.GetOrigin()[0] != origin[0] || !appended.HasScalar("label") )
+      {
+      std::cerr << "Wrong appended bundle" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( appended.GetScalar("label")[0] != 0.0f || appended.GetScalar("label")[1] != 0.0f )
+      {
+      std::cerr << "The label of the first fiber is not zero" << std::endl;
+      return EXIT_FAILURE;
+      }
+    for( unsigned long k = appended.GetFiberBegin(1); k < appended.GetNumberOfPoints(); ++k )
+      {
+      if( !SamePoint(appended, k, fibers, k - appended.GetFiberBegin(1) + fibers.GetFiberBegin(1) ) )
+        {
+        return EXIT_FAILURE;
+        }
+      }
+
+    // Group of tubes and back
+    FiberBundle group;
+    group.FromGroup(fibers.ToGroup() );
+    if( group.GetNumberOfFibers() != fibers.GetNumberOfFibers() )
+      {
+      std::cerr << group.GetNumberOfFibers() << " fibers in the group" << std::endl;
+      return EXIT_FAILURE;
+      }
+    for( unsigned long f = 0; f < fibers.GetNumberOfFibers(); ++f )
+      {
+      if( group.GetFiberBegin(f) != fibers.GetFiberBegin(f) || group.GetFiberEnd(f) != fibers.GetFiberEnd(f) )
+        {
+        std::cerr << "Wrong points of fiber " << f << " in the group" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    for( unsigned long k = 0; k < fibers.GetNumberOfPoints(); ++k )
+      {
+      if( !SamePoint(group, k, fibers, k) )
+        {
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Writes a fiber bundle a chunk at a time to a fiber file, reads it
+// back a chunk of a different size at a time, and fails if the fibers
+// read are not the fibers written.
+//
+// Usage: FiberChunkTest output.(vtk|vtp|fbin)
+
+#include "fiberio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static void MakeFibers(FiberBundle & bundle)
+{
+  const double spacing[3] = { 1.5, 2.0, 2.5 };
+  const double origin[3] = { -120.0, 64.5, 33.25 };
+  bundle.SetSpacing(spacing);
+  bundle.SetOrigin(origin);
+
+  // 50 fibers of 1 to 20 points
+  for( unsigned long f = 0; f < 50; ++f )
+    {
+    bundle.AddFiber(1 + (7 * f) % 20);
+    }
+  FiberBundle::ArrayType & positions = bundle.GetPositions();
+  FiberBundle::ArrayType & tensors = bundle.GetTensors();
+  FiberBundle::ArrayType & label = bundle.GetScalar("label");
+  for( unsigned long k = 0; k < bundle.GetNumberOfPoints(); ++k )
+    {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      positions[3 * k + i] = 0.125f * (k % 97) + i;
+      }
+    tensors[6 * k] = 1.7e-3f;
+    tensors[6 * k + 1] = 1e-5f * (k % 11);
+    tensors[6 * k + 2] = 0.0f;
+    tensors[6 * k + 3] = 0.4e-3f;
+    tensors[6 * k + 4] = 0.0f;
+    tensors[6 * k + 5] = 0.3e-3f;
+    label[k] = static_cast<float>(k % 5);
+    }
+}
+
+static bool SameFibers(const FiberBundle & read, const FiberBundle & written, bool scalars)
+{
+  if( read.GetNumberOfFibers() != written.GetNumberOfFibers()
+      || read.GetNumberOfPoints() != written.GetNumberOfPoints() )
+    {
+    std::cerr << read.GetNumberOfFibers() << " fibers of " << read.GetNumberOfPoints() << " points read, "
+              << written.GetNumberOfFibers() << " fibers of " << written.GetNumberOfPoints() << " points written"
+              << std::endl;
+    return false;
+    }
+  for( unsigned long f = 0; f < read.GetNumberOfFibers(); ++f )
+    {
+    if( read.GetFiberBegin(f) != written.GetFiberBegin(f) )
+      {
+      std::cerr << "Wrong points of fiber " << f << std::endl;
+      return false;
+      }
+    }
+  for( unsigned long k = 0; k < read.GetNumberOfPoints(); ++k )
+    {
+    double worldread[3];
+    double worldwritten[3];
+    read.GetWorldPosition(k, worldread);
+    written.GetWorldPosition(k, worldwritten);
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      if( std::fabs(worldread[i] - worldwritten[i]) > 1e-4 )
+        {
+        std::cerr << "Wrong position of point " << k << std::endl;
+        return false;
+        }
+      }
+    }
+  if( read.GetTensors() != written.GetTensors() )
+    {
+    std::cerr << "Wrong tensors" << std::endl;
+    return false;
+    }
+  if( scalars && (!read.HasScalar("label") || read.GetScalar("label") != written.GetScalar("label") ) )
+    {
+    std::cerr << "Wrong label scalars" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " output.(vtk|vtp|fbin)" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string   filename(argv[1]);
+  const unsigned long writechunk = 7;
+  const unsigned long readchunk = 11;
+
+  try
+    {
+    FiberBundle written;
+    MakeFibers(written);
+
+    FiberFileWriter writer;
+    writer.Open(filename);
+    for( unsigned long first = 0; first < written.GetNumberOfFibers(); first += writechunk )
+      {
+      FiberBundle chunk;
+      chunk.AppendFibers(written, first, std::min(first + writechunk, written.GetNumberOfFibers() ) );
+      writer.WriteFibers(chunk);
+      }
+    writer.Close();
+
+    FiberFileReader reader;
+    reader.Open(filename);
+    if( reader.GetNumberOfFibers() != written.GetNumberOfFibers() )
+      {
+      std::cerr << reader.GetNumberOfFibers() << " fibers in the file" << std::endl;
+      return EXIT_FAILURE;
+      }
+    FiberBundle read;
+    FiberBundle chunk;
+    while( reader.ReadFibers(readchunk, chunk) )
+      {
+      if( chunk.GetNumberOfFibers() == 0 || chunk.GetNumberOfFibers() > readchunk )
+        {
+        std::cerr << "Chunk of " << chunk.GetNumberOfFibers() << " fibers" << std::endl;
+        return EXIT_FAILURE;
+        }
+      read.AppendFibers(chunk, 0, chunk.GetNumberOfFibers() );
+      }
+    if( chunk.GetNumberOfFibers() != 0 )
+      {
+      std::cerr << "The last chunk is not empty" << std::endl;
+      return EXIT_FAILURE;
+      }
+    reader.Close();
+
+    // Only binary fiber files keep the scalars that are not tensor
+    // scalars
+    if( !SameFibers(read, written, filename.rfind(".fbin") != std::string::npos) )
+      {
+      std::cerr << "The fibers read from " << filename << " are not the fibers written" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Writes fibers of diagonal tensors to a VTK fiber file and reads them
+// back, so that their tensor scalars are deferred.  Fails if the
+// scalars of one fiber, of all the fibers or of fibers appended to a
+// bundle that does not defer them are not those of the eigenvalues.
+//
+// Usage: FiberScalarsTest output.(vtk|vtp)
+
+#include "fiberio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Eigenvalues of the tensor at point k, largest first
+static void Eigenvalues(unsigned long k, double lambdas[3])
+{
+  lambdas[0] = 1.7e-3;
+  lambdas[1] = 0.4e-3 + 2e-5 * (k % 11);
+  lambdas[2] = 0.1e-3 + 1e-5 * (k % 7);
+}
+
+static void MakeFibers(FiberBundle & bundle)
+{
+  // 12 fibers of 1 to 15 points
+  for( unsigned long f = 0; f < 12; ++f )
+    {
+    bundle.AddFiber(1 + (4 * f) % 15);
+    }
+  FiberBundle::ArrayType & positions = bundle.GetPositions();
+  FiberBundle::ArrayType & tensors = bundle.GetTensors();
+  for( unsigned long k = 0; k < bundle.GetNumberOfPoints(); ++k )
+    {
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      positions[3 * k + i] = 0.5f * k + i;
+      }
+
+    // The largest eigenvalue along x, y or z in turn
+    double lambdas[3];
+    Eigenvalues(k, lambdas);
+    const unsigned int diagonal[3] = { 0, 3, 5 };
+    float *            tensor = &tensors[6 * k];
+    std::fill(tensor, tensor + 6, 0.0f);
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      tensor[diagonal[(i + k) % 3]] = static_cast<float>(lambdas[i]);
+      }
+    }
+}
+
+static double Expected(const std::string & name, unsigned long k)
+{
+  double lambdas[3];
+  Eigenvalues(k, lambdas);
+  const double md = (lambdas[0] + lambdas[1] + lambdas[2]) / 3;
+  if( name == "fa" )
+    {
+    return std::sqrt(1.5) * std::sqrt( (lambdas[0] - md) * (lambdas[0] - md) + (lambdas[1] - md) * (lambdas[1] - md)
+                                       + (lambdas[2] - md) * (lambdas[2] - md) )
+           / std::sqrt(lambdas[0] * lambdas[0] + lambdas[1] * lambdas[1] + lambdas[2] * lambdas[2]);
+    }
+  else if( name == "md" )
+    {
+    return md;
+    }
+  else if( name == "l1" || name == "ad" )
+    {
+    return lambdas[0];
+    }
+  else if( name == "l2" )
+    {
+    return lambdas[1];
+    }
+  else if( name == "l3" )
+    {
+    return lambdas[2];
+    }
+  // rd
+  return (lambdas[1] + lambdas[2]) / 2;
+}
+
+static bool CheckValue(const std::string & name, unsigned long k, float value)
+{
+  const double expected = Expected(name, k);
+  if( std::fabs(value - expected) > 1e-4 * expected )
+    {
+    std::cerr << "Wrong " << name << " at point " << k << ": " << value << " instead of " << expected << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " output.(vtk|vtp)" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const char * const names[] = { "fa", "md", "l1", "l2", "l3", "ad", "rd" };
+  const unsigned int numberOfNames = sizeof(names) / sizeof(names[0]);
+
+  try
+    {
+    FiberBundle written;
+    MakeFibers(written);
+    writeFiberFile(argv[1], written);
+
+    FiberBundle read;
+    readFiberFile(argv[1], read);
+    if( read.GetNumberOfPoints() != written.GetNumberOfPoints() )
+      {
+      std::cerr << read.GetNumberOfPoints() << " points read" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // One fiber first, then all of them, then appended to a bundle that
+    // computes its scalars
+    const FiberBundle & bundle = read;
+    const unsigned long fiber = 5;
+    for( unsigned int j = 0; j < numberOfNames; ++j )
+      {
+      if( !bundle.HasScalar(names[j]) )
+        {
+        std::cerr << "No " << names[j] << " scalar" << std::endl;
+        return EXIT_FAILURE;
+        }
+      const float * values = bundle.GetFiberScalar(names[j], fiber);
+      for( unsigned long k = bundle.GetFiberBegin(fiber); k < bundle.GetFiberEnd(fiber); ++k )
+        {
+        if( !CheckValue(names[j], k, values[k - bundle.GetFiberBegin(fiber)]) )
+          {
+          return EXIT_FAILURE;
+          }
+        }
+      }
+    for( unsigned int j = 0; j < numberOfNames; ++j )
+      {
+      const FiberBundle::ArrayType & values = bundle.GetScalar(names[j]);
+      for( unsigned long k = 0; k < bundle.GetNumberOfPoints(); ++k )
+        {
+        if( !CheckValue(names[j], k, values[k]) )
+          {
+          return EXIT_FAILURE;
+          }
+        }
+      }
+
+    FiberBundle reread;
+    readFiberFile(argv[1], reread);
+    FiberBundle appended;
+    appended.AddFiber(3);
+    appended.AppendFibers(reread, 2, reread.GetNumberOfFibers() );
+    const FiberBundle::ArrayType & fa = appended.GetScalar("fa");
+    for( unsigned long k = reread.GetFiberBegin(2); k < reread.GetNumberOfPoints(); ++k )
+      {
+      if( !CheckValue("fa", k, fa[3 + k - reread.GetFiberBegin(2)]) )
+        {
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
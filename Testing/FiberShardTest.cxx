@@ -0,0 +1,216 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// With "track", tracks a synthetic tensor field into whole.fbin and, in
+// 3 shards, into shard0.fbin to shard2.fbin of the output directory, as
+// fibertrack does.  With "compare", fails if the two fiber files do not
+// hold the same fibers, e.g. whole.fbin and the shards merged by
+// fibermerge.
+//
+// Usage: FiberShardTest track directory
+//        FiberShardTest compare fibers1 fibers2
+
+#include "itkImageToDTIStreamlineTractographyFilter.h"
+#include "dtitypes.h"
+#include "fiberio.h"
+
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImageType, IntImageType, GroupType> TractographyFilter;
+
+// Helix around the z axis
+static TensorImageType::Pointer MakeTensorField(unsigned int size)
+{
+  TensorImageType::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImageType::Pointer image = TensorImageType::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIteratorWithIndex<TensorImageType> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImageType::IndexType index = it.GetIndex();
+    const double                     x = index[0] - center;
+    const double                     y = index[1] - center;
+    double                           d[3] = { -y, x, 0.3 * std::sqrt(x * x + y * y) + 1.0 };
+    const double                     norm = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // Prolate tensor along d: 0.3e-3 I + 1.4e-3 d d^T
+    TensorPixelType tensor;
+    unsigned int    n = 0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = i; j < 3; ++j, ++n )
+        {
+        tensor[n] = 1.4e-3 * d[i] * d[j] / (norm * norm) + (i == j ? 0.3e-3 : 0.0);
+        }
+      }
+    it.Set(tensor);
+    }
+  return image;
+}
+
+static IntImageType::Pointer MakeSeeds(unsigned int size, unsigned int spacing)
+{
+  IntImageType::SizeType imagesize;
+  imagesize.Fill(size);
+  IntImageType::Pointer image = IntImageType::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<IntImageType> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IntImageType::IndexType index = it.GetIndex();
+    const bool                    seed = index[0] % spacing == 0 && index[1] % spacing == 0 && index[2] % spacing == 0;
+    it.Set(seed ? 2 : 0);
+    }
+  return image;
+}
+
+static void Track(TensorImageType * tensors, IntImageType * seeds, unsigned int shards, unsigned int shard,
+                  const std::string & filename)
+{
+  TractographyFilter::Pointer fibertracker = TractographyFilter::New();
+  fibertracker->SetTensorImage(tensors);
+  fibertracker->SetROIImage(seeds);
+  fibertracker->SetTargetLabel(0);
+  fibertracker->SetNumberOfShards(shards);
+  fibertracker->SetShard(shard);
+
+  FiberFileSink::Pointer fibersink = FiberFileSink::New();
+  fibersink->SetFileName(filename);
+  fibertracker->SetFiberSink(fibersink);
+  fibertracker->Update();
+}
+
+static bool SameArrays(const FiberBundle::ArrayType & a, const FiberBundle::ArrayType & b, const std::string & name)
+{
+  if( a != b )
+    {
+    std::cerr << "The " << name << " differ" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+static bool SameFibers(const FiberBundle & a, const FiberBundle & b)
+{
+  if( a.GetNumberOfFibers() != b.GetNumberOfFibers() || a.GetNumberOfPoints() != b.GetNumberOfPoints() )
+    {
+    std::cerr << a.GetNumberOfFibers() << " fibers of " << a.GetNumberOfPoints() << " points and "
+              << b.GetNumberOfFibers() << " fibers of " << b.GetNumberOfPoints() << " points" << std::endl;
+    return false;
+    }
+  for( unsigned long f = 0; f < a.GetNumberOfFibers(); ++f )
+    {
+    if( a.GetFiberBegin(f) != b.GetFiberBegin(f) )
+      {
+      std::cerr << "Fiber " << f << " starts at point " << a.GetFiberBegin(f) << " and "
+                << b.GetFiberBegin(f) << std::endl;
+      return false;
+      }
+    }
+  for( unsigned long k = 0; k < a.GetNumberOfPoints(); ++k )
+    {
+    double worlda[3];
+    double worldb[3];
+    a.GetWorldPosition(k, worlda);
+    b.GetWorldPosition(k, worldb);
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      if( std::fabs(worlda[i] - worldb[i]) > 1e-4 )
+        {
+        std::cerr << "Point " << k << " differs" << std::endl;
+        return false;
+        }
+      }
+    }
+  if( !SameArrays(a.GetTensors(), b.GetTensors(), "tensors") )
+    {
+    return false;
+    }
+
+  const FiberBundle::ScalarMapType & scalarsa = a.GetScalars();
+  const FiberBundle::ScalarMapType & scalarsb = b.GetScalars();
+  if( scalarsa.size() != scalarsb.size() )
+    {
+    std::cerr << scalarsa.size() << " and " << scalarsb.size() << " scalars" << std::endl;
+    return false;
+    }
+  for( FiberBundle::ScalarMapType::const_iterator it = scalarsa.begin(); it != scalarsa.end(); ++it )
+    {
+    if( !b.HasScalar(it->first) || !SameArrays(it->second, b.GetScalar(it->first), it->first + " scalars") )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3 || (std::string(argv[1]) == "compare" && argc < 4) )
+    {
+    std::cerr << "Usage: " << argv[0] << " track directory" << std::endl;
+    std::cerr << "       " << argv[0] << " compare fibers1 fibers2" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  try
+    {
+    if( std::string(argv[1]) == "track" )
+      {
+      const unsigned int       size = 24;
+      const unsigned int       shards = 3;
+      const std::string        directory(argv[2]);
+      TensorImageType::Pointer tensors = MakeTensorField(size);
+      IntImageType::Pointer    seeds = MakeSeeds(size, 3);
+
+      Track(tensors, seeds, 1, 0, directory + "/whole.fbin");
+      for( unsigned int shard = 0; shard < shards; ++shard )
+        {
+        std::ostringstream filename;
+        filename << directory << "/shard" << shard << ".fbin";
+        Track(tensors, seeds, shards, shard, filename.str() );
+        }
+      return EXIT_SUCCESS;
+      }
+
+    FiberBundle a;
+    FiberBundle b;
+    readFiberFile(argv[2], a);
+    readFiberFile(argv[3], b);
+    if( a.GetNumberOfFibers() == 0 )
+      {
+      std::cerr << argv[2] << " has no fiber" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( !SameFibers(a, b) )
+      {
+      std::cerr << argv[2] << " and " << argv[3] << " differ" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
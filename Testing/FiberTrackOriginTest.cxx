@@ -0,0 +1,150 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Tracks a tensor field with a non-zero origin into a fiber file, as
+// fibertrack does, and fails if the fibers read back are not at the
+// world positions of the fibers tracked into a group, or are outside
+// the image.
+//
+// Usage: FiberTrackOriginTest output.vtk|output.fbin
+
+#include "itkImageToDTIStreamlineTractographyFilter.h"
+#include "dtitypes.h"
+#include "fiberio.h"
+
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImageType, IntImageType, GroupType> TractographyFilter;
+
+// Fibers along x in an image of 16 x 8 x 8 voxels, with an anisotropic
+// spacing and an origin far from zero
+static TensorImageType::Pointer MakeTensorField()
+{
+  TensorImageType::SizeType size;
+  size[0] = 16;
+  size[1] = 8;
+  size[2] = 8;
+  TensorImageType::Pointer image = TensorImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+
+  TensorImageType::SpacingType spacing;
+  spacing[0] = 2.0;
+  spacing[1] = 1.5;
+  spacing[2] = 1.0;
+  image->SetSpacing(spacing);
+  TensorImageType::PointType origin;
+  origin[0] = -130.0;
+  origin[1] = 62.0;
+  origin[2] = 37.5;
+  image->SetOrigin(origin);
+
+  TensorPixelType tensor(0.0);
+  tensor[0] = 1.7e-3;
+  tensor[3] = 0.3e-3;
+  tensor[5] = 0.3e-3;
+  image->FillBuffer(tensor);
+  return image;
+}
+
+static IntImageType::Pointer MakeSeeds(const TensorImageType * tensors)
+{
+  IntImageType::Pointer image = IntImageType::New();
+  image->CopyInformation(tensors);
+  image->SetRegions(tensors->GetLargestPossibleRegion() );
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<IntImageType> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IntImageType::IndexType index = it.GetIndex();
+    it.Set(index[0] == 8 && index[1] >= 3 && index[1] <= 4 && index[2] == 4 ? 2 : 0);
+    }
+  return image;
+}
+
+static TractographyFilter::Pointer MakeTracker(const TensorImageType * tensors, const IntImageType * seeds)
+{
+  TractographyFilter::Pointer fibertracker = TractographyFilter::New();
+  fibertracker->SetTensorImage(tensors);
+  fibertracker->SetROIImage(seeds);
+  fibertracker->SetTargetLabel(0);
+  return fibertracker;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " output.vtk|output.fbin" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  TensorImageType::Pointer tensors = MakeTensorField();
+  IntImageType::Pointer    seeds = MakeSeeds(tensors);
+
+  FiberBundle written;
+  FiberBundle tracked;
+  try
+    {
+    TractographyFilter::Pointer streamed = MakeTracker(tensors, seeds);
+    FiberFileSink::Pointer      fibersink = FiberFileSink::New();
+    fibersink->SetFileName(argv[1]);
+    streamed->SetFiberSink(fibersink);
+    streamed->Update();
+    readFiberFile(argv[1], written);
+
+    TractographyFilter::Pointer grouped = MakeTracker(tensors, seeds);
+    grouped->Update();
+    tracked.FromGroup(grouped->GetOutput() );
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if( tracked.GetNumberOfFibers() != 2 || written.GetNumberOfFibers() != tracked.GetNumberOfFibers()
+      || written.GetNumberOfPoints() != tracked.GetNumberOfPoints() )
+    {
+    std::cerr << "Wrong fibers: " << written.GetNumberOfFibers() << " fibers of " << written.GetNumberOfPoints()
+              << " points written, " << tracked.GetNumberOfFibers() << " fibers of "
+              << tracked.GetNumberOfPoints() << " points tracked" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const TensorImageType::PointType   origin = tensors->GetOrigin();
+  const TensorImageType::SpacingType spacing = tensors->GetSpacing();
+  const TensorImageType::SizeType    size = tensors->GetLargestPossibleRegion().GetSize();
+  for( unsigned long k = 0; k < written.GetNumberOfPoints(); ++k )
+    {
+    double world[3];
+    double expected[3];
+    written.GetWorldPosition(k, world);
+    tracked.GetWorldPosition(k, expected);
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      const double lower = origin[i] - 0.5 * spacing[i];
+      const double upper = origin[i] + (size[i] - 0.5) * spacing[i];
+      if( std::fabs(world[i] - expected[i]) > 1e-3 || world[i] < lower || world[i] > upper )
+        {
+        std::cerr << "Point " << k << " written at (" << world[0] << ", " << world[1] << ", " << world[2]
+                  << "), tracked at (" << expected[0] << ", " << expected[1] << ", " << expected[2] << ")"
+                  << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Tracks a synthetic tensor field probabilistically with one thread and
+// with several threads, and fails if the connectivity images differ or
+// are empty.
+//
+// Usage: ProbabilisticTrackingTest [threads]
+
+#include "itkImageToDTIStreamlineTractographyFilter.h"
+
+#include <itkDiffusionTensor3D.h>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkGroupSpatialObject.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+typedef itk::DiffusionTensor3D<double> DiffusionTensor;
+typedef itk::Image<DiffusionTensor, 3> TensorImage;
+typedef itk::Image<unsigned short, 3>  LabelImage;
+typedef itk::GroupSpatialObject<3>     FiberBundle;
+
+typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImage, LabelImage, FiberBundle> TractographyFilter;
+
+// Helix around the z axis
+static TensorImage::Pointer MakeTensorField(unsigned int size)
+{
+  TensorImage::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImage::Pointer image = TensorImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIteratorWithIndex<TensorImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImage::IndexType index = it.GetIndex();
+    const double                 x = index[0] - center;
+    const double                 y = index[1] - center;
+    double                       d[3] = { -y, x, 0.3 * std::sqrt(x * x + y * y) + 1.0 };
+    const double                 norm = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // Prolate tensor along d: 0.3e-3 I + 1.4e-3 d d^T
+    DiffusionTensor tensor;
+    unsigned int    n = 0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = i; j < 3; ++j, ++n )
+        {
+        tensor[n] = 1.4e-3 * d[i] * d[j] / (norm * norm) + (i == j ? 0.3e-3 : 0.0);
+        }
+      }
+    it.Set(tensor);
+    }
+  return image;
+}
+
+static LabelImage::Pointer MakeSeeds(unsigned int size, unsigned int spacing)
+{
+  LabelImage::SizeType imagesize;
+  imagesize.Fill(size);
+  LabelImage::Pointer image = LabelImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<LabelImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const LabelImage::IndexType index = it.GetIndex();
+    const bool                  seed = index[0] % spacing == 0 && index[1] % spacing == 0 && index[2] % spacing == 0;
+    it.Set(seed ? 2 : 0);
+    }
+  return image;
+}
+
+static TractographyFilter::ConnectivityImageType::Pointer Track(TensorImage * tensors, LabelImage * seeds,
+                                                                unsigned int threads)
+{
+  TractographyFilter::Pointer fibertracker = TractographyFilter::New();
+  fibertracker->SetTensorImage(tensors);
+  fibertracker->SetROIImage(seeds);
+  fibertracker->SetTargetLabel(0);
+  fibertracker->SetProbabilistic(true);
+  fibertracker->SetNumberOfSamples(20);
+  fibertracker->SetRandomSeed(7);
+  fibertracker->SetNumberOfThreads(threads);
+  fibertracker->Update();
+  return fibertracker->GetConnectivityImage();
+}
+
+int main(int argc, char* argv[])
+{
+  const unsigned int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+  const unsigned int size = 24;
+
+  TensorImage::Pointer tensors = MakeTensorField(size);
+  LabelImage::Pointer  seeds = MakeSeeds(size, 4);
+
+  TractographyFilter::ConnectivityImageType::Pointer serial = Track(tensors, seeds, 1);
+  TractographyFilter::ConnectivityImageType::Pointer parallel = Track(tensors, seeds, threads);
+
+  const float *      serialbuffer = serial->GetBufferPointer();
+  const float *      parallelbuffer = parallel->GetBufferPointer();
+  const unsigned int voxels = size * size * size;
+  unsigned int       visited = 0;
+  for( unsigned int i = 0; i < voxels; ++i )
+    {
+    if( serialbuffer[i] != parallelbuffer[i] )
+      {
+      std::cerr << "The connectivity images of 1 and " << threads << " threads differ at voxel " << i
+                << ": " << serialbuffer[i] << " and " << parallelbuffer[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    visited += serialbuffer[i] > 0.0f;
+    }
+  std::cout << visited << " voxels visited" << std::endl;
+  if( visited == 0 )
+    {
+    std::cerr << "No voxel was visited" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
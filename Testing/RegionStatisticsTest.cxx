@@ -0,0 +1,208 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Writes the JSON and CSV statistics reports of a label map with a
+// large label, a single voxel label, a single voxel label of an invalid
+// tensor and a label of a valid and an invalid tensor.  Fails if the
+// reports hold NaN or infinite numbers, if the statistics of the
+// invalid label are not all null or empty, or if the invalid tensor
+// changes the statistics of the mixed label.
+//
+// Usage: RegionStatisticsTest output.json output.csv
+
+#include "regionstatistics.h"
+
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+
+static const char * const measures[] = { "fa", "md", "ad", "rd", "l2", "l3" };
+
+static std::string ReadFile(const char * filename)
+{
+  std::ifstream in(filename);
+  return std::string( (std::istreambuf_iterator<char>(in) ), std::istreambuf_iterator<char>() );
+}
+
+// NaN or infinite numbers, but not the nonfinite count
+static bool HasNonFinite(const std::string & report)
+{
+  std::string lower(report);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  for( std::string::size_type pos = lower.find("nonfinite"); pos != std::string::npos; pos = lower.find("nonfinite") )
+    {
+    lower.erase(pos, 9);
+    }
+  return lower.find("nan") != std::string::npos || lower.find("inf") != std::string::npos;
+}
+
+// JSON object of a label, from its label field to its closing brace
+static std::string LabelObject(const std::string & report, unsigned short label)
+{
+  std::ostringstream key;
+  key << "\"label\": " << label << ",";
+  const std::string::size_type begin = report.find(key.str() );
+  if( begin == std::string::npos )
+    {
+    return "";
+    }
+  return report.substr(begin, report.find("\n    }", begin) - begin);
+}
+
+// JSON object of a label without its label, count and nonfinite fields
+static std::string LabelStatistics(const std::string & report, unsigned short label)
+{
+  const std::string object = LabelObject(report, label);
+  const std::string::size_type begin = object.find("\"fa\"");
+  return begin == std::string::npos ? "" : object.substr(begin);
+}
+
+// CSV row of a label
+static std::string LabelRow(const std::string & report, unsigned short label)
+{
+  std::ostringstream key;
+  key << "\n" << label << ",";
+  const std::string::size_type begin = report.find(key.str() );
+  if( begin == std::string::npos )
+    {
+    return "";
+    }
+  return report.substr(begin + 1, report.find("\n", begin + 1) - begin - 1);
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3 )
+    {
+    std::cerr << "Usage: " << argv[0] << " output.json output.csv" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  TensorImageType::SizeType size;
+  size.Fill(4);
+  TensorImageType::Pointer tensors = TensorImageType::New();
+  tensors->SetRegions(size);
+  tensors->Allocate();
+  IntImageType::Pointer labels = IntImageType::New();
+  labels->SetRegions(size);
+  labels->Allocate();
+
+  // Label 1 everywhere but four voxels, label 2 on one valid tensor,
+  // label 3 on one tensor of NaNs and label 4 on the tensor of label 2
+  // and a tensor of NaNs
+  itk::ImageRegionIteratorWithIndex<TensorImageType> it(tensors, tensors->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImageType::IndexType index = it.GetIndex();
+    TensorPixelType                  tensor;
+    tensor.Fill(0.0);
+    tensor[0] = 1.5e-3 + 1e-4 * index[0];
+    tensor[3] = 0.4e-3;
+    tensor[5] = 0.3e-3 + 1e-5 * index[1];
+    unsigned short label = 1;
+    if( index[0] == 0 && index[1] == 0 && index[2] == 0 )
+      {
+      label = 2;
+      }
+    else if( index[0] == 0 && index[1] == 0 && index[2] == 1 )
+      {
+      label = 4;
+      }
+    else if( index[0] == 3 && index[1] == 3 && index[2] >= 2 )
+      {
+      tensor.Fill(std::numeric_limits<double>::quiet_NaN() );
+      label = index[2] == 3 ? 3 : 4;
+      }
+    it.Set(tensor);
+    labels->SetPixel(index, label);
+    }
+
+  std::vector<double> percentiles;
+  percentiles.push_back(50.0);
+  try
+    {
+    writeRegionStatistics(argv[1], tensors, labels, percentiles);
+    writeRegionStatistics(argv[2], tensors, labels, percentiles);
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << e << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const std::string json = ReadFile(argv[1]);
+  const std::string csv = ReadFile(argv[2]);
+  if( HasNonFinite(json) || HasNonFinite(csv) )
+    {
+    std::cerr << "The reports hold NaN or infinite numbers:" << std::endl << json << csv;
+    return EXIT_FAILURE;
+    }
+
+  // JSON
+  if( LabelObject(json, 2).find("\"count\": 1,\n      \"nonfinite\": 0,") == std::string::npos )
+    {
+    std::cerr << "The single voxel label is missing:" << std::endl << json;
+    return EXIT_FAILURE;
+    }
+  if( LabelObject(json, 1).find("null") != std::string::npos || LabelObject(json, 2).find("null") != std::string::npos )
+    {
+    std::cerr << "The statistics of the valid labels have null values:" << std::endl << json;
+    return EXIT_FAILURE;
+    }
+  const std::string invalid = LabelObject(json, 3);
+  if( invalid.find("\"count\": 1,\n      \"nonfinite\": 1,") == std::string::npos
+      || invalid.find("\"logeuclidean_mean\": [null, null, null, null, null, null]") == std::string::npos )
+    {
+    std::cerr << "Wrong counts or Log-Euclidean mean of the invalid tensor:" << std::endl << invalid << std::endl;
+    return EXIT_FAILURE;
+    }
+  for( unsigned int m = 0; m < sizeof(measures) / sizeof(measures[0]); ++m )
+    {
+    const std::string expected = std::string("\"") + measures[m]
+      + "\": {\"mean\": null, \"std\": null, \"min\": null, \"max\": null, \"p50\": null}";
+    if( invalid.find(expected) == std::string::npos )
+      {
+      std::cerr << "The " << measures[m] << " statistics of the invalid tensor are not null:" << std::endl
+                << invalid << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if( LabelObject(json, 4).find("\"count\": 2,\n      \"nonfinite\": 1,") == std::string::npos
+      || LabelStatistics(json, 4) != LabelStatistics(json, 2) )
+    {
+    std::cerr << "The invalid tensor changes the statistics of its label:" << std::endl << json;
+    return EXIT_FAILURE;
+    }
+
+  // CSV: 6 measures of 4 statistics and 1 percentile, then 6 components
+  // of the Log-Euclidean mean
+  const std::string emptyFields(6 * 5 + 6, ',');
+  if( LabelRow(csv, 3) != "3,1,1" + emptyFields )
+    {
+    std::cerr << "The CSV statistics of the invalid tensor are not empty:" << std::endl << csv;
+    return EXIT_FAILURE;
+    }
+  const std::string row2 = LabelRow(csv, 2);
+  const std::string row4 = LabelRow(csv, 4);
+  if( row2.compare(0, 6, "2,1,0,") != 0 || row4.compare(0, 6, "4,2,1,") != 0 || row2.substr(6) != row4.substr(6) )
+    {
+    std::cerr << "Wrong CSV statistics of the mixed label:" << std::endl << csv;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
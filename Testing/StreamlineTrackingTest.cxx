@@ -0,0 +1,250 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Tracks a synthetic tensor field with one thread and with several
+// threads and small seed blocks, and fails if the fibers differ or if
+// there are none.  Then tracks a uniform field, in which the fibers are
+// straight lines, and fails if they are not, or for rk45 if they do not
+// take fewer steps than with rk4.
+//
+// Usage: StreamlineTrackingTest [threads] [euler|midpoint|rk4|rk45]
+
+#include "itkImageToDTIStreamlineTractographyFilter.h"
+
+#include <itkDiffusionTensor3D.h>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkGroupSpatialObject.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+typedef itk::DiffusionTensor3D<double> DiffusionTensor;
+typedef itk::Image<DiffusionTensor, 3> TensorImage;
+typedef itk::Image<unsigned short, 3>  LabelImage;
+typedef itk::GroupSpatialObject<3>     FiberBundle;
+
+typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImage, LabelImage, FiberBundle> TractographyFilter;
+typedef TractographyFilter::DTITubeSpatialObjectType                                     TubeType;
+
+// Helix around the z axis: the fibers turn through x and y and climb
+// along z
+static TensorImage::Pointer MakeTensorField(unsigned int size)
+{
+  TensorImage::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImage::Pointer image = TensorImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIteratorWithIndex<TensorImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImage::IndexType index = it.GetIndex();
+    const double                 x = index[0] - center;
+    const double                 y = index[1] - center;
+    double                       d[3] = { -y, x, 0.3 * std::sqrt(x * x + y * y) + 1.0 };
+    const double                 norm = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // Prolate tensor along d: 0.3e-3 I + 1.4e-3 d d^T
+    DiffusionTensor tensor;
+    unsigned int    n = 0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = i; j < 3; ++j, ++n )
+        {
+        tensor[n] = 1.4e-3 * d[i] * d[j] / (norm * norm) + (i == j ? 0.3e-3 : 0.0);
+        }
+      }
+    it.Set(tensor);
+    }
+  return image;
+}
+
+// Prolate tensors along (1, 2, 2) / 3
+static TensorImage::Pointer MakeUniformTensorField(unsigned int size)
+{
+  TensorImage::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImage::Pointer image = TensorImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  const double    d[3] = { 1.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0 };
+  DiffusionTensor tensor;
+  unsigned int    n = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = i; j < 3; ++j, ++n )
+      {
+      tensor[n] = 1.4e-3 * d[i] * d[j] + (i == j ? 0.3e-3 : 0.0);
+      }
+    }
+  image->FillBuffer(tensor);
+  return image;
+}
+
+static LabelImage::Pointer MakeSeeds(unsigned int size, unsigned int spacing)
+{
+  LabelImage::SizeType imagesize;
+  imagesize.Fill(size);
+  LabelImage::Pointer image = LabelImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<LabelImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const LabelImage::IndexType index = it.GetIndex();
+    const bool                  seed = index[0] % spacing == 0 && index[1] % spacing == 0 && index[2] % spacing == 0;
+    it.Set(seed ? 2 : 0);
+    }
+  return image;
+}
+
+static FiberBundle::Pointer Track(TensorImage * tensors, LabelImage * seeds,
+                                  TractographyFilter::IntegratorType integrator, unsigned int threads,
+                                  unsigned int blocksize)
+{
+  TractographyFilter::Pointer fibertracker = TractographyFilter::New();
+  fibertracker->SetTensorImage(tensors);
+  fibertracker->SetROIImage(seeds);
+  fibertracker->SetTargetLabel(0);
+  fibertracker->SetIntegrator(integrator);
+  fibertracker->SetNumberOfThreads(threads);
+  fibertracker->SetFiberBufferSize(blocksize);
+  fibertracker->Update();
+  return fibertracker->GetOutput();
+}
+
+static bool SameFibers(FiberBundle * a, FiberBundle * b)
+{
+  std::auto_ptr<FiberBundle::ChildrenListType> childrena(a->GetChildren(0) );
+  std::auto_ptr<FiberBundle::ChildrenListType> childrenb(b->GetChildren(0) );
+  if( childrena->size() != childrenb->size() )
+    {
+    return false;
+    }
+  FiberBundle::ChildrenListType::const_iterator ita = childrena->begin();
+  FiberBundle::ChildrenListType::const_iterator itb = childrenb->begin();
+  for( ; ita != childrena->end(); ++ita, ++itb )
+    {
+    TubeType * tubea = dynamic_cast<TubeType *>( ita->GetPointer() );
+    TubeType * tubeb = dynamic_cast<TubeType *>( itb->GetPointer() );
+    if( tubea->GetNumberOfPoints() != tubeb->GetNumberOfPoints() )
+      {
+      return false;
+      }
+    for( unsigned int k = 0; k < tubea->GetNumberOfPoints(); ++k )
+      {
+      if( tubea->GetPoint(k)->GetPosition() != tubeb->GetPoint(k)->GetPosition() )
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+// Number of points of the fibers, or 0 if one of them is not straight
+static unsigned long StraightFiberPoints(FiberBundle * fibers)
+{
+  unsigned long                                points = 0;
+  std::auto_ptr<FiberBundle::ChildrenListType> children(fibers->GetChildren(0) );
+  for( FiberBundle::ChildrenListType::const_iterator it = children->begin(); it != children->end(); ++it )
+    {
+    TubeType *                   tube = dynamic_cast<TubeType *>( it->GetPointer() );
+    const unsigned int           n = tube->GetNumberOfPoints();
+    if( n < 2 )
+      {
+      points += n;
+      continue;
+      }
+    const TubeType::PointType    first = tube->GetPoint(0)->GetPosition();
+    const TubeType::PointType    last = tube->GetPoint(n - 1)->GetPosition();
+    const itk::Vector<double, 3> axis = (last - first) / (last - first).GetNorm();
+    for( unsigned int k = 0; k < n; ++k )
+      {
+      const itk::Vector<double, 3> v = tube->GetPoint(k)->GetPosition() - first;
+      if( (v - axis * (v * axis) ).GetNorm() > 1e-3 )
+        {
+        return 0;
+        }
+      }
+    points += n;
+    }
+  return points;
+}
+
+int main(int argc, char* argv[])
+{
+  const unsigned int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+  const std::string  name = argc > 2 ? argv[2] : "rk4";
+  const unsigned int size = 24;
+
+  TractographyFilter::IntegratorType integrator = TractographyFilter::RK4;
+  if( name == "euler" )
+    {
+    integrator = TractographyFilter::Euler;
+    }
+  else if( name == "midpoint" )
+    {
+    integrator = TractographyFilter::Midpoint;
+    }
+  else if( name == "rk45" )
+    {
+    integrator = TractographyFilter::RK45;
+    }
+
+  TensorImage::Pointer tensors = MakeTensorField(size);
+  LabelImage::Pointer  seeds = MakeSeeds(size, 3);
+
+  FiberBundle::Pointer serial = Track(tensors, seeds, integrator, 1, 10000);
+  FiberBundle::Pointer parallel = Track(tensors, seeds, integrator, threads, 7);
+
+  const unsigned int fibers = serial->GetNumberOfChildren();
+  std::cout << fibers << " fibers" << std::endl;
+  if( fibers == 0 )
+    {
+    std::cerr << "No fiber was tracked" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if( !SameFibers(serial, parallel) )
+    {
+    std::cerr << "The fibers of 1 and " << threads << " threads differ" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  TensorImage::Pointer uniform = MakeUniformTensorField(size);
+  FiberBundle::Pointer straight = Track(uniform, seeds, integrator, threads, 10000);
+  const unsigned long  points = StraightFiberPoints(straight);
+  if( straight->GetNumberOfChildren() == 0 || points == 0 )
+    {
+    std::cerr << "The fibers of a uniform field are not straight" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if( integrator == TractographyFilter::RK45 )
+    {
+    // Straight tracts are followed with the largest steps
+    const unsigned long fixedpoints = StraightFiberPoints(Track(uniform, seeds, TractographyFilter::RK4, threads,
+                                                                10000) );
+    std::cout << points << " points with rk45, " << fixedpoints << " with rk4" << std::endl;
+    if( points >= fixedpoints )
+      {
+      std::cerr << "rk45 does not lengthen its steps on straight fibers" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Tracks the same synthetic tensor field with the scanline and the
+// bricked tensor layouts, prints the fiber steps per second of both and
+// fails if the fibers differ.
+//
+// Usage: TensorBrickedLayoutBenchmark [size] [seed spacing]
+
+#include "itkImageToDTIStreamlineTractographyFilter.h"
+
+#include <itkDiffusionTensor3D.h>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkGroupSpatialObject.h>
+#include <itkTimeProbe.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+typedef itk::DiffusionTensor3D<double> DiffusionTensor;
+typedef itk::Image<DiffusionTensor, 3> TensorImage;
+typedef itk::Image<unsigned short, 3>  LabelImage;
+typedef itk::GroupSpatialObject<3>     FiberBundle;
+
+typedef itk::ImageToDTIStreamlineTractographyFilter<TensorImage, LabelImage, FiberBundle> TractographyFilter;
+
+// Helix around the z axis: the fibers turn through x and y and climb
+// along z, so the accesses go in every direction
+static TensorImage::Pointer MakeTensorField(unsigned int size)
+{
+  TensorImage::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImage::Pointer image = TensorImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  const double center = (size - 1) / 2.0;
+  itk::ImageRegionIteratorWithIndex<TensorImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImage::IndexType index = it.GetIndex();
+    const double                 x = index[0] - center;
+    const double                 y = index[1] - center;
+    double                       d[3] = { -y, x, 0.3 * std::sqrt(x * x + y * y) + 1.0 };
+    const double                 norm = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // Prolate tensor along d: 0.3e-3 I + 1.4e-3 d d^T
+    DiffusionTensor tensor;
+    unsigned int    n = 0;
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = i; j < 3; ++j, ++n )
+        {
+        tensor[n] = 1.4e-3 * d[i] * d[j] / (norm * norm) + (i == j ? 0.3e-3 : 0.0);
+        }
+      }
+    it.Set(tensor);
+    }
+  return image;
+}
+
+static LabelImage::Pointer MakeSeeds(unsigned int size, unsigned int spacing)
+{
+  LabelImage::SizeType imagesize;
+  imagesize.Fill(size);
+  LabelImage::Pointer image = LabelImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<LabelImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const LabelImage::IndexType index = it.GetIndex();
+    const bool                  seed = index[0] % spacing == 0 && index[1] % spacing == 0 && index[2] % spacing == 0;
+    it.Set(seed ? 2 : 0);
+    }
+  return image;
+}
+
+static FiberBundle::Pointer Track(TensorImage * tensors, LabelImage * seeds, bool bricked,
+                                  unsigned long & steps, double & seconds)
+{
+  TractographyFilter::Pointer fibertracker = TractographyFilter::New();
+  fibertracker->SetTensorImage(tensors);
+  fibertracker->SetROIImage(seeds);
+  fibertracker->SetTargetLabel(0);
+  fibertracker->SetBrickedLayout(bricked);
+
+  itk::TimeProbe probe;
+  probe.Start();
+  fibertracker->Update();
+  probe.Stop();
+  seconds = probe.GetTotal();
+
+  FiberBundle::Pointer fibers = fibertracker->GetOutput();
+  steps = 0;
+  std::auto_ptr<FiberBundle::ChildrenListType> children(fibers->GetChildren(0) );
+  for( FiberBundle::ChildrenListType::const_iterator it = children->begin(); it != children->end(); ++it )
+    {
+    steps += dynamic_cast<TractographyFilter::DTITubeSpatialObjectType *>( it->GetPointer() )->GetNumberOfPoints();
+    }
+  return fibers;
+}
+
+static bool SameFibers(FiberBundle * a, FiberBundle * b)
+{
+  typedef TractographyFilter::DTITubeSpatialObjectType TubeType;
+
+  std::auto_ptr<FiberBundle::ChildrenListType> childrena(a->GetChildren(0) );
+  std::auto_ptr<FiberBundle::ChildrenListType> childrenb(b->GetChildren(0) );
+  if( childrena->size() != childrenb->size() )
+    {
+    return false;
+    }
+  FiberBundle::ChildrenListType::const_iterator ita = childrena->begin();
+  FiberBundle::ChildrenListType::const_iterator itb = childrenb->begin();
+  for( ; ita != childrena->end(); ++ita, ++itb )
+    {
+    TubeType * tubea = dynamic_cast<TubeType *>( ita->GetPointer() );
+    TubeType * tubeb = dynamic_cast<TubeType *>( itb->GetPointer() );
+    if( tubea->GetNumberOfPoints() != tubeb->GetNumberOfPoints() )
+      {
+      return false;
+      }
+    for( unsigned int k = 0; k < tubea->GetNumberOfPoints(); ++k )
+      {
+      if( tubea->GetPoint(k)->GetPosition() != tubeb->GetPoint(k)->GetPosition() )
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  const unsigned int size = argc > 1 ? std::atoi(argv[1]) : 64;
+  const unsigned int spacing = argc > 2 ? std::atoi(argv[2]) : 4;
+
+  TensorImage::Pointer tensors = MakeTensorField(size);
+  LabelImage::Pointer  seeds = MakeSeeds(size, spacing);
+
+  unsigned long        plainsteps, brickedsteps;
+  double               plainseconds, brickedseconds;
+  FiberBundle::Pointer plain = Track(tensors, seeds, false, plainsteps, plainseconds);
+  FiberBundle::Pointer bricked = Track(tensors, seeds, true, brickedsteps, brickedseconds);
+
+  std::cout << "Volume " << size << "^3, " << plainsteps << " fiber steps" << std::endl;
+  std::cout << "Scanline layout: " << plainseconds << " s, " << plainsteps / plainseconds
+            << " steps/s" << std::endl;
+  std::cout << "Bricked layout:  " << brickedseconds << " s, " << brickedsteps / brickedseconds
+            << " steps/s" << std::endl;
+
+  if( !SameFibers(plain, bricked) )
+    {
+    std::cerr << "The two layouts give different fibers" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Checks the Riemannian mean of tensors with the same eigenvectors,
+// which is the geometric mean of their eigenvalues, and the counting
+// of the maps from a base point that is not positive definite.
+//
+// Usage: TensorGeometryTest
+
+#include "SymmetricSpaceTensorGeometry.h"
+#include "TensorStatistics.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+typedef SymmetricSpaceTensorGeometry<double> GeometryType;
+typedef TensorStatistics<double>             StatisticsType;
+typedef GeometryType::TensorType             TensorType;
+
+static TensorType Diagonal(double a, double b, double c)
+{
+  TensorType tensor(0.0);
+
+  tensor[0] = a;
+  tensor[3] = b;
+  tensor[5] = c;
+  return tensor;
+}
+
+int main(int, char* [])
+{
+  GeometryType   geometry;
+  StatisticsType statistics(&geometry);
+
+  StatisticsType::TensorListPointerType tensors = StatisticsType::TensorListType::New();
+  tensors->push_back(Diagonal(1e-3, 2e-3, 4e-3) );
+  tensors->push_back(Diagonal(4e-3, 2e-3, 1e-3) );
+  tensors->push_back(Diagonal(2e-3, 2e-3, 2e-3) );
+
+  TensorType mean;
+  statistics.ComputeMean(tensors, mean);
+  const TensorType expected = Diagonal(2e-3, 2e-3, 2e-3);
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    if( std::fabs(mean[i] - expected[i]) > 1e-9 )
+      {
+      std::cerr << "Wrong Riemannian mean: " << mean << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if( geometry.GetNumberOfFallbacks() != 0 )
+    {
+    std::cerr << "Fallbacks counted for positive definite tensors" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Maps from a base point that is not positive definite are zero and
+  // counted
+  const TensorType invalid = Diagonal(1e-3, -1e-3, 1e-3);
+  TensorType       maps[3];
+  geometry.ExpMapBatch(invalid, &tensors->ElementAt(0), maps, 3);
+  const TensorType log = geometry.LogMap(invalid, expected);
+  if( geometry.GetNumberOfFallbacks() != 4 || maps[1] != TensorType(0.0) || log != TensorType(0.0) )
+    {
+    std::cerr << "Wrong fallbacks: " << geometry.GetNumberOfFallbacks() << " counted" << std::endl;
+    return EXIT_FAILURE;
+    }
+  geometry.ResetNumberOfFallbacks();
+  if( geometry.GetNumberOfFallbacks() != 0 )
+    {
+    std::cerr << "The fallback count is not reset" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Interpolates a tensor field at the points of a curve one by one and
+// in a single batch, with the scanline and the bricked interpolators,
+// and fails if the tensors differ.
+//
+// Usage: TensorInterpolateBatchTest
+
+#include <itkTensorLinearInterpolateImageFunction.h>
+#include <itkTensorBrickedLinearInterpolateImageFunction.h>
+
+#include <itkDiffusionTensor3D.h>
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+typedef itk::DiffusionTensor3D<double> DiffusionTensor;
+typedef itk::Image<DiffusionTensor, 3> TensorImage;
+
+typedef itk::TensorInterpolateImageFunction<TensorImage, double>              InterpolateType;
+typedef itk::TensorLinearInterpolateImageFunction<TensorImage, double>        LinearInterpolateType;
+typedef itk::TensorBrickedLinearInterpolateImageFunction<TensorImage, double> BrickedInterpolateType;
+
+static TensorImage::Pointer MakeTensorField(unsigned int size)
+{
+  TensorImage::SizeType imagesize;
+  imagesize.Fill(size);
+  TensorImage::Pointer image = TensorImage::New();
+  image->SetRegions(imagesize);
+  image->Allocate();
+
+  TensorImage::SpacingType spacing;
+  spacing[0] = 1.5;
+  spacing[1] = 2.0;
+  spacing[2] = 2.5;
+  image->SetSpacing(spacing);
+  TensorImage::PointType origin;
+  origin[0] = -10.0;
+  origin[1] = 5.0;
+  origin[2] = 20.0;
+  image->SetOrigin(origin);
+
+  itk::ImageRegionIteratorWithIndex<TensorImage> it(image, image->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const TensorImage::IndexType index = it.GetIndex();
+    DiffusionTensor              tensor;
+    for( unsigned int n = 0; n < 6; ++n )
+      {
+      tensor[n] = 1e-4 * std::sin(0.7 * index[0] + 1.3 * index[1] + 0.4 * index[2] + n);
+      }
+    it.Set(tensor);
+    }
+  return image;
+}
+
+static bool CheckBatch(InterpolateType * interpolator, const TensorImage * image, const char * name)
+{
+  // Points of a spiral inside the image
+  const unsigned int                                n = 200;
+  std::vector<InterpolateType::PointType>           points(n);
+  std::vector<InterpolateType::ContinuousIndexType> indices(n);
+  for( unsigned int k = 0; k < n; ++k )
+    {
+    InterpolateType::ContinuousIndexType index;
+    index[0] = 5.0 + 3.5 * std::cos(0.1 * k);
+    index[1] = 5.0 + 3.5 * std::sin(0.1 * k);
+    index[2] = 0.04 * k;
+    image->TransformContinuousIndexToPhysicalPoint(index, points[k]);
+    indices[k] = index;
+    }
+
+  std::vector<InterpolateType::OutputType> fromIndices(n);
+  std::vector<InterpolateType::OutputType> fromPoints(n);
+  interpolator->EvaluateAtContinuousIndexBatch(&indices[0], &fromIndices[0], n);
+  interpolator->EvaluateBatch(&points[0], &fromPoints[0], n);
+  for( unsigned int k = 0; k < n; ++k )
+    {
+    const InterpolateType::OutputType single = interpolator->EvaluateAtContinuousIndex(indices[k]);
+    for( unsigned int i = 0; i < 6; ++i )
+      {
+      if( std::fabs(fromIndices[k][i] - single[i]) > 1e-15 || std::fabs(fromPoints[k][i] - single[i]) > 1e-15 )
+        {
+        std::cerr << name << ": batch and single evaluations differ at point " << k << ": "
+                  << fromIndices[k] << ", " << fromPoints[k] << ", " << single << std::endl;
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+int main(int, char* [])
+{
+  TensorImage::Pointer image = MakeTensorField(11);
+
+  LinearInterpolateType::Pointer linear = LinearInterpolateType::New();
+  linear->SetInputImage(image);
+  BrickedInterpolateType::Pointer bricked = BrickedInterpolateType::New();
+  bricked->SetInputImage(image);
+
+  if( !CheckBatch(linear, image, "Linear") || !CheckBatch(bricked, image, "Bricked") )
+    {
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/*=========================================================================
+
+  Program:   NeuroLib (DTI command line tools)
+  Language:  C++
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+// Accumulates populations of constant log tensor fields with a known
+// covariance and checks the generalized variance, the merge of two
+// groups of subjects, and the generalized variance of a rank deficient
+// population.
+//
+// Usage: TensorPopulationTest
+
+#include "tensorpopulation.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static LogTensorImageType::Pointer MakeLogTensors(const LogTensorPixelType & value)
+{
+  LogTensorImageType::SizeType size;
+  size.Fill(3);
+  LogTensorImageType::Pointer image = LogTensorImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(value);
+  return image;
+}
+
+static bool Near(double value, double expected, double tolerance)
+{
+  return std::fabs(value - expected) <= tolerance * std::fabs(expected);
+}
+
+int main(int, char* [])
+{
+  // Subjects +a_k e_k and -a_k e_k for every component k: the mean is
+  // zero and the covariance diagonal, 2 a_k^2 / 11
+  const double                     a[6] = { 0.3, 0.25, 0.2, 0.15, 0.1, 0.05 };
+  LogEuclideanPopulationStatistics all;
+  LogEuclideanPopulationStatistics first;
+  LogEuclideanPopulationStatistics second;
+  double                           expected = 1.0;
+  for( unsigned int k = 0; k < 6; ++k )
+    {
+    LogTensorPixelType x(0.0);
+    x[k] = a[k];
+    all.Add(MakeLogTensors(x) );
+    (k < 3 ? first : second).Add(MakeLogTensors(x) );
+    x[k] = -a[k];
+    all.Add(MakeLogTensors(x) );
+    (k < 3 ? first : second).Add(MakeLogTensors(x) );
+    expected *= 2.0 * a[k] * a[k] / 11.0;
+    }
+  first.Merge(second);
+
+  LogTensorImageType::IndexType index;
+  index.Fill(1);
+  const double generalized = all.GetGeneralizedVariance()->GetPixel(index);
+  const double merged = first.GetGeneralizedVariance()->GetPixel(index);
+  std::cout << "Generalized variance: " << generalized << ", merged: " << merged
+            << ", expected: " << expected << std::endl;
+  if( !Near(generalized, expected, 1e-12) || !Near(merged, expected, 1e-10) )
+    {
+    std::cerr << "Wrong generalized variance" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Two subjects: the covariance has rank 1
+  LogEuclideanPopulationStatistics pair;
+  LogTensorPixelType               x(0.1);
+  pair.Add(MakeLogTensors(x) );
+  x[2] = 0.4;
+  pair.Add(MakeLogTensors(x) );
+  const double deficient = pair.GetGeneralizedVariance()->GetPixel(index);
+  std::cout << "Generalized variance of two subjects: " << deficient << std::endl;
+  if( std::fabs(deficient) > 1e-30 )
+    {
+    std::cerr << "The generalized variance of a rank deficient population is not zero" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}